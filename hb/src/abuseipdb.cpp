@@ -246,7 +246,7 @@ AbuseIPDBCheckResult AbuseIPDB::checkAddress(std::string address, bool verbose)
 	return result;
 }
 
-bool AbuseIPDB::reportAddress(std::string address, std::string comment, std::vector<unsigned int> &categories)
+bool AbuseIPDB::reportAddress(std::string address, std::string comment, const std::vector<unsigned int> &categories)
 {
 	this->isError = false;
 
@@ -277,7 +277,7 @@ bool AbuseIPDB::reportAddress(std::string address, std::string comment, std::vec
 		headers = curl_slist_append(headers, ("Key: " + this->abuseipdbKey).c_str());
 		url += "/api/v2/report";
 		std::string requestParams = "categories=";
-		std::vector<unsigned int>::iterator cit;
+		std::vector<unsigned int>::const_iterator cit;
 		bool firstIteration = true;
 		for (cit = categories.begin(); cit != categories.end(); ++cit) {
 			if (firstIteration) {
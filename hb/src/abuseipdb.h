@@ -104,7 +104,7 @@ class AbuseIPDB{
 		/*
 		 * Report IP address to abuseipdb.com
 		 */
-		bool reportAddress(std::string address, std::string comment, std::vector<unsigned int> &categories);
+		bool reportAddress(std::string address, std::string comment, const std::vector<unsigned int> &categories);
 
 		/*
 		 * Download blacklist from abuseipdb.com
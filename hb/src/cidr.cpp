@@ -0,0 +1,332 @@
+/*
+ * Address ranges (CIDR) for IPv4 and IPv6 kept in path compressed binary trie
+ */
+
+// Standard string library
+#include <string>
+// C string (memcpy, memset)
+#include <cstring>
+// Algorithms (min)
+#include <algorithm>
+// Address conversion (inet_pton, inet_ntop)
+#include <arpa/inet.h>
+// Header
+#include "cidr.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+PrefixTrie::PrefixTrie()
+{
+	this->clear();
+}
+
+/*
+ * Value of bit at position (0 is most significant bit of first byte)
+ */
+unsigned int PrefixTrie::bit(const unsigned char* address, unsigned int position)
+{
+	return (address[position / 8] >> (7 - position % 8)) & 1;
+}
+
+/*
+ * Length of common prefix of two addresses, compares at most limit bits
+ */
+unsigned int PrefixTrie::commonLength(const unsigned char* a, const unsigned char* b, unsigned int limit)
+{
+	unsigned int length = 0;
+	unsigned char diff;
+	while (length < limit) {
+		diff = a[length / 8] ^ b[length / 8];
+		if (diff == 0) {
+			length += 8;
+			continue;
+		}
+		while ((diff & 0x80) == 0) {
+			diff <<= 1;
+			length++;
+		}
+		break;
+	}
+	if (length > limit) {
+		length = limit;
+	}
+	return length;
+}
+
+/*
+ * Parse IPv4 or IPv6 address with optional prefix length (address/length), bits after prefix length are cleared
+ */
+bool PrefixTrie::parse(const std::string& text, hb::Prefix* prefix)
+{
+	char address[INET6_ADDRSTRLEN];
+	std::size_t pos = text.find('/');
+	std::size_t addressLength = pos == std::string::npos ? text.length() : pos;
+	if (addressLength == 0 || addressLength >= sizeof(address)) {
+		return false;
+	}
+	std::memcpy(address, text.data(), addressLength);
+	address[addressLength] = '\0';
+
+	std::memset(prefix->address, 0, sizeof(prefix->address));
+	if (inet_pton(AF_INET, address, prefix->address) == 1) {
+		prefix->ipv6 = false;
+		prefix->length = 32;
+	} else if (inet_pton(AF_INET6, address, prefix->address) == 1) {
+		prefix->ipv6 = true;
+		prefix->length = 128;
+	} else {
+		return false;
+	}
+
+	// Prefix length
+	if (pos != std::string::npos) {
+		if (pos + 1 == text.length() || text.length() - pos > 4) {
+			return false;
+		}
+		unsigned int length = 0;
+		for (std::size_t i = pos + 1; i < text.length(); i++) {
+			if (text[i] < '0' || text[i] > '9') {
+				return false;
+			}
+			length = length * 10 + (text[i] - '0');
+		}
+		if (length > prefix->length) {
+			return false;
+		}
+		prefix->length = length;
+	}
+
+	// Clear host bits
+	for (unsigned int i = prefix->length; i < 128; i++) {
+		prefix->address[i / 8] &= (unsigned char)~(0x80 >> (i % 8));
+	}
+	return true;
+}
+
+/*
+ * Canonical text of prefix, network address and prefix length
+ */
+std::string PrefixTrie::format(const hb::Prefix& prefix)
+{
+	char address[INET6_ADDRSTRLEN];
+	if (inet_ntop(prefix.ipv6 ? AF_INET6 : AF_INET, prefix.address, address, sizeof(address)) == NULL) {
+		return "";
+	}
+	return std::string(address) + "/" + std::to_string(prefix.length);
+}
+
+/*
+ * Add range to list, range added later overrides same range added earlier
+ */
+bool PrefixTrie::insert(const std::string& range, hb::RangeList list)
+{
+	hb::Prefix prefix;
+	if (!PrefixTrie::parse(range, &prefix)) {
+		return false;
+	}
+
+	int current = prefix.ipv6 ? 1 : 0;
+	int next, split, leaf;
+	unsigned int b, common;
+	while (true) {
+		// Prefix of current node is prefix of new range
+		if (this->nodes[current].prefix.length == prefix.length) {
+			this->nodes[current].list = list;
+			this->nodes[current].range = PrefixTrie::format(prefix);
+			return true;
+		}
+		b = PrefixTrie::bit(prefix.address, this->nodes[current].prefix.length);
+		next = this->nodes[current].child[b];
+
+		// Nothing below in this direction, new range becomes leaf
+		if (next == -1) {
+			hb::PrefixNode node;
+			node.prefix = prefix;
+			node.list = list;
+			node.range = PrefixTrie::format(prefix);
+			this->nodes.push_back(node);
+			this->nodes[current].child[b] = this->nodes.size() - 1;
+			return true;
+		}
+
+		// Whole prefix of child matches, go down
+		common = PrefixTrie::commonLength(this->nodes[next].prefix.address, prefix.address, std::min(this->nodes[next].prefix.length, prefix.length));
+		if (common == this->nodes[next].prefix.length) {
+			current = next;
+			continue;
+		}
+
+		// Paths diverge (or new range is shorter than child), split compressed path at common prefix
+		hb::PrefixNode node;
+		node.prefix = prefix;
+		node.prefix.length = common;
+		for (unsigned int i = common; i < 128; i++) {
+			node.prefix.address[i / 8] &= (unsigned char)~(0x80 >> (i % 8));
+		}
+		node.child[PrefixTrie::bit(this->nodes[next].prefix.address, common)] = next;
+		if (common == prefix.length) {
+			node.list = list;
+			node.range = PrefixTrie::format(prefix);
+		}
+		this->nodes.push_back(node);
+		split = this->nodes.size() - 1;
+		this->nodes[current].child[b] = split;
+		if (common < prefix.length) {
+			hb::PrefixNode leafNode;
+			leafNode.prefix = prefix;
+			leafNode.list = list;
+			leafNode.range = PrefixTrie::format(prefix);
+			this->nodes.push_back(leafNode);
+			leaf = this->nodes.size() - 1;
+			this->nodes[split].child[PrefixTrie::bit(prefix.address, common)] = leaf;
+		}
+		return true;
+	}
+}
+
+/*
+ * Remove all ranges
+ */
+void PrefixTrie::clear()
+{
+	this->nodes.clear();
+	hb::PrefixNode root;
+	this->nodes.push_back(root);
+	root.prefix.ipv6 = true;
+	this->nodes.push_back(root);
+}
+
+/*
+ * Count of ranges
+ */
+std::size_t PrefixTrie::size()
+{
+	std::size_t count = 0;
+	for (std::vector<hb::PrefixNode>::iterator it = this->nodes.begin(); it != this->nodes.end(); ++it) {
+		if (it->list != NotListed) {
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+ * Find node with longest prefix that contains address
+ */
+const hb::PrefixNode* PrefixTrie::find(const hb::Prefix& address)
+{
+	const hb::PrefixNode* found = NULL;
+	int current = address.ipv6 ? 1 : 0;
+	int next;
+	while (true) {
+		if (this->nodes[current].list != NotListed) {
+			found = &this->nodes[current];
+		}
+		if (this->nodes[current].prefix.length >= address.length) {
+			break;
+		}
+		next = this->nodes[current].child[PrefixTrie::bit(address.address, this->nodes[current].prefix.length)];
+		if (next == -1 || PrefixTrie::commonLength(this->nodes[next].prefix.address, address.address, this->nodes[next].prefix.length) < this->nodes[next].prefix.length) {
+			break;
+		}
+		current = next;
+	}
+	return found;
+}
+
+/*
+ * List of longest range that contains address
+ */
+hb::RangeList PrefixTrie::lookup(const std::string& address, std::string* range)
+{
+	if (this->nodes.size() == 2 && this->nodes[0].list == NotListed && this->nodes[1].list == NotListed) {
+		return NotListed;
+	}
+	hb::Prefix prefix;
+	if (!PrefixTrie::parse(address, &prefix)) {
+		return NotListed;
+	}
+	const hb::PrefixNode* found = this->find(prefix);
+	if (found == NULL) {
+		return NotListed;
+	}
+	if (range != NULL) {
+		*range = found->range;
+	}
+	return found->list;
+}
+
+/*
+ * Whether any node in subtree (including node itself) belongs to list
+ */
+bool PrefixTrie::subtreeHas(int node, hb::RangeList list)
+{
+	std::vector<int> stack(1, node);
+	int current;
+	while (stack.size() > 0) {
+		current = stack.back();
+		stack.pop_back();
+		if (this->nodes[current].list == list) {
+			return true;
+		}
+		for (unsigned int b = 0; b < 2; b++) {
+			if (this->nodes[current].child[b] != -1) {
+				stack.push_back(this->nodes[current].child[b]);
+			}
+		}
+	}
+	return false;
+}
+
+/*
+ * Whether any range of list overlaps with range (contains range or is inside of it)
+ */
+bool PrefixTrie::overlaps(const std::string& range, hb::RangeList list)
+{
+	hb::Prefix prefix;
+	if (!PrefixTrie::parse(range, &prefix)) {
+		return false;
+	}
+	int current = prefix.ipv6 ? 1 : 0;
+	int next;
+	unsigned int limit;
+	while (true) {
+		// Node is inside of range, so is whole subtree
+		if (this->nodes[current].prefix.length >= prefix.length) {
+			return this->subtreeHas(current, list);
+		}
+
+		// Node contains range
+		if (this->nodes[current].list == list) {
+			return true;
+		}
+
+		next = this->nodes[current].child[PrefixTrie::bit(prefix.address, this->nodes[current].prefix.length)];
+		if (next == -1) {
+			return false;
+		}
+		limit = std::min(this->nodes[next].prefix.length, prefix.length);
+		if (PrefixTrie::commonLength(this->nodes[next].prefix.address, prefix.address, limit) < limit) {
+			return false;
+		}
+		current = next;
+	}
+}
+
+/*
+ * All ranges of list, in canonical form
+ */
+std::vector<std::string> PrefixTrie::ranges(hb::RangeList list)
+{
+	std::vector<std::string> result;
+	for (std::vector<hb::PrefixNode>::iterator it = this->nodes.begin(); it != this->nodes.end(); ++it) {
+		if (it->list == list && list != NotListed) {
+			result.push_back(it->range);
+		}
+	}
+	return result;
+}
@@ -0,0 +1,126 @@
+/*
+ * Address ranges (CIDR) for IPv4 and IPv6 kept in path compressed binary trie (Patricia trie),
+ * longest prefix lookup visits at most one node per bit of prefix length
+ */
+
+#ifndef HBCIDR_H
+#define HBCIDR_H
+
+// Vector
+#include <vector>
+// Standard string library
+#include <string>
+
+namespace hb{
+
+/*
+ * List to which address range belongs
+ */
+enum RangeList {
+	NotListed,
+	Whitelist,
+	Blacklist
+};
+
+/*
+ * Network prefix, address bits after prefix length are always zero
+ */
+struct Prefix {
+	bool ipv6 = false;
+	unsigned char address[16] = {0};
+	unsigned int length = 0;// Prefix length in bits
+};
+
+/*
+ * Trie node, holds prefix that is common to all nodes below it
+ */
+struct PrefixNode {
+	hb::Prefix prefix;
+	hb::RangeList list = NotListed;// NotListed for nodes created only to split path
+	std::string range = "";// Range as configured, in canonical form
+	int child[2] = {-1, -1};// Child by next bit after prefix
+};
+
+class PrefixTrie{
+	private:
+
+		/*
+		 * Trie nodes, 0 is IPv4 root and 1 is IPv6 root
+		 */
+		std::vector<hb::PrefixNode> nodes;
+
+		/*
+		 * Value of bit at position (0 is most significant bit of first byte)
+		 */
+		static unsigned int bit(const unsigned char* address, unsigned int position);
+
+		/*
+		 * Length of common prefix of two addresses, compares at most limit bits
+		 */
+		static unsigned int commonLength(const unsigned char* a, const unsigned char* b, unsigned int limit);
+
+		/*
+		 * Find node with longest prefix that contains address
+		 */
+		const hb::PrefixNode* find(const hb::Prefix& address);
+
+		/*
+		 * Whether any node in subtree (including node itself) belongs to list
+		 */
+		bool subtreeHas(int node, hb::RangeList list);
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		PrefixTrie();
+
+		/*
+		 * Parse IPv4 or IPv6 address with optional prefix length (address/length), bits after prefix length are cleared
+		 * Returns false if text is not valid address or range
+		 */
+		static bool parse(const std::string& text, hb::Prefix* prefix);
+
+		/*
+		 * Canonical text of prefix, network address and prefix length
+		 */
+		static std::string format(const hb::Prefix& prefix);
+
+		/*
+		 * Add range to list, range added later overrides same range added earlier
+		 * Returns false if range is not valid
+		 */
+		bool insert(const std::string& range, hb::RangeList list);
+
+		/*
+		 * Remove all ranges
+		 */
+		void clear();
+
+		/*
+		 * Count of ranges
+		 */
+		std::size_t size();
+
+		/*
+		 * List of longest range that contains address (NotListed if address is not in any range or is not valid address)
+		 * If range is not NULL, then matched range is set
+		 */
+		hb::RangeList lookup(const std::string& address, std::string* range = NULL);
+
+		/*
+		 * Whether any range of list overlaps with range (contains range or is inside of it)
+		 */
+		bool overlaps(const std::string& range, hb::RangeList list);
+
+		/*
+		 * All ranges of list, in canonical form
+		 */
+		std::vector<std::string> ranges(hb::RangeList list);
+
+};
+
+}
+
+#endif
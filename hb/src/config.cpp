@@ -10,10 +10,16 @@
 #include <fstream>
 // Time library (time_t, time, localtime)
 #include <time.h>
+// C string (strerror)
+#include <cstring>
+// Algorithm (find)
+#include <algorithm>
 // Logger
 #include "logger.h"
 // Util
 #include "util.h"
+// Native log format parsers
+#include "nativeparser.h"
 // Header
 #include "config.h"
 // Syslog
@@ -74,6 +80,12 @@ bool Config::load()
 			}
 			this->logGroups.clear();
 
+			// Clear address ranges
+			this->addressRanges.clear();
+			this->addressAggregation.clear();
+			this->peerAddresses.clear();
+			this->peerAllow.clear();
+
 			// Reset log group iterator
 			itlg = this->logGroups.begin();
 
@@ -132,6 +144,51 @@ bool Config::load()
 								this->logCheckInterval = strtoul(line.c_str(), NULL, 10);
 								if (logDetails) this->log->debug("Interval for log file check: " + std::to_string(this->logCheckInterval));
 							}
+						} else if (line.substr(0, 18) == "log.overload.bytes") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->overloadBytes = strtoull(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Bytes behind end of log file for overload mode: " + std::to_string(this->overloadBytes));
+							}
+						} else if (line.substr(0, 16) == "log.overload.lag") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->overloadLag = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Lag behind end of log file for overload mode: " + std::to_string(this->overloadLag));
+							}
+						} else if (line.substr(0, 17) == "log.newest.window") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->newestWindow = strtoull(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Window of newest bytes to read first: " + std::to_string(this->newestWindow));
+							}
+						} else if (line.substr(0, 18) == "log.backfill.bytes") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->backfillBytes = strtoull(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Bytes to backfill for each log check: " + std::to_string(this->backfillBytes));
+							}
+						} else if (line.substr(0, 17) == "log.match.threads") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->matchThreads = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Threads of matcher pool: " + std::to_string(this->matchThreads));
+							}
+						} else if (line.substr(0, 14) == "log.match.ring") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->matchRing = strtoul(line.c_str(), NULL, 10);
+								if (this->matchRing == 0) {
+									this->matchRing = 1024;
+								}
+								if (logDetails) this->log->debug("Lines in ring of each matcher: " + std::to_string(this->matchRing));
+							}
 						} else if (line.substr(0, 19) == "address.block.score") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -146,6 +203,131 @@ bool Config::load()
 								this->keepBlockedScoreMultiplier = strtoul(line.c_str(), NULL, 10);
 								if (logDetails) this->log->debug("Score multiplier for rule keeping: " + std::to_string(this->keepBlockedScoreMultiplier));
 							}
+						} else if (line.substr(0, 18) == "subnet.prefix.ipv4") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->subnetPrefixIPv4 = strtoul(line.c_str(), NULL, 10);
+								if (this->subnetPrefixIPv4 > 32) {
+									this->subnetPrefixIPv4 = 32;
+								}
+								if (logDetails) this->log->debug("Subnet prefix length (IPv4): " + std::to_string(this->subnetPrefixIPv4));
+							}
+						} else if (line.substr(0, 18) == "subnet.prefix.ipv6") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->subnetPrefixIPv6 = strtoul(line.c_str(), NULL, 10);
+								if (this->subnetPrefixIPv6 > 128) {
+									this->subnetPrefixIPv6 = 128;
+								}
+								if (logDetails) this->log->debug("Subnet prefix length (IPv6): " + std::to_string(this->subnetPrefixIPv6));
+							}
+						} else if (line.substr(0, 18) == "subnet.block.score") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->subnetScoreToBlock = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Subnet block score: " + std::to_string(this->subnetScoreToBlock));
+							}
+						} else if (line.substr(0, 17) == "subnet.cache.size") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->subnetCacheSize = strtoul(line.c_str(), NULL, 10);
+								if (this->subnetCacheSize == 0) {
+									this->subnetCacheSize = 1;
+								}
+								if (logDetails) this->log->debug("Subnet cache size: " + std::to_string(this->subnetCacheSize));
+							}
+						} else if (line.substr(0, 14) == "feed.directory") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								this->feedDirectory = hb::Util::rtrim(hb::Util::ltrim(line.substr(pos + 1)));
+								while (this->feedDirectory.length() > 1 && this->feedDirectory[this->feedDirectory.length() - 1] == '/') {
+									this->feedDirectory.erase(this->feedDirectory.length() - 1);
+								}
+								if (logDetails) this->log->debug("Feed directory: " + this->feedDirectory);
+							}
+						} else if (line.substr(0, 11) == "peer.listen") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								this->peerListen = hb::Util::rtrim(hb::Util::ltrim(line.substr(pos + 1)));
+								if (logDetails) this->log->debug("Peer sync listen address: " + this->peerListen);
+							}
+						} else if (line.substr(0, 12) == "peer.address") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::rtrim(hb::Util::ltrim(line.substr(pos + 1)));
+								if (line.length() > 0) {
+									this->peerAddresses.push_back(line);
+									if (logDetails) this->log->debug("Peer: " + line);
+								}
+							}
+						} else if (line.substr(0, 10) == "peer.allow") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::rtrim(hb::Util::ltrim(line.substr(pos + 1)));
+								if (line.length() > 0) {
+									this->peerAllow.push_back(line);
+									if (logDetails) this->log->debug("Peers allowed from: " + line);
+								}
+							}
+						} else if (line.substr(0, 9) == "peer.name") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								this->peerName = hb::Util::rtrim(hb::Util::ltrim(line.substr(pos + 1)));
+								if (logDetails) this->log->debug("Peer name: " + this->peerName);
+							}
+						} else if (line.substr(0, 16) == "peer.block.score") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->peerScoreToBlock = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Peer block score: " + std::to_string(this->peerScoreToBlock));
+							}
+						} else if (line.substr(0, 8) == "peer.ttl") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->peerTtl = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Peer decision TTL: " + std::to_string(this->peerTtl));
+							}
+						} else if (line.substr(0, 12) == "peer.history") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->peerHistory = strtoul(line.c_str(), NULL, 10);
+								if (this->peerHistory == 0) {
+									this->peerHistory = 1;
+								}
+								if (logDetails) this->log->debug("Published decisions kept for peers: " + std::to_string(this->peerHistory));
+							}
+						} else if (line.substr(0, 17) == "address.aggregate") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								posd = line.find_first_of(":");
+								unsigned long int prefixLength = strtoul(line.c_str(), NULL, 10);
+								unsigned long int minCount = posd != std::string::npos ? strtoul(line.substr(posd + 1).c_str(), NULL, 10) : 0;
+								if (prefixLength > 0 && prefixLength < 32 && minCount > 1) {
+									this->addressAggregation[prefixLength] = minCount;
+									if (logDetails) this->log->debug("Aggregate blocked addresses to /" + std::to_string(prefixLength) + " if at least " + std::to_string(minCount) + " addresses are blocked");
+								} else {
+									this->log->warning("Invalid address aggregation rule: " + line);
+								}
+							}
+						} else if (line.substr(0, 17) == "address.whitelist" || line.substr(0, 17) == "address.blacklist") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								hb::RangeList list = line.substr(8, 9) == "whitelist" ? hb::Whitelist : hb::Blacklist;
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								if (this->addressRanges.insert(line, list)) {
+									if (logDetails) this->log->debug(std::string(list == hb::Whitelist ? "Whitelisted" : "Blacklisted") + " address range: " + line);
+								} else {
+									this->log->warning("Invalid address range: " + line);
+								}
+							}
 						} else if (line.substr(0, 20) == "iptables.rules.block") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -158,6 +340,42 @@ bool Config::load()
 									this->log->error("Failed to parse iptables.rules.block, IP address placeholder not found! Will use default value.");
 								}
 							}
+						} else if (line.substr(0, 16) == "firewall.backend") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (line == "iptables" || line == "simulated") {
+									this->firewallBackend = line;
+									if (logDetails) this->log->debug("Firewall backend: " + this->firewallBackend);
+								} else {
+									this->log->error("Failed to parse firewall.backend, unknown backend " + line + "! Will use default value.");
+								}
+							}
+						} else if (line.substr(0, 26) == "firewall.simulated.latency") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->firewallSimulatedLatency = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Simulated firewall latency: " + std::to_string(this->firewallSimulatedLatency));
+							}
+						} else if (line.substr(0, 27) == "firewall.simulated.failrate") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->firewallSimulatedFailureRate = strtod(line.c_str(), NULL);
+								if (this->firewallSimulatedFailureRate < 0.0) {
+									this->firewallSimulatedFailureRate = 0.0;
+								} else if (this->firewallSimulatedFailureRate > 100.0) {
+									this->firewallSimulatedFailureRate = 100.0;
+								}
+								if (logDetails) this->log->debug("Simulated firewall failure rate: " + std::to_string(this->firewallSimulatedFailureRate));
+							}
+						} else if (line.substr(0, 12) == "metrics.path") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								this->metricsPath = hb::Util::ltrim(line.substr(pos + 1));
+								if (logDetails) this->log->debug("Metrics file path: " + this->metricsPath);
+							}
 						} else if (line.substr(0, 15) == "datetime.format") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -220,6 +438,15 @@ bool Config::load()
 								}
 								if (logDetails) this->log->debug("Report all matches to AbuseIPDB: " + std::to_string(this->abuseipdbReportAll));
 							}
+						} else if (line.substr(0, 27) == "abuseipdb.report.maskphrase") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								if (line.length() > 0) {
+									this->abuseipdbMaskPhrases.push_back(line);
+									if (logDetails) this->log->debug("Phrase to mask before sending report to AbuseIPDB: " + line);
+								}
+							}
 						} else if (line.substr(0, 21) == "abuseipdb.report.mask") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -323,6 +550,128 @@ bool Config::load()
 								itlg->abuseipdbCommentIsSet = true;
 								if (logDetails) this->log->debug("Log group AbuseIPDB comment for reporting: " + itlg->abuseipdbComment);
 							}
+						} else if (line.substr(0, 11) == "log.reorder") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (line == "true") {
+									itlg->reorder = Report::True;
+								} else if (line == "false") {
+									itlg->reorder = Report::False;
+								} else {
+									itlg->reorder = Report::NotSet;
+								}
+								if (logDetails) this->log->debug("Log group pattern reordering: " + std::to_string(itlg->reorder));
+							}
+						} else if (line.substr(0, 11) == "log.program") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								itlg->programs.clear();
+								// Loop delimiters
+								while ((posd = line.find(",")) != std::string::npos) {
+									if (hb::Util::rtrim(hb::Util::ltrim(line.substr(0, posd))).length() > 0) {
+										itlg->programs.push_back(hb::Util::rtrim(hb::Util::ltrim(line.substr(0, posd))));
+									}
+									line.erase(0, posd + 1);// position + delimiter length
+								}
+								// And last one
+								if (hb::Util::rtrim(hb::Util::ltrim(line)).length() > 0) {
+									itlg->programs.push_back(hb::Util::rtrim(hb::Util::ltrim(line)));
+								}
+								if (logDetails) this->log->debug("Log group syslog programs: " + std::to_string(itlg->programs.size()));
+							}
+						} else if (line.substr(0, 19) == "log.overload.sample") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								itlg->overloadSample = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Log group sampling in overload mode: " + std::to_string(itlg->overloadSample));
+							}
+						} else if (line.substr(0, 15) == "log.time.format") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								itlg->timeFormat = hb::Util::ltrim(line.substr(pos + 1));
+								if (logDetails) this->log->debug("Log group timestamp format: " + itlg->timeFormat);
+							}
+						} else if (line.substr(0, 10) == "log.source") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (line == "docker_json") {
+									itlg->source = LogSource::DockerJson;
+								} else {
+									if (line != "plain") {
+										this->log->warning("Unknown log source, expected plain or docker_json: " + line);
+									}
+									itlg->source = LogSource::Plain;
+								}
+								if (logDetails) this->log->debug("Log group source: " + line);
+							}
+						} else if (line.substr(0, 10) == "log.format") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (hb::NativeParser::format(line, &itlg->format)) {
+									if (logDetails) this->log->debug("Log group format: " + line);
+								} else {
+									this->log->warning("Unknown log format, expected regex, apache_combined, sshd or postfix_sasl: " + line);
+								}
+							}
+						} else if (line.substr(0, 10) == "log.native") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								hb::Pattern pattern;
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								// Rule compares fields of native format set before it
+								if (itlg->format != LogFormat::Regex && hb::NativeParser::rule(line, itlg->format, &pattern)) {
+									itp = itlg->patterns.end();
+									itp = itlg->patterns.insert(itp, pattern);
+									if (logDetails) this->log->debug("Native rule to match: " + pattern.patternString);
+								} else {
+									this->log->warning("Invalid native rule for log format " + hb::NativeParser::formatName(itlg->format) + ", rule skipped: " + line);
+								}
+							}
+						} else if (line.substr(0, 19) == "log.correlate.start") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								hb::CorrelationRule rule;
+								rule.startString = hb::Util::ltrim(line.substr(pos + 1));
+								// Start pattern must contain both %i and %k
+								if (rule.startString.find("%i") != std::string::npos && rule.startString.find("%k") != std::string::npos) {
+									itlg->correlations.push_back(rule);
+									if (logDetails) this->log->debug("Correlation start pattern: " + rule.startString);
+								} else {
+									this->log->warning("Unable to find \%i and \%k in correlation start pattern, rule skipped: " + rule.startString);
+								}
+							}
+						} else if (line.substr(0, 19) == "log.correlate.match") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos && itlg->correlations.size() > 0) {
+								itlg->correlations.back().matchString = hb::Util::ltrim(line.substr(pos + 1));
+								if (logDetails) this->log->debug("Correlation match pattern: " + itlg->correlations.back().matchString);
+							}
+						} else if (line.substr(0, 19) == "log.correlate.score") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos && itlg->correlations.size() > 0) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								itlg->correlations.back().score = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Score for previous correlation rule: " + std::to_string(itlg->correlations.back().score));
+							}
+						} else if (line.substr(0, 17) == "log.correlate.ttl") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos && itlg->correlations.size() > 0) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								itlg->correlations.back().ttl = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("TTL for previous correlation rule: " + std::to_string(itlg->correlations.back().ttl));
+							}
+						} else if (line.substr(0, 21) == "log.correlate.entries") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos && itlg->correlations.size() > 0) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								itlg->correlations.back().entries = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Max IDs for previous correlation rule: " + std::to_string(itlg->correlations.back().entries));
+							}
 						} else if (line.substr(0, 8) == "log.path") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -334,6 +683,26 @@ bool Config::load()
 								itlg->logFiles.push_back(logFile);
 								if (logDetails) this->log->debug("Logfile path: " + hb::Util::ltrim(line.substr(pos+1)));
 							}
+						} else if (line.substr(0, 16) == "log.pattern.rate") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos && itlg->patterns.size() > 0) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								if (Config::parseRate(line, &itlg->patterns.back().rate)) {
+									if (logDetails) this->log->debug("Rate rule for previous pattern: " + line);
+								} else {
+									this->log->warning("Invalid rate rule, expected count/seconds: " + line);
+								}
+							}
+						} else if (line.substr(0, 8) == "log.rate") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								if (Config::parseRate(line, &itlg->rate)) {
+									if (logDetails) this->log->debug("Log group rate rule: " + line);
+								} else {
+									this->log->warning("Invalid rate rule, expected count/seconds: " + line);
+								}
+							}
 						} else if (line.substr(0, 11) == "log.pattern") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -356,6 +725,17 @@ bool Config::load()
 								itp->score = strtoul(line.c_str(), NULL, 10);
 								if (logDetails) this->log->debug("Score for previous pattern: " + std::to_string(itp->score));
 							}
+						} else if (line.substr(0, 12) == "log.severity") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos && itlg->patterns.size() > 0) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (line == "high") {
+									itlg->patterns.back().severity = Severity::High;
+								} else {
+									itlg->patterns.back().severity = Severity::Normal;
+								}
+								if (logDetails) this->log->debug("Severity for previous pattern: " + line);
+							}
 						} else if (line.substr(0, 19) == "log.refused.pattern") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -448,18 +828,46 @@ bool Config::load()
 	return true;
 }
 
+/*
+ * Parse rate rule (count/seconds)
+ */
+bool Config::parseRate(const std::string& value, hb::RateLimit* rate)
+{
+	std::size_t pos = value.find_first_of("/");
+	if (pos == std::string::npos) {
+		return false;
+	}
+	unsigned long int count = strtoul(value.substr(0, pos).c_str(), NULL, 10);
+	unsigned long int seconds = strtoul(value.substr(pos + 1).c_str(), NULL, 10);
+	if (count == 0 || seconds == 0) {
+		return false;
+	}
+	rate->count = count;
+	rate->seconds = seconds;
+	return true;
+}
+
 /*
  * Process patterns
  * std::string patternString -> std::regex pattern
  */
 bool Config::processPatterns()
 {
+	this->rateBucketWidths.clear();
 	std::vector<LogGroup>::iterator itlg;
 	std::vector<Pattern>::iterator itpa;
-	std::size_t posip, posport;
+	std::vector<CorrelationRule>::iterator itcr;
+	std::size_t posip, posport, posid;
+	unsigned int index;
 	try{
 		for (itlg = this->logGroups.begin(); itlg != this->logGroups.end(); ++itlg) {
 			for (itpa = itlg->patterns.begin(); itpa != itlg->patterns.end(); ++itpa) {
+				// Native rule has no regex, port is known only for sshd messages
+				if (itpa->native) {
+					itpa->portSearch = itlg->format == LogFormat::Sshd;
+					itpa->reportPolicy = this->reportPolicy(&(*itlg), &(*itpa));
+					continue;
+				}
 				posip = itpa->patternString.find("%i");
 				posport = itpa->patternString.find("%p");
 				if (posip != std::string::npos) {
@@ -468,6 +876,8 @@ bool Config::processPatterns()
 						itpa->portSearch = true;
 					}
 					itpa->pattern = std::regex(itpa->patternString.replace(posip, 2, "(\\d{1,3}\\.\\d{1,3}\\.\\d{1,3}\\.\\d{1,3})"), std::regex_constants::icase);
+					itpa->literal = Util::requiredLiteral(itpa->patternString);
+					itpa->reportPolicy = this->reportPolicy(&(*itlg), &(*itpa));
 					// std::cout << "Regex pattern: " << itpa->patternString << std::endl;
 				} else {
 					this->log->error("Unable to find ip address placeholder \%i in pattern, failed to parse pattern: " + itpa->patternString);
@@ -483,12 +893,88 @@ bool Config::processPatterns()
 						itpa->portSearch = true;
 					}
 					itpa->pattern = std::regex(itpa->patternString.replace(posip, 2, "(\\d{1,3}\\.\\d{1,3}\\.\\d{1,3}\\.\\d{1,3})"), std::regex_constants::icase);
+					itpa->literal = Util::requiredLiteral(itpa->patternString);
+					itpa->reportPolicy = this->reportPolicy(&(*itlg), &(*itpa));
 					// std::cout << "Regex pattern: " << itpa->patternString << std::endl;
 				} else {
 					this->log->error("Unable to find ip address placeholder \%i in pattern, failed to parse pattern: " + itpa->patternString);
 					return false;
 				}
 			}
+
+			// Escaped container log line can be rejected before unescaping only if each pattern requires literal that is never escaped
+			itlg->rawPrefilter = itlg->source == LogSource::DockerJson && itlg->correlations.size() == 0 && itlg->patterns.size() + itlg->refusedPatterns.size() > 0;
+			for (itpa = itlg->patterns.begin(); itpa != itlg->patterns.end() && itlg->rawPrefilter; ++itpa) {
+				itlg->rawPrefilter = !itpa->native && itpa->literal.length() > 0 && Util::jsonRawSafe(itpa->literal);
+			}
+			for (itpa = itlg->refusedPatterns.begin(); itpa != itlg->refusedPatterns.end() && itlg->rawPrefilter; ++itpa) {
+				itlg->rawPrefilter = itpa->literal.length() > 0 && Util::jsonRawSafe(itpa->literal);
+			}
+
+			// Correlation rules, ID is any text without whitespace, state is kept in table of rule
+			index = 0;
+			for (itcr = itlg->correlations.begin(); itcr != itlg->correlations.end(); ++itcr) {
+				itcr->index = ++index;
+				if (itcr->matchString.find("%k") == std::string::npos) {
+					this->log->error("Unable to find ID placeholder \%k in correlation match pattern, failed to parse correlation rule: " + itcr->startString);
+					return false;
+				}
+				posip = itcr->startString.find("%i");
+				posid = itcr->startString.find("%k");
+				itcr->addressGroup = posip < posid ? 1 : 2;
+				itcr->idGroup = posip < posid ? 2 : 1;
+				itcr->startString.replace(posip, 2, "(\\d{1,3}\\.\\d{1,3}\\.\\d{1,3}\\.\\d{1,3})");
+				itcr->startString.replace(itcr->startString.find("%k"), 2, "(\\S+)");
+				itcr->start = std::regex(itcr->startString, std::regex_constants::icase);
+				itcr->startLiteral = Util::requiredLiteral(itcr->startString);
+				itcr->matchString.replace(itcr->matchString.find("%k"), 2, "(\\S+)");
+				itcr->match = std::regex(itcr->matchString, std::regex_constants::icase);
+				itcr->matchLiteral = Util::requiredLiteral(itcr->matchString);
+				itcr->table = std::make_shared<hb::CorrelationTable>(itcr->ttl, itcr->entries);
+			}
+
+			// Rate rule of log group applies to patterns without own rule, period of rule fits in ring of its window
+			for (itpa = itlg->patterns.begin(); itpa != itlg->patterns.end(); ++itpa) {
+				if (itpa->rate.count == 0) {
+					itpa->rate = itlg->rate;
+				}
+				if (itpa->rate.count > 0) {
+					itpa->rate.bucketSeconds = (itpa->rate.seconds + hb::kRateBuckets - 1) / hb::kRateBuckets;
+					itpa->rate.window = std::find(this->rateBucketWidths.begin(), this->rateBucketWidths.end(), itpa->rate.bucketSeconds) - this->rateBucketWidths.begin();
+					if (itpa->rate.window == this->rateBucketWidths.size()) {
+						this->rateBucketWidths.push_back(itpa->rate.bucketSeconds);
+					}
+				}
+			}
+
+			// Configured order is identity of pattern, evaluation order starts as configured
+			itlg->patternOrder.clear();
+			index = 0;
+			for (itpa = itlg->patterns.begin(); itpa != itlg->patterns.end(); ++itpa) {
+				itpa->index = ++index;
+				itlg->patternOrder.push_back(index - 1);
+			}
+			itlg->refusedPatternOrder.clear();
+			index = 0;
+			for (itpa = itlg->refusedPatterns.begin(); itpa != itlg->refusedPatterns.end(); ++itpa) {
+				itpa->index = ++index;
+				itlg->refusedPatternOrder.push_back(index - 1);
+			}
+
+			// First matched pattern wins, so reordering is allowed only if explicitly configured or if all patterns have same effect
+			if (itlg->reorder == Report::True) {
+				itlg->reorderPatterns = true;
+				itlg->reorderRefusedPatterns = true;
+			} else if (itlg->reorder == Report::False) {
+				itlg->reorderPatterns = false;
+				itlg->reorderRefusedPatterns = false;
+			} else {
+				itlg->reorderPatterns = Config::equivalentPatterns(&itlg->patterns);
+				itlg->reorderRefusedPatterns = Config::equivalentPatterns(&itlg->refusedPatterns);
+			}
+			if (itlg->reorderPatterns || itlg->reorderRefusedPatterns) {
+				this->log->debug("Patterns of log group " + itlg->name + " will be ordered by hit statistics");
+			}
 		}
 	} catch (std::regex_error& e){
 		std::string message = e.what();
@@ -499,6 +985,104 @@ bool Config::processPatterns()
 	return true;
 }
 
+/*
+ * Whether match with any of patterns has same result (score, port search and AbuseIPDB reporting), i.e. evaluation order does not matter
+ */
+bool Config::equivalentPatterns(std::vector<hb::Pattern>* patterns)
+{
+	if (patterns->size() < 2) {
+		return false;
+	}
+	std::vector<hb::Pattern>::iterator first = patterns->begin();
+	for (std::vector<hb::Pattern>::iterator itpa = patterns->begin() + 1; itpa != patterns->end(); ++itpa) {
+		if (itpa->score != first->score
+			|| itpa->portSearch != first->portSearch
+			|| itpa->abuseipdbReport != first->abuseipdbReport
+			|| itpa->abuseipdbCategories != first->abuseipdbCategories
+			|| itpa->abuseipdbCommentIsSet != first->abuseipdbCommentIsSet
+			|| itpa->abuseipdbComment != first->abuseipdbComment
+			|| itpa->severity != first->severity
+			|| itpa->rate.count != first->rate.count
+			|| itpa->rate.seconds != first->rate.seconds) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Resolve AbuseIPDB report policy of pattern (global -> log group -> pattern)
+ * Note, port search of pattern must be known
+ */
+std::shared_ptr<const hb::ReportPolicy> Config::reportPolicy(hb::LogGroup* group, hb::Pattern* pattern)
+{
+	std::shared_ptr<hb::ReportPolicy> policy = std::make_shared<hb::ReportPolicy>();
+	std::vector<unsigned int>::iterator itc;
+	std::vector<hb::CommentToken>::iterator itt;
+
+	// Without API key nothing is reported
+	if (this->abuseipdbKey.size() == 0) {
+		return policy;
+	}
+
+	// Global setting
+	bool report = this->abuseipdbReportAll;
+	std::vector<unsigned int>* categories = &this->abuseipdbDefaultCategories;
+	std::string comment = "";
+	if (this->abuseipdbDefaultCommentIsSet) {
+		comment = this->abuseipdbDefaultComment;
+	}
+	// Log group setting overrides global setting
+	if (group->abuseipdbReport == Report::True) {
+		report = true;
+	} else if (group->abuseipdbReport == Report::False) {
+		report = false;
+	}
+	if (group->abuseipdbCategories.size() > 0) {
+		categories = &group->abuseipdbCategories;
+	}
+	if (group->abuseipdbCommentIsSet) {
+		comment = group->abuseipdbComment;
+	}
+	// Pattern setting overrides log group setting
+	if (pattern->abuseipdbReport == Report::True) {
+		report = true;
+	} else if (pattern->abuseipdbReport == Report::False) {
+		report = false;
+	}
+	if (pattern->abuseipdbCategories.size() > 0) {
+		categories = &pattern->abuseipdbCategories;
+	}
+	if (pattern->abuseipdbCommentIsSet) {
+		comment = pattern->abuseipdbComment;
+	}
+
+	policy->report = report;
+	for (itc = categories->begin(); itc != categories->end(); ++itc) {
+		if (*itc >= policy->categories.size()) {
+			this->log->warning("AbuseIPDB category " + std::to_string(*itc) + " is out of range, skipped! Log group: " + group->name);
+			continue;
+		}
+		if (!policy->categories.test(*itc)) {
+			policy->categories.set(*itc);
+			policy->categoryList.push_back(*itc);
+		}
+	}
+	policy->comment = Util::compileComment(comment);
+	for (itt = policy->comment.begin(); itt != policy->comment.end(); ++itt) {
+		if (itt->placeholder == 'p' && !pattern->portSearch) {
+			this->log->warning("Comment template contains port placeholder, but pattern does not contain port! Adjust pattern or comment to avoid this warning! Log group: " + group->name + " Pattern: " + pattern->patternString);
+			// Keep placeholder as text
+			itt->placeholder = 0;
+			itt->text = "%p";
+		} else if (itt->placeholder == 'm') {
+			policy->commentUsesLine = true;
+		}
+	}
+
+	return policy;
+}
+
 /*
  * Print (stdout) currently loaded config
  */
@@ -517,12 +1101,98 @@ void Config::print()
 	std::cout << "log.level = " << this->logLevel << std::endl << std::endl;
 	std::cout << "## Interval for log file check (seconds, default 30)" << std::endl;
 	std::cout << "log.check.interval = " << this->logCheckInterval << std::endl << std::endl;
+	if (this->overloadBytes > 0 || this->overloadLag > 0) {
+		std::cout << "## Overload mode thresholds, bytes behind end of log file and estimated seconds to catch up with it, 0 disables (default 0)" << std::endl;
+		std::cout << "log.overload.bytes = " << this->overloadBytes << std::endl;
+		std::cout << "log.overload.lag = " << this->overloadLag << std::endl << std::endl;
+	}
+	if (this->newestWindow > 0) {
+		std::cout << "## Read newest bytes of log file first if it is further behind, 0 disables (default 0)" << std::endl;
+		std::cout << "log.newest.window = " << this->newestWindow << std::endl << std::endl;
+		std::cout << "## Max bytes of older lines to backfill for each log check, 0 for no limit (default 0)" << std::endl;
+		std::cout << "log.backfill.bytes = " << this->backfillBytes << std::endl << std::endl;
+	}
+	if (this->matchThreads > 0) {
+		std::cout << "## Threads matching lines with patterns, 0 matches lines in reading thread (default 0)" << std::endl;
+		std::cout << "log.match.threads = " << this->matchThreads << std::endl;
+		std::cout << "log.match.ring = " << this->matchRing << std::endl << std::endl;
+	}
 	std::cout << "Needed score to create iptables rule for IP address connection drop (default 10)" << std::endl;
 	std::cout << "address.block.score = " << this->activityScoreToBlock << std::endl << std::endl;
 	std::cout << "## Score multiplier to calculate time how long iptables rule should be kept (seconds, default 3600, 0 will not remove automatically)" << std::endl;
 	std::cout << "address.block.multiplier = " << this->keepBlockedScoreMultiplier << std::endl << std::endl;
+	if (this->addressAggregation.size() > 0) {
+		std::cout << "## Aggregate blocked IPv4 addresses (prefix length:min count of blocked addresses in prefix)" << std::endl;
+		for (std::map<unsigned int, unsigned int>::iterator ita = this->addressAggregation.begin(); ita != this->addressAggregation.end(); ++ita) {
+			std::cout << "address.aggregate = " << ita->first << ":" << ita->second << std::endl;
+		}
+		std::cout << std::endl;
+	}
+	if (this->subnetScoreToBlock > 0) {
+		std::cout << "## Needed aggregate score of subnet to block whole subnet, 0 disables (default 0)" << std::endl;
+		std::cout << "subnet.block.score = " << this->subnetScoreToBlock << std::endl << std::endl;
+		std::cout << "## Subnet prefix length for IPv4 and IPv6 addresses (default 24 and 64)" << std::endl;
+		std::cout << "subnet.prefix.ipv4 = " << this->subnetPrefixIPv4 << std::endl;
+		std::cout << "subnet.prefix.ipv6 = " << this->subnetPrefixIPv6 << std::endl << std::endl;
+		std::cout << "## Max count of subnets to keep aggregate activity for (default 10000)" << std::endl;
+		std::cout << "subnet.cache.size = " << this->subnetCacheSize << std::endl << std::endl;
+	}
+	if (this->peerListen.length() > 0 || this->peerAddresses.size() > 0) {
+		std::cout << "## Peer sync, address to publish block decisions on and peers to receive them from (host:port)" << std::endl;
+		if (this->peerListen.length() > 0) {
+			std::cout << "peer.listen = " << this->peerListen << std::endl;
+		}
+		for (std::vector<std::string>::iterator itpa = this->peerAddresses.begin(); itpa != this->peerAddresses.end(); ++itpa) {
+			std::cout << "peer.address = " << *itpa << std::endl;
+		}
+		for (std::vector<std::string>::iterator itpa = this->peerAllow.begin(); itpa != this->peerAllow.end(); ++itpa) {
+			std::cout << "peer.allow = " << *itpa << std::endl;
+		}
+		if (this->peerName.length() > 0) {
+			std::cout << "peer.name = " << this->peerName << std::endl;
+		}
+		std::cout << std::endl;
+		std::cout << "## Needed sum of scores of peer decisions to block address, 0 disables (default 10)" << std::endl;
+		std::cout << "peer.block.score = " << this->peerScoreToBlock << std::endl << std::endl;
+		std::cout << "## Seconds to block address for peer decision without expiry time (default 3600)" << std::endl;
+		std::cout << "peer.ttl = " << this->peerTtl << std::endl << std::endl;
+		std::cout << "## Count of published decisions kept for peers to resume sync (default 100000)" << std::endl;
+		std::cout << "peer.history = " << this->peerHistory << std::endl << std::endl;
+	}
+	if (this->feedDirectory.length() > 0) {
+		std::cout << "## Directory with blocklist feeds, each file is source with address or CIDR range on each line" << std::endl;
+		std::cout << "feed.directory = " << this->feedDirectory << std::endl << std::endl;
+	}
+	std::vector<std::string> ranges = this->addressRanges.ranges(hb::Whitelist);
+	if (ranges.size() > 0) {
+		std::cout << "## Whitelisted address ranges (CIDR, IPv4 or IPv6), matches from these ranges are ignored" << std::endl;
+		for (std::vector<std::string>::iterator itr = ranges.begin(); itr != ranges.end(); ++itr) {
+			std::cout << "address.whitelist = " << *itr << std::endl;
+		}
+		std::cout << std::endl;
+	}
+	ranges = this->addressRanges.ranges(hb::Blacklist);
+	if (ranges.size() > 0) {
+		std::cout << "## Blacklisted address ranges (CIDR, IPv4 or IPv6), single iptables rule is created for each range" << std::endl;
+		for (std::vector<std::string>::iterator itr = ranges.begin(); itr != ranges.end(); ++itr) {
+			std::cout << "address.blacklist = " << *itr << std::endl;
+		}
+		std::cout << std::endl;
+	}
 	std::cout << "## Rule to use in IP tables rule (use %i as placeholder to specify IP address)" << std::endl;
 	std::cout << "iptables.rules.block = " << this->iptablesRule << std::endl << std::endl;
+	if (this->firewallBackend != "iptables") {
+		std::cout << "## Firewall backend (iptables|simulated, default iptables)" << std::endl;
+		std::cout << "firewall.backend = " << this->firewallBackend << std::endl << std::endl;
+		std::cout << "## Simulated firewall latency for each operation (microseconds, default 0)" << std::endl;
+		std::cout << "firewall.simulated.latency = " << this->firewallSimulatedLatency << std::endl << std::endl;
+		std::cout << "## Simulated firewall failure rate for each operation (percent, default 0)" << std::endl;
+		std::cout << "firewall.simulated.failrate = " << this->firewallSimulatedFailureRate << std::endl << std::endl;
+	}
+	if (this->metricsPath.length() > 0) {
+		std::cout << "## Metrics file (Prometheus text format), empty to disable (default empty)" << std::endl;
+		std::cout << "metrics.path = " << this->metricsPath << std::endl << std::endl;
+	}
 	std::cout << "## Datetime format (default %Y-%m-%d %H:%M:%S)" << std::endl;
 	std::cout << "datetime.format = " << this->dateTimeFormat << std::endl << std::endl;
 	std::cout << "## Datafile location" << std::endl;
@@ -561,6 +1231,13 @@ void Config::print()
 			std::cout << "false";
 		}
 		std::cout << std::endl << std::endl;
+		if (this->abuseipdbMaskPhrases.size() > 0) {
+			std::cout << "## Additional custom phrases to mask before sending report to AbuseIPDB" << std::endl;
+			for (std::vector<std::string>::iterator itmp = this->abuseipdbMaskPhrases.begin(); itmp != this->abuseipdbMaskPhrases.end(); ++itmp) {
+				std::cout << "abuseipdb.report.maskphrase = " << *itmp << std::endl;
+			}
+			std::cout << std::endl;
+		}
 		if (this->abuseipdbDefaultCategories.size() > 0) {
 			std::cout << "## Default categories for reporting to AbuseIPDB (default 15, separated with comma, must have at least one category)" << std::endl;
 			std::cout << "abuseipdb.report.categories = ";
@@ -611,6 +1288,37 @@ void Config::print()
 			}
 			std::cout << std::endl;
 		}
+		if (itlg->reorder != Report::NotSet) {
+			std::cout << "## Whether patterns may be evaluated in order of hit statistics instead of configured order (true|false, default only if all patterns have same score and reporting settings)" << std::endl;
+			std::cout << "log.reorder = ";
+			if (itlg->reorder == Report::True) {
+				std::cout << "true";
+			} else {
+				std::cout << "false";
+			}
+			std::cout << std::endl << std::endl;
+		}
+		if (itlg->programs.size() > 0) {
+			std::cout << "## Syslog program(s) of interest, only lines with these tags are matched with patterns" << std::endl;
+			std::cout << "log.program = ";
+			for (std::vector<std::string>::iterator itpr = itlg->programs.begin(); itpr != itlg->programs.end(); ++itpr) {
+				if (itpr != itlg->programs.begin()) std::cout << ", ";
+				std::cout << *itpr;
+			}
+			std::cout << std::endl << std::endl;
+		}
+		if (itlg->rate.count > 0) {
+			std::cout << "## Block address if count of matches happen within seconds (count/seconds), regardless of score" << std::endl;
+			std::cout << "log.rate = " << itlg->rate.count << "/" << itlg->rate.seconds << std::endl << std::endl;
+		}
+		if (itlg->overloadSample != 1) {
+			std::cout << "## In overload mode match only each Nth line with patterns, 0 skips all lines (default 1)" << std::endl;
+			std::cout << "log.overload.sample = " << itlg->overloadSample << std::endl << std::endl;
+		}
+		if (itlg->timeFormat.length() > 0) {
+			std::cout << "## Format of timestamp in log lines, used to score activity in log time with --backfill-history" << std::endl;
+			std::cout << "log.time.format = " << itlg->timeFormat << std::endl << std::endl;
+		}
 		std::cout << "## Full path to log file(s)" << std::endl;
 		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
 			std::cout << "log.path = " << itlf->path << std::endl << std::endl;
@@ -620,10 +1328,20 @@ void Config::print()
 			std::cout << "## Use %i to specify where in pattern IP address should be looked for" << std::endl;
 			std::cout << "## Score must follow after pattern, if not specified by default will be set 1" << std::endl;
 			for (itpa = itlg->patterns.begin(); itpa != itlg->patterns.end(); ++itpa) {
-				std::cout << "log.pattern = " << itpa->patternString << std::endl;
+				if (itpa->native) {
+					std::cout << "log.native = " << itpa->patternString << std::endl;
+				} else {
+					std::cout << "log.pattern = " << itpa->patternString << std::endl;
+				}
 				if (itpa->score > 1) {
 					std::cout << "log.score = " << itpa->score << std::endl;
 				}
+				if (itpa->severity == Severity::High) {
+					std::cout << "log.severity = high" << std::endl;
+				}
+				if (itpa->rate.count > 0 && (itpa->rate.count != itlg->rate.count || itpa->rate.seconds != itlg->rate.seconds)) {
+					std::cout << "log.pattern.rate = " << itpa->rate.count << "/" << itpa->rate.seconds << std::endl;
+				}
 				if (itpa->abuseipdbReport != Report::NotSet) {
 					std::cout << "log.abuseipdb.report = ";
 					if (itpa->abuseipdbReport == Report::True) {
@@ -649,6 +1367,32 @@ void Config::print()
 				std::cout << std::endl;
 			}
 		}
+		if (itlg->source == LogSource::DockerJson) {
+			std::cout << "## Source of log lines, docker_json for container json-file logs (message is in \"log\" field)" << std::endl;
+			std::cout << "log.source = docker_json" << std::endl << std::endl;
+		}
+		if (itlg->format != LogFormat::Regex) {
+			std::cout << "## Format of log lines for native rules (log.native)" << std::endl;
+			std::cout << "log.format = " << hb::NativeParser::formatName(itlg->format) << std::endl << std::endl;
+		}
+		if (itlg->correlations.size() > 0) {
+			std::cout << "## Correlation rules, line matched with start pattern maps ID (%k) to address (%i)," << std::endl;
+			std::cout << "## later line matched with match pattern with same ID is scored as activity of address" << std::endl;
+			for (std::vector<CorrelationRule>::iterator itcr = itlg->correlations.begin(); itcr != itlg->correlations.end(); ++itcr) {
+				std::cout << "log.correlate.start = " << itcr->startString << std::endl;
+				std::cout << "log.correlate.match = " << itcr->matchString << std::endl;
+				if (itcr->score > 1) {
+					std::cout << "log.correlate.score = " << itcr->score << std::endl;
+				}
+				if (itcr->ttl != 600) {
+					std::cout << "log.correlate.ttl = " << itcr->ttl << std::endl;
+				}
+				if (itcr->entries != 10000) {
+					std::cout << "log.correlate.entries = " << itcr->entries << std::endl;
+				}
+				std::cout << std::endl;
+			}
+		}
 		if (itlg->refusedPatterns.size() > 0) {
 			std::cout << "## Patterns in log file to count refused connection count" << std::endl;
 			std::cout << "## Include %i in pattern, will search there for IP address" << std::endl;
@@ -15,12 +15,29 @@
 #include "logger.h"
 // Util
 #include "util.h"
+// Address ranges
+#include "cidr.h"
 
 namespace hb{
 
 class Config{
 	private:
 
+		/*
+		 * Whether match with any of patterns has same result, i.e. evaluation order does not matter
+		 */
+		static bool equivalentPatterns(std::vector<hb::Pattern>* patterns);
+
+		/*
+		 * Parse rate rule (count/seconds)
+		 */
+		static bool parseRate(const std::string& value, hb::RateLimit* rate);
+
+		/*
+		 * Resolve AbuseIPDB report policy of pattern (global -> log group -> pattern)
+		 */
+		std::shared_ptr<const hb::ReportPolicy> reportPolicy(hb::LogGroup* group, hb::Pattern* pattern);
+
 	public:
 
 		/*
@@ -38,6 +55,26 @@ class Config{
 		 */
 		std::string iptablesRule = "-s %i -j DROP";
 
+		/*
+		 * Firewall backend, iptables or simulated (in-memory, for tests and benchmarks)
+		 */
+		std::string firewallBackend = "iptables";
+
+		/*
+		 * Simulated firewall latency for each operation (microseconds)
+		 */
+		unsigned int firewallSimulatedLatency = 0;
+
+		/*
+		 * Simulated firewall failure rate for each operation (percent, 0 - 100)
+		 */
+		double firewallSimulatedFailureRate = 0.0;
+
+		/*
+		 * Metrics file (Prometheus text format), empty to disable
+		 */
+		std::string metricsPath = "";
+
 		/*
 		 * Datetime format
 		 */
@@ -53,6 +90,26 @@ class Config{
 		 */
 		unsigned int logCheckInterval = 30;
 
+		/*
+		 * Overload mode thresholds, bytes behind end of log file and estimated seconds to catch up with it (0 disables)
+		 * In overload mode lines of low value log groups are sampled or skipped, reports and debug messages are skipped
+		 */
+		unsigned long long int overloadBytes = 0;
+		unsigned int overloadLag = 0;
+
+		/*
+		 * Newest first reading, if log file is more than window bytes behind, newest window is read first and older lines are backfilled later
+		 * Backfill reads at most given bytes for each check (0 disables newest first reading, 0 for backfill means no limit)
+		 */
+		unsigned long long int newestWindow = 0;
+		unsigned long long int backfillBytes = 0;
+
+		/*
+		 * Matcher pool, lines are matched with patterns by worker threads (0 - lines are matched by reader) connected with rings of given size (lines)
+		 */
+		unsigned int matchThreads = 0;
+		unsigned int matchRing = 1024;
+
 		/*
 		 * Needed suspicious activity score to block access (to create iptables rule)
 		 */
@@ -76,6 +133,71 @@ class Config{
 		 */
 		unsigned int keepBlockedScoreMultiplier = 3600;
 
+		/*
+		 * Prefix length of subnets to count aggregate activity for
+		 */
+		unsigned int subnetPrefixIPv4 = 24;
+		unsigned int subnetPrefixIPv6 = 64;
+
+		/*
+		 * Needed aggregate activity score of subnet to block whole subnet, 0 disables subnet activity counting
+		 */
+		unsigned int subnetScoreToBlock = 0;
+
+		/*
+		 * Max count of subnets to keep aggregate activity for (least recently updated subnet is dropped first)
+		 */
+		unsigned int subnetCacheSize = 10000;
+
+		/*
+		 * Peer sync, block decisions are published on listen address (host:port, empty disables) and received from peers (host:port)
+		 */
+		std::string peerListen = "";
+		std::vector<std::string> peerAddresses;
+
+		/*
+		 * Addresses and ranges (CIDR) peers are accepted from on listen address (addresses of peers if empty)
+		 */
+		std::vector<std::string> peerAllow;
+
+		/*
+		 * Name of this instance in published decisions (hostname if not set)
+		 */
+		std::string peerName = "";
+
+		/*
+		 * Needed sum of scores of peer decisions to block address, 0 disables blocking because of peers
+		 */
+		unsigned int peerScoreToBlock = 10;
+
+		/*
+		 * Seconds to keep block of peer decision without expiry time, and count of published decisions kept for resuming peers
+		 */
+		unsigned int peerTtl = 3600;
+		unsigned int peerHistory = 100000;
+
+		/*
+		 * Directory with blocklist feeds (each file is source with address or CIDR range on each line), empty disables
+		 */
+		std::string feedDirectory = "";
+
+		/*
+		 * Aggregation of blocked addresses (prefix length -> min count of blocked addresses in prefix)
+		 * Prefix with enough blocked addresses is blocked with single rule instead of rule for each address
+		 */
+		std::map<unsigned int, unsigned int> addressAggregation;
+
+		/*
+		 * Distinct bucket widths of rate rules (seconds), index is rate window of rule, resolved when patterns are processed
+		 * Each rule counts matches in buckets of its own period, so short period is not counted in buckets of long period
+		 */
+		std::vector<unsigned int> rateBucketWidths;
+
+		/*
+		 * Whitelisted and blacklisted address ranges (CIDR)
+		 */
+		hb::PrefixTrie addressRanges;
+
 		/*
 		 * Path to data file
 		 */
@@ -116,6 +238,11 @@ class Config{
 		 */
 		bool abuseipdbReportMask = true;
 
+		/*
+		 * Additional phrases to mask in comment (if %m is used) before sending report to AbuseIPDB
+		 */
+		std::vector<std::string> abuseipdbMaskPhrases;
+
 		/*
 		 * Default AbuseIPDB categories for reporting (can be overridden at log group and pattern level)
 		 */
@@ -146,6 +273,7 @@ class Config{
 		/*
 		 * Process patterns
 		 * std::string patternString -> std::regex pattern
+		 * Also resolves report policy of each pattern, must be called after each load
 		 */
 		bool processPatterns();
 
@@ -0,0 +1,99 @@
+/*
+ * Correlation state for events spread over several log lines, bounded table with TTL
+ */
+
+// Iterator (prev)
+#include <iterator>
+// Header
+#include "correlation.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+CorrelationTable::CorrelationTable(unsigned int ttl, std::size_t capacity)
+{
+	this->ttl = ttl;
+	this->capacity = capacity;
+	this->entries.reserve(capacity);
+}
+
+/*
+ * Remove entry
+ */
+void CorrelationTable::remove(std::unordered_map<std::string, hb::CorrelationEntry>::iterator entry)
+{
+	this->order.erase(entry->second.age);
+	this->entries.erase(entry);
+}
+
+/*
+ * Map ID to address, existing entry of ID is replaced, expired entries are removed and oldest entry is evicted if table is full
+ */
+void CorrelationTable::insert(const std::string& id, const std::string& address, unsigned long long int now)
+{
+	if (this->capacity == 0) {
+		return;
+	}
+	std::unordered_map<std::string, hb::CorrelationEntry>::iterator it = this->entries.find(id);
+	if (it != this->entries.end()) {
+		this->remove(it);
+	}
+
+	// Oldest entries are first, stop at first entry that is not expired
+	while (this->order.size() > 0) {
+		it = this->entries.find(this->order.front());
+		if (it->second.expires > now) {
+			break;
+		}
+		this->remove(it);
+		this->expirations++;
+	}
+	if (this->entries.size() >= this->capacity) {
+		this->remove(this->entries.find(this->order.front()));
+		this->evictions++;
+	}
+
+	this->order.push_back(id);
+	hb::CorrelationEntry& entry = this->entries[id];
+	entry.address = address;
+	entry.expires = now + this->ttl;
+	entry.age = std::prev(this->order.end());
+}
+
+/*
+ * Address mapped to ID, returns false if ID is not known or entry is expired
+ */
+bool CorrelationTable::lookup(const std::string& id, unsigned long long int now, std::string* address)
+{
+	std::unordered_map<std::string, hb::CorrelationEntry>::iterator it = this->entries.find(id);
+	if (it == this->entries.end()) {
+		return false;
+	}
+	if (it->second.expires <= now) {
+		this->remove(it);
+		this->expirations++;
+		return false;
+	}
+	*address = it->second.address;
+	return true;
+}
+
+/*
+ * Count of entries (including expired entries not removed yet)
+ */
+std::size_t CorrelationTable::size()
+{
+	return this->entries.size();
+}
+
+/*
+ * Remove all entries
+ */
+void CorrelationTable::clear()
+{
+	this->entries.clear();
+	this->order.clear();
+}
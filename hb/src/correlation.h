@@ -0,0 +1,92 @@
+/*
+ * Correlation state for events spread over several log lines, ID captured from first line (session, queue or process ID) maps to address,
+ * table is bounded (oldest entry is evicted when full) and entries expire after TTL
+ */
+
+#ifndef HBCORRELATION_H
+#define HBCORRELATION_H
+
+// Standard string library
+#include <string>
+// List
+#include <list>
+// Unordered map
+#include <unordered_map>
+
+namespace hb{
+
+/*
+ * Address seen with ID
+ */
+struct CorrelationEntry {
+	std::string address = "";
+	unsigned long long int expires = 0;// Time when entry expires
+	std::list<std::string>::iterator age;// Position in list ordered by insert time
+};
+
+class CorrelationTable{
+	private:
+
+		/*
+		 * Entries by ID
+		 */
+		std::unordered_map<std::string, hb::CorrelationEntry> entries;
+
+		/*
+		 * IDs ordered by insert time, oldest first (expiry and eviction order)
+		 */
+		std::list<std::string> order;
+
+		/*
+		 * Remove entry
+		 */
+		void remove(std::unordered_map<std::string, hb::CorrelationEntry>::iterator entry);
+
+	public:
+
+		/*
+		 * Seconds entry is kept after insert
+		 */
+		unsigned int ttl = 600;
+
+		/*
+		 * Max count of entries
+		 */
+		std::size_t capacity = 10000;
+
+		/*
+		 * Entries removed because table was full and because of TTL
+		 */
+		unsigned long long int evictions = 0;
+		unsigned long long int expirations = 0;
+
+		/*
+		 * Constructor
+		 */
+		CorrelationTable(unsigned int ttl, std::size_t capacity);
+
+		/*
+		 * Map ID to address, existing entry of ID is replaced, expired entries are removed and oldest entry is evicted if table is full
+		 */
+		void insert(const std::string& id, const std::string& address, unsigned long long int now);
+
+		/*
+		 * Address mapped to ID, returns false if ID is not known or entry is expired
+		 */
+		bool lookup(const std::string& id, unsigned long long int now, std::string* address);
+
+		/*
+		 * Count of entries (including expired entries not removed yet)
+		 */
+		std::size_t size();
+
+		/*
+		 * Remove all entries
+		 */
+		void clear();
+
+};
+
+}
+
+#endif
@@ -17,6 +17,10 @@
  * lines:
  * b|bookmark|size|file_path
  *
+ * Range of log file after bookmark that is already parsed (newest lines are
+ * read first if log file is far behind, lines before range are read later):
+ * t|tailstart|tailend|file_path
+ *
  * Data about IP address received from AbuseIPDB (API blacklist endpoint)
  * a|addr|repcount|confscore
  *
@@ -44,6 +48,10 @@
  * file_path   - full path to log file, variable len (limits.h/PATH_MAX is not
  *               reliable so no max len here)
  *
+ * tailstart   - start of parsed range after bookmark, len 20
+ * tailend     - end of parsed range after bookmark (empty range if equal to
+ *               tailstart), len 20
+ *
  * repcount    - AbuseIPDB report count, len 10
  * confscore   - AbuseIPDB confidence score, len 3
  *               (https://www.abuseipdb.com/faq.html#confidence)
@@ -64,8 +72,12 @@
 #include <regex>
 // Unordered map
 #include <unordered_map>
+// Set
+#include <set>
 // C Math
 #include <cmath>
+// C string (strerror)
+#include <cstring>
 // Linux stat
 namespace cstat{
 	#include <errno.h>
@@ -84,12 +96,18 @@ namespace cunistd{
 #include <ext/stdio_filebuf.h>
 // Limits
 #include <climits>
+// Sorting and binary search
+#include <algorithm>
+// Time measurement
+#include <chrono>
 // Util
 #include "util.h"
 // Config
 #include "config.h"
 // Header
 #include "data.h"
+// Persister stage
+#include "pipeline.h"
 
 // Hostblock namespace
 using namespace hb;
@@ -97,8 +115,8 @@ using namespace hb;
 /*
  * Constructor
  */
-Data::Data(hb::Logger* log, hb::Config* config, hb::Iptables* iptables)
-: log(log), config(config), iptables(iptables)
+Data::Data(hb::Logger* log, hb::Config* config, hb::Firewall* firewall)
+: log(log), config(config), firewall(firewall)
 {
 
 }
@@ -246,7 +264,7 @@ bool Data::loadData()
 			// Path to log file
 			logFilePath = hb::Util::rtrim(hb::Util::ltrim(line.substr(41)));
 
-			// Update info about log file
+			// Update info about log file (same file can be used by multiple log groups)
 			logFileFound = false;
 			for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
 				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
@@ -255,11 +273,9 @@ bool Data::loadData()
 						itlf->size = size;
 						itlf->dataFileRecord = true;
 						logFileFound = true;
-						this->log->debug("Bookmark: " + std::to_string(bookmark) + " Size: " + std::to_string(size) + " Path: " + logFilePath);
-						break;
+						this->log->debug("Bookmark: " + std::to_string(bookmark) + " Size: " + std::to_string(size) + " Path: " + logFilePath + " Log group: " + itlg->name);
 					}
 				}
-				if (logFileFound) break;
 			}
 
 			// If log file is not found this->config
@@ -268,6 +284,46 @@ bool Data::loadData()
 				this->removeFile(logFilePath);
 			}
 
+		} else if (recordType == 't') {// Parsed range of log file after bookmark
+
+			// Start and end of range
+			bookmark = std::strtoull(hb::Util::ltrim(line.substr(1, 20)).c_str(), NULL, 10);
+			size = std::strtoull(hb::Util::ltrim(line.substr(21, 20)).c_str(), NULL, 10);
+
+			// Path to log file
+			logFilePath = hb::Util::rtrim(hb::Util::ltrim(line.substr(41)));
+
+			// Update info about log file (record of log file not present in configuration is removed together with bookmark record)
+			for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					if (itlf->path == logFilePath) {
+						itlf->tailStart = bookmark;
+						itlf->tailEnd = size;
+						itlf->tailRecord = true;
+						this->log->debug("Parsed range: " + std::to_string(bookmark) + " - " + std::to_string(size) + " Path: " + logFilePath + " Log group: " + itlg->name);
+					}
+				}
+			}
+
+		} else if (recordType == 'i') {// Inode of log file that bookmark belongs to
+
+			// Inode (second number is not used)
+			bookmark = std::strtoull(hb::Util::ltrim(line.substr(1, 20)).c_str(), NULL, 10);
+
+			// Path to log file
+			logFilePath = hb::Util::rtrim(hb::Util::ltrim(line.substr(41)));
+
+			// Update info about log file (record of log file not present in configuration is removed together with bookmark record)
+			for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					if (itlf->path == logFilePath) {
+						itlf->inode = bookmark;
+						itlf->inodeRecord = true;
+						this->log->debug("Inode: " + std::to_string(bookmark) + " Path: " + logFilePath + " Log group: " + itlg->name);
+					}
+				}
+			}
+
 		} else if (recordType == 'a') {// AbuseIPDB blacklisted address
 
 			// IP address
@@ -311,7 +367,14 @@ bool Data::loadData()
 		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
 			if (!itlf->dataFileRecord) {
 				this->addFile(itlf->path);
-				itlf->dataFileRecord = true;
+				// Mark all log groups that use same file
+				for (std::vector<hb::LogGroup>::iterator itlg2 = this->config->logGroups.begin(); itlg2 != this->config->logGroups.end(); ++itlg2) {
+					for (std::vector<hb::LogFile>::iterator itlf2 = itlg2->logFiles.begin(); itlf2 != itlg2->logFiles.end(); ++itlf2) {
+						if (itlf2->path == itlf->path) {
+							itlf2->dataFileRecord = true;
+						}
+					}
+				}
 			}
 		}
 	}
@@ -385,6 +448,7 @@ bool Data::loadData()
  */
 bool Data::saveData()
 {
+	if (this->persister != NULL) this->persister->drain();
 	this->log->info("Updating datafile " + this->config->dataFilePath);
 
 	// Open file (overwrite)
@@ -445,16 +509,38 @@ bool Data::saveData()
 		f << "\n";// \n should not flush buffer
 	}
 
-	// Loop all log files
+	// Loop all log files, write one record for each path (same file can be used by multiple log groups)
 	std::vector<hb::LogGroup>::iterator itlg;
 	std::vector<hb::LogFile>::iterator itlf;
+	std::set<std::string> savedPaths;
 	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
 		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+			if (!savedPaths.insert(itlf->path).second) {
+				continue;
+			}
 			f << 'b';
 			f << std::right << std::setw(20) << itlf->bookmark;
 			f << std::right << std::setw(20) << itlf->size;
 			f << itlf->path;
 			f << std::endl;// endl should flush buffer
+			itlf->tailRecord = false;
+			if (itlf->tailEnd > itlf->tailStart) {
+				f << 't';
+				f << std::right << std::setw(20) << itlf->tailStart;
+				f << std::right << std::setw(20) << itlf->tailEnd;
+				f << itlf->path;
+				f << std::endl;
+				itlf->tailRecord = true;
+			}
+			itlf->inodeRecord = false;
+			if (itlf->inode != 0) {
+				f << 'i';
+				f << std::right << std::setw(20) << itlf->inode;
+				f << std::right << std::setw(20) << 0;
+				f << itlf->path;
+				f << std::endl;
+				itlf->inodeRecord = true;
+			}
 		}
 	}
 
@@ -497,7 +583,13 @@ bool Data::saveData()
 bool Data::checkIptables()
 {
 	this->log->info("Checking iptables rules...");
-	std::map<unsigned int, std::string> rules = this->iptables->listRules("INPUT");
+
+	// Rules for blacklisted address ranges
+	if (!this->updateRangeRules()) {
+		this->log->error("Failed to update iptables rules for blacklisted address ranges!");
+	}
+
+	std::map<unsigned int, std::string> rules = this->firewall->listRules("INPUT");
 	try {
 
 		// Regex to search for IP address
@@ -510,6 +602,8 @@ bool Data::checkIptables()
 		std::map<std::string, AbuseIPDBBlacklistedAddressType>::iterator sbit;
 		std::smatch regexSearchResults;
 		std::string regexSearchResult;
+		std::string range;
+		std::set<std::string> feedRulesFound;
 		std::size_t posip = this->config->iptablesRule.find("%i");
 		std::string ruleStart = "";
 		std::string ruleEnd = "";
@@ -530,6 +624,29 @@ bool Data::checkIptables()
 					if (regexSearchResults.size() == 1) {
 						regexSearchResult = regexSearchResults[0].str();
 
+						// Rules for address ranges are maintained separately
+						range = Data::ruleRange(rit->second, regexSearchResults.position(0), regexSearchResults.position(0) + regexSearchResults.length(0));
+						if (range.length() > 0) {
+							if (this->rangeRules.count(range) > 0 || (this->subnetActivity.count(range) > 0 && this->subnetActivity[range].rule.length() > 0) || this->aggregateRules.count(range) > 0
+									|| (this->feedEntries.count(range) > 0 && this->feedEntries[range].rule.length() > 0)) {
+								continue;
+							}
+							if (this->config->addressAggregation.count(std::stoul(range.substr(range.find('/') + 1))) > 0) {
+								// Rule of aggregated prefix (i.e. created before restart), aggregation will remove it if no longer needed
+								this->aggregateRules.insert(std::pair<std::string, std::string>(range, ruleStart + range + ruleEnd));
+								this->aggregates.insert(range, hb::Blacklist);
+							} else {
+								this->log->warning("Found iptables rule for address range " + range + " but this range is not blacklisted in configuration, please review manually.");
+							}
+							continue;
+						}
+
+						// Rule of feed entry is maintained separately, another rule of same address belongs to address
+						if (this->feedEntries.size() > 0 && feedRulesFound.count(regexSearchResult) == 0 && this->feedEntries.count(regexSearchResult) > 0 && this->feedEntries[regexSearchResult].rule.length() > 0) {
+							feedRulesFound.insert(regexSearchResult);
+							continue;
+						}
+
 						// Search for address in map
 						sait = this->suspiciousAddresses.find(regexSearchResult);
 						sbit = this->abuseIPDBBlacklist.find(regexSearchResult);
@@ -563,6 +680,12 @@ bool Data::checkIptables()
 		for (sbit = this->abuseIPDBBlacklist.begin(); sbit!=this->abuseIPDBBlacklist.end(); ++sbit) {
 			this->updateIptables(sbit->first);
 		}
+
+		// Aggregate blocked addresses
+		this->aggregatesChanged = true;
+		if (!this->updateAggregates()) {
+			this->log->error("Failed to aggregate blocked addresses!");
+		}
 	} catch (std::regex_error& e) {
 		std::string message = e.what();
 		this->log->error(message + ": " + std::to_string(e.code()));
@@ -571,12 +694,132 @@ bool Data::checkIptables()
 	return true;
 }
 
+/*
+ * Add/remove iptables rules for blacklisted address ranges, single rule for each range
+ */
+bool Data::updateRangeRules()
+{
+	bool result = true;
+	std::size_t posip = this->config->iptablesRule.find("%i");
+	if (posip == std::string::npos) {
+		return false;
+	}
+	std::string ruleStart = this->config->iptablesRule.substr(0, posip);
+	std::string ruleEnd = this->config->iptablesRule.substr(posip + 2);
+
+	// Rules needed for currently configured ranges
+	std::map<std::string, std::string> neededRules;
+	std::vector<std::string> ranges = this->config->addressRanges.ranges(hb::Blacklist);
+	for (std::vector<std::string>::iterator itr = ranges.begin(); itr != ranges.end(); ++itr) {
+		if (itr->find(':') != std::string::npos) {
+			this->log->warning("IPv6 address range " + *itr + " can't be blocked with iptables rule, range skipped!");
+			continue;
+		}
+		neededRules.insert(std::pair<std::string, std::string>(*itr, ruleStart + *itr + ruleEnd));
+	}
+
+	// Remove rules of ranges that are no longer blacklisted (or if rule is changed in configuration)
+	std::map<std::string, std::string>::iterator itrr, itnr;
+	for (itrr = this->rangeRules.begin(); itrr != this->rangeRules.end();) {
+		itnr = neededRules.find(itrr->first);
+		if (itnr != neededRules.end() && itnr->second == itrr->second) {
+			++itrr;
+			continue;
+		}
+		this->log->info("Removing rule for address range " + itrr->first + " from iptables chain!");
+		try {
+			if (this->firewall->remove("INPUT", itrr->second) == false) {
+				this->log->error("Address range " + itrr->first + " no longer needs iptables rule, but failed to remove rule from chain!");
+				result = false;
+			}
+		} catch (std::runtime_error& e) {
+			std::string message = e.what();
+			this->log->error(message);
+			this->log->error("Address range " + itrr->first + " no longer needs iptables rule, but failed to remove rule from chain!");
+			result = false;
+		}
+		itrr = this->rangeRules.erase(itrr);
+	}
+
+	// Ranges that already have rule (i.e. rule created before restart)
+	std::set<std::string> existingRanges;
+	if (neededRules.size() > this->rangeRules.size()) {
+		std::map<unsigned int, std::string> rules = this->firewall->listRules("INPUT");
+		std::map<unsigned int, std::string>::iterator rit;
+		std::smatch regexSearchResults;
+		std::regex ipSearchPattern("\\d{1,3}\\.\\d{1,3}\\.\\d{1,3}\\.\\d{1,3}");
+		std::string range;
+		for (rit = rules.begin(); rit != rules.end(); ++rit) {
+			if (rit->second.find(ruleStart) != std::string::npos && rit->second.find(ruleEnd) != std::string::npos && std::regex_search(rit->second, regexSearchResults, ipSearchPattern)) {
+				range = Data::ruleRange(rit->second, regexSearchResults.position(0), regexSearchResults.position(0) + regexSearchResults.length(0));
+				if (range.length() > 0) {
+					existingRanges.insert(range);
+				}
+			}
+		}
+	}
+
+	// Add missing rules
+	for (itnr = neededRules.begin(); itnr != neededRules.end(); ++itnr) {
+		if (this->rangeRules.count(itnr->first) > 0) {
+			continue;
+		}
+		if (existingRanges.count(itnr->first) == 0) {
+			this->log->info("Adding rule for address range " + itnr->first + " to iptables chain!");
+			try {
+				if (this->firewall->append("INPUT", itnr->second) == false) {
+					this->log->error("Address range " + itnr->first + " should have iptables rule, but hostblock failed to append rule to chain!");
+					result = false;
+					continue;
+				}
+			} catch (std::runtime_error& e) {
+				std::string message = e.what();
+				this->log->error(message);
+				this->log->error("Address range " + itnr->first + " should have iptables rule, but hostblock failed to append rule to chain!");
+				result = false;
+				continue;
+			}
+		}
+		this->rangeRules.insert(*itnr);
+	}
+
+	return result;
+}
+
+/*
+ * Address range of iptables rule (canonical form), empty if rule is for single address
+ */
+std::string Data::ruleRange(const std::string& rule, std::size_t addressStart, std::size_t addressEnd)
+{
+	if (addressEnd >= rule.length() || rule[addressEnd] != '/') {
+		return "";
+	}
+	std::size_t end = rule.find_first_not_of("0123456789", addressEnd + 1);
+	if (end == std::string::npos) {
+		end = rule.length();
+	}
+	hb::Prefix prefix;
+	if (!hb::PrefixTrie::parse(rule.substr(addressStart, end - addressStart), &prefix) || prefix.length == 32) {
+		return "";
+	}
+	return hb::PrefixTrie::format(prefix);
+}
+
 /*
  * Add new record to datafile end based on this->suspiciousAddresses
  */
-bool Data::addAddress(std::string address)
+bool Data::addAddress(const std::string& address)
 {
-	this->log->debug("Adding record to " + this->config->dataFilePath + ", adding address " + address);
+	if (this->persister != NULL) this->persister->drain();
+	return this->appendRecord(address, this->suspiciousAddresses[address]);
+}
+
+/*
+ * Add new record to datafile end
+ */
+bool Data::appendRecord(const std::string& address, const hb::SuspiciosAddressType& record)
+{
+	if (this->log->isDebug()) this->log->debug("Adding record to " + this->config->dataFilePath + ", adding address " + address);
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "a");
@@ -622,15 +865,15 @@ bool Data::addAddress(std::string address)
 	// Write record to the end of datafile
 	f << 'd';
 	f << std::right << std::setw(39) << address;// Address, left padded with spaces
-	f << std::right << std::setw(20) << this->suspiciousAddresses[address].lastActivity;// Last activity, left padded with spaces
-	f << std::right << std::setw(10) << this->suspiciousAddresses[address].activityScore;// Current activity score, left padded with spaces
-	f << std::right << std::setw(10) << this->suspiciousAddresses[address].activityCount;// Total activity count, left padded with spaces
-	f << std::right << std::setw(10) << this->suspiciousAddresses[address].refusedCount;// Total refused connection count, left padded with spaces
-	if(this->suspiciousAddresses[address].whitelisted == true) f << 'y';
+	f << std::right << std::setw(20) << record.lastActivity;// Last activity, left padded with spaces
+	f << std::right << std::setw(10) << record.activityScore;// Current activity score, left padded with spaces
+	f << std::right << std::setw(10) << record.activityCount;// Total activity count, left padded with spaces
+	f << std::right << std::setw(10) << record.refusedCount;// Total refused connection count, left padded with spaces
+	if(record.whitelisted == true) f << 'y';
 	else f << 'n';
-	if(this->suspiciousAddresses[address].blacklisted == true) f << 'y';
+	if(record.blacklisted == true) f << 'y';
 	else f << 'n';
-	f << std::right << std::setw(20) << this->suspiciousAddresses[address].lastReported;// Last report, left padded with spaces
+	f << std::right << std::setw(20) << record.lastReported;// Last report, left padded with spaces
 	f << std::endl;
 
 	// Unlock file
@@ -649,13 +892,22 @@ bool Data::addAddress(std::string address)
 /*
  * Update record in datafile based on this->suspiciousAddresses
  */
-bool Data::updateAddress(std::string address)
+bool Data::updateAddress(const std::string& address)
+{
+	if (this->persister != NULL) this->persister->drain();
+	return this->replaceRecord(address, this->suspiciousAddresses[address]);
+}
+
+/*
+ * Update existing record in datafile
+ */
+bool Data::replaceRecord(const std::string& address, const hb::SuspiciosAddressType& record)
 {
 	bool recordFound = false;
 	char c;
 	char fAddress[40];
 
-	this->log->debug("Updating record in " + this->config->dataFilePath + ", updating address " + address);
+	if (this->log->isDebug()) this->log->debug("Updating record in " + this->config->dataFilePath + ", updating address " + address);
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -709,15 +961,15 @@ bool Data::updateAddress(std::string address)
 					return false;
 				}
 
-				f << std::right << std::setw(20) << this->suspiciousAddresses[address].lastActivity;// Last activity, left padded with spaces
-				f << std::right << std::setw(10) << this->suspiciousAddresses[address].activityScore;// Current activity score, left padded with spaces
-				f << std::right << std::setw(10) << this->suspiciousAddresses[address].activityCount;// Total activity count, left padded with spaces
-				f << std::right << std::setw(10) << this->suspiciousAddresses[address].refusedCount;// Total refused connection count, left padded with spaces
-				if(this->suspiciousAddresses[address].whitelisted == true) f << 'y';
+				f << std::right << std::setw(20) << record.lastActivity;// Last activity, left padded with spaces
+				f << std::right << std::setw(10) << record.activityScore;// Current activity score, left padded with spaces
+				f << std::right << std::setw(10) << record.activityCount;// Total activity count, left padded with spaces
+				f << std::right << std::setw(10) << record.refusedCount;// Total refused connection count, left padded with spaces
+				if(record.whitelisted == true) f << 'y';
 				else f << 'n';
-				if(this->suspiciousAddresses[address].blacklisted == true) f << 'y';
+				if(record.blacklisted == true) f << 'y';
 				else f << 'n';
-				f << std::right << std::setw(20) << this->suspiciousAddresses[address].lastReported;// Last report, left padded with spaces
+				f << std::right << std::setw(20) << record.lastReported;// Last report, left padded with spaces
 				f << std::endl;// endl should flush buffer
 				recordFound = true;
 
@@ -759,6 +1011,7 @@ bool Data::updateAddress(std::string address)
  */
 bool Data::removeAddress(std::string address)
 {
+	if (this->persister != NULL) this->persister->drain();
 	bool recordFound = false;
 	char c;
 	char fAddress[40];
@@ -860,6 +1113,7 @@ bool Data::removeAddress(std::string address)
  */
 bool Data::addFile(std::string filePath)
 {
+	if (this->persister != NULL) this->persister->drain();
 	this->log->debug("Adding record to " + this->config->dataFilePath + ", adding log file " + filePath);
 
 	// Open file
@@ -951,7 +1205,10 @@ bool Data::addFile(std::string filePath)
  */
 bool Data::updateFile(std::string filePath)
 {
+	if (this->persister != NULL) this->persister->drain();
 	bool recordFound = false;
+	bool tailRecordFound = false;
+	bool inodeRecordFound = false;
 	bool logFileFound = false;
 	char c;
 	std::string fPath;
@@ -980,11 +1237,27 @@ bool Data::updateFile(std::string filePath)
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::in | std::ios::out);
 	std::iostream f(&filebuf);
 
-	while (f.get(c)) {
+	// Find log file in config
+	hb::LogFile* logFile = NULL;
+	std::vector<hb::LogGroup>::iterator itlg;
+	std::vector<hb::LogFile>::iterator itlf;
+	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end() && logFile == NULL; ++itlg) {
+		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+			if (itlf->path == filePath) {
+				logFile = &(*itlf);
+				break;
+			}
+		}
+	}
+	if (logFile != NULL) {
+		logFileFound = true;
+	}
+
+	while (logFileFound && f.get(c)) {
 		// std::cerr << "Record type: " << c << " tellg: " << std::to_string(f.tellg()) << std::endl;
 		if (c == 'd') {// Address record, skip to next one
 			f.seekg(112, f.cur);
-		} else if (c == 'b') {// Log file record, check if path matches needed one
+		} else if (c == 'b' || c == 't' || c == 'i') {// Log file record (bookmark, parsed range after it or inode), check if path matches needed one
 			// Save current position, will need later if file path will match needed one
 			tmppos = f.tellg();
 
@@ -998,52 +1271,56 @@ bool Data::updateFile(std::string filePath)
 				// Go back to bookmark position
 				f.seekg(tmppos, f.beg);
 
-				// Search for log file in config
-				std::vector<hb::LogGroup>::iterator itlg;
-				std::vector<hb::LogFile>::iterator itlf;
-				for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
-					for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
-						if (itlf->path == filePath) {
-							// Lock file
-							int fs = cfcntl::lockf(fd, F_LOCK, 40);
-							unsigned int retryCounter = 1;
-							while (fs == -1) {
-								if (retryCounter >= 3) {
-									break;
-								}
-								// Sleep
-								cunistd::usleep(500000);
-								// Retry
-								fs = cfcntl::lockf(fd, F_LOCK, 40);
-								++retryCounter;
-							}
-							if (fs == -1) {
-								filebuf.close();
-								std::fclose(fp);
-								this->log->error("Error " + std::to_string(errno) + ": " + strerror(errno));
-								this->log->error("Unable to update datafile, file is locked!");
-								return false;
-							}
+				// Lock file
+				int fs = cfcntl::lockf(fd, F_LOCK, 40);
+				unsigned int retryCounter = 1;
+				while (fs == -1) {
+					if (retryCounter >= 3) {
+						break;
+					}
+					// Sleep
+					cunistd::usleep(500000);
+					// Retry
+					fs = cfcntl::lockf(fd, F_LOCK, 40);
+					++retryCounter;
+				}
+				if (fs == -1) {
+					filebuf.close();
+					std::fclose(fp);
+					this->log->error("Error " + std::to_string(errno) + ": " + strerror(errno));
+					this->log->error("Unable to update datafile, file is locked!");
+					return false;
+				}
 
-							// Update bookmark and size in datafile
-							f << std::right << std::setw(20) << itlf->bookmark;
-							f << std::right << std::setw(20) << itlf->size;
-							logFileFound = true;
+				// Update bookmark and size (or parsed range) in datafile
+				if (c == 'b') {
+					f << std::right << std::setw(20) << logFile->bookmark;
+					f << std::right << std::setw(20) << logFile->size;
+					recordFound = true;
+				} else if (c == 't') {
+					f << std::right << std::setw(20) << logFile->tailStart;
+					f << std::right << std::setw(20) << logFile->tailEnd;
+					tailRecordFound = true;
+				} else {
+					f << std::right << std::setw(20) << logFile->inode;
+					f << std::right << std::setw(20) << 0;
+					inodeRecordFound = true;
+				}
 
-							// Unlock file
-							fs = cfcntl::lockf(fd, F_ULOCK, 0);
-							if (fs == -1) {
-								this->log->warning("Failed to unlock datafile after update!");
-							}
+				// Unlock file
+				fs = cfcntl::lockf(fd, F_ULOCK, 0);
+				if (fs == -1) {
+					this->log->warning("Failed to unlock datafile after update!");
+				}
 
-							break;
-						}
-					}
-					if (logFileFound) break;
+				// Parsed range record is present only if newest first reading has been used for log file, inode record once inode is known
+				if (recordFound && (!logFile->tailRecord || tailRecordFound) && (!logFile->inodeRecord || inodeRecordFound)) {
+					break;
 				}
-				recordFound = true;
 
-				break;
+				// Skip to next record
+				f.seekg(tmppos + 40, f.beg);
+				std::getline(f, fPath);
 			}
 		} else {// Other type of record (e.g. suspicious activity, file bookmark or removed record)
 			// Read until end of line
@@ -1056,16 +1333,58 @@ bool Data::updateFile(std::string filePath)
 		}
 	}
 
+	// Parsed range after bookmark is not in datafile yet, add it to the end of datafile
+	if (recordFound && !tailRecordFound && logFile->tailEnd > logFile->tailStart) {
+		f.clear();
+		f.seekp(0, f.end);
+		int fs = cfcntl::lockf(fd, F_LOCK, filePath.length() + 42);
+		if (fs == -1) {
+			this->log->warning("Unable to add parsed range of " + filePath + " to datafile, file is locked!");
+		} else {
+			f << 't';
+			f << std::right << std::setw(20) << logFile->tailStart;
+			f << std::right << std::setw(20) << logFile->tailEnd;
+			f << filePath;
+			f << std::endl;// endl should flush buffer
+			logFile->tailRecord = true;
+			fs = cfcntl::lockf(fd, F_ULOCK, 0);
+			if (fs == -1) {
+				this->log->warning("Failed to unlock datafile after update!");
+			}
+		}
+	}
+
+	// Inode of log file is not in datafile yet, add it to the end of datafile
+	if (recordFound && !inodeRecordFound && logFile->inode != 0) {
+		f.clear();
+		f.seekp(0, f.end);
+		int fs = cfcntl::lockf(fd, F_LOCK, filePath.length() + 42);
+		if (fs == -1) {
+			this->log->warning("Unable to add inode of " + filePath + " to datafile, file is locked!");
+		} else {
+			f << 'i';
+			f << std::right << std::setw(20) << logFile->inode;
+			f << std::right << std::setw(20) << 0;
+			f << filePath;
+			f << std::endl;// endl should flush buffer
+			logFile->inodeRecord = true;
+			fs = cfcntl::lockf(fd, F_ULOCK, 0);
+			if (fs == -1) {
+				this->log->warning("Failed to unlock datafile after update!");
+			}
+		}
+	}
+
 	// Close datafile
 	filebuf.close();
 	std::fclose(fp);
 
-	if (!recordFound) {
-		this->log->error("Failed to update " + filePath + " in datafile, record not found in datafile!");
-		return false;
-	} else if (!logFileFound) {
+	if (!logFileFound) {
 		this->log->error("Failed to update " + filePath + " in datafile, log file not found in configuration!");
 		return false;
+	} else if (!recordFound) {
+		this->log->error("Failed to update " + filePath + " in datafile, record not found in datafile!");
+		return false;
 	} else {
 		return true;
 	}
@@ -1076,6 +1395,7 @@ bool Data::updateFile(std::string filePath)
  */
 bool Data::removeFile(std::string filePath)
 {
+	if (this->persister != NULL) this->persister->drain();
 	bool recordFound = false;
 	char c;
 	std::string fPath;
@@ -1108,7 +1428,7 @@ bool Data::removeFile(std::string filePath)
 		// std::cout << "Record type: " << c << " tellg: " << std::to_string(f.tellg()) << std::endl;
 		if (c == 'd') {// Address record, skip to next one
 			f.seekg(112, f.cur);
-		} else if (c == 'b') {// Log file record, check if path matches needed one
+		} else if (c == 'b' || c == 't' || c == 'i') {// Log file record (bookmark, parsed range after it or inode), check if path matches needed one
 			// Save current position, will need later if file path will match needed one
 			tmppos = f.tellg();
 
@@ -1145,7 +1465,9 @@ bool Data::removeFile(std::string filePath)
 
 				// Mark record as removed
 				f << 'r';
-				recordFound = true;
+				if (c == 'b') {
+					recordFound = true;
+				}
 
 				// Unlock file
 				fs = cfcntl::lockf(fd, F_ULOCK, 0);
@@ -1153,7 +1475,9 @@ bool Data::removeFile(std::string filePath)
 					this->log->warning("Failed to unlock datafile after update!");
 				}
 
-				break;
+				// Continue with next record, parsed range or inode record might follow
+				f.seekg(tmppos + 40, f.beg);
+				std::getline(f, fPath);
 			}
 		} else {// Other type of record (e.g. suspicious activity, file bookmark or removed record)
 			// Read until end of line
@@ -1904,7 +2228,7 @@ bool Data::updateAbuseIPDBSyncData(unsigned long long int syncTime, unsigned lon
 /*
  * Add/remove iptables rule based on score and blacklist
  */
-bool Data::updateIptables(std::string address)
+bool Data::updateIptables(const std::string& address)
 {
 	bool createRule = false;
 	bool removeRule = false;
@@ -1987,6 +2311,30 @@ bool Data::updateIptables(std::string address)
 		}
 	}
 
+	// Address in whitelisted range must not have rule (unless address itself is blacklisted), address in blacklisted range is blocked by rule of range
+	bool hasRule = (this->suspiciousAddresses.count(address) > 0 && this->suspiciousAddresses[address].iptableRule) || (this->abuseIPDBBlacklist.count(address) > 0 && this->abuseIPDBBlacklist[address].iptableRule);
+	bool addressBlacklisted = this->suspiciousAddresses.count(address) > 0 && this->suspiciousAddresses[address].blacklisted;
+	hb::RangeList rangeList = this->config->addressRanges.lookup(address);
+	if (rangeList == hb::Whitelist && !addressBlacklisted) {
+		createRule = false;
+		if (hasRule) {
+			removeRule = true;
+		}
+	} else if (rangeList == hb::Blacklist) {
+		createRule = false;
+	}
+
+	// Address in blocked subnet is blocked by rule of subnet (unless address itself is blacklisted)
+	if (this->subnetActivity.size() > 0 && !addressBlacklisted) {
+		std::unordered_map<std::string, hb::SubnetActivityType>::iterator its = this->subnetActivity.find(this->subnetOf(address));
+		if (its != this->subnetActivity.end() && its->second.rule.length() > 0) {
+			createRule = false;
+			if (hasRule) {
+				removeRule = true;
+			}
+		}
+	}
+
 	// Adjust iptables rules
 	std::string ruleStart = "";
 	std::string ruleEnd = "";
@@ -1997,19 +2345,50 @@ bool Data::updateIptables(std::string address)
 			ruleEnd = this->config->iptablesRule.substr(posip + 2);
 		}
 	}
+
+	// Address in aggregated prefix is blocked by rule of prefix, only status of address is changed
+	bool aggregated = false;
+	if (createRule == true || removeRule == true) {
+		this->aggregatesChanged = true;
+		aggregated = this->aggregateRules.size() > 0 && this->aggregates.lookup(address) == hb::Blacklist;
+	}
+	// Rule created because of peers becomes rule of address
+	bool peerRule = false;
+	if (createRule == true && !aggregated && this->peerBlocks.size() > 0) {
+		std::unordered_map<std::string, hb::PeerBlockType>::iterator itp = this->peerBlocks.find(address);
+		if (itp != this->peerBlocks.end() && itp->second.rule == ruleStart + address + ruleEnd) {
+			itp->second.rule = "";
+			peerRule = true;
+		}
+	}
 	if (createRule == true) {
-		this->log->info("Adding rule for " + address + " to iptables chain!");
+		if (!aggregated) this->log->info("Adding rule for " + address + " to iptables chain!");
 		try {
-			if (this->iptables->append("INPUT", ruleStart + address + ruleEnd) == false) {
+			if (!aggregated && !peerRule && !this->queueRules && this->firewall->append("INPUT", ruleStart + address + ruleEnd) == false) {
 				this->log->error("Address " + address + " should have iptables rule, but hostblock failed to append rule to chain!");
 				return false;
 			} else {
+				if (!aggregated && !peerRule && this->queueRules) {
+					this->queuedAppends.push_back(ruleStart + address + ruleEnd);
+				}
 				if (this->suspiciousAddresses.count(address) > 0) {
 					this->suspiciousAddresses[address].iptableRule = true;
 				}
 				if (this->abuseIPDBBlacklist.count(address) > 0) {
 					this->abuseIPDBBlacklist[address].iptableRule = true;
 				}
+
+				// Publish decision based on score to peers, score without multiplier and time when rule is removed
+				if (this->config->peerListen.length() > 0 && this->suspiciousAddresses.count(address) > 0 && !this->suspiciousAddresses[address].blacklisted) {
+					hb::PeerDelta delta;
+					delta.address = address;
+					delta.score = this->suspiciousAddresses[address].activityScore;
+					if (this->config->keepBlockedScoreMultiplier > 0) {
+						delta.score = delta.score / this->config->keepBlockedScoreMultiplier;
+						delta.expires = this->suspiciousAddresses[address].lastActivity + this->suspiciousAddresses[address].activityScore;
+					}
+					this->peerOutbox.push_back(delta);
+				}
 			}
 		} catch (std::runtime_error& e) {
 			std::string message = e.what();
@@ -2019,12 +2398,15 @@ bool Data::updateIptables(std::string address)
 		}
 	}
 	if (removeRule == true) {
-		this->log->info("Removing rule for " + address + " from iptables chain!");
+		if (!aggregated) this->log->info("Removing rule for " + address + " from iptables chain!");
 		try {
-			if (this->iptables->remove("INPUT", ruleStart + address + ruleEnd) == false){
+			if (!aggregated && !this->queueRules && this->firewall->remove("INPUT", ruleStart + address + ruleEnd) == false){
 				this->log->error("Address " + address + " no longer needs iptables rule, but failed to remove rule from chain!");
 				return false;
 			} else {
+				if (!aggregated && this->queueRules) {
+					this->queuedRemovals.push_back(ruleStart + address + ruleEnd);
+				}
 				if (this->suspiciousAddresses.count(address) > 0) {
 					this->suspiciousAddresses[address].iptableRule = false;
 				}
@@ -2038,6 +2420,11 @@ bool Data::updateIptables(std::string address)
 			this->log->error("Address " + address + " no longer needs iptables rule, but failed to remove rule from chain!");
 			return false;
 		}
+
+		// Peers might still need address to be blocked
+		if (this->peerBlocks.count(address) > 0) {
+			this->updatePeerIptables(address);
+		}
 	}
 
 	return true;
@@ -2047,22 +2434,23 @@ bool Data::updateIptables(std::string address)
  * Save suspicious activity to data->suspiciousAddreses and datafile (add new or update existing)
  * Additionally add/remove iptables rule
  */
-void Data::saveActivity(std::string address, unsigned int activityScore, unsigned int activityCount, unsigned int refusedCount)
+void Data::saveActivity(const std::string& address, unsigned int activityScore, unsigned int activityCount, unsigned int refusedCount, const hb::RateLimit* rate, bool immediate)
 {
+	unsigned int matchScore = activityScore;
 	std::time_t currentRawTime;
 	std::time(&currentRawTime);
-	unsigned long long int currentTime = (unsigned long long int)currentRawTime;
+	unsigned long long int currentTime = this->activityTime > 0 ? this->activityTime : (unsigned long long int)currentRawTime;
 
 	// Check if new record needs to be added or we need to update existing data
 	bool newEntry = false;
 	if (this->suspiciousAddresses.count(address) > 0) {
 
 		// This address already had some activity previously, need to recalculate score
-		this->log->debug("Previous activity: " + std::to_string(this->suspiciousAddresses[address].lastActivity));
+		if (this->log->isDebug()) this->log->debug("Previous activity: " + std::to_string(this->suspiciousAddresses[address].lastActivity));
 
-		// Adjust old score according to time passed
-		if (this->config->keepBlockedScoreMultiplier > 0 && this->suspiciousAddresses[address].activityScore > 0) {
-			this->log->debug("Adjusting previous score according to time passed...");
+		// Adjust old score according to time passed (activity time might be older with historic log replay)
+		if (this->config->keepBlockedScoreMultiplier > 0 && this->suspiciousAddresses[address].activityScore > 0 && currentTime > this->suspiciousAddresses[address].lastActivity) {
+			if (this->log->isDebug()) this->log->debug("Adjusting previous score according to time passed...");
 			if (this->suspiciousAddresses[address].activityScore < currentTime - this->suspiciousAddresses[address].lastActivity) {
 				this->suspiciousAddresses[address].activityScore = 0;
 			} else {
@@ -2071,11 +2459,13 @@ void Data::saveActivity(std::string address, unsigned int activityScore, unsigne
 		}
 
 		// Last activity is now
-		this->suspiciousAddresses[address].lastActivity = currentTime;
+		if (currentTime > this->suspiciousAddresses[address].lastActivity) {
+			this->suspiciousAddresses[address].lastActivity = currentTime;
+		}
 
 		// Use score multiplier for score that needs to be added to old one
 		if (this->config->keepBlockedScoreMultiplier > 0) {
-			this->log->debug("Adjusting new score according to multiplier...");
+			if (this->log->isDebug()) this->log->debug("Adjusting new score according to multiplier...");
 			activityScore = activityScore * this->config->keepBlockedScoreMultiplier;
 		}
 
@@ -2118,19 +2508,64 @@ void Data::saveActivity(std::string address, unsigned int activityScore, unsigne
 		newEntry = true;
 	}
 
-	// Few details for debug
-	this->log->debug("Last activity: " + std::to_string(this->suspiciousAddresses[address].lastActivity));
-	this->log->debug("Activity score: " + std::to_string(this->suspiciousAddresses[address].activityScore));
-	this->log->debug("Activity count: " + std::to_string(this->suspiciousAddresses[address].activityCount));
-	this->log->debug("Refused count: " + std::to_string(this->suspiciousAddresses[address].refusedCount));
-	if (this->suspiciousAddresses[address].whitelisted) this->log->debug("Address is in whitelist!");
-	if (this->suspiciousAddresses[address].blacklisted) this->log->debug("Address is in blacklist!");
-	this->log->debug("Last reported: " + std::to_string(this->suspiciousAddresses[address].lastReported));
+	// Burst of matches blocks address regardless of score built up so far
+	if (rate != NULL && rate->count > 0 && activityCount > 0) {
+		std::vector<hb::RateWindowType>* windows = &this->rateWindows[address];
+		if (windows->size() <= rate->window) {
+			windows->resize(rate->window + 1);
+		}
+		hb::RateWindowType* window = &(*windows)[rate->window];
+		if (window->bucketSeconds != rate->bucketSeconds) {
+			*window = hb::RateWindowType();
+			window->bucketSeconds = rate->bucketSeconds;
+		}
+		if (Data::countRate(window, currentTime, rate->bucketSeconds, rate->seconds) >= rate->count) {
+			if (this->suspiciousAddresses[address].activityScore < this->blockScore()) {
+				this->log->info("Address " + address + " exceeded rate of " + std::to_string(rate->count) + " matches in " + std::to_string(rate->seconds) + " seconds");
+				this->suspiciousAddresses[address].activityScore = this->blockScore();
+			}
+		}
+	}
+
+	// High severity match, rule is created before anything else is done
+	if (immediate) {
+		if (this->suspiciousAddresses[address].activityScore < this->blockScore()) {
+			this->suspiciousAddresses[address].activityScore = this->blockScore();
+		}
+		if (!this->batch) {
+			this->updateIptables(address);
+		}
+	}
 
-	this->updateIptables(address);
+	// Few details for debug, strings are only formatted with debug log level
+	if (this->log->isDebug()) {
+		this->log->debug("Last activity: " + std::to_string(this->suspiciousAddresses[address].lastActivity));
+		this->log->debug("Activity score: " + std::to_string(this->suspiciousAddresses[address].activityScore));
+		this->log->debug("Activity count: " + std::to_string(this->suspiciousAddresses[address].activityCount));
+		this->log->debug("Refused count: " + std::to_string(this->suspiciousAddresses[address].refusedCount));
+		if (this->suspiciousAddresses[address].whitelisted) this->log->debug("Address is in whitelist!");
+		if (this->suspiciousAddresses[address].blacklisted) this->log->debug("Address is in blacklist!");
+		this->log->debug("Last reported: " + std::to_string(this->suspiciousAddresses[address].lastReported));
+	}
 
-	// Update data file
-	if (newEntry == true) {
+	// Aggregate activity of subnet (whitelisted addresses are not counted)
+	if (this->config->subnetScoreToBlock > 0 && this->suspiciousAddresses[address].whitelisted == false) {
+		this->saveSubnetActivity(address, matchScore, activityCount);
+	}
+
+	// In batch mode firewall and datafile are updated once at the end
+	if (this->batch) {
+		return;
+	}
+
+	if (!immediate) {
+		this->updateIptables(address);
+	}
+
+	// Update data file, by persister thread if it is running (copy of record)
+	if (this->persister != NULL) {
+		this->persister->save(address, this->suspiciousAddresses[address], newEntry);
+	} else if (newEntry == true) {
 		// Add new entry to end of data file
 		this->addAddress(address);
 	} else {
@@ -2139,6 +2574,1036 @@ void Data::saveActivity(std::string address, unsigned int activityScore, unsigne
 	}
 }
 
+/*
+ * Replace rules of blocked addresses with rules of prefixes that have configured count of blocked addresses
+ * Shorter prefixes are selected first, addresses covered by selected prefix are not counted for longer prefixes
+ */
+bool Data::updateAggregates()
+{
+	if (!this->aggregatesChanged || (this->config->addressAggregation.size() == 0 && this->aggregateRules.size() == 0)) {
+		return true;
+	}
+	this->aggregatesChanged = false;
+	std::chrono::steady_clock::time_point aggregationStart = std::chrono::steady_clock::now();
+	bool result = true;
+	std::size_t posip = this->config->iptablesRule.find("%i");
+	if (posip == std::string::npos) {
+		return false;
+	}
+	std::string ruleStart = this->config->iptablesRule.substr(0, posip);
+	std::string ruleEnd = this->config->iptablesRule.substr(posip + 2);
+
+	// Blocked and whitelisted IPv4 addresses as numbers
+	std::vector<std::pair<unsigned int, std::string>> blocked;
+	std::vector<unsigned int> whitelisted;
+	hb::Prefix prefix;
+	for (std::map<std::string, hb::SuspiciosAddressType>::iterator sait = this->suspiciousAddresses.begin(); sait != this->suspiciousAddresses.end(); ++sait) {
+		if (!hb::PrefixTrie::parse(sait->first, &prefix) || prefix.ipv6) {
+			continue;
+		}
+		if (sait->second.whitelisted) {
+			whitelisted.push_back((prefix.address[0] << 24) | (prefix.address[1] << 16) | (prefix.address[2] << 8) | prefix.address[3]);
+		} else if (sait->second.iptableRule) {
+			blocked.push_back(std::pair<unsigned int, std::string>((prefix.address[0] << 24) | (prefix.address[1] << 16) | (prefix.address[2] << 8) | prefix.address[3], sait->first));
+		}
+	}
+	for (std::map<std::string, hb::AbuseIPDBBlacklistedAddressType>::iterator sbit = this->abuseIPDBBlacklist.begin(); sbit != this->abuseIPDBBlacklist.end(); ++sbit) {
+		if (!sbit->second.iptableRule || this->suspiciousAddresses.count(sbit->first) > 0 || !hb::PrefixTrie::parse(sbit->first, &prefix) || prefix.ipv6) {
+			continue;
+		}
+		blocked.push_back(std::pair<unsigned int, std::string>((prefix.address[0] << 24) | (prefix.address[1] << 16) | (prefix.address[2] << 8) | prefix.address[3], sbit->first));
+	}
+	std::sort(blocked.begin(), blocked.end());
+	std::sort(whitelisted.begin(), whitelisted.end());
+
+	// Select prefixes
+	std::map<std::string, std::string> selected;
+	std::vector<bool> covered(blocked.size(), false);
+	std::size_t i, j, k;
+	unsigned int mask, network, count;
+	std::vector<unsigned int>::iterator itw;
+	std::string range;
+	for (std::map<unsigned int, unsigned int>::iterator ita = this->config->addressAggregation.begin(); ita != this->config->addressAggregation.end(); ++ita) {
+		mask = 0xFFFFFFFF << (32 - ita->first);
+		for (i = 0; i < blocked.size(); i = j) {
+			network = blocked[i].first & mask;
+			count = 0;
+			for (j = i; j < blocked.size() && (blocked[j].first & mask) == network; j++) {
+				if (!covered[j]) {
+					count++;
+				}
+			}
+			if (count < ita->second) {
+				continue;
+			}
+
+			// Whitelisted addresses must never be covered
+			itw = std::lower_bound(whitelisted.begin(), whitelisted.end(), network);
+			if (itw != whitelisted.end() && *itw <= (network | ~mask)) {
+				continue;
+			}
+			prefix.ipv6 = false;
+			prefix.length = ita->first;
+			prefix.address[0] = network >> 24;
+			prefix.address[1] = (network >> 16) & 0xFF;
+			prefix.address[2] = (network >> 8) & 0xFF;
+			prefix.address[3] = network & 0xFF;
+			range = hb::PrefixTrie::format(prefix);
+			if (this->config->addressRanges.overlaps(range, hb::Whitelist)) {
+				continue;
+			}
+			selected.insert(std::pair<std::string, std::string>(range, ruleStart + range + ruleEnd));
+			for (k = i; k < j; k++) {
+				covered[k] = true;
+			}
+		}
+	}
+
+	// Add rules of new prefixes
+	unsigned int added = 0, removed = 0, replaced = 0, restored = 0;
+	hb::PrefixTrie selectedTrie;
+	std::map<std::string, std::string>::iterator its, ito;
+	for (its = selected.begin(); its != selected.end();) {
+		ito = this->aggregateRules.find(its->first);
+		if (ito == this->aggregateRules.end() || ito->second != its->second) {
+			try {
+				if (this->firewall->append("INPUT", its->second) == false) {
+					this->log->error("Failed to append iptables rule for aggregated prefix " + its->first + "!");
+					result = false;
+					its = selected.erase(its);
+					continue;
+				}
+			} catch (std::runtime_error& e) {
+				std::string message = e.what();
+				this->log->error(message);
+				this->log->error("Failed to append iptables rule for aggregated prefix " + its->first + "!");
+				result = false;
+				its = selected.erase(its);
+				continue;
+			}
+			added++;
+		}
+		selectedTrie.insert(its->first, hb::Blacklist);
+		++its;
+	}
+
+	// Rules of addresses newly covered by prefix are no longer needed, addresses no longer covered need own rule again
+	bool coveredBefore, coveredNow;
+	for (i = 0; i < blocked.size(); i++) {
+		coveredBefore = this->aggregates.lookup(blocked[i].second) == hb::Blacklist;
+		coveredNow = selectedTrie.lookup(blocked[i].second) == hb::Blacklist;
+		if (coveredBefore == coveredNow) {
+			continue;
+		}
+		try {
+			if (coveredNow) {
+				if (this->firewall->remove("INPUT", ruleStart + blocked[i].second + ruleEnd) == false) {
+					this->log->error("Address " + blocked[i].second + " is covered by aggregated prefix, but failed to remove rule of address from chain!");
+				}
+				replaced++;
+			} else {
+				if (this->firewall->append("INPUT", ruleStart + blocked[i].second + ruleEnd) == false) {
+					this->log->error("Address " + blocked[i].second + " is no longer covered by aggregated prefix, but failed to append rule of address to chain!");
+					result = false;
+				}
+				restored++;
+			}
+		} catch (std::runtime_error& e) {
+			std::string message = e.what();
+			this->log->error(message);
+			this->log->error("Failed to update iptables rule of address " + blocked[i].second + " after aggregation!");
+			result = false;
+		}
+	}
+
+	// Remove rules of prefixes that are no longer needed
+	for (ito = this->aggregateRules.begin(); ito != this->aggregateRules.end(); ++ito) {
+		its = selected.find(ito->first);
+		if (its != selected.end() && its->second == ito->second) {
+			continue;
+		}
+		try {
+			if (this->firewall->remove("INPUT", ito->second) == false) {
+				this->log->error("Aggregated prefix " + ito->first + " is no longer needed, but failed to remove rule from chain!");
+			}
+		} catch (std::runtime_error& e) {
+			std::string message = e.what();
+			this->log->error(message);
+			this->log->error("Aggregated prefix " + ito->first + " is no longer needed, but failed to remove rule from chain!");
+		}
+		removed++;
+	}
+
+	this->aggregateRules.swap(selected);
+	this->aggregates = selectedTrie;
+	if (added > 0 || removed > 0) {
+		this->log->info("Aggregated " + std::to_string(blocked.size()) + " blocked addresses into " + std::to_string(this->aggregateRules.size()) + " prefixes (" + std::to_string(added) + " added, " + std::to_string(removed) + " removed, " + std::to_string(replaced) + " address rules replaced, " + std::to_string(restored) + " address rules restored) in " + std::to_string(std::chrono::duration<double>(std::chrono::steady_clock::now() - aggregationStart).count()) + " sec");
+	}
+	return result;
+}
+
+/*
+ * Subnet of address (canonical form, prefix length from configuration), empty if address is not valid
+ */
+std::string Data::subnetOf(const std::string& address)
+{
+	hb::Prefix prefix;
+	if (!hb::PrefixTrie::parse(address, &prefix)) {
+		return "";
+	}
+	unsigned int length = prefix.ipv6 ? this->config->subnetPrefixIPv6 : this->config->subnetPrefixIPv4;
+	for (unsigned int i = length; i < prefix.length; i++) {
+		prefix.address[i / 8] &= (unsigned char)~(0x80 >> (i % 8));
+	}
+	prefix.length = length;
+	return hb::PrefixTrie::format(prefix);
+}
+
+/*
+ * Add activity to aggregate of address subnet and create iptables rule for subnet if needed
+ * Score is adjusted same way as score of single address in saveActivity
+ */
+void Data::saveSubnetActivity(const std::string& address, unsigned int activityScore, unsigned int activityCount)
+{
+	std::string subnet = this->subnetOf(address);
+	if (subnet.length() == 0) {
+		return;
+	}
+
+	std::time_t currentRawTime;
+	std::time(&currentRawTime);
+	unsigned long long int currentTime = this->activityTime > 0 ? this->activityTime : (unsigned long long int)currentRawTime;
+
+	std::unordered_map<std::string, hb::SubnetActivityType>::iterator its = this->subnetActivity.find(subnet);
+	if (its == this->subnetActivity.end()) {
+
+		// Drop least recently updated subnets to keep count within limit, blocked subnets are not in list until their rule expires
+		while (this->subnetActivity.size() >= this->config->subnetCacheSize && this->subnetLRU.size() > 0) {
+			this->subnetActivity.erase(this->subnetLRU.back());
+			this->subnetLRU.pop_back();
+		}
+
+		// First activity from subnet
+		hb::SubnetActivityType activity;
+		activity.lastActivity = currentTime;
+		this->subnetLRU.push_front(subnet);
+		activity.lru = this->subnetLRU.begin();
+		its = this->subnetActivity.insert(std::pair<std::string, hb::SubnetActivityType>(subnet, activity)).first;
+	} else {
+
+		// Most recently updated subnet goes to front
+		if (its->second.lru != this->subnetLRU.end()) {
+			this->subnetLRU.splice(this->subnetLRU.begin(), this->subnetLRU, its->second.lru);
+		}
+
+		// Adjust old score according to time passed
+		if (this->config->keepBlockedScoreMultiplier > 0 && its->second.activityScore > 0 && currentTime > its->second.lastActivity) {
+			if (its->second.activityScore < currentTime - its->second.lastActivity) {
+				its->second.activityScore = 0;
+			} else {
+				its->second.activityScore -= currentTime - its->second.lastActivity;
+			}
+		}
+		if (currentTime > its->second.lastActivity) {
+			its->second.lastActivity = currentTime;
+		}
+	}
+
+	// Use score multiplier for score that needs to be added
+	if (this->config->keepBlockedScoreMultiplier > 0) {
+		activityScore = activityScore * this->config->keepBlockedScoreMultiplier;
+	}
+
+	// Increase score
+	if (its->second.activityScore + activityScore < its->second.activityScore) {
+		its->second.activityScore = UINT_MAX;
+	} else {
+		its->second.activityScore += activityScore;
+	}
+	if (its->second.activityCount + activityCount < its->second.activityCount) {
+		its->second.activityCount = UINT_MAX;
+	} else {
+		its->second.activityCount += activityCount;
+	}
+	if (this->log->isDebug()) this->log->debug("Subnet " + subnet + " activity score: " + std::to_string(its->second.activityScore));
+
+	if (its->second.rule.length() == 0 && !this->batch) {
+		this->updateSubnetIptables(subnet);
+	}
+}
+
+/*
+ * Add/remove iptables rule of subnet based on aggregate score
+ */
+bool Data::updateSubnetIptables(const std::string& subnet)
+{
+	std::unordered_map<std::string, hb::SubnetActivityType>::iterator its = this->subnetActivity.find(subnet);
+	if (its == this->subnetActivity.end()) {
+		return false;
+	}
+
+	std::time_t currentRawTime;
+	std::time(&currentRawTime);
+	unsigned long long int currentTime = (unsigned long long int)currentRawTime;
+	bool createRule = false;
+	bool removeRule = false;
+	std::size_t posip = this->config->iptablesRule.find("%i");
+	if (posip == std::string::npos) {
+		return false;
+	}
+	std::string rule = this->config->iptablesRule.substr(0, posip) + subnet + this->config->iptablesRule.substr(posip + 2);
+
+	if (its->second.rule.length() > 0) {// Rule exists, check if need to remove
+		if (this->config->subnetScoreToBlock == 0 || its->second.rule != rule) {
+			removeRule = true;
+		} else if (this->config->keepBlockedScoreMultiplier > 0) {
+			// Score multiplier configured, recheck if score is no longer high enough to keep this rule
+			if (currentTime > its->second.lastActivity + its->second.activityScore) {
+				removeRule = true;
+			}
+		} else if (its->second.activityScore == 0) {
+			removeRule = true;
+		}
+	} else if (this->config->subnetScoreToBlock > 0) {// Rule does not exist, check if need to add
+		if (this->config->keepBlockedScoreMultiplier > 0) {
+			if (its->second.activityScore > 0
+					&& its->second.lastActivity + its->second.activityScore > this->config->subnetScoreToBlock * this->config->keepBlockedScoreMultiplier
+					&& currentTime < (its->second.lastActivity + its->second.activityScore) - (this->config->subnetScoreToBlock * this->config->keepBlockedScoreMultiplier)) {
+				createRule = true;
+			}
+		} else if (its->second.activityScore > this->config->subnetScoreToBlock) {
+			createRule = true;
+		}
+
+		// iptables rules are only for IPv4
+		if (createRule && subnet.find(':') != std::string::npos) {
+			createRule = false;
+		}
+
+		// Whitelisted addresses must not be blocked by subnet rule
+		if (createRule && this->config->addressRanges.overlaps(subnet, hb::Whitelist)) {
+			if (this->log->isDebug()) this->log->debug("Subnet " + subnet + " contains whitelisted address range, not creating iptables rule!");
+			createRule = false;
+		}
+		if (createRule) {
+			for (std::map<std::string, hb::SuspiciosAddressType>::iterator sait = this->suspiciousAddresses.begin(); sait != this->suspiciousAddresses.end(); ++sait) {
+				if (sait->second.whitelisted && this->subnetOf(sait->first) == subnet) {
+					if (this->log->isDebug()) this->log->debug("Subnet " + subnet + " contains whitelisted address " + sait->first + ", not creating iptables rule!");
+					createRule = false;
+					break;
+				}
+			}
+		}
+	}
+
+	if (createRule) {
+		this->log->info("Adding rule for subnet " + subnet + " to iptables chain!");
+		try {
+			if (this->firewall->append("INPUT", rule) == false) {
+				this->log->error("Subnet " + subnet + " should have iptables rule, but hostblock failed to append rule to chain!");
+				return false;
+			}
+		} catch (std::runtime_error& e) {
+			std::string message = e.what();
+			this->log->error(message);
+			this->log->error("Subnet " + subnet + " should have iptables rule, but hostblock failed to append rule to chain!");
+			return false;
+		}
+		its->second.rule = rule;
+
+		// Blocked subnet is pinned in cache until its rule expires
+		if (its->second.lru != this->subnetLRU.end()) {
+			this->subnetLRU.erase(its->second.lru);
+			its->second.lru = this->subnetLRU.end();
+		}
+	}
+	if (removeRule) {
+		this->log->info("Removing rule for subnet " + subnet + " from iptables chain!");
+		try {
+			if (this->firewall->remove("INPUT", its->second.rule) == false) {
+				this->log->error("Subnet " + subnet + " no longer needs iptables rule, but failed to remove rule from chain!");
+			}
+		} catch (std::runtime_error& e) {
+			std::string message = e.what();
+			this->log->error(message);
+			this->log->error("Subnet " + subnet + " no longer needs iptables rule, but failed to remove rule from chain!");
+		}
+		its->second.rule = "";
+
+		// Expired subnet can be dropped first, it is trimmed to cache size by caller
+		if (its->second.lru == this->subnetLRU.end()) {
+			its->second.lru = this->subnetLRU.insert(this->subnetLRU.end(), its->first);
+		}
+	}
+
+	// Rules of addresses in subnet are no longer needed or are needed again
+	if (createRule || removeRule) {
+		for (std::map<std::string, hb::SuspiciosAddressType>::iterator sait = this->suspiciousAddresses.begin(); sait != this->suspiciousAddresses.end(); ++sait) {
+			if (this->subnetOf(sait->first) == subnet) {
+				this->updateIptables(sait->first);
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Remove expired iptables rules of subnets
+ */
+void Data::updateSubnetRules()
+{
+	if (this->config->subnetScoreToBlock == 0) {
+		if (this->subnetActivity.size() > 0) {
+			this->removeSubnetRules();
+		}
+		return;
+	}
+	for (std::unordered_map<std::string, hb::SubnetActivityType>::iterator its = this->subnetActivity.begin(); its != this->subnetActivity.end(); ++its) {
+		if (its->second.rule.length() > 0) {
+			this->updateSubnetIptables(its->first);
+		}
+	}
+	this->trimSubnets();
+}
+
+/*
+ * Drop least recently updated subnets without rule while count is over limit (blocked subnets can keep it over limit)
+ */
+void Data::trimSubnets()
+{
+	while (this->subnetActivity.size() > this->config->subnetCacheSize && this->subnetLRU.size() > 0) {
+		this->subnetActivity.erase(this->subnetLRU.back());
+		this->subnetLRU.pop_back();
+	}
+}
+
+/*
+ * Remove all iptables rules of subnets and clear aggregate activity
+ */
+void Data::removeSubnetRules()
+{
+	std::vector<std::string> blocked;
+	for (std::unordered_map<std::string, hb::SubnetActivityType>::iterator its = this->subnetActivity.begin(); its != this->subnetActivity.end(); ++its) {
+		if (its->second.rule.length() > 0) {
+			blocked.push_back(its->first);
+			its->second.activityScore = 0;
+			its->second.lastActivity = 0;
+		}
+	}
+	for (std::vector<std::string>::iterator itb = blocked.begin(); itb != blocked.end(); ++itb) {
+		this->updateSubnetIptables(*itb);
+	}
+	this->subnetActivity.clear();
+	this->subnetLRU.clear();
+}
+
+/*
+ * Save block decision received from peer and create iptables rule for address if needed
+ * Decision without expiry time is kept for config->peerTtl seconds, newer decision of same peer replaces older one
+ */
+void Data::savePeerBlock(const hb::PeerDelta& delta)
+{
+	hb::Prefix prefix;
+	if (!hb::PrefixTrie::parse(delta.address, &prefix)) {
+		return;
+	}
+
+	std::time_t currentRawTime;
+	std::time(&currentRawTime);
+	unsigned long long int currentTime = (unsigned long long int)currentRawTime;
+	unsigned long long int expires = delta.expires > 0 ? delta.expires : currentTime + this->config->peerTtl;
+	if (expires <= currentTime) {
+		return;
+	}
+
+	this->peerBlocks[delta.address].decisions[delta.source] = std::pair<unsigned int, unsigned long long int>(delta.score, expires);
+	if (this->log->isDebug()) this->log->debug("Peer " + delta.source + " blocked " + delta.address + " with score " + std::to_string(delta.score));
+	this->updatePeerIptables(delta.address);
+}
+
+/*
+ * Add/remove iptables rule of address based on sum of scores of peer decisions
+ * Addresses that are whitelisted or already blocked by this instance get no rule because of peers
+ */
+bool Data::updatePeerIptables(const std::string& address)
+{
+	std::unordered_map<std::string, hb::PeerBlockType>::iterator itp = this->peerBlocks.find(address);
+	if (itp == this->peerBlocks.end()) {
+		return false;
+	}
+
+	std::time_t currentRawTime;
+	std::time(&currentRawTime);
+	unsigned long long int currentTime = (unsigned long long int)currentRawTime;
+
+	// Sum of scores of decisions not expired yet
+	itp->second.score = 0;
+	itp->second.expires = 0;
+	for (std::map<std::string, std::pair<unsigned int, unsigned long long int>>::iterator itd = itp->second.decisions.begin(); itd != itp->second.decisions.end();) {
+		if (itd->second.second <= currentTime) {
+			itd = itp->second.decisions.erase(itd);
+			continue;
+		}
+		itp->second.score = itp->second.score + itd->second.first < itp->second.score ? UINT_MAX : itp->second.score + itd->second.first;
+		if (itd->second.second > itp->second.expires) {
+			itp->second.expires = itd->second.second;
+		}
+		++itd;
+	}
+
+	bool blockRule = this->config->peerScoreToBlock > 0 && itp->second.score >= this->config->peerScoreToBlock;
+	bool addressBlacklisted = this->suspiciousAddresses.count(address) > 0 && this->suspiciousAddresses[address].blacklisted;
+	if (this->suspiciousAddresses.count(address) > 0 && (this->suspiciousAddresses[address].whitelisted || this->suspiciousAddresses[address].iptableRule)) {
+		blockRule = false;
+	}
+	if (this->abuseIPDBBlacklist.count(address) > 0 && this->abuseIPDBBlacklist[address].iptableRule) {
+		blockRule = false;
+	}
+	hb::RangeList rangeList = this->config->addressRanges.lookup(address);
+	if ((rangeList == hb::Whitelist && !addressBlacklisted) || rangeList == hb::Blacklist) {
+		blockRule = false;
+	}
+
+	std::size_t posip = this->config->iptablesRule.find("%i");
+	if (posip == std::string::npos) {
+		return false;
+	}
+	std::string rule = this->config->iptablesRule.substr(0, posip) + address + this->config->iptablesRule.substr(posip + 2);
+
+	if (blockRule && itp->second.rule.length() == 0) {
+		this->log->info("Adding rule for " + address + " (blocked by peers) to iptables chain!");
+		try {
+			if (this->firewall->append("INPUT", rule) == false) {
+				this->log->error("Address " + address + " should have iptables rule, but hostblock failed to append rule to chain!");
+				return false;
+			}
+		} catch (std::runtime_error& e) {
+			std::string message = e.what();
+			this->log->error(message);
+			this->log->error("Address " + address + " should have iptables rule, but hostblock failed to append rule to chain!");
+			return false;
+		}
+		itp->second.rule = rule;
+	} else if (!blockRule && itp->second.rule.length() > 0) {
+		this->log->info("Removing rule for " + address + " (blocked by peers) from iptables chain!");
+		try {
+			if (this->firewall->remove("INPUT", itp->second.rule) == false) {
+				this->log->error("Address " + address + " no longer needs iptables rule, but failed to remove rule from chain!");
+			}
+		} catch (std::runtime_error& e) {
+			std::string message = e.what();
+			this->log->error(message);
+			this->log->error("Address " + address + " no longer needs iptables rule, but failed to remove rule from chain!");
+		}
+		itp->second.rule = "";
+	}
+
+	if (itp->second.decisions.size() == 0 && itp->second.rule.length() == 0) {
+		this->peerBlocks.erase(itp);
+	}
+
+	return true;
+}
+
+/*
+ * Remove expired peer decisions and their iptables rules
+ */
+void Data::updatePeerRules()
+{
+	std::vector<std::string> addresses;
+	for (std::unordered_map<std::string, hb::PeerBlockType>::iterator itp = this->peerBlocks.begin(); itp != this->peerBlocks.end(); ++itp) {
+		addresses.push_back(itp->first);
+	}
+	for (std::vector<std::string>::iterator ita = addresses.begin(); ita != addresses.end(); ++ita) {
+		this->updatePeerIptables(*ita);
+	}
+}
+
+/*
+ * Remove all iptables rules created because of peers and clear peer decisions
+ */
+void Data::removePeerRules()
+{
+	std::vector<std::string> addresses;
+	for (std::unordered_map<std::string, hb::PeerBlockType>::iterator itp = this->peerBlocks.begin(); itp != this->peerBlocks.end(); ++itp) {
+		itp->second.decisions.clear();
+		addresses.push_back(itp->first);
+	}
+	for (std::vector<std::string>::iterator ita = addresses.begin(); ita != addresses.end(); ++ita) {
+		this->updatePeerIptables(*ita);
+	}
+	this->peerBlocks.clear();
+}
+
+/*
+ * Replace entries of feed source (empty to remove source), only difference with previous entries is applied to firewall
+ * Entry listed by several sources has single rule, whitelisted entries and IPv6 entries (iptables rules are only for IPv4) have no rule
+ */
+bool Data::updateFeed(const std::string& source, std::vector<hb::Prefix>* entries)
+{
+	std::size_t posip = this->config->iptablesRule.find("%i");
+	if (posip == std::string::npos) {
+		return false;
+	}
+	std::string ruleStart = this->config->iptablesRule.substr(0, posip);
+	std::string ruleEnd = this->config->iptablesRule.substr(posip + 2);
+
+	// Difference with previous version of source
+	std::vector<hb::Prefix> added, removed;
+	std::unordered_map<std::string, std::vector<hb::Prefix>>::iterator its = this->feedSources.find(source);
+	if (its == this->feedSources.end()) {
+		its = this->feedSources.insert(std::pair<std::string, std::vector<hb::Prefix>>(source, std::vector<hb::Prefix>())).first;
+	}
+	hb::FeedWatcher::diff(its->second, *entries, &added, &removed);
+	its->second.swap(*entries);
+	if (its->second.size() == 0) {
+		this->feedSources.erase(its);
+	}
+
+	// Rules of entries no longer listed by any source and entries listed first time
+	std::vector<std::string> appends, removals, ruleEntries;
+	std::unordered_map<std::string, hb::FeedEntryType>::iterator ite;
+	std::map<std::string, hb::SuspiciosAddressType>::iterator sait;
+	std::string entry;
+	for (std::vector<hb::Prefix>::iterator itp = removed.begin(); itp != removed.end(); ++itp) {
+		ite = this->feedEntries.find(hb::FeedWatcher::format(*itp));
+		if (ite == this->feedEntries.end() || --ite->second.sources > 0) {
+			continue;
+		}
+		if (ite->second.rule.length() > 0) {
+			removals.push_back(ite->second.rule);
+		}
+		this->feedEntries.erase(ite);
+	}
+	for (std::vector<hb::Prefix>::iterator itp = added.begin(); itp != added.end(); ++itp) {
+		entry = hb::FeedWatcher::format(*itp);
+		hb::FeedEntryType* feedEntry = &this->feedEntries[entry];
+		if (feedEntry->sources++ > 0 || itp->ipv6) {
+			continue;
+		}
+		if (this->config->addressRanges.overlaps(entry, hb::Whitelist)) {
+			if (this->log->isDebug()) this->log->debug("Feed entry " + entry + " overlaps whitelisted address range, not creating iptables rule!");
+			continue;
+		}
+		sait = this->suspiciousAddresses.find(entry);
+		if (sait != this->suspiciousAddresses.end() && sait->second.whitelisted) {
+			continue;
+		}
+		feedEntry->rule = ruleStart + entry + ruleEnd;
+		appends.push_back(feedEntry->rule);
+		ruleEntries.push_back(entry);
+	}
+
+	this->log->info("Feed " + source + ": " + std::to_string(added.size()) + " entries added, " + std::to_string(removed.size()) + " removed, " + std::to_string(appends.size()) + " rules added, " + std::to_string(removals.size()) + " removed");
+	bool applied = true;
+	try {
+		if (removals.size() > 0 && this->firewall->remove("INPUT", &removals) == false) {
+			this->log->error("Failed to remove " + std::to_string(removals.size()) + " rules of feed " + source + " from chain!");
+			applied = false;
+		}
+		if (applied && appends.size() > 0 && this->firewall->append("INPUT", &appends) == false) {
+			this->log->error("Failed to append " + std::to_string(appends.size()) + " rules of feed " + source + " to chain!");
+			applied = false;
+		}
+	} catch (std::runtime_error& e) {
+		std::string message = e.what();
+		this->log->error(message);
+		this->log->error("Failed to update iptables rules of feed " + source + "!");
+		applied = false;
+	}
+
+	// Rules of new entries are not appended if anything failed, so these entries are not blocked
+	if (!applied) {
+		for (std::vector<std::string>::iterator itn = ruleEntries.begin(); itn != ruleEntries.end(); ++itn) {
+			ite = this->feedEntries.find(*itn);
+			if (ite != this->feedEntries.end()) {
+				ite->second.rule = "";
+			}
+		}
+	}
+	return applied;
+}
+
+/*
+ * Remove all iptables rules of feeds and clear feed entries
+ */
+void Data::removeFeedRules()
+{
+	std::vector<std::string> removals;
+	for (std::unordered_map<std::string, hb::FeedEntryType>::iterator ite = this->feedEntries.begin(); ite != this->feedEntries.end(); ++ite) {
+		if (ite->second.rule.length() > 0) {
+			removals.push_back(ite->second.rule);
+		}
+	}
+	try {
+		if (removals.size() > 0 && this->firewall->remove("INPUT", &removals) == false) {
+			this->log->error("Failed to remove " + std::to_string(removals.size()) + " rules of feeds from chain!");
+		}
+	} catch (std::runtime_error& e) {
+		std::string message = e.what();
+		this->log->error(message);
+		this->log->error("Failed to remove iptables rules of feeds!");
+	}
+	this->feedEntries.clear();
+	this->feedSources.clear();
+}
+
+/*
+ * Bring data in line with firewall after queued rule failed to be applied, same state as if firewall call failed right away
+ * Missing rule (append failed) unblocks address, subnet, peer decision, aggregated prefix, address range or feed entry it belongs to
+ * Rule left in firewall (remove failed) keeps address blocked, so removal is tried again
+ */
+void Data::ruleFailed(bool append, const std::string& rule)
+{
+	std::size_t posip = this->config->iptablesRule.find("%i");
+	if (posip == std::string::npos) {
+		return;
+	}
+	std::string ruleStart = this->config->iptablesRule.substr(0, posip);
+	std::string ruleEnd = this->config->iptablesRule.substr(posip + 2);
+	if (rule.length() <= ruleStart.length() + ruleEnd.length() || rule.compare(0, ruleStart.length(), ruleStart) != 0 || rule.compare(rule.length() - ruleEnd.length(), ruleEnd.length(), ruleEnd) != 0) {
+		return;
+	}
+	std::string target = rule.substr(ruleStart.length(), rule.length() - ruleStart.length() - ruleEnd.length());
+	std::map<std::string, hb::SuspiciosAddressType>::iterator sait = this->suspiciousAddresses.find(target);
+	std::map<std::string, hb::AbuseIPDBBlacklistedAddressType>::iterator sbit = this->abuseIPDBBlacklist.find(target);
+
+	// Rule of address is still in firewall
+	if (!append) {
+		if (this->aggregateRules.size() > 0 && this->aggregates.lookup(target) == hb::Blacklist) {
+			return;
+		}
+		if (sait != this->suspiciousAddresses.end() && !sait->second.iptableRule) {
+			this->log->warning("Address " + target + " still has iptables rule, removal will be tried again");
+			sait->second.iptableRule = true;
+		}
+		if (sbit != this->abuseIPDBBlacklist.end() && !sbit->second.iptableRule) {
+			sbit->second.iptableRule = true;
+		}
+		return;
+	}
+
+	// Address
+	if (sait != this->suspiciousAddresses.end() && sait->second.iptableRule) {
+		this->log->warning("Address " + target + " has no iptables rule, address is not blocked");
+		sait->second.iptableRule = false;
+	}
+	if (sbit != this->abuseIPDBBlacklist.end() && sbit->second.iptableRule) {
+		sbit->second.iptableRule = false;
+	}
+
+	// Subnet, addresses in subnet need own rules again
+	std::unordered_map<std::string, hb::SubnetActivityType>::iterator its = this->subnetActivity.find(target);
+	if (its != this->subnetActivity.end() && its->second.rule == rule) {
+		this->log->warning("Subnet " + target + " has no iptables rule, subnet is not blocked");
+		its->second.rule = "";
+		if (its->second.lru == this->subnetLRU.end()) {
+			its->second.lru = this->subnetLRU.insert(this->subnetLRU.begin(), its->first);
+		}
+		for (sait = this->suspiciousAddresses.begin(); sait != this->suspiciousAddresses.end(); ++sait) {
+			if (this->subnetOf(sait->first) == target) {
+				this->updateIptables(sait->first);
+			}
+		}
+	}
+
+	// Decision of peers
+	std::unordered_map<std::string, hb::PeerBlockType>::iterator itp = this->peerBlocks.find(target);
+	if (itp != this->peerBlocks.end() && itp->second.rule == rule) {
+		this->log->warning("Address " + target + " (blocked by peers) has no iptables rule, address is not blocked");
+		itp->second.rule = "";
+	}
+
+	// Aggregated prefix, addresses it covers need own rules again
+	std::map<std::string, std::string>::iterator ito = this->aggregateRules.find(target);
+	if (ito != this->aggregateRules.end() && ito->second == rule) {
+		this->log->warning("Aggregated prefix " + target + " has no iptables rule, rules of its addresses are restored");
+		this->aggregateRules.erase(ito);
+		hb::PrefixTrie failedTrie;
+		failedTrie.insert(target, hb::Blacklist);
+		this->aggregates.clear();
+		for (ito = this->aggregateRules.begin(); ito != this->aggregateRules.end(); ++ito) {
+			this->aggregates.insert(ito->first, hb::Blacklist);
+		}
+		std::vector<std::string> covered;
+		for (sait = this->suspiciousAddresses.begin(); sait != this->suspiciousAddresses.end(); ++sait) {
+			if (sait->second.iptableRule && !sait->second.whitelisted && failedTrie.lookup(sait->first) == hb::Blacklist) {
+				covered.push_back(sait->first);
+			}
+		}
+		for (sbit = this->abuseIPDBBlacklist.begin(); sbit != this->abuseIPDBBlacklist.end(); ++sbit) {
+			if (sbit->second.iptableRule && this->suspiciousAddresses.count(sbit->first) == 0 && failedTrie.lookup(sbit->first) == hb::Blacklist) {
+				covered.push_back(sbit->first);
+			}
+		}
+		bool restored = false;
+		for (std::vector<std::string>::iterator itc = covered.begin(); itc != covered.end(); ++itc) {
+			try {
+				restored = this->firewall->append("INPUT", ruleStart + *itc + ruleEnd);
+			} catch (std::runtime_error& e) {
+				std::string message = e.what();
+				this->log->error(message);
+				restored = false;
+			}
+			if (!restored) {
+				this->log->error("Address " + *itc + " is no longer covered by aggregated prefix, but failed to append rule of address to chain!");
+				if (this->suspiciousAddresses.count(*itc) > 0) {
+					this->suspiciousAddresses[*itc].iptableRule = false;
+				}
+				if (this->abuseIPDBBlacklist.count(*itc) > 0) {
+					this->abuseIPDBBlacklist[*itc].iptableRule = false;
+				}
+			}
+		}
+		this->aggregatesChanged = true;
+	}
+
+	// Address range and feed entry
+	std::map<std::string, std::string>::iterator itr = this->rangeRules.find(target);
+	if (itr != this->rangeRules.end() && itr->second == rule) {
+		this->rangeRules.erase(itr);
+	}
+	std::unordered_map<std::string, hb::FeedEntryType>::iterator ite = this->feedEntries.find(target);
+	if (ite != this->feedEntries.end() && ite->second.rule == rule) {
+		ite->second.rule = "";
+	}
+}
+
+/*
+ * Update firewall rules of all addresses and subnets (with current time) and save datafile, after batch mode (historic log replay)
+ * Only addresses and subnets with score still high enough at the end are blocked
+ */
+bool Data::applyBatch()
+{
+	bool result = true;
+	std::map<std::string, hb::SuspiciosAddressType>::iterator it;
+	this->queueRules = true;
+	for (it = this->suspiciousAddresses.begin(); it != this->suspiciousAddresses.end(); ++it) {
+		if (!this->updateIptables(it->first)) {
+			result = false;
+		}
+	}
+	for (std::map<std::string, hb::AbuseIPDBBlacklistedAddressType>::iterator itb = this->abuseIPDBBlacklist.begin(); itb != this->abuseIPDBBlacklist.end(); ++itb) {
+		if (this->suspiciousAddresses.count(itb->first) == 0 && !this->updateIptables(itb->first)) {
+			result = false;
+		}
+	}
+	this->queueRules = false;
+
+	// Queued rules of addresses with single firewall call, before aggregation replaces them
+	try {
+		if (this->queuedRemovals.size() > 0 && this->firewall->remove("INPUT", &this->queuedRemovals) == false) {
+			this->log->error("Failed to remove " + std::to_string(this->queuedRemovals.size()) + " rules from chain!");
+			result = false;
+		}
+		if (this->queuedAppends.size() > 0 && this->firewall->append("INPUT", &this->queuedAppends) == false) {
+			this->log->error("Failed to append " + std::to_string(this->queuedAppends.size()) + " rules to chain!");
+			result = false;
+		}
+	} catch (std::runtime_error& e) {
+		std::string message = e.what();
+		this->log->error(message);
+		this->log->error("Failed to update iptables rules of addresses!");
+		result = false;
+	}
+	this->queuedRemovals.clear();
+	this->queuedAppends.clear();
+
+	for (std::unordered_map<std::string, hb::SubnetActivityType>::iterator its = this->subnetActivity.begin(); its != this->subnetActivity.end(); ++its) {
+		this->updateSubnetIptables(its->first);
+	}
+	this->trimSubnets();
+	this->updateAggregates();
+	if (!this->saveData()) {
+		result = false;
+	}
+	return result;
+}
+
+/*
+ * Write snapshot of addresses, lists and AbuseIPDB blacklist
+ */
+bool Data::exportSnapshot(const std::string& path)
+{
+	hb::SnapshotWriter writer(this->log);
+	hb::SnapshotRecord record;
+	if (!writer.open(path)) {
+		return false;
+	}
+	hb::Prefix prefix;
+	record.type = 'A';
+	for (std::map<std::string, hb::SuspiciosAddressType>::iterator it = this->suspiciousAddresses.begin(); it != this->suspiciousAddresses.end(); ++it) {
+		if (!hb::PrefixTrie::parse(it->first, &prefix)) {
+			this->log->warning("Address " + it->first + " is not valid, not written to snapshot");
+			continue;
+		}
+		record.address = it->first;
+		record.activity = it->second;
+		if (!writer.write(record)) {
+			return false;
+		}
+	}
+	record.type = 'B';
+	for (std::map<std::string, hb::AbuseIPDBBlacklistedAddressType>::iterator itb = this->abuseIPDBBlacklist.begin(); itb != this->abuseIPDBBlacklist.end(); ++itb) {
+		if (!hb::PrefixTrie::parse(itb->first, &prefix)) {
+			this->log->warning("Address " + itb->first + " is not valid, not written to snapshot");
+			continue;
+		}
+		record.address = itb->first;
+		record.abuseIPDB = itb->second;
+		if (!writer.write(record)) {
+			return false;
+		}
+	}
+	record.type = 'S';
+	record.syncTime = this->abuseIPDBSyncTime;
+	record.blacklistGenTime = this->abuseIPDBBlacklistGenTime;
+	if (!writer.write(record) || !writer.close()) {
+		return false;
+	}
+	this->log->info("Snapshot " + path + " saved with " + std::to_string(writer.records()) + " records");
+	return true;
+}
+
+/*
+ * Merge up to limit records of snapshot (0 for all) into data, firewall and datafile are updated by applyBatch() when reader is done
+ * Existing address keeps its flags (unless it has none) and newer activity wins, counts are not added (same snapshot can be imported again)
+ */
+bool Data::importSnapshot(hb::SnapshotReader* reader, std::size_t limit)
+{
+	hb::SnapshotRecord record;
+	hb::Prefix prefix;
+	std::map<std::string, hb::SuspiciosAddressType>::iterator it;
+	std::map<std::string, hb::AbuseIPDBBlacklistedAddressType>::iterator itb;
+	for (std::size_t i = 0; (limit == 0 || i < limit) && !reader->done(); i++) {
+		if (!reader->next(&record)) {
+			this->log->error("Invalid record in snapshot!");
+			return false;
+		}
+		// Address ends up in firewall rule, anything that is not address or address range is refused
+		if ((record.type == 'A' || record.type == 'B') && !hb::PrefixTrie::parse(record.address, &prefix)) {
+			this->log->error("Invalid address in snapshot record, record skipped!");
+			continue;
+		}
+		if (record.type == 'A') {
+			it = this->suspiciousAddresses.find(record.address);
+			if (it == this->suspiciousAddresses.end()) {
+				this->suspiciousAddresses.insert(std::pair<std::string, hb::SuspiciosAddressType>(record.address, record.activity));
+				continue;
+			}
+			if (record.activity.lastActivity > it->second.lastActivity) {
+				it->second.lastActivity = record.activity.lastActivity;
+				it->second.activityScore = record.activity.activityScore;
+			}
+			if (record.activity.activityCount > it->second.activityCount) {
+				it->second.activityCount = record.activity.activityCount;
+			}
+			if (record.activity.refusedCount > it->second.refusedCount) {
+				it->second.refusedCount = record.activity.refusedCount;
+			}
+			if (record.activity.lastReported > it->second.lastReported) {
+				it->second.lastReported = record.activity.lastReported;
+			}
+			if (!it->second.whitelisted && !it->second.blacklisted) {
+				it->second.whitelisted = record.activity.whitelisted;
+				it->second.blacklisted = record.activity.blacklisted;
+			}
+		} else if (record.type == 'B') {
+			itb = this->abuseIPDBBlacklist.find(record.address);
+			if (itb == this->abuseIPDBBlacklist.end()) {
+				this->abuseIPDBBlacklist.insert(std::pair<std::string, hb::AbuseIPDBBlacklistedAddressType>(record.address, record.abuseIPDB));
+			} else {
+				itb->second.totalReports = record.abuseIPDB.totalReports;
+				itb->second.abuseConfidenceScore = record.abuseIPDB.abuseConfidenceScore;
+			}
+		} else if (record.type == 'S') {
+			if (record.syncTime > this->abuseIPDBSyncTime) {
+				this->abuseIPDBSyncTime = record.syncTime;
+			}
+			if (record.blacklistGenTime > this->abuseIPDBBlacklistGenTime) {
+				this->abuseIPDBBlacklistGenTime = record.blacklistGenTime;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * Score just high enough to create iptables rule (rule is kept for one score unit if score multiplier is configured)
+ */
+unsigned int Data::blockScore()
+{
+	if (this->config->keepBlockedScoreMultiplier > 0) {
+		return (this->config->activityScoreToBlock + 1) * this->config->keepBlockedScoreMultiplier;
+	}
+	return this->config->activityScoreToBlock + 1;
+}
+
+/*
+ * Add match to rate window and return count of matches within seconds (rounded to whole buckets)
+ * Window is ring of buckets, buckets that are older than window are reused, so each call is O(1)
+ */
+unsigned int Data::countRate(hb::RateWindowType* window, unsigned long long int time, unsigned int bucketSeconds, unsigned int seconds)
+{
+	unsigned long long int bucketStart = time - time % bucketSeconds;
+	unsigned int i;
+	if (window->newestStart == 0 || bucketStart >= window->newestStart + (unsigned long long int)hb::kRateBuckets * bucketSeconds) {
+		// All buckets are older than window
+		for (i = 0; i < hb::kRateBuckets; i++) {
+			window->buckets[i] = 0;
+		}
+		window->newest = 0;
+		window->newestStart = bucketStart;
+	} else {
+		// Move to current bucket, clearing buckets in between
+		while (window->newestStart < bucketStart) {
+			window->newest = (window->newest + 1) % hb::kRateBuckets;
+			window->buckets[window->newest] = 0;
+			window->newestStart += bucketSeconds;
+		}
+	}
+	if (window->buckets[window->newest] < USHRT_MAX) {
+		window->buckets[window->newest]++;
+	}
+
+	// Sum of buckets within seconds
+	unsigned int bucketCount = (seconds + bucketSeconds - 1) / bucketSeconds;
+	if (bucketCount > hb::kRateBuckets) {
+		bucketCount = hb::kRateBuckets;
+	}
+	unsigned int count = 0;
+	for (i = 0; i < bucketCount; i++) {
+		count += window->buckets[(window->newest + hb::kRateBuckets - i) % hb::kRateBuckets];
+	}
+	return count;
+}
+
+/*
+ * Remove rate windows without matches within window length
+ */
+void Data::pruneRateWindows()
+{
+	std::time_t currentRawTime;
+	std::time(&currentRawTime);
+	unsigned long long int currentTime = (unsigned long long int)currentRawTime;
+	bool expired;
+	for (std::unordered_map<std::string, std::vector<hb::RateWindowType>>::iterator itr = this->rateWindows.begin(); itr != this->rateWindows.end();) {
+		expired = true;
+		for (std::vector<hb::RateWindowType>::iterator itw = itr->second.begin(); itw != itr->second.end(); ++itw) {
+			if (currentTime < itw->newestStart + (unsigned long long int)hb::kRateBuckets * itw->bucketSeconds) {
+				expired = false;
+				break;
+			}
+		}
+		if (expired) {
+			itr = this->rateWindows.erase(itr);
+		} else {
+			++itr;
+		}
+	}
+}
+
 /*
  * Save AbuseIPDB blacklist record in data->abuseIPDBBlacklist and datafile (add new or update existing)
  */
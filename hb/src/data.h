@@ -7,19 +7,31 @@
 
 // Map
 #include <map>
+// Unordered map
+#include <unordered_map>
+// List
+#include <list>
+// Vector
+#include <vector>
 // String
 #include <string>
 // Logger
 #include "logger.h"
 // Config
 #include "config.h"
-// Iptables
-#include "iptables.h"
+// Firewall
+#include "firewall.h"
 // Util
 #include "util.h"
+// Snapshot
+#include "snapshot.h"
+// Blocklist feeds
+#include "feed.h"
 
 namespace hb{
 
+class RecordPersister;
+
 class Data{
 	private:
 
@@ -42,9 +54,9 @@ class Data{
 		hb::Config* config;
 
 		/*
-		 * Iptables object
+		 * Firewall object (iptables or simulated)
 		 */
-		hb::Iptables* iptables;
+		hb::Firewall* firewall;
 
 		/*
 		 * Data about suspicious, whitelisted and blacklisted addresses
@@ -66,10 +78,84 @@ class Data{
 		 */
 		std::map<std::string, hb::AbuseIPDBBlacklistedAddressType> abuseIPDBBlacklist;
 
+		/*
+		 * Aggregate activity of subnets (subnet -> activity), count is limited by config->subnetCacheSize
+		 */
+		std::unordered_map<std::string, hb::SubnetActivityType> subnetActivity;
+
+		/*
+		 * Subnets without rule ordered by last update, most recently updated first (blocked subnets are pinned outside of list)
+		 */
+		std::list<std::string> subnetLRU;
+
+		/*
+		 * Block decisions received from peers (address -> decisions)
+		 */
+		std::unordered_map<std::string, hb::PeerBlockType> peerBlocks;
+
+		/*
+		 * Block decisions of this instance not published to peers yet
+		 */
+		std::vector<hb::PeerDelta> peerOutbox;
+
+		/*
+		 * Entries of blocklist feeds (source -> sorted entries) and their rules (entry -> rule), kept apart from suspicious addresses
+		 */
+		std::unordered_map<std::string, std::vector<hb::Prefix>> feedSources;
+		std::unordered_map<std::string, hb::FeedEntryType> feedEntries;
+
+		/*
+		 * Recent matches of addresses (only matches of patterns with rate rule), window for each bucket width of rules
+		 */
+		std::unordered_map<std::string, std::vector<hb::RateWindowType>> rateWindows;
+
+		/*
+		 * iptables rules of aggregated prefixes (prefix -> rule), blocked addresses in these prefixes have no own rule
+		 */
+		std::map<std::string, std::string> aggregateRules;
+
+		/*
+		 * Aggregated prefixes, to check whether address is covered by rule of prefix
+		 */
+		hb::PrefixTrie aggregates;
+
+		/*
+		 * Whether set of blocked addresses is changed since last aggregation
+		 */
+		bool aggregatesChanged = true;
+
+		/*
+		 * iptables rules created for blacklisted address ranges (range -> rule)
+		 */
+		std::map<std::string, std::string> rangeRules;
+
+		/*
+		 * Time of activity to use instead of current time, 0 for current time (historic log replay uses time from log line)
+		 */
+		unsigned long long int activityTime = 0;
+
+		/*
+		 * Batch mode (historic log replay), firewall rules and datafile are not updated on each activity, see applyBatch()
+		 */
+		bool batch = false;
+
+		/*
+		 * Whether rules of addresses are queued and appended/removed with single firewall call, see applyBatch()
+		 */
+		bool queueRules = false;
+		std::vector<std::string> queuedAppends;
+		std::vector<std::string> queuedRemovals;
+
+		/*
+		 * Persister stage (matcher pool), records of addresses changed by saveActivity are written by its thread, NULL to write them right away
+		 * Other datafile writes wait until saved records are written
+		 */
+		hb::RecordPersister* persister = NULL;
+
 		/*
 		 * Constructor
 		 */
-		Data(hb::Logger* log, hb::Config* config, hb::Iptables* iptables);
+		Data(hb::Logger* log, hb::Config* config, hb::Firewall* firewall);
 
 		/*
 		 * Read data file and store results in this->suspiciousAddresses
@@ -89,15 +175,32 @@ class Data{
 		 */
 		bool checkIptables();
 
+		/*
+		 * Add/remove iptables rules for blacklisted address ranges, single rule for each range
+		 */
+		bool updateRangeRules();
+
+		/*
+		 * Address range of iptables rule (canonical form), empty if rule is for single address
+		 * addressStart and addressEnd - position of IPv4 address in rule
+		 */
+		static std::string ruleRange(const std::string& rule, std::size_t addressStart, std::size_t addressEnd);
+
 		/*
 		 * Add new record to datafile based on this->suspiciousAddresses
 		 */
-		bool addAddress(std::string address);
+		bool addAddress(const std::string& address);
 
 		/*
 		 * Update record in datafile based on this->suspiciousAddresses
 		 */
-		bool updateAddress(std::string address);
+		bool updateAddress(const std::string& address);
+
+		/*
+		 * Add new record to datafile end, update existing record in datafile (record is copy, so persister thread can write it)
+		 */
+		bool appendRecord(const std::string& address, const hb::SuspiciosAddressType& record);
+		bool replaceRecord(const std::string& address, const hb::SuspiciosAddressType& record);
 
 		/*
 		 * Mark record for removal in datafile
@@ -157,12 +260,117 @@ class Data{
 		/*
 		 * Add/remove iptables rule based on score and blacklist
 		 */
-		bool updateIptables(std::string address);
+		bool updateIptables(const std::string& address);
 
 		/*
 		 * Save suspicious activity (add new or update existing) and create/remove iptables rule if needed
+		 * If rate rule is given, address is blocked when count of matches happen within seconds
+		 * If immediate, address is blocked right away (high severity match), before subnet aggregation and datafile update
+		 */
+		void saveActivity(const std::string& address, unsigned int activityScore, unsigned int activityCount, unsigned int refusedCount, const hb::RateLimit* rate = NULL, bool immediate = false);
+
+		/*
+		 * Update firewall rules of all addresses and subnets (with current time) and save datafile, after batch mode
+		 */
+		bool applyBatch();
+
+		/*
+		 * Write snapshot of addresses, lists and AbuseIPDB blacklist
+		 */
+		bool exportSnapshot(const std::string& path);
+
+		/*
+		 * Merge up to limit records of snapshot (0 for all) into data, firewall and datafile are updated by applyBatch() when reader is done
+		 * Existing address keeps its flags and newer activity wins, returns false if record is not valid
+		 */
+		bool importSnapshot(hb::SnapshotReader* reader, std::size_t limit);
+
+		/*
+		 * Score just high enough to create iptables rule (rule is kept for one score unit if score multiplier is configured)
+		 */
+		unsigned int blockScore();
+
+		/*
+		 * Add match to rate window and return count of matches within seconds (rounded to whole buckets)
+		 */
+		static unsigned int countRate(hb::RateWindowType* window, unsigned long long int time, unsigned int bucketSeconds, unsigned int seconds);
+
+		/*
+		 * Remove rate windows without matches within window length
+		 */
+		void pruneRateWindows();
+
+		/*
+		 * Replace rules of blocked addresses with rules of prefixes that have configured count of blocked addresses
+		 * Only difference with previously aggregated prefixes is applied to firewall
+		 */
+		bool updateAggregates();
+
+		/*
+		 * Subnet of address (canonical form, prefix length from configuration), empty if address is not valid
+		 */
+		std::string subnetOf(const std::string& address);
+
+		/*
+		 * Add activity to aggregate of address subnet and create iptables rule for subnet if needed
+		 */
+		void saveSubnetActivity(const std::string& address, unsigned int activityScore, unsigned int activityCount);
+
+		/*
+		 * Add/remove iptables rule of subnet based on aggregate score
+		 */
+		bool updateSubnetIptables(const std::string& subnet);
+
+		/*
+		 * Remove expired iptables rules of subnets
+		 */
+		void updateSubnetRules();
+
+		/*
+		 * Drop least recently updated subnets without rule while count is over limit
+		 */
+		void trimSubnets();
+
+		/*
+		 * Remove all iptables rules of subnets and clear aggregate activity
+		 */
+		void removeSubnetRules();
+
+		/*
+		 * Save block decision received from peer and create iptables rule for address if needed
+		 */
+		void savePeerBlock(const hb::PeerDelta& delta);
+
+		/*
+		 * Add/remove iptables rule of address based on sum of scores of peer decisions
+		 */
+		bool updatePeerIptables(const std::string& address);
+
+		/*
+		 * Remove expired peer decisions and their iptables rules
+		 */
+		void updatePeerRules();
+
+		/*
+		 * Remove all iptables rules created because of peers and clear peer decisions
+		 */
+		void removePeerRules();
+
+		/*
+		 * Replace entries of feed source (empty to remove source), only difference with previous entries is applied to firewall
+		 */
+		bool updateFeed(const std::string& source, std::vector<hb::Prefix>* entries);
+
+		/*
+		 * Remove all iptables rules of feeds and clear feed entries
+		 */
+		void removeFeedRules();
+
+		/*
+		 * Bring data in line with firewall after queued rule failed to be applied (see FirewallApplier::takeFailed)
+		 * Missing rule (append failed) unblocks what it belonged to, rule left in firewall (remove failed) keeps address blocked
 		 */
-		void saveActivity(std::string address, unsigned int activityScore, unsigned int activityCount, unsigned int refusedCount);
+		void ruleFailed(bool append, const std::string& rule);
 
 		/*
 		 * Save AbuseIPDB blacklist record (add new or update existing) and create/remove iptables rule if needed
@@ -0,0 +1,295 @@
+/*
+ * Blocklist feeds, each file in feed directory is named source with address or CIDR range on each line
+ */
+
+// C string (memcmp, strerror)
+#include <cstring>
+// Algorithm (sort, unique)
+#include <algorithm>
+// File stream
+#include <fstream>
+// Errors
+#include <errno.h>
+// Directory listing
+#include <dirent.h>
+// inotify
+#include <sys/inotify.h>
+// Miscellaneous UNIX symbolic constants, types and functions
+namespace cunistd{
+	#include <unistd.h>
+}
+// Header
+#include "feed.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+FeedWatcher::FeedWatcher(hb::Logger* log)
+{
+	this->log = log;
+}
+
+/*
+ * Destructor, stops watching
+ */
+FeedWatcher::~FeedWatcher()
+{
+	this->stop();
+}
+
+/*
+ * Start watching directory, all files in it are returned as changed by next call of changes()
+ */
+bool FeedWatcher::watch(const std::string& directory)
+{
+	this->stop();
+	this->directory = directory;
+	this->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (this->inotifyFd < 0) {
+		this->log->error("Failed to initialize inotify! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+		return false;
+	}
+	this->watchFd = inotify_add_watch(this->inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF);
+	if (this->watchFd < 0) {
+		this->log->error("Failed to watch feed directory " + directory + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+		cunistd::close(this->inotifyFd);
+		this->inotifyFd = -1;
+		return false;
+	}
+	this->rescan = true;
+	this->log->info("Watching feed directory " + directory);
+	return true;
+}
+
+/*
+ * Stop watching directory
+ */
+void FeedWatcher::stop()
+{
+	if (this->inotifyFd >= 0) {
+		cunistd::close(this->inotifyFd);
+	}
+	this->inotifyFd = -1;
+	this->watchFd = -1;
+	this->rescan = false;
+}
+
+/*
+ * Names of files in directory (hidden files are temporary files of editors and of atomic replace)
+ */
+void FeedWatcher::listFiles(std::set<std::string>* names)
+{
+	DIR* dir = opendir(this->directory.c_str());
+	if (dir == NULL) {
+		this->log->error("Unable to list feed directory " + this->directory + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+		return;
+	}
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] != '.' && (entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)) {
+			names->insert(entry->d_name);
+		}
+	}
+	closedir(dir);
+}
+
+/*
+ * Names of files that are changed, created or removed since last call (does not wait)
+ */
+void FeedWatcher::changes(std::set<std::string>* names)
+{
+	if (this->inotifyFd < 0) {
+		return;
+	}
+
+	// Events, buffer aligned as inotify_event
+	alignas(struct inotify_event) char buffer[16384];
+	ssize_t length;
+	const struct inotify_event* event;
+	while ((length = cunistd::read(this->inotifyFd, buffer, sizeof(buffer))) > 0) {
+		for (char* pos = buffer; pos < buffer + length; pos += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event*)pos;
+			if (event->mask & IN_Q_OVERFLOW) {
+				this->rescan = true;
+			} else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+				this->log->warning("Feed directory " + this->directory + " was removed or moved, feeds are no longer watched!");
+			} else if (event->len > 0 && event->name[0] != '.') {
+				names->insert(event->name);
+			}
+		}
+	}
+
+	// Files in directory and sources loaded before (they might be removed)
+	if (this->rescan) {
+		this->rescan = false;
+		this->listFiles(names);
+		names->insert(this->sources.begin(), this->sources.end());
+	}
+}
+
+/*
+ * Read feed file to sorted list of unique entries, returns false if file does not exist (source is removed)
+ */
+bool FeedWatcher::load(const std::string& name, std::vector<hb::Prefix>* entries)
+{
+	entries->clear();
+	std::ifstream file(this->directory + "/" + name, std::ios::in | std::ios::binary);
+	if (!file.is_open()) {
+		this->sources.erase(name);
+		return false;
+	}
+	std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	unsigned long long int invalid = FeedWatcher::parse(content, entries);
+	if (invalid > 0) {
+		this->log->warning("Feed " + name + " has " + std::to_string(invalid) + " lines that are not address or CIDR range!");
+		this->invalidLines += invalid;
+	}
+	this->sources.insert(name);
+	return true;
+}
+
+/*
+ * Address or range from line (first word, # and ; start comment), host bits of range are cleared
+ * IPv4 is parsed directly, IPv6 with inet_pton
+ */
+bool FeedWatcher::parseLine(const char* begin, const char* end, hb::Prefix* prefix)
+{
+	while (begin < end && (*begin == ' ' || *begin == '\t')) {
+		begin++;
+	}
+	const char* wordEnd = begin;
+	while (wordEnd < end && *wordEnd != ' ' && *wordEnd != '\t' && *wordEnd != '\r' && *wordEnd != '#' && *wordEnd != ';' && *wordEnd != ',') {
+		wordEnd++;
+	}
+	if (wordEnd == begin) {
+		return false;
+	}
+
+	// IPv4 address with optional prefix length
+	unsigned int octet = 0, octets = 0, digits = 0, length = 32;
+	const char* pos = begin;
+	std::memset(prefix->address, 0, sizeof(prefix->address));
+	for (; pos < wordEnd && *pos != '/'; pos++) {
+		if (*pos >= '0' && *pos <= '9') {
+			octet = octet * 10 + (*pos - '0');
+			if (++digits > 3 || octet > 255) {
+				break;
+			}
+		} else if (*pos == '.' && digits > 0 && octets < 3) {
+			prefix->address[octets++] = (unsigned char)octet;
+			octet = 0;
+			digits = 0;
+		} else {
+			break;
+		}
+	}
+	if ((pos == wordEnd || *pos == '/') && octets == 3 && digits > 0) {
+		prefix->address[3] = (unsigned char)octet;
+		if (pos < wordEnd) {
+			length = 0;
+			digits = 0;
+			for (pos++; pos < wordEnd && *pos >= '0' && *pos <= '9' && digits < 3; pos++, digits++) {
+				length = length * 10 + (*pos - '0');
+			}
+			if (pos != wordEnd || digits == 0 || length > 32) {
+				return false;
+			}
+		}
+		prefix->ipv6 = false;
+		prefix->length = length;
+		for (unsigned int i = length; i < 32; i++) {
+			prefix->address[i / 8] &= (unsigned char)~(0x80 >> (i % 8));
+		}
+		return true;
+	}
+
+	// IPv6 address
+	if (std::find(begin, wordEnd, ':') == wordEnd) {
+		return false;
+	}
+	return hb::PrefixTrie::parse(std::string(begin, wordEnd), prefix);
+}
+
+/*
+ * Sorted list of unique entries in feed content, returns count of lines that are not valid (empty and comment lines are valid)
+ */
+unsigned long long int FeedWatcher::parse(const std::string& content, std::vector<hb::Prefix>* entries)
+{
+	unsigned long long int invalid = 0;
+	const char* pos = content.data();
+	const char* end = pos + content.length();
+	const char* lineEnd;
+	const char* first;
+	hb::Prefix prefix;
+	entries->clear();
+	while (pos < end) {
+		lineEnd = (const char*)std::memchr(pos, '\n', end - pos);
+		if (lineEnd == NULL) {
+			lineEnd = end;
+		}
+		if (FeedWatcher::parseLine(pos, lineEnd, &prefix)) {
+			entries->push_back(prefix);
+		} else {
+			for (first = pos; first < lineEnd && (*first == ' ' || *first == '\t' || *first == '\r'); first++) {}
+			if (first < lineEnd && *first != '#' && *first != ';') {
+				invalid++;
+			}
+		}
+		pos = lineEnd + 1;
+	}
+	std::sort(entries->begin(), entries->end(), FeedWatcher::less);
+	entries->erase(std::unique(entries->begin(), entries->end(), [](const hb::Prefix& a, const hb::Prefix& b) {
+		return !FeedWatcher::less(a, b) && !FeedWatcher::less(b, a);
+	}), entries->end());
+	return invalid;
+}
+
+/*
+ * Order of entries (IPv4 first, then by address and prefix length)
+ */
+bool FeedWatcher::less(const hb::Prefix& a, const hb::Prefix& b)
+{
+	if (a.ipv6 != b.ipv6) {
+		return !a.ipv6;
+	}
+	int compare = std::memcmp(a.address, b.address, a.ipv6 ? 16 : 4);
+	if (compare != 0) {
+		return compare < 0;
+	}
+	return a.length < b.length;
+}
+
+/*
+ * Entries added and removed between two sorted lists, with single sorted merge
+ */
+void FeedWatcher::diff(const std::vector<hb::Prefix>& previous, const std::vector<hb::Prefix>& current, std::vector<hb::Prefix>* added, std::vector<hb::Prefix>* removed)
+{
+	std::vector<hb::Prefix>::const_iterator itp = previous.begin(), itc = current.begin();
+	while (itp != previous.end() || itc != current.end()) {
+		if (itc == current.end() || (itp != previous.end() && FeedWatcher::less(*itp, *itc))) {
+			removed->push_back(*itp);
+			++itp;
+		} else if (itp == previous.end() || FeedWatcher::less(*itc, *itp)) {
+			added->push_back(*itc);
+			++itc;
+		} else {
+			++itp;
+			++itc;
+		}
+	}
+}
+
+/*
+ * Entry as address (full prefix length) or range
+ */
+std::string FeedWatcher::format(const hb::Prefix& prefix)
+{
+	std::string range = hb::PrefixTrie::format(prefix);
+	if (prefix.length == (prefix.ipv6 ? 128u : 32u)) {
+		return range.substr(0, range.find('/'));
+	}
+	return range;
+}
@@ -0,0 +1,118 @@
+/*
+ * Blocklist feeds, each file in feed directory is named source with address or CIDR range on each line
+ * Directory is watched with inotify, changed file is parsed again and compared with previous version of same source
+ */
+
+#ifndef HBFEED_H
+#define HBFEED_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Set
+#include <set>
+// Logger
+#include "logger.h"
+// Prefix
+#include "cidr.h"
+
+namespace hb{
+
+class FeedWatcher{
+	private:
+
+		/*
+		 * Logger
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Watched directory, inotify descriptor and watch descriptor
+		 */
+		std::string directory = "";
+		int inotifyFd = -1;
+		int watchFd = -1;
+
+		/*
+		 * Whether all files have to be loaded (after start or lost events)
+		 */
+		bool rescan = false;
+
+		/*
+		 * Names of loaded sources
+		 */
+		std::set<std::string> sources;
+
+		/*
+		 * Names of files in directory
+		 */
+		void listFiles(std::set<std::string>* names);
+
+	public:
+
+		/*
+		 * Lines in feeds that are not address or range, since start
+		 */
+		unsigned long long int invalidLines = 0;
+
+		/*
+		 * Constructor
+		 */
+		FeedWatcher(hb::Logger* log);
+
+		/*
+		 * Destructor, stops watching
+		 */
+		~FeedWatcher();
+
+		/*
+		 * Start watching directory, all files in it are returned as changed by next call of changes()
+		 */
+		bool watch(const std::string& directory);
+
+		/*
+		 * Stop watching directory
+		 */
+		void stop();
+
+		/*
+		 * Names of files that are changed, created or removed since last call (does not wait)
+		 */
+		void changes(std::set<std::string>* names);
+
+		/*
+		 * Read feed file to sorted list of unique entries, returns false if file does not exist (source is removed)
+		 */
+		bool load(const std::string& name, std::vector<hb::Prefix>* entries);
+
+		/*
+		 * Address or range from line (first word, # and ; start comment), host bits of range are cleared
+		 */
+		static bool parseLine(const char* begin, const char* end, hb::Prefix* prefix);
+
+		/*
+		 * Sorted list of unique entries in feed content, returns count of lines that are not valid
+		 */
+		static unsigned long long int parse(const std::string& content, std::vector<hb::Prefix>* entries);
+
+		/*
+		 * Order of entries (IPv4 first, then by address and prefix length)
+		 */
+		static bool less(const hb::Prefix& a, const hb::Prefix& b);
+
+		/*
+		 * Entries added and removed between two sorted lists, with single sorted merge
+		 */
+		static void diff(const std::vector<hb::Prefix>& previous, const std::vector<hb::Prefix>& current, std::vector<hb::Prefix>* added, std::vector<hb::Prefix>* removed);
+
+		/*
+		 * Entry as address (full prefix length) or range
+		 */
+		static std::string format(const hb::Prefix& prefix);
+
+};
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Firewall interface, implemented by iptables and by in-memory simulation
+ */
+
+// Map
+#include <map>
+// Vector
+#include <vector>
+// Standard string library
+#include <string>
+
+#ifndef HBFIREWALL_H
+#define HBFIREWALL_H
+
+namespace hb{
+
+class Firewall{
+	private:
+
+	public:
+
+		/*
+		 * Destructor
+		 */
+		virtual ~Firewall() {}
+
+		/*
+		 * Create new chain
+		 */
+		virtual bool newChain(std::string chain) = 0;
+
+		/*
+		 * Append chain with new rule
+		 */
+		virtual bool append(std::string chain, std::string rule) = 0;
+		virtual bool append(std::string chain, std::vector<std::string>* rules) = 0;
+
+		/*
+		 * Delete rule from chain
+		 */
+		virtual bool remove(std::string chain, std::string rule) = 0;
+		virtual bool remove(std::string chain, std::vector<std::string>* rules) = 0;
+
+		/*
+		 * Get rule list (same format as iptables --list-rules, each line as entry in map)
+		 */
+		virtual std::map<unsigned int, std::string> listRules(std::string chain) = 0;
+
+		/*
+		 * Exec any command with custom options
+		 */
+		virtual bool command(std::string options) = 0;
+
+		/*
+		 * Exec any command with custom options and return stdout in map each line as entry in map
+		 */
+		virtual std::map<unsigned int, std::string> custom(std::string options) = 0;
+
+};
+
+}
+
+#endif
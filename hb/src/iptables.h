@@ -6,13 +6,15 @@
 #include <map>
 // Vector
 #include <vector>
+// Firewall interface
+#include "firewall.h"
 
 #ifndef HBIPTABLES_H
 #define HBIPTABLES_H
 
 namespace hb{
 
-class Iptables{
+class Iptables : public Firewall{
 	private:
 
 	public:
@@ -25,34 +27,34 @@ class Iptables{
 		/*
 		 * Create new chain
 		 */
-		bool newChain(std::string chain);
+		bool newChain(std::string chain) override;
 
 		/*
 		 * Append chain with new rule
 		 */
-		bool append(std::string chain, std::string rule);
-		bool append(std::string chain, std::vector<std::string>* rules);
+		bool append(std::string chain, std::string rule) override;
+		bool append(std::string chain, std::vector<std::string>* rules) override;
 
 		/*
 		 * Delete rule from chain
 		 */
-		bool remove(std::string chain, std::string rule);
-		bool remove(std::string chain, std::vector<std::string>* rules);
+		bool remove(std::string chain, std::string rule) override;
+		bool remove(std::string chain, std::vector<std::string>* rules) override;
 
 		/*
 		 * Get rule list
 		 */
-		std::map<unsigned int, std::string> listRules(std::string chain);
+		std::map<unsigned int, std::string> listRules(std::string chain) override;
 
 		/*
 		 * Exec iptables any command with custom options
 		 */
-		bool command(std::string options);
+		bool command(std::string options) override;
 
 		/*
 		 * Exec iptables any command with custom options and return stdout in map each line as entry in map
 		 */
-		std::map<unsigned int, std::string> custom(std::string options);
+		std::map<unsigned int, std::string> custom(std::string options) override;
 
 };
 
@@ -53,6 +53,15 @@ void Logger::closeLog()
 void Logger::setLevel(int level)
 {
 	csyslog::setlogmask(LOG_UPTO(level));
+	this->level = level;
+}
+
+/*
+ * Whether debug messages are logged (to skip building messages in hot paths)
+ */
+bool Logger::isDebug()
+{
+	return this->level >= LOG_DEBUG;
 }
 
 /*
@@ -13,6 +13,11 @@ namespace hb{
 class Logger{
 	private:
 
+		/*
+		 * Current log level (syslog priority code)
+		 */
+		int level = 6;
+
 	public:
 
 		/*
@@ -40,6 +45,11 @@ class Logger{
 		 */
 		void setLevel(int level);
 
+		/*
+		 * Whether debug messages are logged (to skip building messages in hot paths)
+		 */
+		bool isDebug();
+
 		/*
 		 * Log info message
 		 */
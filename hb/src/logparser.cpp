@@ -10,6 +10,12 @@
 #include <fstream>
 // C string
 #include <cstring>
+// Set
+#include <set>
+// Algorithms (stable_sort)
+#include <algorithm>
+// Chrono (steady_clock)
+#include <chrono>
 // Definition for network database operations (NI_MAXHOST, NI_NUMERICHOST)
 #include <netdb.h>
 // Declarations for getting network interface addresses (getifaddrs, freeifaddrs)
@@ -40,6 +46,19 @@ using namespace hb;
 LogParser::LogParser(hb::Logger* log, hb::Config* config, hb::Data* data, std::queue<ReportToAbuseIPDB>* abuseipdbReportingQueue, std::mutex* abuseipdbReportingQueueMutex)
 : log(log), config(config), data(data), abuseipdbReportingQueue(abuseipdbReportingQueue), abuseipdbReportingQueueMutex(abuseipdbReportingQueueMutex)
 {
+	this->buildMasker();
+}
+
+/*
+ * Build masker for AbuseIPDB report comments (hostname, IP addresses and configured phrases)
+ * Note, needs to be called after config reload
+ */
+void LogParser::buildMasker()
+{
+	this->hostname = "";
+	this->ipAddresses.clear();
+	this->masker.clear();
+
 	if (this->config->abuseipdbReportMask) {
 		int s;
 
@@ -86,461 +105,1069 @@ LogParser::LogParser(hb::Logger* log, hb::Config* config, hb::Data* data, std::q
 			}
 			freeifaddrs(addrs);
 		}
+
+		// Phrases to mask
+		this->masker.add(this->hostname);
+		for (std::vector<std::string>::iterator it = this->ipAddresses.begin(); it != this->ipAddresses.end(); ++it) {
+			this->masker.add(*it);
+		}
+		for (std::vector<std::string>::iterator it = this->config->abuseipdbMaskPhrases.begin(); it != this->config->abuseipdbMaskPhrases.end(); ++it) {
+			this->masker.add(*it);
+		}
+		this->masker.build();
 	}
 }
 
 /*
  * Check all configured log files for suspicious activity
+ * Note, each physical file (device and inode) is read once, lines are passed to all log groups that reference it
  */
 void LogParser::checkFiles()
 {
 	this->log->debug("Checking log files for suspicious activity...");
 	std::vector<hb::LogGroup>::iterator itlg;
 	std::vector<hb::LogFile>::iterator itlf;
-	std::vector<hb::Pattern>::iterator itlp;
+	std::vector<hb::SharedLogFile> sharedFiles;
+	std::vector<hb::SharedLogFile>::iterator itsf;
+	std::map<std::pair<unsigned long long int, unsigned long long int>, std::size_t> sharedFileIndex;
+	std::map<std::pair<unsigned long long int, unsigned long long int>, std::size_t>::iterator itsi;
+	std::vector<std::pair<hb::LogGroup*, hb::LogFile*>>::iterator itsb;
+	std::vector<std::string>::iterator itpr;
+	std::set<std::string> updatedPaths;
+	auto checkStart = std::chrono::steady_clock::now();
 	struct cstat::stat buffer;
-	unsigned long long int fileSize = 0;
-	unsigned long long int initialBookmark = 0;
-	std::string line;
-	std::string ipAddress, port;
-	std::smatch patternMatchResults;
-	time_t currentTime, lastInfo;
+	unsigned long long int initialBookmark = 0, backfillEnd = 0, bytesDone = 0, backfillBudget = this->config->backfillBytes;
+	bool backlog = false, inodeChanged = false;
+	time_t currentTime;
 	time(&currentTime);
-	lastInfo = currentTime;
-	unsigned long long int jobTotal = 0, jobDone = 0;
-	float jobPercentage = 0;
-	bool sendReport = false;
-	ReportToAbuseIPDB reportToSend;
-	std::vector<unsigned int> reportCategories;
-	std::string reportComment = "";
-	std::size_t posc, posh;
-	std::map<std::string, hb::SuspiciosAddressType>::iterator itsa;
+	struct tm localParts;
+	if (localtime_r(&currentTime, &localParts) != NULL) {
+		this->utcOffset = localParts.tm_gmtoff;
+	}
 	std::string currentTimeFormatted = Util::formatDateTime((const time_t)currentTime, this->config->dateTimeFormat.c_str());
 
-	// Loop log groups
+	// Matcher pool with persister and firewall stages, started again if count of threads or ring size is changed (configuration reload)
+	if (this->config->matchThreads == 0) {
+		this->pipeline.reset();
+		this->persister.reset();
+		this->firewallApplier.reset();
+	} else if (this->pipeline == NULL || this->pipeline->size() != this->config->matchThreads || this->pipeline->capacity() != this->config->matchRing || this->firewallApplier->firewall() != this->data->firewall) {
+		this->pipeline.reset();
+		this->persister.reset();
+		this->firewallApplier.reset();
+		this->pipeline = std::make_shared<hb::MatchPipeline>(this->config->matchThreads, this->config->matchRing);
+		this->persister = std::make_shared<hb::RecordPersister>(this->data, this->config->matchRing);
+		this->firewallApplier = std::make_shared<hb::FirewallApplier>(this->log, this->data->firewall, this->config->matchRing);
+		this->log->info("Matcher pool started, threads: " + std::to_string(this->config->matchThreads));
+	}
+	std::vector<double> stageBefore = {this->readerTime - this->readerWait - this->aggregatorTime, this->aggregatorTime};
+	if (this->pipeline != NULL) {
+		for (std::size_t w = 0; w < this->pipeline->size(); w++) {
+			stageBefore.push_back(this->pipeline->busy(w));
+		}
+		stageBefore.push_back(this->persister->busy());
+		stageBefore.push_back(this->firewallApplier->busy());
+
+		// Stages are attached to data only while log files are checked, nothing else uses data meanwhile
+		this->data->persister = this->persister.get();
+		this->data->firewall = this->firewallApplier.get();
+	}
+
+	// Loop log groups, collect physical files
 	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
-		this->log->debug("Checking log group: " + itlg->name);
+		// Adjust evaluation order according to statistics collected so far
+		this->reorderPatterns(&(*itlg));
 
-		// Loop log files in each group
 		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
-			this->log->debug("Checking log file: " + itlf->path);
-
-			// Simple log rotation check (based on file size change)
-			if (cstat::stat(itlf->path.c_str(), &buffer) == 0) {
-				fileSize = (intmax_t)buffer.st_size;
-				if (fileSize < itlf->size) {
-					itlf->bookmark = 0;
-					this->log->warning("Last known size reset for " + itlf->path);
-					this->data->updateFile(itlf->path);
-				}
-				this->log->debug("Current size: " + std::to_string(fileSize) + " Last known size: " + std::to_string(itlf->size));
-			} else {
+			if (cstat::stat(itlf->path.c_str(), &buffer) != 0) {
 				this->log->error("Unable to open file " + itlf->path + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
 				continue;
 			}
+			std::pair<unsigned long long int, unsigned long long int> key((unsigned long long int)buffer.st_dev, (unsigned long long int)buffer.st_ino);
+			itsi = sharedFileIndex.find(key);
+			if (itsi == sharedFileIndex.end()) {
+				hb::SharedLogFile sharedFile;
+				sharedFile.path = itlf->path;
+				sharedFile.size = (intmax_t)buffer.st_size;
+				sharedFile.inode = key.second;
+				sharedFiles.push_back(sharedFile);
+				itsi = sharedFileIndex.insert(std::make_pair(key, sharedFiles.size() - 1)).first;
+			}
+			sharedFiles[itsi->second].subscribers.push_back(std::make_pair(&(*itlg), &(*itlf)));
+			// Syslog program routing
+			for (itpr = itlg->programs.begin(); itpr != itlg->programs.end(); ++itpr) {
+				sharedFiles[itsi->second].programs[*itpr].push_back(sharedFiles[itsi->second].subscribers.size() - 1);
+				sharedFiles[itsi->second].tagged = true;
+			}
+		}
+	}
 
-			// Check log file
-			std::ifstream is(itlf->path, std::ifstream::binary);
-			if (is && is.is_open()) {
-				// Seek to last known position
-				is.seekg(itlf->bookmark, is.beg);
-
-				// For comparision after log check to see if bookmark has changed and datafile needs to be updated
-				initialBookmark = itlf->bookmark;
-
-				// Calculate total job to do
-				jobTotal = fileSize - initialBookmark;
-
-				// Read new lines until end of file
-				while (std::getline(is, line)) {
-
-					// Match patterns
-					for (itlp = itlg->patterns.begin(); itlp != itlg->patterns.end(); ++itlp) {
-						try {
-
-							/*
-							 * Match line with pattern
-							 * Note, using regex groups to get IP address and port
-							 * http://www.cplusplus.com/reference/regex/ECMAScript/#groups
-							 * Match results:
-							 *   index 0 - whole match
-							 *   index 1 - IP address
-							 *   index 2 - port (optional)
-							 */
-							if (std::regex_match(line, patternMatchResults, itlp->pattern)) {
-								if (patternMatchResults.size() > 1) {
-
-									// IP address
-									ipAddress = std::string(patternMatchResults[1]);
-									this->log->debug("Suspicious acitivity pattern match! Address: " + ipAddress + " Score: " + std::to_string(itlp->score));
-									// TODO check that this result is actually an IP address
-
-									// Port
-									if (itlp->portSearch) {
-										if (patternMatchResults.size() > 2) {
-											port = std::string(patternMatchResults[2]);
-											// TODO check that this regex result is actually a port (0 - 65535)
-										} else {
-											this->log->warning("Port search is specified in pattern, but was not found in matched line!");
-											port = "";
-										}
-									}
-
-									// Update address data
-									this->data->saveActivity(ipAddress, itlp->score, 1, 0);
-
-									// Check whether need to send report about match
-									sendReport = false;
-									reportCategories.clear();
-									reportComment = "";
-									if (this->config->abuseipdbKey.size() > 0) {
-										// Need to send if have global setting
-										if (this->config->abuseipdbReportAll) {
-											sendReport = true;
-										}
-										reportCategories = this->config->abuseipdbDefaultCategories;
-										if (this->config->abuseipdbDefaultCommentIsSet) {
-											reportComment = this->config->abuseipdbDefaultComment;
-										}
-										// Log group setting overrides global setting
-										if (itlg->abuseipdbReport == Report::True) {
-											sendReport = true;
-										} else if (itlg->abuseipdbReport == Report::False) {
-											sendReport = false;
-										}
-										if (itlg->abuseipdbCategories.size() > 0) {
-											reportCategories = itlg->abuseipdbCategories;
-										}
-										if (itlg->abuseipdbCommentIsSet) {
-											reportComment = itlg->abuseipdbComment;
-										}
-										// Pattern setting overrides log group setting
-										if (itlp->abuseipdbReport == Report::True) {
-											sendReport = true;
-										} else if (itlp->abuseipdbReport == Report::False) {
-											sendReport = false;
-										}
-										if (itlp->abuseipdbCategories.size() > 0) {
-											reportCategories = itlp->abuseipdbCategories;
-										}
-										if (itlp->abuseipdbCommentIsSet) {
-											reportComment = itlp->abuseipdbComment;
-										}
-									}
-
-									// Do not report whitelisted addresses
-									if (this->data->suspiciousAddresses.count(ipAddress) > 0 && this->data->suspiciousAddresses[ipAddress].whitelisted) {
-										sendReport = false;
-									}
-
-									// Check whether 15 minutes are passed since last report
-									// TODO implement config parameter and use 15 minutes as min with default 1h
-									if (sendReport) {
-										if (this->data->suspiciousAddresses.count(ipAddress) > 0) {
-											if (currentTime - this->data->suspiciousAddresses[ipAddress].lastReported < 900) {
-												this->log->debug("Not enqueuing report about " + ipAddress + " more often than each 15 minutes!");
-												sendReport = false;
-											} else {
-												this->data->suspiciousAddresses[ipAddress].lastReported = currentTime;
-												// this->data->updateAddress(ipAddress);
-											}
-										} else {
-											this->log->warning("Need to send report about address " + ipAddress + ", but data about it is not found in data file! Skipping!");
-											sendReport = false;
-										}
-									}
-
-									// Search for %i, %p and %m placeholders in comment and replace with data if needed
-									if (sendReport) {
-										posc = reportComment.find("%i");
-										if (posc != std::string::npos) {
-											reportComment = reportComment.replace(posc, 2, ipAddress);
-										}
-										posc = reportComment.find("%p");
-										if (posc != std::string::npos) {
-											if (itlp->portSearch) {
-												reportComment = reportComment.replace(posc, 2, port);
-											} else {
-												this->log->warning("Comment template contains port placeholder, but port is not found in matched line! Adjust pattern or comment to avoid this warning!");
-											}
-										}
-										posc = reportComment.find("%m");
-										if (posc != std::string::npos) {
-											reportComment = reportComment.replace(posc, 2, line);
-											if (this->config->abuseipdbReportMask) {
-												// Mask all hostname occurrences
-												posh = reportComment.find(this->hostname);
-												while (posh != std::string::npos) {
-													reportComment = reportComment.replace(posh, this->hostname.length(), std::string(this->hostname.length(), '*'));
-													posh = reportComment.find(this->hostname, posh);
-												}
-												// Mask all IP address occurrences
-												for (std::vector<std::string>::iterator it = this->ipAddresses.begin(); it != this->ipAddresses.end(); ++it) {
-													posh = reportComment.find(*it);
-													while (posh != std::string::npos) {
-														reportComment = reportComment.replace(posh, (*it).length(), std::string((*it).length(), '*'));
-														posh = reportComment.find(*it, posh);
-													}
-												}
-											}
-										}
-										posc = reportComment.find("%d");
-										if (posc != std::string::npos) {
-											reportComment = reportComment.replace(posc, 2, currentTimeFormatted);
-										}
-									}
-
-									// Strip comment to 1500 characters
-									if (sendReport) {
-										if (reportComment.length() > 1500) {
-											reportComment = reportComment.substr(0, 1500);
-											this->log->warning("Comment for AbuseIPDB report is too long, length was reduced by removing characters from end!");
-										}
-									}
-
-									// Put report into queue for sending to AbuseIPDB
-									if (sendReport) {
-										ReportToAbuseIPDB reportToSend;
-										reportToSend.ip = ipAddress;
-										reportToSend.categories = reportCategories;
-										reportToSend.comment = reportComment;
-										this->abuseipdbReportingQueueMutex->lock();
-										this->abuseipdbReportingQueue->push(reportToSend);
-										this->abuseipdbReportingQueueMutex->unlock();
-										this->log->debug("Information about " + ipAddress + " is put into queue for sending to AbuseIPDB...");
-									}
-
-									this->log->debug("Match with pattern: " + itlp->patternString);
-
-									// Line matched with suspicious activity pattern, break the loop
-									break;
-								}
+	// Loop physical files, newest lines first
+	for (itsf = sharedFiles.begin(); itsf != sharedFiles.end(); ++itsf) {
+		this->log->debug("Checking log file: " + itsf->path + " (log groups: " + std::to_string(itsf->subscribers.size()) + ")");
 
-							}
+		// Log rotation check (file replaced by new file or size decreased), start reading from lowest position not processed yet
+		initialBookmark = itsf->size;
+		backlog = false;
+		this->readRotated(&(*itsf), currentTime, currentTimeFormatted);
+		for (itsb = itsf->subscribers.begin(); itsb != itsf->subscribers.end(); ++itsb) {
+			if (itsb->second->inode != 0 && itsb->second->inode != itsf->inode) {
+				itsb->second->bookmark = 0;
+				itsb->second->tailStart = 0;
+				itsb->second->tailEnd = 0;
+				itsb->second->size = 0;
+				itsb->second->inode = itsf->inode;
+				this->log->warning("Log file " + itsb->second->path + " replaced (inode changed), reading from start");
+				this->data->updateFile(itsb->second->path);
+			} else if (itsf->size < itsb->second->size) {
+				itsb->second->bookmark = 0;
+				itsb->second->tailStart = 0;
+				itsb->second->tailEnd = 0;
+				this->log->warning("Last known size reset for " + itsb->second->path);
+				this->data->updateFile(itsb->second->path);
+			}
+			this->log->debug("Log group: " + itsb->first->name + " Current size: " + std::to_string(itsf->size) + " Last known size: " + std::to_string(itsb->second->size));
+			if (itsb->second->tailEnd > itsb->second->tailStart) {
+				backlog = true;
+				if (itsb->second->tailEnd < initialBookmark) {
+					initialBookmark = itsb->second->tailEnd;
+				}
+			} else if (itsb->second->bookmark < initialBookmark) {
+				initialBookmark = itsb->second->bookmark;
+			}
+		}
 
-						} catch (std::regex_error& e) {
-							std::string message = e.what();
-							this->log->error(message + ": " + std::to_string(e.code()));
-							this->log->error(hb::Util::regexErrorCode2Text(e.code()));
-						}
-					}
+		// Large backlog, read newest lines first (older lines are backfilled later)
+		bytesDone = 0;
+		if (this->config->newestWindow > 0 && !this->historic && !backlog && itsf->size - initialBookmark > this->config->newestWindow) {
+			this->log->info("Log file " + itsf->path + " is " + std::to_string(itsf->size - initialBookmark) + " bytes behind, reading newest " + std::to_string(this->config->newestWindow) + " bytes first");
+			bytesDone = this->readLines(&(*itsf), itsf->size - this->config->newestWindow, ULLONG_MAX, true, false, currentTime, currentTimeFormatted);
+		}
 
-					// Check refused patterns
-					for (itlp = itlg->refusedPatterns.begin(); itlp != itlg->refusedPatterns.end(); ++itlp) {
-						try {
-
-							/*
-							 * Match line with pattern
-							 * Note, using regex groups to get IP address and port
-							 * http://www.cplusplus.com/reference/regex/ECMAScript/#groups
-							 * Match results:
-							 *   index 0 - whole match
-							 *   index 1 - IP address
-							 *   index 2 - port (optional)
-							 */
-							if (std::regex_match(line, patternMatchResults, itlp->pattern)) {
-								if (patternMatchResults.size() > 1) {
-
-									// IP address
-									ipAddress = std::string(patternMatchResults[1]);
-									this->log->debug("Blocked access pattern match! Address: " + ipAddress + " Score: " + std::to_string(itlp->score));
-									// TODO check that this result is actually an IP address
-
-									// Port
-									if (itlp->portSearch) {
-										if (patternMatchResults.size() > 2) {
-											port = std::string(patternMatchResults[2]);
-											// TODO check that this regex result is actually a port (0 - 65535)
-										} else {
-											this->log->warning("Port search is specified in pattern, but was not found in matched line!");
-											port = "";
-										}
-									}
-
-									// Update address data
-									if (this->data->suspiciousAddresses.count(ipAddress) > 0 || this->data->abuseIPDBBlacklist.count(ipAddress) > 0) {
-										this->data->saveActivity(ipAddress, itlp->score, 0, 1);
-
-										// Check whether need to send report about match
-										sendReport = false;
-										reportCategories.clear();
-										reportComment = "";
-										if (this->config->abuseipdbKey.size() > 0) {
-											// Need to send if have global setting
-											if (this->config->abuseipdbReportAll) {
-												sendReport = true;
-											}
-											reportCategories = this->config->abuseipdbDefaultCategories;
-											if (this->config->abuseipdbDefaultCommentIsSet) {
-												reportComment = this->config->abuseipdbDefaultComment;
-											}
-											// Log group setting overrides global setting
-											if (itlg->abuseipdbReport == Report::True) {
-												sendReport = true;
-											} else if (itlg->abuseipdbReport == Report::False) {
-												sendReport = false;
-											}
-											if (itlg->abuseipdbCategories.size() > 0) {
-												reportCategories = itlg->abuseipdbCategories;
-											}
-											if (itlg->abuseipdbCommentIsSet) {
-												reportComment = itlg->abuseipdbComment;
-											}
-											// Pattern setting overrides log group setting
-											if (itlp->abuseipdbReport == Report::True) {
-												sendReport = true;
-											} else if (itlp->abuseipdbReport == Report::False) {
-												sendReport = false;
-											}
-											if (itlp->abuseipdbCategories.size() > 0) {
-												reportCategories = itlp->abuseipdbCategories;
-											}
-											if (itlp->abuseipdbCommentIsSet) {
-												reportComment = itlp->abuseipdbComment;
-											}
-										}
-
-										// Do not report whitelisted addresses
-										if (this->data->suspiciousAddresses.count(ipAddress) > 0 && this->data->suspiciousAddresses[ipAddress].whitelisted) {
-											sendReport = false;
-										}
-
-										// Check whether 15 minutes are passed since last report
-										// TODO implement config parameter and use 15 minutes as min with default 1h
-										if (sendReport) {
-											if (this->data->suspiciousAddresses.count(ipAddress) > 0) {
-												if (currentTime - this->data->suspiciousAddresses[ipAddress].lastReported < 900) {
-													this->log->debug("Not enqueuing report about " + ipAddress + " more often than each 15 minutes!");
-													sendReport = false;
-												} else {
-													this->data->suspiciousAddresses[ipAddress].lastReported = currentTime;
-													// this->data->updateAddress(ipAddress);
-												}
-											} else {
-												this->log->warning("Need to send report about address " + ipAddress + ", but data about it is not found in data file! Skipping!");
-												sendReport = false;
-											}
-										}
-
-										// Search for %i, %p and %m placeholders in comment and replace with data if needed
-										if (sendReport) {
-											posc = reportComment.find("%i");
-											if (posc != std::string::npos) {
-												reportComment = reportComment.replace(posc, 2, ipAddress);
-											}
-											posc = reportComment.find("%p");
-											if (posc != std::string::npos) {
-												if (itlp->portSearch) {
-													reportComment = reportComment.replace(posc, 2, port);
-												} else {
-													this->log->warning("Comment template contains port placeholder, but port is not found in matched line! Adjust pattern or comment to avoid this warning!");
-												}
-											}
-											posc = reportComment.find("%m");
-											if (posc != std::string::npos) {
-												if (this->config->abuseipdbReportMask) {
-													// TODO put in loop, there can be multiple occurrences
-													posh = line.find(this->hostname);
-													if (posh != std::string::npos) {
-														reportComment = reportComment.replace(posc, 2, line.substr(0, posh) + std::string(this->hostname.length(), '*') + line.substr(posh + this->hostname.length()));
-													} else {
-														reportComment = reportComment.replace(posc, 2, line);
-													}
-												} else {
-													reportComment = reportComment.replace(posc, 2, line);
-												}
-											}
-											posc = reportComment.find("%d");
-											if (posc != std::string::npos) {
-												reportComment = reportComment.replace(posc, 2, currentTimeFormatted);
-											}
-										}
-
-										// Strip comment to 1500 characters
-										if (sendReport) {
-											if (reportComment.length() > 1500) {
-												reportComment = reportComment.substr(0, 1500);
-												this->log->warning("Comment for AbuseIPDB report is too long, length was reduced by removing characters from end!");
-											}
-										}
-
-										// Put report into queue for sending to AbuseIPDB
-										if (sendReport) {
-											ReportToAbuseIPDB reportToSend;
-											reportToSend.ip = ipAddress;
-											reportToSend.categories = reportCategories;
-											reportToSend.comment = reportComment;
-											this->abuseipdbReportingQueueMutex->lock();
-											this->abuseipdbReportingQueue->push(reportToSend);
-											this->abuseipdbReportingQueueMutex->unlock();
-											this->log->debug("Information about " + ipAddress + " is put into queue for sending to AbuseIPDB...");
-										}
-									} else {
-										this->log->warning("Matched blocked access pattern, but no previous information about suspicious activity, skipping...");
-									}
-
-									this->log->debug("Match with pattern: " + itlp->patternString);
-
-									// Line matched with blocked access pattern, break the loop
-									break;
-								}
+		// No newest first reading, or last line is longer than window
+		if (bytesDone == 0) {
+			bytesDone = this->readLines(&(*itsf), initialBookmark, ULLONG_MAX, false, false, currentTime, currentTimeFormatted);
+		}
 
-							}
+		// Update last known file size and datafile (once for each path)
+		updatedPaths.clear();
+		for (itsb = itsf->subscribers.begin(); itsb != itsf->subscribers.end(); ++itsb) {
+			itsb->second->size = itsf->size;
+			inodeChanged = itsb->second->inode != itsf->inode;
+			itsb->second->inode = itsf->inode;
+			if ((bytesDone > 0 || inodeChanged) && updatedPaths.count(itsb->second->path) == 0) {
+				this->data->updateFile(itsb->second->path);
+				updatedPaths.insert(itsb->second->path);
+			}
+		}
+	}
 
-						} catch (std::regex_error& e) {
-							std::string message = e.what();
-							this->log->error(message + ": " + std::to_string(e.code()));
-							this->log->error(hb::Util::regexErrorCode2Text(e.code()));
-						}
+	// Backfill lines skipped by newest first reading, at lower priority (after new lines of all files and limited by bytes per check)
+	this->backfillPending = 0;
+	for (itsf = sharedFiles.begin(); itsf != sharedFiles.end(); ++itsf) {
+		initialBookmark = itsf->size;
+		backfillEnd = 0;
+		for (itsb = itsf->subscribers.begin(); itsb != itsf->subscribers.end(); ++itsb) {
+			if (itsb->second->tailEnd > itsb->second->tailStart) {
+				if (itsb->second->bookmark < initialBookmark) {
+					initialBookmark = itsb->second->bookmark;
+				}
+				if (itsb->second->tailStart > backfillEnd) {
+					backfillEnd = itsb->second->tailStart;
+				}
+			}
+		}
+		if (backfillEnd <= initialBookmark) {
+			continue;
+		}
+		if (this->config->backfillBytes > 0 && !this->historic && backfillEnd - initialBookmark > backfillBudget) {
+			this->backfillPending += backfillEnd - initialBookmark - backfillBudget;
+			backfillEnd = initialBookmark + backfillBudget;
+		}
+		if (backfillEnd <= initialBookmark) {
+			continue;
+		}
+		this->log->debug("Backfilling log file: " + itsf->path + " from: " + std::to_string(initialBookmark) + " to: " + std::to_string(backfillEnd));
+		bytesDone = this->readLines(&(*itsf), initialBookmark, backfillEnd, false, true, currentTime, currentTimeFormatted);
+		this->bytesBackfilled += bytesDone;
+		if (this->config->backfillBytes > 0 && !this->historic) {
+			backfillBudget -= bytesDone < backfillBudget ? bytesDone : backfillBudget;
+		}
+
+		// Update datafile (once for each path)
+		updatedPaths.clear();
+		backlog = false;
+		for (itsb = itsf->subscribers.begin(); itsb != itsf->subscribers.end(); ++itsb) {
+			if (itsb->second->tailEnd > itsb->second->tailStart) {
+				backlog = true;
+			}
+			if (bytesDone > 0 && updatedPaths.count(itsb->second->path) == 0) {
+				this->data->updateFile(itsb->second->path);
+				updatedPaths.insert(itsb->second->path);
+			}
+		}
+		if (!backlog) {
+			this->log->info("Backfill of log file " + itsf->path + " finished");
+		}
+	}
+
+	// Detach persister and firewall stages, saved records and queued rules are written first
+	if (this->pipeline != NULL) {
+		this->persister->drain();
+		this->firewallApplier->drain();
+		this->data->persister = NULL;
+		this->data->firewall = this->firewallApplier->firewall();
+		for (unsigned int l = 0; l < 2; l++) {
+			this->blockLatency[l] += this->firewallApplier->takeLatency(l);
+		}
+
+		// Data is brought in line with rules that failed to be applied and datafile with data if records failed to be written
+		std::vector<hb::FirewallJob> failedRules;
+		this->firewallApplier->takeFailed(&failedRules);
+		for (std::vector<hb::FirewallJob>::iterator itfr = failedRules.begin(); itfr != failedRules.end(); ++itfr) {
+			this->data->ruleFailed(itfr->append, itfr->rule);
+		}
+		unsigned long long int failedRecords = this->persister->takeFailed();
+		if (failedRecords > 0) {
+			this->log->warning(std::to_string(failedRecords) + " datafile records failed to be written, datafile is saved again");
+			this->data->saveData();
+		}
+	}
+
+	// Pattern statistics and check duration
+	if (this->metrics != NULL) {
+		this->updateMetrics();
+		this->metrics->describe("hostblock_log_check_duration_seconds", "gauge", "Duration of last log file check");
+		this->metrics->set("hostblock_log_check_duration_seconds", "", std::chrono::duration<double>(std::chrono::steady_clock::now() - checkStart).count());
+		this->metrics->describe("hostblock_log_lines_read_total", "counter", "Lines read from log files (shared files are read once for all log groups)");
+		this->metrics->set("hostblock_log_lines_read_total", "", this->linesRead);
+		this->metrics->describe("hostblock_log_bytes_read_total", "counter", "Bytes read from log files");
+		this->metrics->set("hostblock_log_bytes_read_total", "", this->bytesRead);
+		this->metrics->describe("hostblock_log_lines_skipped_by_program_total", "counter", "Lines not matched with patterns of log group because of syslog program");
+		this->metrics->set("hostblock_log_lines_skipped_by_program_total", "", this->linesSkippedByProgram);
+		this->metrics->describe("hostblock_matches_whitelisted_total", "counter", "Pattern matches ignored because address is in whitelisted range");
+		this->metrics->set("hostblock_matches_whitelisted_total", "", this->matchesWhitelisted);
+		this->metrics->describe("hostblock_blocks_total", "counter", "Addresses blocked right after pattern match, by lane (priority - high severity patterns)");
+		this->metrics->describe("hostblock_block_latency_seconds_total", "counter", "Total time from reading line to firewall rule, by lane (priority - high severity patterns)");
+		for (unsigned int l = 0; l < 2; l++) {
+			this->metrics->set("hostblock_blocks_total", Metrics::labels({{"lane", l == 1 ? "priority" : "normal"}}), this->blocks[l]);
+			this->metrics->set("hostblock_block_latency_seconds_total", Metrics::labels({{"lane", l == 1 ? "priority" : "normal"}}), this->blockLatency[l]);
+		}
+		this->metrics->describe("hostblock_log_backfill_bytes_total", "counter", "Bytes of older lines read after newest lines (newest first reading)");
+		this->metrics->set("hostblock_log_backfill_bytes_total", "", this->bytesBackfilled);
+		this->metrics->describe("hostblock_log_backfill_pending_bytes", "gauge", "Bytes of older lines left for backfill in next log file checks");
+		this->metrics->set("hostblock_log_backfill_pending_bytes", "", this->backfillPending);
+		this->metrics->describe("hostblock_overload_activations_total", "counter", "Times overload mode was switched on (log file too far behind)");
+		this->metrics->set("hostblock_overload_activations_total", "", this->overloadActivations);
+		this->metrics->describe("hostblock_reports_shed_total", "counter", "Reports to AbuseIPDB not enqueued because of overload mode");
+		this->metrics->set("hostblock_reports_shed_total", "", this->reportsShed);
+		this->metrics->describe("hostblock_log_lines_shed_total", "counter", "Lines not matched with patterns of log group because of overload mode");
+		this->metrics->clear("hostblock_log_lines_shed_total");
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			this->metrics->set("hostblock_log_lines_shed_total", Metrics::labels({{"group", itlg->name}}), itlg->linesShed);
+		}
+		this->metrics->describe("hostblock_pipeline_busy_seconds_total", "counter", "Time stage of log file check was busy, reader (reading lines), matcher (worker of matcher pool), aggregator (applying matches), persister (datafile records) and firewall (rules)");
+		this->metrics->describe("hostblock_pipeline_utilization", "gauge", "Share of last log file check stage was busy, stage with highest utilization is bottleneck");
+		this->metrics->describe("hostblock_pipeline_stalls_total", "counter", "Times stage waited because ring to next stage was full, reader (matcher is bottleneck), matcher and aggregator (stage after it is bottleneck)");
+		this->metrics->describe("hostblock_pipeline_failures_total", "counter", "Datafile records (persister) and firewall rules (firewall) that failed to be written by stage");
+		this->metrics->clear("hostblock_pipeline_busy_seconds_total");
+		this->metrics->clear("hostblock_pipeline_utilization");
+		this->metrics->clear("hostblock_pipeline_stalls_total");
+		this->metrics->clear("hostblock_pipeline_failures_total");
+		if (this->pipeline != NULL) {
+			double checkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - checkStart).count();
+			std::vector<double> stageAfter = {this->readerTime - this->readerWait - this->aggregatorTime, this->aggregatorTime};
+			std::vector<std::string> stageLabels = {Metrics::labels({{"stage", "reader"}}), Metrics::labels({{"stage", "aggregator"}})};
+			for (std::size_t w = 0; w < this->pipeline->size(); w++) {
+				stageAfter.push_back(this->pipeline->busy(w));
+				stageLabels.push_back(Metrics::labels({{"stage", "matcher"}, {"worker", std::to_string(w)}}));
+				this->metrics->set("hostblock_pipeline_stalls_total", stageLabels.back(), this->pipeline->stalls(w));
+			}
+			stageAfter.push_back(this->persister->busy());
+			stageLabels.push_back(Metrics::labels({{"stage", "persister"}}));
+			this->metrics->set("hostblock_pipeline_failures_total", stageLabels.back(), this->persister->failed());
+			stageAfter.push_back(this->firewallApplier->busy());
+			stageLabels.push_back(Metrics::labels({{"stage", "firewall"}}));
+			this->metrics->set("hostblock_pipeline_failures_total", stageLabels.back(), this->firewallApplier->failed());
+			this->metrics->set("hostblock_pipeline_stalls_total", stageLabels[0], this->readerStalls);
+			this->metrics->set("hostblock_pipeline_stalls_total", stageLabels[1], this->persister->stalls() + this->firewallApplier->stalls());
+			for (std::size_t i = 0; i < stageAfter.size(); i++) {
+				this->metrics->set("hostblock_pipeline_busy_seconds_total", stageLabels[i], stageAfter[i]);
+				this->metrics->set("hostblock_pipeline_utilization", stageLabels[i], checkSeconds > 0 && i < stageBefore.size() ? (stageAfter[i] - stageBefore[i]) / checkSeconds : 0);
+			}
+		}
+		this->metrics->describe("hostblock_container_lines_total", "counter", "Container log lines (json-file) by result (unescaped, skipped - rejected before unescaping, invalid)");
+		this->metrics->set("hostblock_container_lines_total", Metrics::labels({{"result", "unescaped"}}), this->containerLinesUnescaped);
+		this->metrics->set("hostblock_container_lines_total", Metrics::labels({{"result", "skipped"}}), this->containerLinesSkipped);
+		this->metrics->set("hostblock_container_lines_total", Metrics::labels({{"result", "invalid"}}), this->containerLinesInvalid);
+		this->metrics->describe("hostblock_log_rotations_followed_total", "counter", "Rotated log files read to the end after log file was replaced");
+		this->metrics->set("hostblock_log_rotations_followed_total", "", this->rotationsFollowed);
+		this->metrics->describe("hostblock_correlation_ids", "gauge", "IDs kept in state of correlation rule");
+		this->metrics->describe("hostblock_correlation_ids_max", "gauge", "Max count of IDs kept by correlation rule (memory limit)");
+		this->metrics->describe("hostblock_correlation_evictions_total", "counter", "IDs removed from full state of correlation rule before TTL");
+		this->metrics->describe("hostblock_correlation_expirations_total", "counter", "IDs removed from state of correlation rule because of TTL");
+		this->metrics->describe("hostblock_correlation_hits_total", "counter", "Lines matched with match pattern of correlation rule, by whether ID was known (result)");
+		this->metrics->clear("hostblock_correlation_ids");
+		this->metrics->clear("hostblock_correlation_ids_max");
+		this->metrics->clear("hostblock_correlation_evictions_total");
+		this->metrics->clear("hostblock_correlation_expirations_total");
+		this->metrics->clear("hostblock_correlation_hits_total");
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (std::vector<hb::CorrelationRule>::iterator itcr = itlg->correlations.begin(); itcr != itlg->correlations.end(); ++itcr) {
+				std::string labels = Metrics::labels({{"group", itlg->name}, {"index", std::to_string(itcr->index)}});
+				this->metrics->set("hostblock_correlation_ids", labels, itcr->table->size());
+				this->metrics->set("hostblock_correlation_ids_max", labels, itcr->table->capacity);
+				this->metrics->set("hostblock_correlation_evictions_total", labels, itcr->table->evictions);
+				this->metrics->set("hostblock_correlation_expirations_total", labels, itcr->table->expirations);
+				this->metrics->set("hostblock_correlation_hits_total", Metrics::labels({{"group", itlg->name}, {"index", std::to_string(itcr->index)}, {"result", "hit"}}), itcr->hits);
+				this->metrics->set("hostblock_correlation_hits_total", Metrics::labels({{"group", itlg->name}, {"index", std::to_string(itcr->index)}, {"result", "miss"}}), itcr->misses);
+			}
+		}
+	}
+}
+
+/*
+ * Read lines written to rotated log files (path.1, same inode as before rotation) after last check
+ * Log groups of replaced file are grouped by rotated file, so that rotated file shared by log groups is read once
+ */
+void LogParser::readRotated(hb::SharedLogFile* current, time_t currentTime, const std::string& currentTimeFormatted)
+{
+	struct cstat::stat buffer;
+	std::vector<std::pair<hb::LogGroup*, hb::LogFile*>>::iterator itsb;
+	std::vector<std::string>::iterator itpr;
+	std::map<std::string, hb::SharedLogFile> rotatedFiles;
+	std::map<std::string, hb::SharedLogFile>::iterator itrf;
+	unsigned long long int start;
+
+	for (itsb = current->subscribers.begin(); itsb != current->subscribers.end(); ++itsb) {
+		if (itsb->second->inode == 0 || itsb->second->inode == current->inode) {
+			continue;
+		}
+		itrf = rotatedFiles.find(itsb->second->path);
+		if (itrf == rotatedFiles.end()) {
+			hb::SharedLogFile rotated;
+			rotated.path = itsb->second->path + ".1";
+			rotated.rotated = true;
+			if (cstat::stat(rotated.path.c_str(), &buffer) == 0) {
+				rotated.size = (intmax_t)buffer.st_size;
+				rotated.inode = (unsigned long long int)buffer.st_ino;
+			}
+			itrf = rotatedFiles.insert(std::make_pair(itsb->second->path, rotated)).first;
+		}
+		if (itrf->second.inode != itsb->second->inode || itrf->second.size <= itsb->second->bookmark) {
+			continue;
+		}
+		itrf->second.subscribers.push_back(*itsb);
+		for (itpr = itsb->first->programs.begin(); itpr != itsb->first->programs.end(); ++itpr) {
+			itrf->second.programs[*itpr].push_back(itrf->second.subscribers.size() - 1);
+			itrf->second.tagged = true;
+		}
+	}
+
+	// Lines are read from lowest bookmark, lines processed by log group already are skipped for it
+	for (itrf = rotatedFiles.begin(); itrf != rotatedFiles.end(); ++itrf) {
+		if (itrf->second.subscribers.size() == 0) {
+			continue;
+		}
+		start = ULLONG_MAX;
+		for (itsb = itrf->second.subscribers.begin(); itsb != itrf->second.subscribers.end(); ++itsb) {
+			if (itsb->second->bookmark < start) {
+				start = itsb->second->bookmark;
+			}
+		}
+		this->log->info("Reading rest of rotated log file " + itrf->second.path + " from: " + std::to_string(start) + " (log groups: " + std::to_string(itrf->second.subscribers.size()) + ")");
+		this->rotationsFollowed++;
+		this->readLines(&itrf->second, start, ULLONG_MAX, false, false, currentTime, currentTimeFormatted);
+	}
+}
+
+/*
+ * Message of container log line (json-file), decoded once for all log groups of file and unescaped only if needed
+ */
+bool LogParser::containerMessage(hb::LogGroup* group, const std::string& line, int* state)
+{
+	static const std::string field = "log";
+	bool escaped = false;
+	std::vector<hb::Pattern>::iterator itpa;
+
+	if (*state == 0) {
+		if (!Util::jsonStringField(line, field, &this->messageStart, &this->messageEnd, &escaped)) {
+			*state = -1;
+			this->containerLinesInvalid++;
+		} else if (escaped) {
+			*state = 2;
+		} else {
+			*state = 1;
+			this->messageBuffer.assign(line, this->messageStart, this->messageEnd - this->messageStart);
+		}
+	}
+	if (*state != 2) {
+		return *state == 1;
+	}
+
+	// Literals required by patterns are never escaped, so line without any of them can not match
+	if (group->rawPrefilter) {
+		for (itpa = group->patterns.begin(); itpa != group->patterns.end(); ++itpa) {
+			if (Util::containsLiteral(line, itpa->literal)) {
+				break;
+			}
+		}
+		if (itpa == group->patterns.end()) {
+			for (itpa = group->refusedPatterns.begin(); itpa != group->refusedPatterns.end(); ++itpa) {
+				if (Util::containsLiteral(line, itpa->literal)) {
+					break;
+				}
+			}
+			if (itpa == group->refusedPatterns.end()) {
+				this->containerLinesSkipped++;
+				return false;
+			}
+		}
+	}
+	Util::jsonUnescape(line, this->messageStart, this->messageEnd, &this->messageBuffer);
+	this->containerLinesUnescaped++;
+	*state = 1;
+	return true;
+}
+
+/*
+ * Read lines of physical file starting from offset until end offset (lines starting before it) or end of file, pass them to log groups that have not processed them yet
+ * If align is set, start is not known beginning of line, so reading starts from next line
+ * Returns count of bytes read
+ */
+unsigned long long int LogParser::readLines(hb::SharedLogFile* file, unsigned long long int start, unsigned long long int end, bool align, bool backfill, time_t currentTime, const std::string& currentTimeFormatted)
+{
+	std::vector<std::pair<hb::LogGroup*, hb::LogFile*>>::iterator itsb;
+	std::unordered_map<std::string, std::vector<std::size_t>>::iterator itpg;
+	const std::vector<std::size_t>* programSubscribers = NULL;
+	std::size_t programStart = 0, programLength = 0;
+	bool routed = false;
+	int messageState = 0;
+	struct cstat::stat buffer;
+	unsigned long long int position = start, lineStart = 0;
+	std::string& line = this->lineBuffer;
+	time_t lastInfo = currentTime;
+	unsigned long long int jobTotal = 0, jobDone = 0;
+	float jobPercentage = 0;
+	unsigned long long int fileLines = 0, behind = 0;
+	std::chrono::steady_clock::time_point readStart = std::chrono::steady_clock::now(), waitStart;
+	double readSeconds = 0, lag = 0;
+	// Backfill is not urgent, so it never switches parser to overload mode
+	bool overloadCheck = !backfill && !this->historic && (this->config->overloadBytes > 0 || this->config->overloadLag > 0);
+
+	std::ifstream is(file->path, std::ifstream::binary);
+	if (!is || !is.is_open()) {
+		this->log->error("Unable to open file " + file->path + " for reading!");
+		return 0;
+	}
+
+	// Seek to start, skip rest of line if start might be in the middle of line
+	if (align && start > 0) {
+		is.seekg(start - 1, is.beg);
+		std::getline(is, line);
+		position = start - 1 + line.length() + (is.eof() ? 0 : 1);
+		start = position;
+	} else {
+		is.seekg(start, is.beg);
+	}
+
+	// Calculate total job to do
+	jobTotal = (end < file->size ? end : file->size) - (start < file->size ? start : file->size);
+
+	// Read new lines until end offset or end of file
+	while (position < end && std::getline(is, line)) {
+		lineStart = position;
+		position += line.length() + (is.eof() ? 0 : 1);
+		this->lineReadTime = std::chrono::steady_clock::now();
+		this->linesRead++;
+		this->bytesRead += position - lineStart;
+
+		// Overload check at start of file and then after each 1000 lines, lag is estimated from read speed so far
+		if (overloadCheck && fileLines++ % 1000 == 0 && cstat::stat(file->path.c_str(), &buffer) == 0) {
+			behind = (unsigned long long int)buffer.st_size > position ? (unsigned long long int)buffer.st_size - position : 0;
+			readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart).count();
+			lag = (position > start && readSeconds > 0) ? (double)behind / ((double)(position - start) / readSeconds) : 0;
+			// Caught up rotated file says nothing about live file behind it
+			if (LogParser::overloaded(this->overload, behind, lag, this->config->overloadBytes, this->config->overloadLag) != this->overload && (!this->overload || !file->rotated)) {
+				this->overload = !this->overload;
+				if (this->overload) {
+					this->overloadActivations++;
+					this->linesShedBefore = this->linesShed;
+					this->reportsShedBefore = this->reportsShed;
+					this->log->warning("Log file " + file->path + " is " + std::to_string(behind) + " bytes behind (estimated lag " + std::to_string((unsigned long long int)lag) + " sec), overload mode on");
+				} else {
+					this->log->info("Log file " + file->path + " caught up, overload mode off, lines shed: " + std::to_string(this->linesShed - this->linesShedBefore) + ", reports shed: " + std::to_string(this->reportsShed - this->reportsShedBefore));
+				}
+			}
+		}
+
+		// Syslog program routing, lines without recognizable header are passed to all log groups
+		routed = false;
+		programSubscribers = NULL;
+		if (file->tagged && Util::syslogProgram(line, &programStart, &programLength)) {
+			routed = true;
+			this->programKey.assign(line, programStart, programLength);
+			itpg = file->programs.find(this->programKey);
+			if (itpg != file->programs.end()) {
+				programSubscribers = &itpg->second;
+			}
+		}
+
+		// Pass line to each log group that has not processed it yet
+		messageState = 0;
+		for (itsb = file->subscribers.begin(); itsb != file->subscribers.end(); ++itsb) {
+			if (!LogParser::isProcessed(itsb->second, lineStart)) {
+				if (routed && itsb->first->programs.size() > 0 && (programSubscribers == NULL || std::find(programSubscribers->begin(), programSubscribers->end(), (std::size_t)(itsb - file->subscribers.begin())) == programSubscribers->end())) {
+					this->linesSkippedByProgram++;
+				} else if (this->overload && itsb->first->overloadSample != 1 && (itsb->first->overloadSample == 0 || itsb->first->overloadLines++ % itsb->first->overloadSample != 0)) {
+					// Overload mode, line of sampled log group is shed
+					itsb->first->linesShed++;
+					this->linesShed++;
+				} else if (itsb->first->source == LogSource::DockerJson) {
+					if (this->containerMessage(itsb->first, line, &messageState)) {
+						this->dispatchLine(itsb->first, this->messageBuffer, currentTime, currentTimeFormatted);
 					}
+				} else {
+					this->dispatchLine(itsb->first, line, currentTime, currentTimeFormatted);
+				}
+
+				// Update bookmark
+				LogParser::markProcessed(itsb->second, lineStart, position);
+			}
+		}
+
+		// TODO Check log rotation after each 500 lines (this process can be long running)
+		// if (cstat::stat(file->path.c_str(), &buffer) == 0) {
+
+		// }
+
+		// TODO Respond on daemon main loop quit request
+		// if (!running) {
+		// 	// Update datafile
+		// 	if (initialBookmark != position) {
+		// 		this->data->updateFile(file->path);
+		// 	}
+		// 	// Break the loop
+		// 	break;
+		// }
+
+		// Sleep (not in overload mode or historic log replay)
+		if (!this->overload && !this->historic) {
+			cunistd::usleep(10);
+		}
+
+		// Output some info to log file each min
+		time(&currentTime);
+		if (currentTime - lastInfo >= 60) {
+			jobDone = position - start;
+			jobPercentage = (float)jobDone * 100 / (float)jobTotal;
+			this->log->info("Processing " + file->path + ", progress: " + std::to_string(jobPercentage) + "%");
+			lastInfo = currentTime;
+		}
+	}
+	this->log->debug("Finished reading until " + std::string(position < end ? "end of file" : "end offset") + ", pos: " + std::to_string(position));
+
+	// Wait until matcher pool has matched all lines of file, so that bookmark is saved only after lines are applied
+	if (this->pipeline != NULL) {
+		while (this->pipeline->pending()) {
+			if (this->collectMatches(currentTime, currentTimeFormatted) == 0) {
+				waitStart = std::chrono::steady_clock::now();
+				std::this_thread::yield();
+				this->readerWait += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+			}
+		}
+		this->pipeline->mergeCounters(&this->config->logGroups);
+	}
+	this->readerTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart).count();
+
+	// End of live file reached, so log file is not behind anymore
+	if (this->overload && !backfill && !file->rotated) {
+		this->overload = false;
+		this->log->info("Log file " + file->path + " caught up, overload mode off, lines shed: " + std::to_string(this->linesShed - this->linesShedBefore) + ", reports shed: " + std::to_string(this->reportsShed - this->reportsShedBefore));
+	}
+
+	// Close file
+	is.close();
+
+	return position - start;
+}
+
+/*
+ * Pass line of log group to matcher pool, or match it right away if there is no pool
+ */
+void LogParser::dispatchLine(hb::LogGroup* group, const std::string& line, time_t currentTime, const std::string& currentTimeFormatted)
+{
+	if (this->pipeline == NULL) {
+		this->lineJob.group = group;
+		this->lineJob.refusedCheck = !this->overload;
+		this->lineJob.readTime = this->lineReadTime;
+		MatchPipeline::match(&this->lineJob, line, &this->matchResults, &this->fields, NULL);
+		if (this->lineJob.pattern >= 0 || this->lineJob.refused >= 0 || this->lineJob.correlationCount > 0 || this->lineJob.errorCode != 0) {
+			this->processLine(&this->lineJob, line, currentTime, currentTimeFormatted);
+		}
+		return;
+	}
+
+	// Ring of next worker is full, apply matched lines or wait for worker (backpressure)
+	hb::MatchJob* job = NULL;
+	std::chrono::steady_clock::time_point waitStart;
+	while ((job = this->pipeline->claim()) == NULL) {
+		if (this->collectMatches(currentTime, currentTimeFormatted) == 0) {
+			this->readerStalls++;
+			waitStart = std::chrono::steady_clock::now();
+			std::this_thread::yield();
+			this->readerWait += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+		}
+	}
+	job->group = group;
+	job->groupIndex = group - this->config->logGroups.data();
+	job->line.assign(line);
+	job->refusedCheck = !this->overload;
+	job->readTime = this->lineReadTime;
+	this->pipeline->submit();
+
+	// Apply lines matched so far, so that aggregator keeps up with reader
+	this->collectMatches(currentTime, currentTimeFormatted);
+}
+
+/*
+ * Apply lines matched by matcher pool to data in order of lines (aggregator), returns count of lines applied
+ */
+unsigned long long int LogParser::collectMatches(time_t currentTime, const std::string& currentTimeFormatted)
+{
+	hb::MatchJob* job = this->pipeline->next();
+	if (job == NULL) {
+		return 0;
+	}
+	unsigned long long int count = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (; job != NULL; job = this->pipeline->next()) {
+		// Line without match is done
+		if (job->pattern >= 0 || job->refused >= 0 || job->correlationCount > 0 || job->errorCode != 0) {
+			this->processLine(job, job->line, currentTime, currentTimeFormatted);
+		}
+		this->pipeline->release();
+		count++;
+	}
+	this->aggregatorTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return count;
+}
+
+/*
+ * Whether line starting at offset is already processed (before bookmark or in processed range after it)
+ */
+bool LogParser::isProcessed(const hb::LogFile* file, unsigned long long int offset)
+{
+	return offset < file->bookmark || (file->tailStart <= offset && offset < file->tailEnd);
+}
 
-					// Update bookmark
-					itlf->bookmark = is.tellg();
-
-					// TODO Check log rotation after each 500 lines (this process can be long running)
-					// if (cstat::stat(itlf->path.c_str(), &buffer) == 0) {
-
-					// }
-
-					// TODO Respond on daemon main loop quit request
-					// if (!running) {
-					// 	// Update datafile
-					// 	if (initialBookmark != itlf->bookmark) {
-					// 		this->data->updateFile(itlf->path);
-					// 	}
-					// 	// Break the loop
-					// 	break;
-					// }
-
-					// Sleep
-					cunistd::usleep(10);
-
-					// Output some info to log file each min
-					time(&currentTime);
-					if (currentTime - lastInfo >= 60) {
-						jobDone = itlf->bookmark - initialBookmark;
-						jobPercentage = (float)jobDone * 100 / (float)jobTotal;
-						this->log->info("Processing " + itlf->path + ", progress: " + std::to_string(jobPercentage) + "%");
-						lastInfo = currentTime;
+/*
+ * Add range to processed ranges of log file, range that fills gap before processed range after bookmark merges both into bookmark
+ * Note, newest first reading keeps at most one range after bookmark, range that is not adjacent to existing one is not recorded
+ */
+void LogParser::markProcessed(hb::LogFile* file, unsigned long long int start, unsigned long long int end)
+{
+	if (start <= file->bookmark) {
+		if (end > file->bookmark) {
+			file->bookmark = end;
+		}
+		if (file->tailEnd > file->tailStart && file->bookmark >= file->tailStart) {
+			if (file->tailEnd > file->bookmark) {
+				file->bookmark = file->tailEnd;
+			}
+			file->tailStart = 0;
+			file->tailEnd = 0;
+		}
+	} else if (file->tailEnd <= file->tailStart) {
+		file->tailStart = start;
+		file->tailEnd = end;
+	} else if (start <= file->tailEnd && end >= file->tailStart) {
+		file->tailStart = std::min(file->tailStart, start);
+		file->tailEnd = std::max(file->tailEnd, end);
+	}
+}
+
+/*
+ * Apply line matched with patterns of log group (captures of job) to data, update correlation state and enqueue reports
+ */
+void LogParser::processLine(const hb::MatchJob* job, const std::string& line, time_t currentTime, const std::string& currentTimeFormatted)
+{
+	std::vector<hb::Pattern>::iterator itlp;
+	std::vector<hb::CorrelationRule>::iterator itcr;
+	bool sendReport = false;
+	bool blockedBefore = false;
+	unsigned int lane = 0;
+	hb::LogGroup* group = job->group;
+	// No debug message formatting in overload mode
+	bool debug = this->log->isDebug() && !this->overload;
+	// Buffer is member, its capacity is reused between lines
+	std::string& ipAddress = this->ipAddressBuffer;
+
+	if (job->errorCode != 0) {
+		this->log->error("Failed to match line of log group " + group->name + ": " + std::to_string(job->errorCode));
+		this->log->error(hb::Util::regexErrorCode2Text((std::regex_constants::error_type)job->errorCode));
+	}
+
+	// Suspicious activity pattern
+	if (job->pattern >= 0) {
+		itlp = group->patterns.begin() + job->pattern;
+		itlp->hits++;
+		const std::string& port = job->port;
+		if (debug) this->log->debug("Suspicious acitivity pattern match! Address: " + job->address + " Score: " + std::to_string(itlp->score));
+		// TODO check that this result is actually an IP address
+
+		// Matches from whitelisted address ranges are ignored (no score, no datafile record, no report)
+		if (this->config->addressRanges.lookup(job->address) == hb::Whitelist) {
+			this->matchesWhitelisted++;
+			if (debug) this->log->debug("Address " + job->address + " is in whitelisted range, match ignored");
+		} else {
+			// Port
+			if (job->portMissing) {
+				this->log->warning("Port search is specified in pattern, but was not found in matched line!");
+			}
+			// TODO check that this regex result is actually a port (0 - 65535)
+
+			// Update address data, high severity match goes to priority lane and blocks address right away
+			if (this->historic) {
+				this->setActivityTime(group, line, currentTime);
+			}
+			std::map<std::string, hb::SuspiciosAddressType>::iterator sait = this->data->suspiciousAddresses.find(job->address);
+			blockedBefore = sait != this->data->suspiciousAddresses.end() && sait->second.iptableRule;
+			lane = itlp->severity == Severity::High ? 1 : 0;
+			// With firewall stage decision is applied when its rule is appended, so rules appended now carry time line was read
+			if (this->firewallApplier != NULL) {
+				this->firewallApplier->trace(blockedBefore ? -1 : (int)lane, job->readTime);
+			}
+			this->data->saveActivity(job->address, itlp->score, 1, 0, &itlp->rate, itlp->severity == Severity::High);
+			if (this->firewallApplier != NULL) {
+				this->firewallApplier->trace(-1, job->readTime);
+			}
+			if (!blockedBefore && this->data->suspiciousAddresses[job->address].iptableRule) {
+				this->blocks[lane]++;
+				// From line read to applied decision, so time line waited for matcher and aggregator is included in both lanes
+				if (this->firewallApplier == NULL) {
+					this->blockLatency[lane] += std::chrono::duration<double>(std::chrono::steady_clock::now() - job->readTime).count();
+				}
+			}
+
+			// Check whether need to send report about match (policy is resolved when patterns are processed)
+			sendReport = itlp->reportPolicy->report;
+
+			// Reports are shed in overload mode, old matches are not reported
+			if (sendReport && this->overload) {
+				this->reportsShed++;
+				sendReport = false;
+			}
+			if (this->historic) {
+				sendReport = false;
+			}
+
+			// Do not report whitelisted addresses
+			if (this->data->suspiciousAddresses.count(job->address) > 0 && this->data->suspiciousAddresses[job->address].whitelisted) {
+				sendReport = false;
+			}
+
+			// Check whether 15 minutes are passed since last report
+			// TODO implement config parameter and use 15 minutes as min with default 1h
+			if (sendReport) {
+				if (this->data->suspiciousAddresses.count(job->address) > 0) {
+					if (currentTime - this->data->suspiciousAddresses[job->address].lastReported < 900) {
+						if (debug) this->log->debug("Not enqueuing report about " + job->address + " more often than each 15 minutes!");
+						sendReport = false;
+					} else {
+						this->data->suspiciousAddresses[job->address].lastReported = currentTime;
+						// this->data->updateAddress(job->address);
 					}
+				} else {
+					this->log->warning("Need to send report about address " + job->address + ", but data about it is not found in data file! Skipping!");
+					sendReport = false;
 				}
-				this->log->debug("Finished reading until end of file, pos: " + std::to_string(itlf->bookmark));
+			}
 
-				// Close file
-				is.close();
+			// Render comment from template, mask hostname, IP addresses and configured phrases in matched line
+			if (sendReport) {
+				this->renderComment(itlp->reportPolicy.get(), job->address, port, line, currentTimeFormatted, &this->commentBuffer);
+			}
+
+			// Strip comment to 1500 characters
+			if (sendReport) {
+				if (this->commentBuffer.length() > 1500) {
+					this->commentBuffer.resize(1500);
+					this->log->warning("Comment for AbuseIPDB report is too long, length was reduced by removing characters from end!");
+				}
+			}
+
+			// Put report into queue for sending to AbuseIPDB
+			if (sendReport) {
+				ReportToAbuseIPDB reportToSend;
+				reportToSend.ip = job->address;
+				reportToSend.policy = itlp->reportPolicy;
+				reportToSend.comment = this->commentBuffer;
+				this->abuseipdbReportingQueueMutex->lock();
+				this->abuseipdbReportingQueue->push(std::move(reportToSend));
+				this->abuseipdbReportingQueueMutex->unlock();
+				if (debug) this->log->debug("Information about " + job->address + " is put into queue for sending to AbuseIPDB...");
+			}
+
+			if (debug) this->log->debug("Match with pattern #" + std::to_string(itlp->index) + ": " + itlp->patternString);
+		}
+	}
 
-				// Update last known file size
-				itlf->size = fileSize;
+	// Correlation rules, start line maps ID to address, match line with known ID is scored as activity of address
+	for (std::size_t c = 0; c < job->correlationCount; c++) {
+		const hb::CorrelationCapture& capture = job->correlations[c];
+		itcr = group->correlations.begin() + capture.rule;
+		if (capture.start) {
+			if (this->config->addressRanges.lookup(capture.address) == hb::Whitelist) {
+				this->matchesWhitelisted++;
+				continue;
+			}
+			itcr->starts++;
+			if (this->historic) {
+				this->setActivityTime(group, line, currentTime);
+			}
+			itcr->table->insert(capture.id, capture.address, this->data->activityTime > 0 ? this->data->activityTime : currentTime);
+			if (debug) this->log->debug("Correlation rule #" + std::to_string(itcr->index) + " start, ID: " + capture.id + " Address: " + capture.address);
+		} else {
+			if (this->historic) {
+				this->setActivityTime(group, line, currentTime);
+			}
+			if (!itcr->table->lookup(capture.id, this->data->activityTime > 0 ? this->data->activityTime : currentTime, &ipAddress)) {
+				itcr->misses++;
+				continue;
+			}
+			itcr->hits++;
+			if (debug) this->log->debug("Correlated match with rule #" + std::to_string(itcr->index) + "! ID: " + capture.id + " Address: " + ipAddress + " Score: " + std::to_string(itcr->score));
+			this->data->saveActivity(ipAddress, itcr->score, 1, 0);
+		}
+	}
 
-				// Update datafile
-				if (initialBookmark != itlf->bookmark) {
-					this->data->updateFile(itlf->path);
+	// Blocked access pattern (refused patterns are skipped in overload mode)
+	if (job->refused < 0 || this->overload) {
+		return;
+	}
+	itlp = group->refusedPatterns.begin() + job->refused;
+	itlp->hits++;
+	const std::string& port = job->refusedPort;
+	if (debug) this->log->debug("Blocked access pattern match! Address: " + job->refusedAddress + " Score: " + std::to_string(itlp->score));
+	// TODO check that this result is actually an IP address
+
+	// Matches from whitelisted address ranges are ignored (no score, no datafile record, no report)
+	if (this->config->addressRanges.lookup(job->refusedAddress) == hb::Whitelist) {
+		this->matchesWhitelisted++;
+		if (debug) this->log->debug("Address " + job->refusedAddress + " is in whitelisted range, match ignored");
+		return;
+	}
+
+	// Port
+	if (job->refusedPortMissing) {
+		this->log->warning("Port search is specified in pattern, but was not found in matched line!");
+	}
+	// TODO check that this regex result is actually a port (0 - 65535)
+
+	// Update address data
+	if (this->data->suspiciousAddresses.count(job->refusedAddress) > 0 || this->data->abuseIPDBBlacklist.count(job->refusedAddress) > 0) {
+		if (this->historic) {
+			this->setActivityTime(group, line, currentTime);
+		}
+		this->data->saveActivity(job->refusedAddress, itlp->score, 0, 1);
+
+		// Check whether need to send report about match (policy is resolved when patterns are processed), old matches are not reported
+		sendReport = itlp->reportPolicy->report && !this->historic;
+
+		// Do not report whitelisted addresses
+		if (this->data->suspiciousAddresses.count(job->refusedAddress) > 0 && this->data->suspiciousAddresses[job->refusedAddress].whitelisted) {
+			sendReport = false;
+		}
+
+		// Check whether 15 minutes are passed since last report
+		// TODO implement config parameter and use 15 minutes as min with default 1h
+		if (sendReport) {
+			if (this->data->suspiciousAddresses.count(job->refusedAddress) > 0) {
+				if (currentTime - this->data->suspiciousAddresses[job->refusedAddress].lastReported < 900) {
+					if (debug) this->log->debug("Not enqueuing report about " + job->refusedAddress + " more often than each 15 minutes!");
+					sendReport = false;
+				} else {
+					this->data->suspiciousAddresses[job->refusedAddress].lastReported = currentTime;
+					// this->data->updateAddress(job->refusedAddress);
 				}
 			} else {
-				this->log->error("Unable to open file " + itlf->path + " for reading!");
-				continue;
+				this->log->warning("Need to send report about address " + job->refusedAddress + ", but data about it is not found in data file! Skipping!");
+				sendReport = false;
 			}
+		}
+
+		// Render comment from template, mask hostname, IP addresses and configured phrases in matched line
+		if (sendReport) {
+			this->renderComment(itlp->reportPolicy.get(), job->refusedAddress, port, line, currentTimeFormatted, &this->commentBuffer);
+		}
+
+		// Strip comment to 1500 characters
+		if (sendReport) {
+			if (this->commentBuffer.length() > 1500) {
+				this->commentBuffer.resize(1500);
+				this->log->warning("Comment for AbuseIPDB report is too long, length was reduced by removing characters from end!");
+			}
+		}
+
+		// Put report into queue for sending to AbuseIPDB
+		if (sendReport) {
+			ReportToAbuseIPDB reportToSend;
+			reportToSend.ip = job->refusedAddress;
+			reportToSend.policy = itlp->reportPolicy;
+			reportToSend.comment = this->commentBuffer;
+			this->abuseipdbReportingQueueMutex->lock();
+			this->abuseipdbReportingQueue->push(std::move(reportToSend));
+			this->abuseipdbReportingQueueMutex->unlock();
+			if (debug) this->log->debug("Information about " + job->refusedAddress + " is put into queue for sending to AbuseIPDB...");
+		}
+	} else {
+		this->log->warning("Matched blocked access pattern, but no previous information about suspicious activity, skipping...");
+	}
+
+	if (debug) this->log->debug("Match with pattern #" + std::to_string(itlp->index) + ": " + itlp->patternString);
+}
+
+/*
+ * Activity time for historic log replay, time parsed from line (or last parsed time of log group if line has no timestamp, current time if there is none)
+ */
+void LogParser::setActivityTime(hb::LogGroup* group, const std::string& line, time_t currentTime)
+{
+	unsigned long long int logTime = 0;
+	if (group->timeFormat.length() > 0 && Util::parseLogTime(line, group->timeFormat, this->utcOffset, (unsigned long long int)currentTime, &logTime)) {
+		group->lastLogTime = logTime;
+	} else {
+		this->timestampsMissing++;
+	}
+	this->data->activityTime = group->lastLogTime;
+}
+
+/*
+ * Whether parser should be in overload mode, switched on when any threshold is reached and off when all are below half of threshold (hysteresis)
+ */
+bool LogParser::overloaded(bool current, unsigned long long int behind, double lag, unsigned long long int bytesLimit, unsigned int lagLimit)
+{
+	if (current) {
+		return (bytesLimit > 0 && behind >= bytesLimit / 2) || (lagLimit > 0 && lag >= (double)lagLimit / 2);
+	}
+	return (bytesLimit > 0 && behind >= bytesLimit) || (lagLimit > 0 && lag >= (double)lagLimit);
+}
+
+/*
+ * Render AbuseIPDB comment from compiled template into buffer (single pass, buffer capacity is reused)
+ */
+void LogParser::renderComment(const hb::ReportPolicy* policy, const std::string& ipAddress, const std::string& port, const std::string& line, const std::string& currentTimeFormatted, std::string* output)
+{
+	std::vector<hb::CommentToken>::const_iterator itt;
+	output->clear();
+	for (itt = policy->comment.begin(); itt != policy->comment.end(); ++itt) {
+		switch (itt->placeholder) {
+			case 'i':
+				output->append(ipAddress);
+				break;
+			case 'p':
+				output->append(port);
+				break;
+			case 'm':
+				if (this->config->abuseipdbReportMask && !this->masker.empty()) {
+					this->masker.mask(line, output);
+				} else {
+					output->append(line);
+				}
+				break;
+			case 'd':
+				output->append(currentTimeFormatted);
+				break;
+			default:
+				output->append(itt->text);
+		}
+	}
+}
 
+/*
+ * Expected evaluation cost until match, mean cost divided by probability of match (smoothed so that patterns without hits are not infinite)
+ */
+double LogParser::patternRank(hb::Pattern* pattern)
+{
+	double meanCost = pattern->evaluations > 0 ? pattern->cost / pattern->evaluations : 0.0;
+	double probability = ((double)pattern->hits + 1.0) / ((double)pattern->evaluations + 2.0);
+	return meanCost / probability;
+}
+
+/*
+ * Order patterns by rank, most likely and cheapest first, ties keep configured order
+ */
+void LogParser::sortPatterns(std::vector<hb::Pattern>* patterns, std::vector<unsigned int>* order, std::string description)
+{
+	unsigned long long int evaluations = 0;
+	for (std::vector<hb::Pattern>::iterator itp = patterns->begin(); itp != patterns->end(); ++itp) {
+		evaluations += itp->evaluations;
+	}
+	if (evaluations < this->reorderMinEvaluations) {
+		return;
+	}
+
+	std::vector<unsigned int> newOrder = *order;
+	std::stable_sort(newOrder.begin(), newOrder.end(), [patterns](unsigned int a, unsigned int b) {
+		return LogParser::patternRank(&(*patterns)[a]) < LogParser::patternRank(&(*patterns)[b]);
+	});
+	if (newOrder != *order) {
+		*order = newOrder;
+		std::string orderS = "";
+		for (std::vector<unsigned int>::iterator ito = order->begin(); ito != order->end(); ++ito) {
+			if (ito != order->begin()) orderS += ", ";
+			orderS += std::to_string((*patterns)[*ito].index);
+		}
+		this->log->info("Evaluation order of " + description + " changed to: " + orderS);
+	}
+}
+
+/*
+ * Reorder pattern evaluation in log group if allowed
+ */
+void LogParser::reorderPatterns(hb::LogGroup* group)
+{
+	if (group->reorderPatterns) {
+		this->sortPatterns(&group->patterns, &group->patternOrder, group->name + " patterns");
+	}
+	if (group->reorderRefusedPatterns) {
+		this->sortPatterns(&group->refusedPatterns, &group->refusedPatternOrder, group->name + " refused patterns");
+	}
+}
+
+/*
+ * Publish pattern statistics to metrics, patterns are identified by log group, type and configured position
+ */
+void LogParser::updateMetrics()
+{
+	std::vector<hb::LogGroup>::iterator itlg;
+	std::vector<hb::Pattern>* patterns;
+	std::vector<unsigned int>* order;
+	std::string labels;
+
+	this->metrics->describe("hostblock_pattern_evaluations_total", "counter", "Lines pattern was evaluated for since config load");
+	this->metrics->describe("hostblock_pattern_hits_total", "counter", "Lines matched by pattern since config load");
+	this->metrics->describe("hostblock_pattern_cost_seconds_total", "counter", "Time spent on pattern evaluation (prefilter and regex) since config load");
+	this->metrics->describe("hostblock_pattern_position", "gauge", "Current position of pattern in evaluation order (starting from 1)");
+
+	// Patterns might be removed with config reload
+	this->metrics->clear("hostblock_pattern_evaluations_total");
+	this->metrics->clear("hostblock_pattern_hits_total");
+	this->metrics->clear("hostblock_pattern_cost_seconds_total");
+	this->metrics->clear("hostblock_pattern_position");
+
+	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+		for (unsigned int t = 0; t < 2; t++) {
+			patterns = (t == 0) ? &itlg->patterns : &itlg->refusedPatterns;
+			order = (t == 0) ? &itlg->patternOrder : &itlg->refusedPatternOrder;
+			for (unsigned int position = 0; position < order->size(); position++) {
+				hb::Pattern* pattern = &(*patterns)[(*order)[position]];
+				labels = Metrics::labels({{"group", itlg->name}, {"type", (t == 0) ? "pattern" : "refused"}, {"index", std::to_string(pattern->index)}});
+				this->metrics->set("hostblock_pattern_evaluations_total", labels, pattern->evaluations);
+				this->metrics->set("hostblock_pattern_hits_total", labels, pattern->hits);
+				this->metrics->set("hostblock_pattern_cost_seconds_total", labels, pattern->cost / 1e9);
+				this->metrics->set("hostblock_pattern_position", labels, position + 1);
+			}
 		}
 	}
 }
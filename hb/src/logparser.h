@@ -9,6 +9,8 @@
 #include <queue>
 // Mutex
 #include <mutex>
+// Unordered map
+#include <unordered_map>
 // Util
 #include "util.h"
 // Logger
@@ -17,9 +19,30 @@
 #include "config.h"
 // Data
 #include "data.h"
+// Metrics
+#include "metrics.h"
+// Masker
+#include "masker.h"
+// Native log format parsers
+#include "nativeparser.h"
+// Matcher pool
+#include "pipeline.h"
 
 namespace hb{
 
+/*
+ * Physical log file (same device and inode) referenced by one or more log groups
+ */
+struct SharedLogFile {
+	std::string path = "";// Path used to open file (first configured)
+	unsigned long long int size = 0;// Current file size
+	std::vector<std::pair<hb::LogGroup*, hb::LogFile*>> subscribers;// Log groups and their bookmarks for this file
+	std::unordered_map<std::string, std::vector<std::size_t>> programs;// Syslog program -> indexes of subscribers that declared it
+	bool tagged = false;// Whether any subscriber declared syslog programs
+	unsigned long long int inode = 0;// Inode of file, changes when file is replaced by log rotation
+	bool rotated = false;// Rest of rotated file, live file is still to be read after it
+};
+
 class LogParser{
 	private:
 
@@ -33,6 +56,103 @@ class LogParser{
 		 */
 		std::vector<std::string> ipAddresses;
 
+		/*
+		 * Read lines of physical file from start until end offset or end of file, pass them to log groups that have not processed them yet
+		 * If align is set, reading starts from next line after start, backfill reading never switches to overload mode
+		 * Rotated file reading only switches overload mode on, it is switched off by reading of live file
+		 * Returns count of bytes read
+		 */
+		unsigned long long int readLines(hb::SharedLogFile* file, unsigned long long int start, unsigned long long int end, bool align, bool backfill, time_t currentTime, const std::string& currentTimeFormatted);
+
+		/*
+		 * Read lines written to rotated log files (path.1, same inode as before rotation) after last check, once for all log groups of file
+		 */
+		void readRotated(hb::SharedLogFile* current, time_t currentTime, const std::string& currentTimeFormatted);
+
+		/*
+		 * Message of container log line (json-file), decoded once for all log groups of file and unescaped only if needed
+		 * State: 0 - not decoded yet, 1 - message in buffer, 2 - message escaped (not unescaped yet), -1 - invalid line
+		 * Returns whether message is in buffer
+		 */
+		bool containerMessage(hb::LogGroup* group, const std::string& line, int* state);
+
+		/*
+		 * Apply line matched with patterns of log group (captures of job) to data, update correlation state and enqueue reports
+		 * Line is matched by reader or by worker of matcher pool, it is not matched again
+		 */
+		void processLine(const hb::MatchJob* job, const std::string& line, time_t currentTime, const std::string& currentTimeFormatted);
+
+		/*
+		 * Pass line of log group to matcher pool, or match it right away if there is no pool
+		 */
+		void dispatchLine(hb::LogGroup* group, const std::string& line, time_t currentTime, const std::string& currentTimeFormatted);
+
+		/*
+		 * Apply lines matched by matcher pool to data in order of lines (aggregator), returns count of lines applied
+		 */
+		unsigned long long int collectMatches(time_t currentTime, const std::string& currentTimeFormatted);
+
+		/*
+		 * Matcher pool (log.match.threads), NULL if lines are matched by reader
+		 */
+		std::shared_ptr<hb::MatchPipeline> pipeline;
+
+		/*
+		 * Persister and firewall stages, run with matcher pool while log files are checked (attached to data by checkFiles)
+		 */
+		std::shared_ptr<hb::RecordPersister> persister;
+		std::shared_ptr<hb::FirewallApplier> firewallApplier;
+
+		/*
+		 * Masker for matched line in AbuseIPDB report comments
+		 */
+		hb::Masker masker;
+
+		/*
+		 * Buffers reused between lines, so that line processing does not allocate in steady state
+		 */
+		std::string lineBuffer;// Current line
+		std::chrono::steady_clock::time_point lineReadTime;// Time current line was read, start of block latency
+		std::string commentBuffer;// AbuseIPDB report comment
+		hb::MatchJob lineJob;// Line matched by reader (without matcher pool)
+		std::string ipAddressBuffer;// Address of correlated ID
+		std::string messageBuffer;// Message of container log line
+		std::size_t messageStart = 0;// Position of message in container log line
+		std::size_t messageEnd = 0;
+		std::string programKey;// Syslog program of line (hash lookup key)
+		std::smatch matchResults;// Regex match results
+		hb::LogFields fields;// Fields of line parsed by native parser of log group
+
+		/*
+		 * UTC offset of local time (seconds), for log timestamps without time zone
+		 */
+		long int utcOffset = 0;
+
+		/*
+		 * Activity time for historic log replay, time parsed from line (or last parsed time of log group if line has no timestamp)
+		 */
+		void setActivityTime(hb::LogGroup* group, const std::string& line, time_t currentTime);
+
+		/*
+		 * Expected evaluation cost until match (lower is better)
+		 */
+		static double patternRank(hb::Pattern* pattern);
+
+		/*
+		 * Order patterns by rank, most likely and cheapest first
+		 */
+		void sortPatterns(std::vector<hb::Pattern>* patterns, std::vector<unsigned int>* order, std::string description);
+
+		/*
+		 * Reorder pattern evaluation in log group if allowed
+		 */
+		void reorderPatterns(hb::LogGroup* group);
+
+		/*
+		 * Publish pattern statistics to metrics
+		 */
+		void updateMetrics();
+
 	public:
 
 		/*
@@ -56,6 +176,82 @@ class LogParser{
 		std::queue<ReportToAbuseIPDB>* abuseipdbReportingQueue;
 		std::mutex* abuseipdbReportingQueueMutex;
 
+		/*
+		 * Metrics (optional)
+		 */
+		hb::Metrics* metrics = NULL;
+
+		/*
+		 * Min evaluation count in log group before patterns are reordered
+		 */
+		unsigned long long int reorderMinEvaluations = 1000;
+
+		/*
+		 * Total lines and bytes read from log files
+		 */
+		unsigned long long int linesRead = 0;
+		unsigned long long int bytesRead = 0;
+
+		/*
+		 * Lines not passed to log group because of syslog program routing
+		 */
+		unsigned long long int linesSkippedByProgram = 0;
+
+		/*
+		 * Pattern matches ignored because address is in whitelisted range
+		 */
+		unsigned long long int matchesWhitelisted = 0;
+
+		/*
+		 * Addresses blocked right after pattern match and total time from match to firewall rule
+		 * Index 0 - normal lane, 1 - priority lane (high severity patterns)
+		 */
+		unsigned long long int blocks[2] = {0, 0};
+		double blockLatency[2] = {0.0, 0.0};
+
+		/*
+		 * Overload mode (log file is too far behind), lines of log groups are sampled, refused patterns, reports and debug messages are skipped
+		 */
+		bool overload = false;
+		unsigned long long int overloadActivations = 0;
+		unsigned long long int linesShed = 0;// Lines not matched with patterns
+		unsigned long long int reportsShed = 0;// Reports not enqueued
+		unsigned long long int linesShedBefore = 0, reportsShedBefore = 0;// Shed counters when overload mode was switched on
+
+		/*
+		 * Historic log replay, matches are scored in log time (log.time.format of log group) and not reported
+		 * No throttling, overload mode or newest first reading, firewall and datafile are updated by caller (Data::batch)
+		 */
+		bool historic = false;
+		unsigned long long int timestampsMissing = 0;// Matched lines without parsable timestamp
+
+		/*
+		 * Bytes read by backfill (lines skipped by newest first reading) and bytes left for next checks
+		 */
+		unsigned long long int bytesBackfilled = 0;
+		unsigned long long int backfillPending = 0;
+
+		/*
+		 * Container log lines (json-file) unescaped, rejected before unescaping (no pattern literal in line) and not valid
+		 */
+		unsigned long long int containerLinesUnescaped = 0;
+		unsigned long long int containerLinesSkipped = 0;
+		unsigned long long int containerLinesInvalid = 0;
+
+		/*
+		 * Rotated log files read to the end after log file was replaced
+		 */
+		unsigned long long int rotationsFollowed = 0;
+
+		/*
+		 * Stage time of log file checks (seconds), total time of reading, time reader waited for matcher pool and time of applying matches (aggregator)
+		 * Reader stalls are times reader waited because ring of worker was full
+		 */
+		double readerTime = 0;
+		double readerWait = 0;
+		double aggregatorTime = 0;
+		unsigned long long int readerStalls = 0;
+
 		/*
 		 * Constructor
 		 */
@@ -66,6 +262,32 @@ class LogParser{
 		 */
 		void checkFiles();
 
+		/*
+		 * Whether parser should be in overload mode, switched on when any threshold is reached and off when all are below half of threshold (0 disables threshold)
+		 */
+		static bool overloaded(bool current, unsigned long long int behind, double lag, unsigned long long int bytesLimit, unsigned int lagLimit);
+
+		/*
+		 * Whether line starting at offset is already processed by log group (before bookmark or in processed range after it)
+		 */
+		static bool isProcessed(const hb::LogFile* file, unsigned long long int offset);
+
+		/*
+		 * Add range to processed ranges of log file, range that fills gap before processed range after bookmark merges both into bookmark
+		 */
+		static void markProcessed(hb::LogFile* file, unsigned long long int start, unsigned long long int end);
+
+		/*
+		 * Build masker for AbuseIPDB report comments (hostname, IP addresses and configured phrases)
+		 * Note, needs to be called after config reload
+		 */
+		void buildMasker();
+
+		/*
+		 * Render AbuseIPDB comment from compiled template into buffer (single pass, buffer capacity is reused)
+		 */
+		void renderComment(const hb::ReportPolicy* policy, const std::string& ipAddress, const std::string& port, const std::string& line, const std::string& currentTimeFormatted, std::string* output);
+
 };
 
 }
@@ -22,6 +22,12 @@
 #include <string>
 // Date and time manipulation
 #include <chrono>
+// C string (strncmp, strlen)
+#include <cstring>
+// Memory (unique_ptr)
+#include <memory>
+// Limits (HOST_NAME_MAX)
+#include <limits.h>
 // For libcurl in abuseipdb.h
 // Note, suspecting that unistd.h includes some headers that are also needed for socket.h, but it gets under cunistd namespace and cannot find type socklen_t...?
 #include <sys/socket.h>
@@ -53,6 +59,8 @@ namespace cstat{
 #include "logger.h"
 // Iptables
 #include "iptables.h"
+// Simulated firewall
+#include "simfirewall.h"
 // Config
 #include "config.h"
 // Data
@@ -61,10 +69,19 @@ namespace cstat{
 #include "logparser.h"
 // AbuseIPDB
 #include "abuseipdb.h"
+// Pattern profiler
+#include "profiler.h"
+// Peer sync
+#include "peersync.h"
+// Blocklist feeds
+#include "feed.h"
 
 // Full path to PID file
 const char* PID_PATH = "/var/run/hostblock.pid";
 
+// Full path to snapshot queued for import by daemon
+const char* SNAPSHOT_PATH = "/var/run/hostblock.snapshot";
+
 // Variables for loop and thread exception handling
 bool running = false;
 bool reportingThreadRunning = false;
@@ -76,6 +93,9 @@ bool reloadDataFile = false;
 // Variable for daemon to reload configuration
 bool reloadConfig = false;
 
+// Variable for daemon to import snapshot from SNAPSHOT_PATH
+bool importSnapshot = false;
+
 // Pending reports to be sent to 3rd party (abuse/suspicious activity reporting)
 std::queue<hb::ReportToAbuseIPDB> abuseipdbReportingQueue;
 std::mutex abuseipdbReportingQueueMutex;
@@ -106,6 +126,10 @@ void printUsage()
 	std::cout << " -r<IP address> | --remove=<IP address>    - remove IP address from data file (excluding AbuseIPDB blacklist)" << std::endl;
 	std::cout << " -d             | --daemon                 - run as daemon" << std::endl;
 	std::cout << "                | --sync-blacklist         - sync AbuseIPDB blacklist" << std::endl;
+	std::cout << "                | --profile-patterns [--json] [<log file>...] - measure configured patterns with sample log files (configured log files if not specified)" << std::endl;
+	std::cout << "                | --backfill-history       - read log files from bookmarks with activity scored in log time (log.time.format), then block addresses still over score" << std::endl;
+	std::cout << "                | --export-snapshot=<file> - save binary snapshot of addresses, lists and AbuseIPDB blacklist" << std::endl;
+	std::cout << "                | --import-snapshot=<file> - merge snapshot into data (running daemon imports it incrementally), then update firewall at once" << std::endl;
 }
 
 /*
@@ -123,6 +147,9 @@ void signalHandler(int signal)
 		// SIGUSR1 to tell daemon to reload data, config and restart threads if needed
 		reloadDataFile = true;
 		reloadConfig = true;
+	} else if (signal == SIGUSR2) {
+		// SIGUSR2 to tell daemon to import queued snapshot
+		importSnapshot = true;
 	}
 }
 
@@ -167,12 +194,12 @@ void reporterThread(hb::Logger* log, hb::Config* config)
 		abuseipdbReportingQueueMutex.unlock();
 		if (!isEmpty) {
 			abuseipdbReportingQueueMutex.lock();
-			itemToReport = abuseipdbReportingQueue.front();
+			itemToReport = std::move(abuseipdbReportingQueue.front());
 			abuseipdbReportingQueue.pop();
 			abuseipdbReportingQueueMutex.unlock();
 
 			// Send report
-			if (apiClient.reportAddress(itemToReport.ip, itemToReport.comment, itemToReport.categories)) {
+			if (apiClient.reportAddress(itemToReport.ip, itemToReport.comment, itemToReport.policy->categoryList)) {
 				log->info("Address " + itemToReport.ip + " reported to AbuseIPDB!");
 				log->debug("Comment: " + itemToReport.comment);
 			} else {
@@ -195,7 +222,7 @@ void reporterThread(hb::Logger* log, hb::Config* config)
 /*
  * Syncrhonize AbuseIPDB blacklist
  */
-void blacklistSync(hb::Logger* log, hb::Config* config, hb::Data* data, hb::Iptables* iptables)
+void blacklistSync(hb::Logger* log, hb::Config* config, hb::Data* data, hb::Firewall* firewall)
 {
 	clock_t cpuStart = clock(), cpuEnd = cpuStart;
 	auto wallStart = std::chrono::steady_clock::now(), wallEnd = wallStart;
@@ -291,6 +318,29 @@ void blacklistSync(hb::Logger* log, hb::Config* config, hb::Data* data, hb::Ipta
 	log->info("AbuseIPDB blacklist sync in " + std::to_string((double)(cpuEnd - cpuStart) / CLOCKS_PER_SEC) + " CPU sec (" + std::to_string((std::chrono::duration<double>(wallEnd - wallStart)).count()) + " sec)");
 }
 
+/*
+ * Start peer sync if it is configured, name of instance is host name unless configured
+ */
+hb::PeerSync* startPeerSync(hb::Logger* log, hb::Config* config)
+{
+	if (config->peerListen.length() == 0 && config->peerAddresses.size() == 0) {
+		return NULL;
+	}
+	std::string name = config->peerName;
+	if (name.length() == 0) {
+		char hname[HOST_NAME_MAX];
+		if (cunistd::gethostname(hname, HOST_NAME_MAX) == 0) {
+			hname[HOST_NAME_MAX - 1] = '\0';
+			name = std::string(hname);
+		}
+	}
+	hb::PeerSync* peerSync = new hb::PeerSync(log, name, config->peerHistory);
+	if (!peerSync->start(config->peerListen, config->peerAddresses, config->peerAllow)) {
+		log->error("Failed to start peer sync!");
+	}
+	return peerSync;
+}
+
 /*
  * Main
  */
@@ -317,6 +367,12 @@ int main(int argc, char *argv[])
 	bool whitelistFlag = false;
 	bool removeFlag = false;
 	bool syncBlacklistFlag = false;
+	bool profilePatternsFlag = false;
+	bool jsonFlag = false;
+	bool backfillHistoryFlag = false;
+	bool exportSnapshotFlag = false;
+	bool importSnapshotFlag = false;
+	std::string snapshotPath = "";
 	std::string ipAddress = "";
 	bool daemonFlag = false;
 
@@ -335,6 +391,12 @@ int main(int argc, char *argv[])
 		{"remove",         required_argument, 0, 'r'},
 		{"daemon",         no_argument,       0, 'd'},
 		{"sync-blacklist", no_argument,       0, 0},
+		{"profile-patterns", no_argument,     0, 0},
+		{"json",           no_argument,       0, 0},
+		{"backfill-history", no_argument,     0, 0},
+		{"export-snapshot", required_argument, 0, 0},
+		{"import-snapshot", required_argument, 0, 0},
+		{0, 0, 0, 0}
 	};
 
 	// Option index
@@ -346,6 +408,18 @@ int main(int argc, char *argv[])
 			case 0:
 				if (strncmp("sync-blacklist", long_options[option_index].name, strlen(long_options[option_index].name)) == 0) {
 					syncBlacklistFlag = true;
+				} else if (strncmp("profile-patterns", long_options[option_index].name, strlen(long_options[option_index].name)) == 0) {
+					profilePatternsFlag = true;
+				} else if (strncmp("json", long_options[option_index].name, strlen(long_options[option_index].name)) == 0) {
+					jsonFlag = true;
+				} else if (strncmp("backfill-history", long_options[option_index].name, strlen(long_options[option_index].name)) == 0) {
+					backfillHistoryFlag = true;
+				} else if (strncmp("export-snapshot", long_options[option_index].name, strlen(long_options[option_index].name)) == 0) {
+					exportSnapshotFlag = true;
+					snapshotPath = cunistd::optarg;
+				} else if (strncmp("import-snapshot", long_options[option_index].name, strlen(long_options[option_index].name)) == 0) {
+					importSnapshotFlag = true;
+					snapshotPath = cunistd::optarg;
 				} else {
 					printUsage();
 					exit(0);
@@ -396,19 +470,6 @@ int main(int argc, char *argv[])
 	// Syslog writter
 	hb::Logger log = hb::Logger(LOG_USER);
 
-	// To work with iptables
-	hb::Iptables iptables = hb::Iptables();
-	/*hb::Iptables* iptables;
-	try {
-		// hb::Iptables iptables = hb::Iptables();
-		iptables = hb::Iptables();
-	} catch (std::runtime_error& e) {
-		std::string message = e.what();
-		log.error(message);
-		std::cerr << message << std::endl;
-		exit(1);
-	}*/
-
 	// Init config, default path to config file is /etc/hostblock.conf
 	hb::Config config = hb::Config(&log, "/etc/hostblock.conf");
 
@@ -429,8 +490,38 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	// Profile patterns with sample log files, does not need datafile or firewall
+	if (profilePatternsFlag) {
+		if (!config.processPatterns()) {
+			std::cerr << "Failed to process patterns!" << std::endl;
+			exit(1);
+		}
+		std::vector<std::string> sampleFiles;
+		for (int i = cunistd::optind; i < argc; i++) {
+			sampleFiles.push_back(std::string(argv[i]));
+		}
+		hb::PatternProfiler profiler = hb::PatternProfiler(&log, &config);
+		if (!profiler.profile(sampleFiles)) {
+			exit(1);
+		}
+		if (jsonFlag) {
+			profiler.printJSON();
+		} else {
+			profiler.printTable();
+		}
+		exit(0);
+	}
+
+	// To work with iptables or with simulated (in-memory) firewall
+	hb::Iptables iptables = hb::Iptables();
+	hb::SimulatedFirewall simulatedFirewall(config.firewallSimulatedLatency, config.firewallSimulatedFailureRate / 100.0);
+	hb::Firewall* firewall = &iptables;
+	if (config.firewallBackend == "simulated") {
+		firewall = &simulatedFirewall;
+	}
+
 	// To work with datafile
-	hb::Data data = hb::Data(&log, &config, &iptables);
+	hb::Data data = hb::Data(&log, &config, firewall);
 
 	// Load datafile
 	if (!data.loadData()) {
@@ -583,7 +674,7 @@ int main(int argc, char *argv[])
 				exit(1);
 			} else {
 				// Check if there is iptables rule for this address
-				std::map<unsigned int, std::string> rules = iptables.listRules("INPUT");
+				std::map<unsigned int, std::string> rules = firewall->listRules("INPUT");
 				try {
 
 					// Regex to search for IP address
@@ -610,7 +701,7 @@ int main(int argc, char *argv[])
 									regexSearchResult = regexSearchResults[0].str();
 									if (regexSearchResult == ipAddress) {
 										// iptables rule found, remove from iptables
-										if (iptables.remove("INPUT", ruleStart + ipAddress + ruleEnd) == false) {
+										if (firewall->remove("INPUT", ruleStart + ipAddress + ruleEnd) == false) {
 											std::cerr << "Address " << ipAddress << " no longer needs iptables rule, but failed to remove rule from chain!" << std::endl;
 											log.error("Address " + ipAddress + " no longer needs iptables rule, but failed to remove rule from chain!");
 											exit(1);
@@ -664,7 +755,7 @@ int main(int argc, char *argv[])
 		std::cout << "Starting AbuseIPDB blacklist sync, please wait..." << std::endl;
 
 		try {
-			blacklistSync(&log, &config, &data, &iptables);
+			blacklistSync(&log, &config, &data, firewall);
 		} catch (std::runtime_error& e) {
 			std::string message = e.what();
 			log.error(message);
@@ -695,6 +786,115 @@ int main(int argc, char *argv[])
 
 		std::cout << "Finished" << std::endl;
 		exit(0);
+	} else if (backfillHistoryFlag) {// Replay log files with activity scored in log time, firewall rules are updated once at the end
+
+		// Datafile is rewritten at the end, so daemon must not run at the same time
+		struct cstat::stat buffer;
+		if (cstat::stat(PID_PATH, &buffer) == 0) {
+			std::ifstream f(PID_PATH);
+			if (f.is_open()){
+				std::string line;
+				std::getline(f, line);
+				pid_t pid = (pid_t)strtoul(line.c_str(), NULL, 10);
+				if (csignal::kill(pid, 0) == 0) {
+					std::cerr << "Unable to replay log files while hostblock daemon is running!" << std::endl;
+					exit(1);
+				}
+			}
+		}
+
+		// Parse regex patterns
+		if (!config.processPatterns()) {
+			std::cerr << "Failed to parse configured patterns!" << std::endl;
+			exit(1);
+		}
+
+		// Compare data with iptables rules
+		if (!data.checkIptables()) {
+			log.error("Failed to compare data with iptables...");
+		}
+
+		std::cout << "Reading log files, please wait..." << std::endl;
+		hb::LogParser logParser = hb::LogParser(&log, &config, &data, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
+		logParser.historic = true;
+		data.batch = true;
+		logParser.checkFiles();
+		data.batch = false;
+		data.activityTime = 0;
+
+		// Block addresses with score still high enough
+		if (!data.applyBatch()) {
+			std::cerr << "Failed to update firewall rules or datafile!" << std::endl;
+			exit(1);
+		}
+		unsigned int blocked = 0;
+		for (std::map<std::string, hb::SuspiciosAddressType>::iterator it = data.suspiciousAddresses.begin(); it != data.suspiciousAddresses.end(); ++it) {
+			if (it->second.iptableRule) {
+				blocked++;
+			}
+		}
+		std::cout << "Lines read: " << logParser.linesRead << ", matched lines without timestamp: " << logParser.timestampsMissing << ", blocked addresses: " << blocked << std::endl;
+
+		cpuEnd = clock();
+		wallEnd = std::chrono::steady_clock::now();
+		log.info("Log files replayed in " + std::to_string((double)(cpuEnd - cpuStart) / CLOCKS_PER_SEC) + " CPU sec (" + std::to_string((std::chrono::duration<double>(wallEnd - wallStart)).count()) + " sec)");
+		exit(0);
+	} else if (exportSnapshotFlag) {// Save binary snapshot of data
+		if (!data.exportSnapshot(snapshotPath)) {
+			std::cerr << "Failed to save snapshot!" << std::endl;
+			exit(1);
+		}
+		std::cout << "Snapshot saved with " << data.suspiciousAddresses.size() << " addresses and " << data.abuseIPDBBlacklist.size() << " AbuseIPDB blacklisted addresses" << std::endl;
+		exit(0);
+	} else if (importSnapshotFlag) {// Merge snapshot into data, firewall is updated once at the end
+		hb::SnapshotReader reader(&log);
+		if (!reader.open(snapshotPath)) {
+			std::cerr << "Failed to read snapshot!" << std::endl;
+			exit(1);
+		}
+
+		// If daemon is running, queue snapshot and signal daemon to import it
+		struct cstat::stat buffer;
+		if (cstat::stat(PID_PATH, &buffer) == 0) {
+			std::ifstream f(PID_PATH);
+			if (f.is_open()){
+				std::string line;
+				std::getline(f, line);
+				pid_t pid = (pid_t)strtoul(line.c_str(), NULL, 10);
+				if (csignal::kill(pid, 0) == 0) {
+					std::string queuedPath = std::string(SNAPSHOT_PATH) + ".tmp";
+					std::ifstream source(snapshotPath, std::ios::in | std::ios::binary);
+					std::ofstream target(queuedPath, std::ios::out | std::ios::binary | std::ios::trunc);
+					target << source.rdbuf();
+					target.close();
+					if (target.fail() || std::rename(queuedPath.c_str(), SNAPSHOT_PATH) != 0) {
+						std::cerr << "Failed to queue snapshot for daemon!" << std::endl;
+						exit(1);
+					}
+					if (csignal::kill(pid, SIGUSR2) != 0) {
+						std::cerr << "Daemon process detected, but failed to signal snapshot import!" << std::endl;
+						exit(1);
+					}
+					std::cout << "Snapshot with " << reader.records() << " records queued for import by daemon" << std::endl;
+					exit(0);
+				}
+			}
+		}
+
+		if (!data.importSnapshot(&reader, 0)) {
+			std::cerr << "Failed to import snapshot!" << std::endl;
+			exit(1);
+		}
+		if (!data.checkIptables() || !data.applyBatch()) {
+			std::cerr << "Failed to update firewall rules or datafile!" << std::endl;
+			exit(1);
+		}
+		std::cout << "Imported " << reader.records() << " records" << std::endl;
+
+		cpuEnd = clock();
+		wallEnd = std::chrono::steady_clock::now();
+		log.info("Snapshot imported in " + std::to_string((double)(cpuEnd - cpuStart) / CLOCKS_PER_SEC) + " CPU sec (" + std::to_string((std::chrono::duration<double>(wallEnd - wallStart)).count()) + " sec)");
+		exit(0);
 	} else if (daemonFlag) {// Run as daemon
 
 		// Check if file with PID exists
@@ -775,6 +975,7 @@ int main(int argc, char *argv[])
 				ruleStart = config.iptablesRule.substr(0, posip);
 				ruleEnd = config.iptablesRule.substr(posip + 2);
 			}
+			unsigned int subnetPrefixIPv4, subnetPrefixIPv6;// To detect subnet prefix length change on reload
 			std::map<unsigned int, std::string> rules;
 			std::map<unsigned int, std::string>::iterator rit;
 			std::size_t checkStart = 0, checkEnd = 0;
@@ -791,6 +992,7 @@ int main(int argc, char *argv[])
 			// Register signal handler
 			csignal::signal(SIGTERM, signalHandler);// Stop daemon
 			csignal::signal(SIGUSR1, signalHandler);// Reload datafile
+			csignal::signal(SIGUSR2, signalHandler);// Import snapshot
 
 			// Fire up thread for matched pattern reporting
 			reportingThreadRunning = true;// No need for mutex, no threads are running yet
@@ -804,6 +1006,34 @@ int main(int argc, char *argv[])
 			// Init object to work with log files (check for suspicious activity)
 			hb::LogParser logParser = hb::LogParser(&log, &config, &data, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
 
+			// Runtime metrics, written to file after each log file check if configured
+			hb::Metrics metrics;
+			logParser.metrics = &metrics;
+
+			// Peer sync, block decisions are shared with other hostblock instances
+			std::unique_ptr<hb::PeerSync> peerSync(startPeerSync(&log, &config));
+			std::vector<hb::PeerDelta> peerDeltas;
+			std::vector<hb::PeerDelta>::iterator itpd;
+			std::string peerListen;// To detect peer sync change on reload
+			std::vector<std::string> peerAddresses;
+			std::vector<std::string> peerAllow;
+			std::string peerName;
+			unsigned int peerHistory;
+			std::vector<unsigned int> rateBucketWidths;// To detect change of rate rules on reload
+
+			// Blocklist feeds, files in feed directory are loaded again when changed
+			hb::FeedWatcher feedWatcher(&log);
+			std::set<std::string> feedChanges;
+			std::set<std::string>::iterator itfc;
+			std::vector<hb::Prefix> feedEntries;
+			std::string feedDirectory = config.feedDirectory;
+			if (feedDirectory.length() > 0) {
+				feedWatcher.watch(feedDirectory);
+			}
+
+			// Snapshot queued for import, merged in parts so that log files are still checked
+			std::unique_ptr<hb::SnapshotReader> snapshotReader;
+
 			time_t lastFileMCheck, currentTime, lastLogCheck;
 			time(&lastFileMCheck);
 			lastLogCheck = lastFileMCheck - config.logCheckInterval;
@@ -826,6 +1056,14 @@ int main(int argc, char *argv[])
 					configMutex.lock();
 					ruleStart = config.iptablesRule.substr(0, posip);
 					ruleEnd = config.iptablesRule.substr(posip + 2);
+					subnetPrefixIPv4 = config.subnetPrefixIPv4;
+					subnetPrefixIPv6 = config.subnetPrefixIPv6;
+					peerListen = config.peerListen;
+					peerAddresses = config.peerAddresses;
+					peerAllow = config.peerAllow;
+					peerName = config.peerName;
+					peerHistory = config.peerHistory;
+					rateBucketWidths = config.rateBucketWidths;
 					if (!config.load()) {
 						log.error("Failed to reload configuration for daemon!");
 					}
@@ -837,6 +1075,35 @@ int main(int argc, char *argv[])
 						log.error("Failed to parse configured patterns for daemon!");
 					}
 
+					// Phrases to mask in AbuseIPDB reports might be changed
+					logParser.buildMasker();
+
+					// Matches counted in buckets of other width are not comparable with changed rate rules
+					if (rateBucketWidths != config.rateBucketWidths) {
+						data.rateWindows.clear();
+					}
+
+					// Aggregate activity is not comparable if subnet prefix length is changed
+					if (subnetPrefixIPv4 != config.subnetPrefixIPv4 || subnetPrefixIPv6 != config.subnetPrefixIPv6) {
+						data.removeSubnetRules();
+					}
+
+					// Restart peer sync if its configuration is changed (peers receive whole log of new process)
+					if (peerListen != config.peerListen || peerAddresses != config.peerAddresses || peerAllow != config.peerAllow || peerName != config.peerName || peerHistory != config.peerHistory) {
+						peerSync.reset();
+						peerSync.reset(startPeerSync(&log, &config));
+					}
+
+					// Feeds of previous directory are no longer blocked
+					if (feedDirectory != config.feedDirectory) {
+						feedWatcher.stop();
+						data.removeFeedRules();
+						feedDirectory = config.feedDirectory;
+						if (feedDirectory.length() > 0) {
+							feedWatcher.watch(feedDirectory);
+						}
+					}
+
 					// Reset config relad flag (so that it is not reladed again on next iteration)
 					reloadConfig = false;
 
@@ -850,7 +1117,7 @@ int main(int argc, char *argv[])
 							log.warning("iptables rule changed in configuration, updating iptables...");
 
 							// Get all current rules for INPUT chain
-							rules = iptables.listRules("INPUT");
+							rules = firewall->listRules("INPUT");
 
 							// Loop all rules
 							for (rit=rules.begin(); rit!=rules.end(); ++rit) {
@@ -864,9 +1131,14 @@ int main(int argc, char *argv[])
 										if (regexSearchResults.size() == 1) {
 											regexSearchResult = regexSearchResults[0].str();
 
+											// Rules for address ranges are updated together with other range rules
+											if (hb::Data::ruleRange(rit->second, regexSearchResults.position(0), regexSearchResults.position(0) + regexSearchResults.length(0)).length() > 0) {
+												continue;
+											}
+
 											// Remove rule based on old config
 											try {
-												if (iptables.remove("INPUT", ruleStart + regexSearchResult + ruleEnd) == false) {
+												if (firewall->remove("INPUT", ruleStart + regexSearchResult + ruleEnd) == false) {
 													log.error("Trying to update rule for address " + regexSearchResult + " based on updated configuraiton, but failed to remove current rule!");
 												} else {
 													sait->second.iptableRule = false;
@@ -879,7 +1151,7 @@ int main(int argc, char *argv[])
 
 											// Add rule based on new config
 											try {
-												if (iptables.append("INPUT", config.iptablesRule.substr(0, posip) + regexSearchResult + config.iptablesRule.substr(posip + 2)) == false) {
+												if (firewall->append("INPUT", config.iptablesRule.substr(0, posip) + regexSearchResult + config.iptablesRule.substr(posip + 2)) == false) {
 													log.error("Trying to update rule for address " + regexSearchResult + " based on updated configuraiton, but failed to add rule based on new configuration!");
 												} else {
 													sait->second.iptableRule = true;
@@ -897,6 +1169,11 @@ int main(int argc, char *argv[])
 						}
 
 					}
+
+					// Address ranges might be changed, recheck rules of ranges and addresses
+					if (!data.checkIptables()) {
+						log.error("Failed to compare data with iptables...");
+					}
 				}
 
 				// Reload datafile
@@ -909,6 +1186,49 @@ int main(int argc, char *argv[])
 						log.error("Failed to compare data with iptables...");
 					}
 					reloadDataFile = false;
+
+					// Merged part of snapshot is lost, import starts again
+					if (snapshotReader) {
+						snapshotReader.reset();
+						importSnapshot = true;
+					}
+				}
+
+				// Apply changed blocklist feeds
+				feedChanges.clear();
+				feedWatcher.changes(&feedChanges);
+				for (itfc = feedChanges.begin(); itfc != feedChanges.end(); ++itfc) {
+					if (!feedWatcher.load(*itfc, &feedEntries)) {
+						feedEntries.clear();
+					}
+					data.updateFeed(*itfc, &feedEntries);
+				}
+
+				// Import queued snapshot
+				if (importSnapshot) {
+					importSnapshot = false;
+					snapshotReader.reset(new hb::SnapshotReader(&log));
+					if (!snapshotReader->open(SNAPSHOT_PATH)) {
+						log.error("Failed to import snapshot!");
+						snapshotReader.reset();
+					} else {
+						log.info("Importing snapshot with " + std::to_string(snapshotReader->records()) + " records...");
+					}
+				}
+				if (snapshotReader) {
+					bool imported = data.importSnapshot(snapshotReader.get(), 100000);
+					if (!imported || snapshotReader->done()) {
+						snapshotReader.reset();
+						std::remove(SNAPSHOT_PATH);
+						if (!imported) {
+							log.error("Snapshot import stopped at invalid record, merged records are kept!");
+						}
+						if (!data.applyBatch()) {
+							log.error("Failed to update firewall rules or datafile after snapshot import!");
+						} else if (imported) {
+							log.info("Snapshot imported");
+						}
+					}
 				}
 
 				// Log file check
@@ -919,21 +1239,84 @@ int main(int argc, char *argv[])
 					// TODO check file size also in this function since this proces can take more time than log rotate
 					logParser.checkFiles();
 
+					// Peer sync metrics
+					if (peerSync) {
+						metrics.describe("hostblock_peer_decisions_published_total", "counter", "Block decisions published to peers");
+						metrics.describe("hostblock_peer_decisions_received_total", "counter", "Block decisions received from peers");
+						metrics.describe("hostblock_peer_subscribers", "gauge", "Peers connected to this instance");
+						metrics.describe("hostblock_peer_blocked_addresses", "gauge", "Addresses with decisions of peers");
+						metrics.describe("hostblock_peer_connections_rejected_total", "counter", "Connections of peers refused because address is not allowed");
+						metrics.describe("hostblock_peer_frames_oversized_total", "counter", "Connections of peers closed because of too large frame");
+						metrics.set("hostblock_peer_decisions_published_total", "", peerSync->published.load());
+						metrics.set("hostblock_peer_decisions_received_total", "", peerSync->received.load());
+						metrics.set("hostblock_peer_subscribers", "", peerSync->subscriberCount.load());
+						metrics.set("hostblock_peer_blocked_addresses", "", data.peerBlocks.size());
+						metrics.set("hostblock_peer_connections_rejected_total", "", peerSync->rejected.load());
+						metrics.set("hostblock_peer_frames_oversized_total", "", peerSync->oversized.load());
+					}
+
+					// Feed metrics
+					if (feedDirectory.length() > 0) {
+						metrics.describe("hostblock_feed_entries", "gauge", "Entries of blocklist feed");
+						metrics.describe("hostblock_feed_rules", "gauge", "iptables rules of blocklist feed entries");
+						metrics.describe("hostblock_feed_invalid_lines_total", "counter", "Lines of blocklist feeds that are not address or range");
+						metrics.clear("hostblock_feed_entries");
+						for (std::unordered_map<std::string, std::vector<hb::Prefix>>::iterator itfs = data.feedSources.begin(); itfs != data.feedSources.end(); ++itfs) {
+							metrics.set("hostblock_feed_entries", hb::Metrics::labels({{"source", itfs->first}}), itfs->second.size());
+						}
+						unsigned long long int feedRules = 0;
+						for (std::unordered_map<std::string, hb::FeedEntryType>::iterator itfe = data.feedEntries.begin(); itfe != data.feedEntries.end(); ++itfe) {
+							if (itfe->second.rule.length() > 0) {
+								feedRules++;
+							}
+						}
+						metrics.set("hostblock_feed_rules", "", feedRules);
+						metrics.set("hostblock_feed_invalid_lines_total", "", feedWatcher.invalidLines);
+					}
+
+					// Write metrics
+					if (config.metricsPath.length() > 0) {
+						if (!metrics.write(config.metricsPath)) {
+							log.warning("Failed to write metrics to " + config.metricsPath);
+						}
+					}
+
 					// Check iptables rules if any are expired and should be removed
 					for (sait = data.suspiciousAddresses.begin(); sait != data.suspiciousAddresses.end(); ++sait) {
 						if (sait->second.iptableRule) {
 							data.updateIptables(sait->first);
 						}
 					}
+					data.updateSubnetRules();
+					data.updatePeerRules();
+					data.pruneRateWindows();
+
+					// Replace rules of adjacent blocked addresses with rules of prefixes
+					if (!data.updateAggregates()) {
+						log.error("Failed to aggregate blocked addresses!");
+					}
 
 					// Update time of last log file check
 					lastLogCheck = currentTime;
 				}
 
+				// Apply decisions received from peers and publish decisions of this instance
+				if (peerSync) {
+					peerDeltas.clear();
+					peerSync->receive(&peerDeltas);
+					for (itpd = peerDeltas.begin(); itpd != peerDeltas.end(); ++itpd) {
+						data.savePeerBlock(*itpd);
+					}
+					for (itpd = data.peerOutbox.begin(); itpd != data.peerOutbox.end(); ++itpd) {
+						peerSync->publish(*itpd);
+					}
+				}
+				data.peerOutbox.clear();
+
 				// AbuseIPDB blacklist sync
 				if (config.abuseipdbBlacklistInterval > 0 && (unsigned int)(currentTime - data.abuseIPDBSyncTime) >= config.abuseipdbBlacklistInterval) {
 					try {
-						blacklistSync(&log, &config, &data, &iptables);
+						blacklistSync(&log, &config, &data, firewall);
 						reloadDataFile = true;
 					} catch (std::runtime_error& e) {
 						std::string message = e.what();
@@ -946,6 +1329,18 @@ int main(int argc, char *argv[])
 				cunistd::usleep(200000);
 			}
 			abuseipdbReporterThread.join();
+
+			// Aggregate subnet activity is kept only in memory, so are rules of subnets
+			data.removeSubnetRules();
+
+			// Rules because of peers are created again from decisions peers send after restart
+			peerSync.reset();
+			data.removePeerRules();
+
+			// Rules of feeds are created again from feed files after restart
+			feedWatcher.stop();
+			data.removeFeedRules();
+
 			log.info("Hostblock daemon stop");
 		}
 
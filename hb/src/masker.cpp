@@ -0,0 +1,160 @@
+/*
+ * Masks phrases (hostname, local IP addresses, custom phrases) in text
+ */
+
+// Standard string library
+#include <string>
+// Queue (breadth first traversal)
+#include <queue>
+// C character classification (tolower)
+#include <cctype>
+// Header
+#include "masker.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+Masker::Masker()
+{
+	this->clear();
+}
+
+/*
+ * Add new state
+ */
+int Masker::addNode()
+{
+	hb::MaskerNode node;
+	for (unsigned int c = 0; c < 256; c++) {
+		node.next[c] = -1;
+	}
+	this->nodes.push_back(node);
+	return this->nodes.size() - 1;
+}
+
+/*
+ * Add phrase to mask (case insensitive), empty phrase is ignored
+ */
+void Masker::add(const std::string& phrase)
+{
+	if (phrase.length() == 0) {
+		return;
+	}
+	std::string lower = phrase;
+	for (std::size_t i = 0; i < lower.length(); i++) {
+		lower[i] = std::tolower((unsigned char)lower[i]);
+	}
+	this->phrases.push_back(lower);
+	this->built = false;
+}
+
+/*
+ * Remove all phrases
+ */
+void Masker::clear()
+{
+	this->phrases.clear();
+	this->nodes.clear();
+	this->addNode();
+	this->built = false;
+}
+
+/*
+ * Build automaton, must be called after phrases are added
+ */
+void Masker::build()
+{
+	std::vector<std::string>::iterator itp;
+	std::queue<int> states;
+	int state, child, fail;
+	unsigned int c;
+
+	this->nodes.clear();
+	this->addNode();
+
+	// Trie of phrases
+	for (itp = this->phrases.begin(); itp != this->phrases.end(); ++itp) {
+		state = 0;
+		for (std::size_t i = 0; i < itp->length(); i++) {
+			c = (unsigned char)(*itp)[i];
+			if (this->nodes[state].next[c] == -1) {
+				child = this->addNode();
+				this->nodes[state].next[c] = child;
+			}
+			state = this->nodes[state].next[c];
+		}
+		if (itp->length() > this->nodes[state].length) {
+			this->nodes[state].length = itp->length();
+		}
+	}
+
+	// Failure links and complete transitions (breadth first)
+	for (c = 0; c < 256; c++) {
+		child = this->nodes[0].next[c];
+		if (child == -1) {
+			this->nodes[0].next[c] = 0;
+		} else {
+			this->nodes[child].fail = 0;
+			states.push(child);
+		}
+	}
+	while (!states.empty()) {
+		state = states.front();
+		states.pop();
+		if (this->nodes[this->nodes[state].fail].length > this->nodes[state].length) {
+			this->nodes[state].length = this->nodes[this->nodes[state].fail].length;
+		}
+		for (c = 0; c < 256; c++) {
+			child = this->nodes[state].next[c];
+			fail = this->nodes[this->nodes[state].fail].next[c];
+			if (child == -1) {
+				this->nodes[state].next[c] = fail;
+			} else {
+				this->nodes[child].fail = fail;
+				states.push(child);
+			}
+		}
+	}
+
+	// Upper case letters use same transitions as lower case
+	for (std::vector<hb::MaskerNode>::iterator itn = this->nodes.begin(); itn != this->nodes.end(); ++itn) {
+		for (c = 'A'; c <= 'Z'; c++) {
+			itn->next[c] = itn->next[c - 'A' + 'a'];
+		}
+	}
+
+	this->built = true;
+}
+
+/*
+ * Whether there is anything to mask
+ */
+bool Masker::empty()
+{
+	return this->phrases.size() == 0;
+}
+
+/*
+ * Append text to output with all phrase occurrences replaced by * (length is kept)
+ * Phrase is found at its last character, so already appended characters are overwritten
+ */
+void Masker::mask(const std::string& text, std::string* output)
+{
+	if (!this->built) {
+		this->build();
+	}
+	std::size_t start = output->length();
+	int state = 0;
+	unsigned int length;
+	output->append(text);
+	for (std::size_t i = 0; i < text.length(); i++) {
+		state = this->nodes[state].next[(unsigned char)text[i]];
+		length = this->nodes[state].length;
+		if (length > 0) {
+			output->replace(start + i + 1 - length, length, length, '*');
+		}
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * Masks phrases (hostname, local IP addresses, custom phrases) in text,
+ * Aho-Corasick automaton finds all phrases in single pass over text
+ */
+
+#ifndef HBMASKER_H
+#define HBMASKER_H
+
+// Vector
+#include <vector>
+// String
+#include <string>
+
+namespace hb{
+
+/*
+ * State of automaton
+ */
+struct MaskerNode {
+	int next[256];// Transition for each byte (goto function completed with failure links)
+	int fail = 0;// Failure link
+	unsigned int length = 0;// Length of longest phrase that ends in this state (including phrases reachable by failure links)
+};
+
+class Masker{
+	private:
+
+		/*
+		 * Automaton states, state 0 is root
+		 */
+		std::vector<hb::MaskerNode> nodes;
+
+		/*
+		 * Phrases to mask (lower case)
+		 */
+		std::vector<std::string> phrases;
+
+		/*
+		 * Whether automaton is built for current phrases
+		 */
+		bool built = false;
+
+		/*
+		 * Add new state
+		 */
+		int addNode();
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		Masker();
+
+		/*
+		 * Add phrase to mask (case insensitive), empty phrase is ignored
+		 */
+		void add(const std::string& phrase);
+
+		/*
+		 * Remove all phrases
+		 */
+		void clear();
+
+		/*
+		 * Build automaton, must be called after phrases are added
+		 */
+		void build();
+
+		/*
+		 * Whether there is anything to mask
+		 */
+		bool empty();
+
+		/*
+		 * Append text to output with all phrase occurrences replaced by * (length is kept)
+		 */
+		void mask(const std::string& text, std::string* output);
+
+};
+
+}
+
+#endif
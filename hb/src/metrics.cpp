@@ -0,0 +1,154 @@
+/*
+ * Runtime metrics, written to file in Prometheus text format
+ */
+
+// Standard string library
+#include <string>
+// String stream library
+#include <sstream>
+// File stream library (ofstream)
+#include <fstream>
+// Parametric manipulators (setprecision)
+#include <iomanip>
+// C standard input and output (rename, remove)
+#include <cstdio>
+// Header
+#include "metrics.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+Metrics::Metrics()
+{
+
+}
+
+/*
+ * Format labels, label values are escaped as required by text format
+ */
+std::string Metrics::labels(std::vector<std::pair<std::string, std::string>> labels)
+{
+	if (labels.size() == 0) {
+		return "";
+	}
+	std::string result = "{";
+	for (std::vector<std::pair<std::string, std::string>>::iterator it = labels.begin(); it != labels.end(); ++it) {
+		if (it != labels.begin()) result += ",";
+		result += it->first + "=\"";
+		for (std::string::iterator itc = it->second.begin(); itc != it->second.end(); ++itc) {
+			if (*itc == '\\') result += "\\\\";
+			else if (*itc == '"') result += "\\\"";
+			else if (*itc == '\n') result += "\\n";
+			else result += *itc;
+		}
+		result += "\"";
+	}
+	result += "}";
+	return result;
+}
+
+/*
+ * Set type (counter or gauge) and description of metric
+ */
+void Metrics::describe(std::string name, std::string type, std::string help)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->families[name].type = type;
+	this->families[name].help = help;
+}
+
+/*
+ * Set value of series
+ */
+void Metrics::set(std::string name, std::string labels, double value)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->families[name].values[labels] = value;
+}
+
+/*
+ * Add to value of series
+ */
+void Metrics::add(std::string name, std::string labels, double value)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->families[name].values[labels] += value;
+}
+
+/*
+ * Get value of series
+ */
+double Metrics::get(std::string name, std::string labels)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	std::map<std::string, hb::MetricFamily>::iterator itf = this->families.find(name);
+	if (itf == this->families.end()) {
+		return 0.0;
+	}
+	std::map<std::string, double>::iterator itv = itf->second.values.find(labels);
+	if (itv == itf->second.values.end()) {
+		return 0.0;
+	}
+	return itv->second;
+}
+
+/*
+ * Remove all series of metric
+ */
+void Metrics::clear(std::string name)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	std::map<std::string, hb::MetricFamily>::iterator itf = this->families.find(name);
+	if (itf != this->families.end()) {
+		itf->second.values.clear();
+	}
+}
+
+/*
+ * All metrics in Prometheus text format
+ */
+std::string Metrics::format()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	std::ostringstream out;
+	out << std::setprecision(15);
+	for (std::map<std::string, hb::MetricFamily>::iterator itf = this->families.begin(); itf != this->families.end(); ++itf) {
+		if (itf->second.values.size() == 0) {
+			continue;
+		}
+		if (itf->second.help.length() > 0) {
+			out << "# HELP " << itf->first << " " << itf->second.help << "\n";
+		}
+		out << "# TYPE " << itf->first << " " << itf->second.type << "\n";
+		for (std::map<std::string, double>::iterator itv = itf->second.values.begin(); itv != itf->second.values.end(); ++itv) {
+			out << itf->first << itv->first << " " << itv->second << "\n";
+		}
+	}
+	return out.str();
+}
+
+/*
+ * Write metrics to file, written to temporary file first and then renamed so that scraper never reads partial file
+ */
+bool Metrics::write(std::string path)
+{
+	std::string tmpPath = path + ".tmp";
+	std::ofstream f(tmpPath, std::ios::out | std::ios::trunc);
+	if (!f.is_open()) {
+		return false;
+	}
+	f << this->format();
+	f.close();
+	if (f.fail()) {
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
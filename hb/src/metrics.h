@@ -0,0 +1,93 @@
+/*
+ * Runtime metrics, written to file in Prometheus text format (node_exporter
+ * textfile collector or any other scraper can pick it up)
+ */
+
+#ifndef HBMETRICS_H
+#define HBMETRICS_H
+
+// Map
+#include <map>
+// Vector
+#include <vector>
+// String
+#include <string>
+// Mutex
+#include <mutex>
+
+namespace hb{
+
+/*
+ * Metric family, all series with same name
+ */
+struct MetricFamily {
+	std::string type = "gauge";// counter or gauge
+	std::string help = "";
+	std::map<std::string, double> values;// Labels -> value
+};
+
+class Metrics{
+	private:
+
+		/*
+		 * Metrics are updated from daemon main loop and threads
+		 */
+		std::mutex mutex;
+
+		/*
+		 * Metric name -> family
+		 */
+		std::map<std::string, hb::MetricFamily> families;
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		Metrics();
+
+		/*
+		 * Format labels, e.g. {group="OpenSSH",index="1"}
+		 */
+		static std::string labels(std::vector<std::pair<std::string, std::string>> labels);
+
+		/*
+		 * Set type (counter or gauge) and description of metric
+		 */
+		void describe(std::string name, std::string type, std::string help);
+
+		/*
+		 * Set value of series
+		 */
+		void set(std::string name, std::string labels, double value);
+
+		/*
+		 * Add to value of series
+		 */
+		void add(std::string name, std::string labels, double value);
+
+		/*
+		 * Get value of series, 0 if series does not exist
+		 */
+		double get(std::string name, std::string labels);
+
+		/*
+		 * Remove all series of metric (e.g. after config reload)
+		 */
+		void clear(std::string name);
+
+		/*
+		 * All metrics in Prometheus text format
+		 */
+		std::string format();
+
+		/*
+		 * Write metrics to file, file is replaced atomically
+		 */
+		bool write(std::string path);
+
+};
+
+}
+
+#endif
@@ -0,0 +1,394 @@
+/*
+ * Native parsers of common log formats, fixed fields are tokenized without regex
+ */
+
+// Standard string library
+#include <string>
+// C standard library (strtoul)
+#include <cstdlib>
+// Algorithms (find)
+#include <algorithm>
+// Header
+#include "nativeparser.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Message of sshd, address is after marker (or right after prefix if marker is empty)
+ */
+struct SshdMessage {
+	const char* prefix;
+	const char* event;
+	const char* marker;
+};
+
+/*
+ * Known sshd messages, longer prefixes first
+ */
+static const SshdMessage kSshdMessages[] = {
+	{"Invalid user ", "invalid_user", " from "},
+	{"Failed password for invalid user ", "failed_password_invalid_user", " from "},
+	{"Failed password for ", "failed_password", " from "},
+	{"Failed keyboard-interactive/pam for invalid user ", "failed_password_invalid_user", " from "},
+	{"error: PAM: Authentication failure for ", "auth_failure", " from "},
+	{"PAM: Authentication failure for ", "auth_failure", " from "},
+	{"ROOT LOGIN REFUSED FROM ", "root_refused", ""},
+	{"Did not receive identification string from ", "no_identification", ""},
+	{"User ", "not_allowed", " from "},
+	{"error: maximum authentication attempts exceeded for ", "max_attempts", " from "},
+	{"Disconnecting invalid user ", "max_attempts", " "},
+	{"Connection closed by ", "connection_closed", ""},
+	{"Disconnected from ", "disconnected", ""},
+	{"Received disconnect from ", "disconnected", ""}
+};
+
+/*
+ * IPv4 address at position (same as regex \d{1,3}\.\d{1,3}\.\d{1,3}\.\d{1,3}), end is set to position after address
+ */
+bool NativeParser::address(const std::string& line, std::size_t pos, std::string* address, std::size_t* end)
+{
+	std::size_t i = pos;
+	unsigned int digits;
+	for (unsigned int octet = 0; octet < 4; octet++) {
+		if (octet > 0) {
+			if (i >= line.length() || line[i] != '.') {
+				return false;
+			}
+			i++;
+		}
+		digits = 0;
+		while (i < line.length() && line[i] >= '0' && line[i] <= '9' && digits < 3) {
+			i++;
+			digits++;
+		}
+		if (digits == 0) {
+			return false;
+		}
+	}
+	if (i < line.length() && line[i] >= '0' && line[i] <= '9') {
+		return false;
+	}
+	address->assign(line, pos, i - pos);
+	*end = i;
+	return true;
+}
+
+/*
+ * Address after first marker (from position) that is followed by IPv4 address, port after address if followed by " port "
+ */
+bool NativeParser::addressAfter(const std::string& line, std::size_t pos, const char* marker, hb::LogFields* fields)
+{
+	std::size_t end = 0;
+	std::size_t markerLength = std::char_traits<char>::length(marker);
+	if (markerLength == 0) {
+		if (!NativeParser::address(line, pos, &fields->address, &end)) {
+			return false;
+		}
+	} else {
+		pos = line.find(marker, pos);
+		while (pos != std::string::npos && !NativeParser::address(line, pos + markerLength, &fields->address, &end)) {
+			pos = line.find(marker, pos + 1);
+		}
+		if (pos == std::string::npos) {
+			return false;
+		}
+	}
+
+	// Port
+	fields->port.clear();
+	if (line.compare(end, 6, " port ") == 0) {
+		end += 6;
+		pos = end;
+		while (end < line.length() && end - pos < 5 && line[end] >= '0' && line[end] <= '9') {
+			end++;
+		}
+		fields->port.assign(line, pos, end - pos);
+	}
+	return true;
+}
+
+/*
+ * Apache/nginx combined (or common) access log: address ident user [time] "method path protocol" status ...
+ */
+template <>
+bool NativeParser::parse<hb::LogFormat::ApacheCombined>(const std::string& line, hb::LogFields* fields)
+{
+	std::size_t pos, requestStart, requestEnd, first, last;
+	fields->event = "";
+	fields->port.clear();
+	if (!NativeParser::address(line, 0, &fields->address, &pos) || pos >= line.length() || line[pos] != ' ') {
+		return false;
+	}
+
+	// Ident and user
+	pos = line.find(' ', pos + 1);
+	if (pos == std::string::npos) {
+		return false;
+	}
+	pos = line.find(' ', pos + 1);
+	if (pos == std::string::npos || line.compare(pos, 2, " [") != 0) {
+		return false;
+	}
+
+	// Time
+	pos = line.find(']', pos);
+	if (pos == std::string::npos || line.compare(pos, 3, "] \"") != 0) {
+		return false;
+	}
+
+	// Request, quotes inside are escaped with backslash
+	pos += 3;
+	requestStart = pos;
+	while (pos < line.length() && line[pos] != '"') {
+		if (line[pos] == '\\') {
+			pos++;
+		}
+		pos++;
+	}
+	if (pos >= line.length()) {
+		return false;
+	}
+	requestEnd = pos;
+
+	// Path is between method and protocol (request without protocol has only path)
+	first = line.find(' ', requestStart);
+	if (first != std::string::npos && first < requestEnd) {
+		last = line.rfind(' ', requestEnd - 1);
+		if (last <= first) {
+			last = requestEnd;
+		}
+		fields->path.assign(line, first + 1, last - first - 1);
+	} else {
+		fields->path.clear();
+	}
+
+	// Status
+	pos++;
+	if (pos + 4 > line.length() || line[pos] != ' ') {
+		return false;
+	}
+	fields->status = 0;
+	for (std::size_t i = pos + 1; i < pos + 4; i++) {
+		if (line[i] < '0' || line[i] > '9') {
+			return false;
+		}
+		fields->status = fields->status * 10 + (line[i] - '0');
+	}
+	return pos + 4 == line.length() || line[pos + 4] == ' ';
+}
+
+/*
+ * OpenSSH messages in syslog: ... sshd[pid]: message
+ */
+template <>
+bool NativeParser::parse<hb::LogFormat::Sshd>(const std::string& line, hb::LogFields* fields)
+{
+	std::size_t pos = line.find("sshd");
+	std::size_t message = std::string::npos;
+	fields->status = 0;
+	fields->path.clear();
+	while (pos != std::string::npos) {
+		pos += 4;
+		if (line.compare(pos, 8, "-session") == 0) {
+			pos += 8;
+		}
+		if (pos < line.length() && line[pos] == '[') {
+			pos = line.find("]: ", pos);
+			if (pos == std::string::npos) {
+				return false;
+			}
+			message = pos + 3;
+			break;
+		} else if (line.compare(pos, 2, ": ") == 0) {
+			message = pos + 2;
+			break;
+		}
+		pos = line.find("sshd", pos);
+	}
+	if (message == std::string::npos) {
+		return false;
+	}
+
+	for (const SshdMessage& m : kSshdMessages) {
+		if (line.compare(message, std::char_traits<char>::length(m.prefix), m.prefix) == 0) {
+			if (!NativeParser::addressAfter(line, message + std::char_traits<char>::length(m.prefix), m.marker, fields)) {
+				return false;
+			}
+			fields->event = m.event;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Postfix SASL failures: ... postfix/smtpd[pid]: warning: host[address]: SASL method authentication failed: ...
+ */
+template <>
+bool NativeParser::parse<hb::LogFormat::PostfixSasl>(const std::string& line, hb::LogFields* fields)
+{
+	std::size_t end;
+	std::size_t pos = line.find("postfix/");
+	fields->status = 0;
+	fields->path.clear();
+	fields->port.clear();
+	if (pos == std::string::npos) {
+		return false;
+	}
+	pos = line.find("]: ", pos);
+	if (pos == std::string::npos) {
+		return false;
+	}
+	pos += 3;
+	if (line.compare(pos, 9, "warning: ") == 0) {
+		pos = line.find('[', pos + 9);
+		if (pos == std::string::npos || !NativeParser::address(line, pos + 1, &fields->address, &end) || line.compare(end, 8, "]: SASL ") != 0 || line.find(" authentication failed", end) == std::string::npos) {
+			return false;
+		}
+		fields->event = "sasl_failed";
+		return true;
+	}
+	if (line.compare(pos, 32, "lost connection after AUTH from ") == 0) {
+		pos = line.find('[', pos + 32);
+		if (pos == std::string::npos || !NativeParser::address(line, pos + 1, &fields->address, &end) || end >= line.length() || line[end] != ']') {
+			return false;
+		}
+		fields->event = "auth_lost";
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Split line into fields with parser of format
+ */
+bool NativeParser::parse(hb::LogFormat format, const std::string& line, hb::LogFields* fields)
+{
+	switch (format) {
+		case LogFormat::ApacheCombined:
+			return NativeParser::parse<LogFormat::ApacheCombined>(line, fields);
+		case LogFormat::Sshd:
+			return NativeParser::parse<LogFormat::Sshd>(line, fields);
+		case LogFormat::PostfixSasl:
+			return NativeParser::parse<LogFormat::PostfixSasl>(line, fields);
+		default:
+			return false;
+	}
+}
+
+/*
+ * Whether parsed fields match native rule
+ */
+bool NativeParser::matches(const hb::Pattern* pattern, const hb::LogFields& fields)
+{
+	if (pattern->nativeEvent.length() > 0 && pattern->nativeEvent != fields.event) {
+		return false;
+	}
+	if (pattern->nativeStatus.size() > 0 && std::find(pattern->nativeStatus.begin(), pattern->nativeStatus.end(), fields.status) == pattern->nativeStatus.end()) {
+		return false;
+	}
+	if (pattern->nativePath.length() > 0 && !Util::containsLiteral(fields.path, pattern->nativePath)) {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Format by name (regex, apache_combined, sshd, postfix_sasl), returns false if name is not known
+ */
+bool NativeParser::format(const std::string& name, hb::LogFormat* format)
+{
+	if (name == "regex") {
+		*format = LogFormat::Regex;
+	} else if (name == "apache_combined") {
+		*format = LogFormat::ApacheCombined;
+	} else if (name == "sshd") {
+		*format = LogFormat::Sshd;
+	} else if (name == "postfix_sasl") {
+		*format = LogFormat::PostfixSasl;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Name of format
+ */
+std::string NativeParser::formatName(hb::LogFormat format)
+{
+	switch (format) {
+		case LogFormat::ApacheCombined:
+			return "apache_combined";
+		case LogFormat::Sshd:
+			return "sshd";
+		case LogFormat::PostfixSasl:
+			return "postfix_sasl";
+		default:
+			return "regex";
+	}
+}
+
+/*
+ * Events of format (sshd, postfix_sasl), comma separated
+ */
+std::string NativeParser::events(hb::LogFormat format)
+{
+	std::string events = "";
+	if (format == LogFormat::Sshd) {
+		for (const SshdMessage& m : kSshdMessages) {
+			if (("," + events + ",").find("," + std::string(m.event) + ",") == std::string::npos) {
+				events += (events.length() > 0 ? "," : "") + std::string(m.event);
+			}
+		}
+	} else if (format == LogFormat::PostfixSasl) {
+		events = "sasl_failed,auth_lost";
+	}
+	return events;
+}
+
+/*
+ * Parse native rule (space separated status=code[,code...] path=text event=name) into pattern, returns false if rule is not valid for format
+ */
+bool NativeParser::rule(const std::string& text, hb::LogFormat format, hb::Pattern* pattern)
+{
+	std::size_t pos = 0, end, eq, posd;
+	std::string token, key, value;
+	pattern->native = true;
+	pattern->patternString = text;
+	while (pos < text.length()) {
+		end = text.find(' ', pos);
+		if (end == std::string::npos) {
+			end = text.length();
+		}
+		token = text.substr(pos, end - pos);
+		pos = end + 1;
+		if (token.length() == 0) {
+			continue;
+		}
+		eq = token.find('=');
+		if (eq == std::string::npos) {
+			return false;
+		}
+		key = token.substr(0, eq);
+		value = token.substr(eq + 1);
+		if (key == "status" && format == LogFormat::ApacheCombined) {
+			while (value.length() > 0) {
+				posd = value.find(',');
+				pattern->nativeStatus.push_back(strtoul(value.substr(0, posd).c_str(), NULL, 10));
+				value = posd == std::string::npos ? "" : value.substr(posd + 1);
+			}
+		} else if (key == "path" && format == LogFormat::ApacheCombined) {
+			pattern->nativePath = Util::toLower(value);
+		} else if (key == "event" && (format == LogFormat::Sshd || format == LogFormat::PostfixSasl)) {
+			if (("," + NativeParser::events(format) + ",").find("," + value + ",") == std::string::npos) {
+				return false;
+			}
+			pattern->nativeEvent = value;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,86 @@
+/*
+ * Native parsers of common log formats, fixed fields are tokenized without regex,
+ * parser is specialized for each format and selected by log group (log.format)
+ */
+
+#ifndef HBNATIVEPARSER_H
+#define HBNATIVEPARSER_H
+
+// Standard string library
+#include <string>
+// Util
+#include "util.h"
+
+namespace hb{
+
+/*
+ * Fields of parsed line, buffers are reused between lines
+ */
+struct LogFields {
+	std::string address = "";// IPv4 address of client
+	std::string port = "";// Port of client, empty if not in line
+	std::string path = "";// Request path (apache_combined)
+	unsigned int status = 0;// Response status code (apache_combined)
+	const char* event = "";// Event of message (sshd, postfix_sasl)
+};
+
+class NativeParser{
+	private:
+
+		/*
+		 * IPv4 address at position (same as regex \d{1,3}\.\d{1,3}\.\d{1,3}\.\d{1,3}), end is set to position after address
+		 */
+		static bool address(const std::string& line, std::size_t pos, std::string* address, std::size_t* end);
+
+		/*
+		 * Address after first marker (from position) that is followed by IPv4 address, port after address if followed by " port "
+		 */
+		static bool addressAfter(const std::string& line, std::size_t pos, const char* marker, hb::LogFields* fields);
+
+	public:
+
+		/*
+		 * Split line of format into fields, returns false if line is not in format
+		 */
+		template <hb::LogFormat F>
+		static bool parse(const std::string& line, hb::LogFields* fields);
+
+		/*
+		 * Split line into fields with parser of format
+		 */
+		static bool parse(hb::LogFormat format, const std::string& line, hb::LogFields* fields);
+
+		/*
+		 * Whether parsed fields match native rule
+		 */
+		static bool matches(const hb::Pattern* pattern, const hb::LogFields& fields);
+
+		/*
+		 * Format by name (regex, apache_combined, sshd, postfix_sasl), returns false if name is not known
+		 */
+		static bool format(const std::string& name, hb::LogFormat* format);
+
+		/*
+		 * Name of format
+		 */
+		static std::string formatName(hb::LogFormat format);
+
+		/*
+		 * Parse native rule (space separated status=code[,code...] path=text event=name) into pattern, returns false if rule is not valid for format
+		 */
+		static bool rule(const std::string& text, hb::LogFormat format, hb::Pattern* pattern);
+
+		/*
+		 * Events of format (sshd, postfix_sasl), comma separated
+		 */
+		static std::string events(hb::LogFormat format);
+
+};
+
+template <> bool NativeParser::parse<hb::LogFormat::ApacheCombined>(const std::string& line, hb::LogFields* fields);
+template <> bool NativeParser::parse<hb::LogFormat::Sshd>(const std::string& line, hb::LogFields* fields);
+template <> bool NativeParser::parse<hb::LogFormat::PostfixSasl>(const std::string& line, hb::LogFields* fields);
+
+}
+
+#endif
@@ -0,0 +1,650 @@
+/*
+ * Peer sync, block decisions are shared between hostblock instances over TCP
+ */
+
+// C string (memcpy, strerror)
+#include <cstring>
+// Chrono (steady_clock)
+#include <chrono>
+// Algorithm (min)
+#include <algorithm>
+// Errors
+#include <errno.h>
+// Non-blocking sockets (fcntl)
+#include <fcntl.h>
+// Poll
+#include <poll.h>
+// Sockets
+#include <sys/socket.h>
+// Address resolution (getaddrinfo)
+#include <netdb.h>
+// Address conversion (inet_pton, inet_ntop)
+#include <arpa/inet.h>
+// Miscellaneous UNIX symbolic constants, types and functions
+namespace cunistd{
+	#include <unistd.h>
+}
+// Header
+#include "peersync.h"
+
+// Hostblock namespace
+using namespace hb;
+
+// Frame header length (type and payload length) and max buffered bytes for each peer
+static const std::size_t kFrameHeader = 3;
+static const std::size_t kWriteBufferMax = 65536;
+// Max buffered bytes read from peer this instance is connected to (largest frame fits) and from peer connected to this instance (hello fits)
+static const std::size_t kReadBufferMax = 131072;
+static const std::size_t kHelloBufferMax = 64;
+
+/*
+ * Append integer in network byte order
+ */
+static void putInteger(std::string* output, unsigned long long int value, unsigned int bytes)
+{
+	for (unsigned int i = bytes; i > 0; i--) {
+		output->push_back((char)((value >> ((i - 1) * 8)) & 0xff));
+	}
+}
+
+/*
+ * Integer in network byte order
+ */
+static unsigned long long int getInteger(const std::string& input, std::size_t pos, unsigned int bytes)
+{
+	unsigned long long int value = 0;
+	for (unsigned int i = 0; i < bytes; i++) {
+		value = (value << 8) | (unsigned char)input[pos + i];
+	}
+	return value;
+}
+
+/*
+ * Append frame header for payload of given length
+ */
+static void putHeader(std::string* output, char type, std::size_t length)
+{
+	output->push_back(type);
+	putInteger(output, length, 2);
+}
+
+/*
+ * Constructor, history is count of published decisions kept for peers to resume
+ */
+PeerSync::PeerSync(hb::Logger* log, const std::string& name, std::size_t history) : running(false), published(0), received(0), subscriberCount(0), rejected(0), oversized(0)
+{
+	this->log = log;
+	this->name = name.substr(0, 255);
+	this->historySize = history > 0 ? history : 1;
+	this->epoch = ((unsigned long long int)time(NULL) << 24) ^ ((unsigned long long int)cunistd::getpid() << 8) ^ (unsigned long long int)std::chrono::steady_clock::now().time_since_epoch().count();
+	if (this->epoch == 0) {
+		this->epoch = 1;
+	}
+}
+
+/*
+ * Destructor, stops sync thread
+ */
+PeerSync::~PeerSync()
+{
+	this->stop();
+}
+
+/*
+ * Start sync thread, listen on address (empty for none) and connect to peers
+ */
+bool PeerSync::start(const std::string& listen, const std::vector<std::string>& peers, const std::vector<std::string>& allow)
+{
+	this->stop();
+
+	// Allowed addresses, hosts of peers are resolved if no ranges are configured (instances usually sync both ways)
+	this->allowed.clear();
+	for (std::vector<std::string>::const_iterator ita = allow.begin(); ita != allow.end(); ++ita) {
+		if (!this->allowed.insert(*ita, hb::Whitelist)) {
+			this->log->error("Invalid address or range " + *ita + " allowed for peers!");
+		}
+	}
+	if (allow.size() == 0) {
+		struct addrinfo hints, *result, *itr;
+		char text[INET6_ADDRSTRLEN];
+		std::string host;
+		std::size_t pos;
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		for (std::vector<std::string>::const_iterator itp = peers.begin(); itp != peers.end(); ++itp) {
+			pos = itp->rfind(':');
+			host = itp->substr(0, pos);
+			if (host.length() > 1 && host[0] == '[' && host[host.length() - 1] == ']') {
+				host = host.substr(1, host.length() - 2);
+			}
+			result = NULL;
+			if (pos == std::string::npos || getaddrinfo(host.c_str(), NULL, &hints, &result) != 0) {
+				this->log->warning("Unable to resolve peer " + *itp + ", connections from it will be refused!");
+				continue;
+			}
+			for (itr = result; itr != NULL; itr = itr->ai_next) {
+				if (itr->ai_family == AF_INET && inet_ntop(AF_INET, &((struct sockaddr_in*)itr->ai_addr)->sin_addr, text, sizeof(text)) != NULL) {
+					this->allowed.insert(text, hb::Whitelist);
+				} else if (itr->ai_family == AF_INET6 && inet_ntop(AF_INET6, &((struct sockaddr_in6*)itr->ai_addr)->sin6_addr, text, sizeof(text)) != NULL) {
+					this->allowed.insert(text, hb::Whitelist);
+				}
+			}
+			freeaddrinfo(result);
+		}
+	}
+	if (listen.length() > 0 && this->allowed.size() == 0) {
+		this->log->warning("No peers are allowed to connect to " + listen + ", configure peer.allow or peer.address!");
+	}
+
+	if (listen.length() > 0) {
+		this->listenFd = this->openSocket(listen, true);
+		if (this->listenFd < 0) {
+			this->log->error("Unable to listen for peers on " + listen + "!");
+			return false;
+		}
+		this->log->info("Publishing block decisions to peers on " + listen);
+	}
+
+	// Connections to peers keep epoch and last sequence number, so sync resumes after restart of thread
+	std::vector<hb::PeerConnection> connections;
+	std::vector<hb::PeerConnection>::iterator itc;
+	for (std::vector<std::string>::const_iterator itp = peers.begin(); itp != peers.end(); ++itp) {
+		hb::PeerConnection connection;
+		connection.address = *itp;
+		for (itc = this->connections.begin(); itc != this->connections.end(); ++itc) {
+			if (itc->address == *itp) {
+				connection.epoch = itc->epoch;
+				connection.last = itc->last;
+			}
+		}
+		connections.push_back(connection);
+	}
+	this->connections = connections;
+
+	this->running.store(true);
+	this->thread = std::thread(&PeerSync::run, this);
+	return true;
+}
+
+/*
+ * Stop sync thread and close all connections (peers resume later)
+ */
+void PeerSync::stop()
+{
+	this->running.store(false);
+	if (this->thread.joinable()) {
+		this->thread.join();
+	}
+	if (this->listenFd >= 0) {
+		cunistd::close(this->listenFd);
+		this->listenFd = -1;
+	}
+	for (std::vector<hb::PeerSubscriber>::iterator its = this->subscribers.begin(); its != this->subscribers.end(); ++its) {
+		cunistd::close(its->fd);
+	}
+	this->subscribers.clear();
+	this->subscriberCount.store(0);
+	for (std::vector<hb::PeerConnection>::iterator itc = this->connections.begin(); itc != this->connections.end(); ++itc) {
+		if (itc->fd >= 0) {
+			cunistd::close(itc->fd);
+			itc->fd = -1;
+		}
+		itc->connecting = false;
+		itc->readBuffer.clear();
+		itc->writeBuffer.clear();
+		itc->retry = 0;
+	}
+}
+
+/*
+ * Port of listening socket, 0 if not listening
+ */
+unsigned int PeerSync::port()
+{
+	struct sockaddr_storage address;
+	socklen_t length = sizeof(address);
+	if (this->listenFd < 0 || getsockname(this->listenFd, (struct sockaddr*)&address, &length) != 0) {
+		return 0;
+	}
+	if (address.ss_family == AF_INET6) {
+		return ntohs(((struct sockaddr_in6*)&address)->sin6_port);
+	}
+	return ntohs(((struct sockaddr_in*)&address)->sin_port);
+}
+
+/*
+ * Add decision of this instance to log (sequence number and source are set here)
+ */
+void PeerSync::publish(hb::PeerDelta delta)
+{
+	std::lock_guard<std::mutex> lock(this->historyMutex);
+	delta.sequence = ++this->sequence;
+	delta.source = this->name;
+	this->history.push_back(delta);
+	while (this->history.size() > this->historySize) {
+		this->history.pop_front();
+	}
+	this->published++;
+}
+
+/*
+ * Take decisions received from peers
+ */
+void PeerSync::receive(std::vector<hb::PeerDelta>* deltas)
+{
+	std::lock_guard<std::mutex> lock(this->inboxMutex);
+	deltas->insert(deltas->end(), this->inbox.begin(), this->inbox.end());
+	this->inbox.clear();
+}
+
+/*
+ * Append frame with decision to buffer
+ */
+void PeerSync::encodeDelta(const hb::PeerDelta& delta, std::string* output)
+{
+	unsigned char address[16];
+	unsigned int family = 0;
+	if (inet_pton(AF_INET, delta.address.c_str(), address) == 1) {
+		family = 4;
+	} else if (inet_pton(AF_INET6, delta.address.c_str(), address) == 1) {
+		family = 6;
+	} else {
+		return;
+	}
+	std::size_t source = delta.source.length() < 255 ? delta.source.length() : 255;
+	putHeader(output, 'D', 8 + 1 + (family == 4 ? 4 : 16) + 4 + 8 + source);
+	putInteger(output, delta.sequence, 8);
+	putInteger(output, family, 1);
+	output->append((const char*)address, family == 4 ? 4 : 16);
+	putInteger(output, delta.score, 4);
+	putInteger(output, delta.expires, 8);
+	output->append(delta.source, 0, source);
+}
+
+/*
+ * Decision from payload of D frame, returns false if payload is not valid
+ */
+bool PeerSync::decodeDelta(const std::string& payload, hb::PeerDelta* delta)
+{
+	char address[INET6_ADDRSTRLEN];
+	if (payload.length() < 9) {
+		return false;
+	}
+	unsigned int family = (unsigned char)payload[8];
+	std::size_t length = family == 4 ? 4 : 16;
+	if ((family != 4 && family != 6) || payload.length() < 9 + length + 12) {
+		return false;
+	}
+	if (inet_ntop(family == 4 ? AF_INET : AF_INET6, payload.data() + 9, address, sizeof(address)) == NULL) {
+		return false;
+	}
+	delta->sequence = getInteger(payload, 0, 8);
+	delta->address = address;
+	delta->score = (unsigned int)getInteger(payload, 9 + length, 4);
+	delta->expires = getInteger(payload, 9 + length + 4, 8);
+	delta->source = payload.substr(9 + length + 12);
+	return true;
+}
+
+/*
+ * Take next complete frame from buffer, returns false if frame is not complete yet
+ */
+bool PeerSync::nextFrame(std::string* buffer, char* type, std::string* payload)
+{
+	if (buffer->length() < kFrameHeader) {
+		return false;
+	}
+	std::size_t length = getInteger(*buffer, 1, 2);
+	if (buffer->length() < kFrameHeader + length) {
+		return false;
+	}
+	*type = (*buffer)[0];
+	payload->assign(*buffer, kFrameHeader, length);
+	buffer->erase(0, kFrameHeader + length);
+	return true;
+}
+
+/*
+ * Open non-blocking listening socket or connection to host:port (IPv6 host in brackets)
+ */
+int PeerSync::openSocket(const std::string& address, bool listen)
+{
+	std::size_t pos = address.rfind(':');
+	if (pos == std::string::npos) {
+		this->log->error("Port not specified in peer address " + address + "!");
+		return -1;
+	}
+	std::string host = address.substr(0, pos);
+	std::string port = address.substr(pos + 1);
+	if (host.length() > 1 && host[0] == '[' && host[host.length() - 1] == ']') {
+		host = host.substr(1, host.length() - 2);
+	}
+
+	struct addrinfo hints, *result = NULL;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = listen ? AI_PASSIVE : 0;
+	if (getaddrinfo(host.length() > 0 ? host.c_str() : NULL, port.c_str(), &hints, &result) != 0 || result == NULL) {
+		this->log->error("Unable to resolve peer address " + address + "!");
+		return -1;
+	}
+
+	int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if (fd >= 0) {
+		int flags = fcntl(fd, F_GETFL, 0);
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+		if (listen) {
+			int reuse = 1;
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+			if (bind(fd, result->ai_addr, result->ai_addrlen) != 0 || ::listen(fd, 16) != 0) {
+				this->log->error("Unable to listen on " + address + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+				cunistd::close(fd);
+				fd = -1;
+			}
+		} else if (connect(fd, result->ai_addr, result->ai_addrlen) != 0 && errno != EINPROGRESS) {
+			this->log->debug("Unable to connect to peer " + address + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+			cunistd::close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(result);
+	return fd;
+}
+
+/*
+ * Accept peers waiting on listening socket, peers from addresses that are not allowed are closed right away
+ * IPv4 peer on dual stack socket is checked with its IPv4 address
+ */
+void PeerSync::acceptPeers()
+{
+	struct sockaddr_storage address;
+	socklen_t length = sizeof(address);
+	char text[INET6_ADDRSTRLEN];
+	int fd;
+	while ((fd = accept(this->listenFd, (struct sockaddr*)&address, &length)) >= 0) {
+		text[0] = '\0';
+		if (address.ss_family == AF_INET) {
+			inet_ntop(AF_INET, &((struct sockaddr_in*)&address)->sin_addr, text, sizeof(text));
+		} else if (address.ss_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED(&((struct sockaddr_in6*)&address)->sin6_addr)) {
+			inet_ntop(AF_INET, ((struct sockaddr_in6*)&address)->sin6_addr.s6_addr + 12, text, sizeof(text));
+		} else if (address.ss_family == AF_INET6) {
+			inet_ntop(AF_INET6, &((struct sockaddr_in6*)&address)->sin6_addr, text, sizeof(text));
+		}
+		length = sizeof(address);
+		if (text[0] == '\0' || this->allowed.lookup(text) != hb::Whitelist) {
+			this->log->warning("Refused connection of peer " + std::string(text) + ", address is not allowed!");
+			this->rejected++;
+			cunistd::close(fd);
+			continue;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+		hb::PeerSubscriber subscriber;
+		subscriber.fd = fd;
+		this->subscribers.push_back(subscriber);
+	}
+}
+
+/*
+ * Read available bytes from socket to buffer (until buffer has limit bytes), returns false if connection is closed or failed
+ * Bytes over limit are left in socket, they are read after frames in buffer are handled
+ */
+bool PeerSync::readSocket(int fd, std::string* buffer, std::size_t limit)
+{
+	char chunk[4096];
+	ssize_t count;
+	while (buffer->length() < limit) {
+		count = recv(fd, chunk, std::min(sizeof(chunk), limit - buffer->length()), 0);
+		if (count > 0) {
+			buffer->append(chunk, count);
+			continue;
+		}
+		if (count == 0) {
+			return false;
+		}
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+	return true;
+}
+
+/*
+ * Write as much of buffer as socket accepts, returns false if connection failed
+ */
+bool PeerSync::writeSocket(int fd, std::string* buffer)
+{
+	ssize_t count;
+	while (buffer->length() > 0) {
+		count = send(fd, buffer->data(), buffer->length(), MSG_NOSIGNAL);
+		if (count > 0) {
+			buffer->erase(0, count);
+			continue;
+		}
+		return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+	}
+	return true;
+}
+
+/*
+ * Handle frames from peer connected to this instance, queue decisions it has not received yet
+ */
+bool PeerSync::serve(hb::PeerSubscriber* subscriber)
+{
+	char type;
+	std::string payload;
+	while (PeerSync::nextFrame(&subscriber->readBuffer, &type, &payload)) {
+		if (type != 'H' || payload.length() < 20 || payload.compare(0, 4, "HBP1") != 0) {
+			return false;
+		}
+		// Same process as before disconnect, continue after last received decision, otherwise send whole log
+		subscriber->next = getInteger(payload, 4, 8) == this->epoch ? getInteger(payload, 12, 8) + 1 : 1;
+		subscriber->started = true;
+		putHeader(&subscriber->writeBuffer, 'S', 8);
+		putInteger(&subscriber->writeBuffer, this->epoch, 8);
+	}
+	if (!subscriber->started) {
+		return true;
+	}
+
+	// Decisions older than kept log are lost, peer continues with oldest kept decision
+	std::lock_guard<std::mutex> lock(this->historyMutex);
+	if (this->history.size() > 0 && subscriber->next < this->history.front().sequence) {
+		subscriber->next = this->history.front().sequence;
+	}
+	while (subscriber->writeBuffer.length() < kWriteBufferMax && this->history.size() > 0 && subscriber->next <= this->history.back().sequence) {
+		PeerSync::encodeDelta(this->history[subscriber->next - this->history.front().sequence], &subscriber->writeBuffer);
+		subscriber->next++;
+	}
+	return true;
+}
+
+/*
+ * Handle frames from peer this instance is connected to
+ */
+bool PeerSync::consume(hb::PeerConnection* connection)
+{
+	char type;
+	std::string payload;
+	hb::PeerDelta delta;
+	while (PeerSync::nextFrame(&connection->readBuffer, &type, &payload)) {
+		if (type == 'S' && payload.length() >= 8) {
+			// Peer process was restarted, its sequence numbers start again
+			if (getInteger(payload, 0, 8) != connection->epoch) {
+				connection->epoch = getInteger(payload, 0, 8);
+				connection->last = 0;
+			}
+		} else if (type == 'D' && PeerSync::decodeDelta(payload, &delta)) {
+			if (delta.sequence <= connection->last) {
+				continue;
+			}
+			connection->last = delta.sequence;
+			this->received++;
+			std::lock_guard<std::mutex> lock(this->inboxMutex);
+			this->inbox.push_back(delta);
+		} else {
+			this->log->warning("Invalid frame from peer " + connection->address + ", disconnecting!");
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Close connection to peer, next attempt after 5 seconds
+ */
+void PeerSync::disconnect(hb::PeerConnection* connection, time_t now)
+{
+	if (connection->fd >= 0) {
+		cunistd::close(connection->fd);
+	}
+	if (!connection->connecting) {
+		this->log->info("Disconnected from peer " + connection->address);
+	}
+	connection->fd = -1;
+	connection->connecting = false;
+	connection->readBuffer.clear();
+	connection->writeBuffer.clear();
+	connection->retry = now + 5;
+}
+
+/*
+ * Sync thread loop, polls sockets (at most 100ms) and moves decisions between sockets, history and inbox
+ */
+void PeerSync::run()
+{
+	std::vector<struct pollfd> fds;
+	std::vector<hb::PeerSubscriber>::iterator its;
+	std::vector<hb::PeerConnection>::iterator itc;
+	struct pollfd entry;
+	std::size_t i, polled;
+	int error;
+	bool keep;
+	socklen_t errorLength;
+	time_t now;
+	while (this->running.load()) {
+		time(&now);
+
+		// Connect to peers
+		for (itc = this->connections.begin(); itc != this->connections.end(); ++itc) {
+			if (itc->fd < 0 && now >= itc->retry) {
+				itc->fd = this->openSocket(itc->address, false);
+				if (itc->fd < 0) {
+					itc->retry = now + 5;
+					continue;
+				}
+				itc->connecting = true;
+				putHeader(&itc->writeBuffer, 'H', 20);
+				itc->writeBuffer.append("HBP1");
+				putInteger(&itc->writeBuffer, itc->epoch, 8);
+				putInteger(&itc->writeBuffer, itc->last, 8);
+			}
+		}
+
+		// Decisions not sent yet
+		for (its = this->subscribers.begin(); its != this->subscribers.end(); ++its) {
+			this->serve(&(*its));
+		}
+
+		// Wait for sockets
+		fds.clear();
+		if (this->listenFd >= 0) {
+			entry.fd = this->listenFd;
+			entry.events = POLLIN;
+			fds.push_back(entry);
+		}
+		for (its = this->subscribers.begin(); its != this->subscribers.end(); ++its) {
+			entry.fd = its->fd;
+			entry.events = POLLIN | (its->writeBuffer.length() > 0 ? POLLOUT : 0);
+			fds.push_back(entry);
+		}
+		polled = this->subscribers.size();
+		for (itc = this->connections.begin(); itc != this->connections.end(); ++itc) {
+			if (itc->fd >= 0) {
+				entry.fd = itc->fd;
+				entry.events = itc->connecting ? POLLOUT : (POLLIN | (itc->writeBuffer.length() > 0 ? POLLOUT : 0));
+				fds.push_back(entry);
+			}
+		}
+		for (i = 0; i < fds.size(); i++) {
+			fds[i].revents = 0;
+		}
+		if (fds.size() == 0) {
+			cunistd::usleep(100000);
+			continue;
+		}
+		if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) {
+			this->log->error("Failed to poll peer sockets! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+			cunistd::usleep(100000);
+			continue;
+		}
+		i = 0;
+
+		// New peers
+		if (this->listenFd >= 0) {
+			if (fds[i].revents & POLLIN) {
+				this->acceptPeers();
+			}
+			i++;
+		}
+
+		// Peers connected to this instance (accepted ones were not polled yet), closed connections are removed
+		for (its = this->subscribers.begin(); its != this->subscribers.end(); polled = polled > 0 ? polled - 1 : 0) {
+			keep = true;
+			if (polled > 0) {
+				if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+					keep = PeerSync::readSocket(its->fd, &its->readBuffer, kHelloBufferMax) && this->serve(&(*its));
+					// Only hello is expected from peer, buffer that is still full holds frame larger than hello
+					if (keep && its->readBuffer.length() >= kHelloBufferMax) {
+						this->log->warning("Too large frame from peer connected to this instance, disconnecting!");
+						this->oversized++;
+						keep = false;
+					}
+				}
+				if (keep && (fds[i].revents & POLLOUT)) {
+					keep = PeerSync::writeSocket(its->fd, &its->writeBuffer);
+				}
+				i++;
+			}
+			if (!keep) {
+				cunistd::close(its->fd);
+				its = this->subscribers.erase(its);
+			} else {
+				++its;
+			}
+		}
+		this->subscriberCount.store(this->subscribers.size());
+
+		// Connections to peers
+		for (itc = this->connections.begin(); itc != this->connections.end(); ++itc) {
+			if (itc->fd < 0 || i >= fds.size() || fds[i].fd != itc->fd) {
+				continue;
+			}
+			if (itc->connecting) {
+				if (fds[i].revents & (POLLOUT | POLLERR | POLLHUP)) {
+					error = 0;
+					errorLength = sizeof(error);
+					if (getsockopt(itc->fd, SOL_SOCKET, SO_ERROR, &error, &errorLength) != 0 || error != 0) {
+						this->disconnect(&(*itc), now);
+					} else {
+						itc->connecting = false;
+						this->log->info("Connected to peer " + itc->address);
+						if (!PeerSync::writeSocket(itc->fd, &itc->writeBuffer)) {
+							this->disconnect(&(*itc), now);
+						}
+					}
+				}
+			} else {
+				if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && (!PeerSync::readSocket(itc->fd, &itc->readBuffer, kReadBufferMax) | !this->consume(&(*itc)))) {
+					this->disconnect(&(*itc), now);
+				} else if (itc->readBuffer.length() >= kReadBufferMax) {
+					this->log->warning("Too large frame from peer " + itc->address + ", disconnecting!");
+					this->oversized++;
+					this->disconnect(&(*itc), now);
+				} else if ((fds[i].revents & POLLOUT) && !PeerSync::writeSocket(itc->fd, &itc->writeBuffer)) {
+					this->disconnect(&(*itc), now);
+				}
+			}
+			i++;
+		}
+	}
+}
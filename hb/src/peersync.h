@@ -0,0 +1,220 @@
+/*
+ * Peer sync, block decisions are shared between hostblock instances over TCP
+ *
+ * Each instance keeps log of its own decisions numbered with sequence numbers and serves it on listen address,
+ * and connects to configured peers to receive their decisions (received decisions are never forwarded).
+ * Peer remembers epoch (random number of publishing process) and last received sequence number, so after
+ * disconnect it asks only for decisions it has not received yet (whole log is sent if publishing process was restarted).
+ *
+ * Peers connecting to listen address are accepted only from allowed addresses (configured ranges, or addresses of configured peers),
+ * buffered bytes of each connection are limited and connection sending larger frame is closed.
+ *
+ * Frames (integers in network byte order): type (1 byte), payload length (2 bytes), payload
+ *   H - hello from peer: "HBP1", epoch (8), last received sequence number (8)
+ *   S - start of stream: epoch (8)
+ *   D - decision: sequence number (8), address family (1, 4 or 6), address (4 or 16), score (4), expiry time (8), source name (rest)
+ */
+
+#ifndef HBPEERSYNC_H
+#define HBPEERSYNC_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Deque
+#include <deque>
+// Mutex
+#include <mutex>
+// Thread
+#include <thread>
+// Atomic
+#include <atomic>
+// Logger
+#include "logger.h"
+// Util
+#include "util.h"
+// Address ranges
+#include "cidr.h"
+
+namespace hb{
+
+/*
+ * Connection of peer to this instance (publishing side)
+ */
+struct PeerSubscriber {
+	int fd = -1;
+	std::string readBuffer = "";
+	std::string writeBuffer = "";
+	bool started = false;// Whether hello is received
+	unsigned long long int next = 0;// Sequence number of next decision to send
+};
+
+/*
+ * Connection of this instance to peer (receiving side)
+ */
+struct PeerConnection {
+	std::string address = "";// host:port
+	int fd = -1;
+	bool connecting = false;
+	std::string readBuffer = "";
+	std::string writeBuffer = "";
+	unsigned long long int epoch = 0;// Epoch of peer process, 0 if unknown
+	unsigned long long int last = 0;// Last received sequence number
+	time_t retry = 0;// Time of next connection attempt
+};
+
+class PeerSync{
+	private:
+
+		/*
+		 * Logger
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Name of this instance, epoch of this process and published decisions (oldest first)
+		 */
+		std::string name;
+		unsigned long long int epoch;
+		std::deque<hb::PeerDelta> history;
+		std::size_t historySize;
+		unsigned long long int sequence = 0;
+		std::mutex historyMutex;
+
+		/*
+		 * Decisions received from peers, not taken by receive() yet
+		 */
+		std::vector<hb::PeerDelta> inbox;
+		std::mutex inboxMutex;
+
+		/*
+		 * Listening socket, peers connected to this instance and connections to peers (used only by sync thread)
+		 */
+		int listenFd = -1;
+		std::vector<hb::PeerSubscriber> subscribers;
+		std::vector<hb::PeerConnection> connections;
+
+		/*
+		 * Addresses peers are accepted from (whitelisted ranges)
+		 */
+		hb::PrefixTrie allowed;
+
+		/*
+		 * Sync thread
+		 */
+		std::thread thread;
+		std::atomic<bool> running;
+
+		/*
+		 * Sync thread loop, polls sockets (at most 100ms) and moves decisions between sockets, history and inbox
+		 */
+		void run();
+
+		/*
+		 * Open non-blocking listening socket or connection to host:port
+		 */
+		int openSocket(const std::string& address, bool listen);
+
+		/*
+		 * Accept peers waiting on listening socket, peers from addresses that are not allowed are closed right away
+		 */
+		void acceptPeers();
+
+		/*
+		 * Read available bytes from socket to buffer (until buffer has limit bytes), returns false if connection is closed or failed
+		 */
+		static bool readSocket(int fd, std::string* buffer, std::size_t limit);
+
+		/*
+		 * Write as much of buffer as socket accepts, returns false if connection failed
+		 */
+		static bool writeSocket(int fd, std::string* buffer);
+
+		/*
+		 * Handle frames from peer connected to this instance, queue decisions it has not received yet
+		 */
+		bool serve(hb::PeerSubscriber* subscriber);
+
+		/*
+		 * Handle frames from peer this instance is connected to
+		 */
+		bool consume(hb::PeerConnection* connection);
+
+		/*
+		 * Close connection to peer, next attempt after 5 seconds
+		 */
+		void disconnect(hb::PeerConnection* connection, time_t now);
+
+	public:
+
+		/*
+		 * Decisions published and received, peers connected to this instance (published decisions are sent to them)
+		 */
+		std::atomic<unsigned long long int> published;
+		std::atomic<unsigned long long int> received;
+		std::atomic<unsigned long long int> subscriberCount;
+
+		/*
+		 * Connections refused because peer address is not allowed, and connections closed because of too large frame
+		 */
+		std::atomic<unsigned long long int> rejected;
+		std::atomic<unsigned long long int> oversized;
+
+		/*
+		 * Constructor, history is count of published decisions kept for peers to resume
+		 */
+		PeerSync(hb::Logger* log, const std::string& name, std::size_t history);
+
+		/*
+		 * Destructor, stops sync thread
+		 */
+		~PeerSync();
+
+		/*
+		 * Start sync thread, listen on address (empty for none) and connect to peers
+		 * Peers are accepted from allowed addresses and ranges, or from addresses of peers if none are allowed
+		 * Returns false if listening socket can not be opened
+		 */
+		bool start(const std::string& listen, const std::vector<std::string>& peers, const std::vector<std::string>& allow);
+
+		/*
+		 * Stop sync thread and close all connections (peers resume later)
+		 */
+		void stop();
+
+		/*
+		 * Port of listening socket (useful if port 0 was used), 0 if not listening
+		 */
+		unsigned int port();
+
+		/*
+		 * Add decision of this instance to log (sequence number and source are set here)
+		 */
+		void publish(hb::PeerDelta delta);
+
+		/*
+		 * Take decisions received from peers
+		 */
+		void receive(std::vector<hb::PeerDelta>* deltas);
+
+		/*
+		 * Append frame with decision to buffer
+		 */
+		static void encodeDelta(const hb::PeerDelta& delta, std::string* output);
+
+		/*
+		 * Decision from payload of D frame, returns false if payload is not valid
+		 */
+		static bool decodeDelta(const std::string& payload, hb::PeerDelta* delta);
+
+		/*
+		 * Take next complete frame from buffer, returns false if frame is not complete yet
+		 */
+		static bool nextFrame(std::string* buffer, char* type, std::string* payload);
+
+};
+
+}
+
+#endif
@@ -0,0 +1,775 @@
+/*
+ * Staged pipeline of log file check, lines are matched with patterns in worker threads, datafile records and firewall rules are written in own threads
+ */
+
+// Chrono
+#include <chrono>
+// Exceptions
+#include <stdexcept>
+// Header
+#include "pipeline.h"
+// Data (datafile records)
+#include "data.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Producer, wake stage thread if it is parked
+ * Note, fence pairs with fence of idleWait, either producer sees parked thread or thread sees published job
+ */
+void StageSignal::wake()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (this->parked.load(std::memory_order_relaxed)) {
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+		}
+		this->condition.notify_one();
+	}
+}
+
+/*
+ * Wait of stage thread without work, spins and yields with count of idle loops, then parks until ready (job or stop)
+ */
+template <typename Ready>
+static void idleWait(unsigned int* idle, hb::StageSignal* signal, Ready ready)
+{
+	(*idle)++;
+	if (*idle < 64) {
+		return;
+	} else if (*idle < 128) {
+		std::this_thread::yield();
+		return;
+	}
+	std::unique_lock<std::mutex> lock(signal->mutex);
+	signal->parked.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	while (!ready()) {
+		signal->condition.wait(lock);
+	}
+	signal->parked.store(false, std::memory_order_relaxed);
+	*idle = 0;
+}
+
+/*
+ * Constructor, starts worker threads, capacity is count of lines in each ring
+ */
+MatchPipeline::MatchPipeline(unsigned int matchers, std::size_t capacity) : ringCapacity(capacity), running(true)
+{
+	for (unsigned int i = 0; i < matchers; i++) {
+		this->workers.push_back(std::unique_ptr<hb::MatchWorker>(new hb::MatchWorker(capacity)));
+	}
+	for (std::vector<std::unique_ptr<hb::MatchWorker>>::iterator itw = this->workers.begin(); itw != this->workers.end(); ++itw) {
+		(*itw)->thread = std::thread(&MatchPipeline::run, this, itw->get());
+	}
+}
+
+/*
+ * Destructor, stops worker threads
+ */
+MatchPipeline::~MatchPipeline()
+{
+	this->running.store(false);
+	for (std::vector<std::unique_ptr<hb::MatchWorker>>::iterator itw = this->workers.begin(); itw != this->workers.end(); ++itw) {
+		(*itw)->signal.wake();
+		if ((*itw)->thread.joinable()) {
+			(*itw)->thread.join();
+		}
+	}
+}
+
+/*
+ * Worker thread loop, spins and yields for a while when there are no jobs, then parks until reader submits next line
+ */
+void MatchPipeline::run(hb::MatchWorker* worker)
+{
+	hb::MatchJob* job = NULL;
+	hb::MatchJob* result = NULL;
+	unsigned int idle = 0;
+	std::chrono::steady_clock::time_point start;
+	while (this->running.load(std::memory_order_relaxed)) {
+		job = worker->jobs.front();
+		if (job == NULL) {
+			idleWait(&idle, &worker->signal, [this, worker]() { return worker->jobs.front() != NULL || !this->running.load(); });
+			continue;
+		}
+		idle = 0;
+
+		start = std::chrono::steady_clock::now();
+		if (worker->counters.size() <= job->groupIndex) {
+			worker->counters.resize(job->groupIndex + 1);
+		}
+		MatchPipeline::match(job, job->line, &worker->matchResults, &worker->fields, &worker->counters[job->groupIndex]);
+		worker->busy.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+
+		// Pass matched line to aggregator, slots are swapped so that line buffers are reused
+		while ((result = worker->results.claim()) == NULL) {
+			worker->stalls.fetch_add(1, std::memory_order_relaxed);
+			if (!this->running.load(std::memory_order_relaxed)) {
+				return;
+			}
+			std::this_thread::yield();
+		}
+		std::swap(*job, *result);
+		worker->results.publish();
+		worker->jobs.pop();
+	}
+}
+
+/*
+ * Match line with patterns and correlation rules of log group, same evaluation order and conditions as reader without matcher pool
+ * Note, using regex groups to get IP address and port
+ * http://www.cplusplus.com/reference/regex/ECMAScript/#groups
+ * Match results:
+ *   index 0 - whole match
+ *   index 1 - IP address
+ *   index 2 - port (optional)
+ */
+void MatchPipeline::match(hb::MatchJob* job, const std::string& line, std::smatch* matchResults, hb::LogFields* fields, std::vector<hb::MatchCounters>* counters)
+{
+	std::vector<unsigned int>::iterator ito;
+	std::vector<hb::Pattern>::iterator itlp;
+	std::vector<hb::CorrelationRule>::iterator itcr;
+	std::chrono::steady_clock::time_point evaluationStart;
+	hb::MatchCounters* counter = NULL;
+	bool matched = false, fieldsParsed = false, fieldsValid = false;
+	hb::LogGroup* group = job->group;
+	hb::CorrelationCapture* capture = NULL;
+	job->pattern = -1;
+	job->refused = -1;
+	job->correlationCount = 0;
+	job->errorCode = 0;
+	if (counters != NULL && counters->size() < group->patterns.size() + group->refusedPatterns.size()) {
+		counters->resize(group->patterns.size() + group->refusedPatterns.size());
+	}
+
+	// Patterns, first match with address
+	for (ito = group->patternOrder.begin(); ito != group->patternOrder.end(); ++ito) {
+		itlp = group->patterns.begin() + *ito;
+		evaluationStart = std::chrono::steady_clock::now();
+		counter = counters != NULL ? &(*counters)[*ito] : NULL;
+		if (counter != NULL) counter->evaluations++; else itlp->evaluations++;
+
+		// Prefilter, skip regex if line does not contain literal required by pattern
+		if (!Util::containsLiteral(line, itlp->literal)) {
+			if (counter != NULL) counter->cost += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - evaluationStart).count();
+			else itlp->cost += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - evaluationStart).count();
+			continue;
+		}
+		try {
+			if (itlp->native) {
+				// Line is split into fields once by native parser of log group, native rules only compare fields
+				if (!fieldsParsed) {
+					fieldsValid = NativeParser::parse(group->format, line, fields);
+					fieldsParsed = true;
+				}
+				matched = fieldsValid && NativeParser::matches(&(*itlp), *fields);
+			} else {
+				matched = std::regex_match(line, *matchResults, itlp->pattern);
+			}
+		} catch (std::regex_error& e) {
+			job->errorCode = e.code();
+			matched = false;
+		}
+		if (counter != NULL) counter->cost += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - evaluationStart).count();
+		else itlp->cost += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - evaluationStart).count();
+		if (matched && (itlp->native || matchResults->size() > 1)) {
+			job->pattern = *ito;
+			job->portMissing = false;
+			if (itlp->native) {
+				job->address.assign(fields->address);
+				job->port.assign(fields->port);
+			} else {
+				job->address.assign((*matchResults)[1].first, (*matchResults)[1].second);
+				job->port.clear();
+				if (itlp->portSearch && matchResults->size() > 2) {
+					job->port.assign((*matchResults)[2].first, (*matchResults)[2].second);
+				} else if (itlp->portSearch) {
+					job->portMissing = true;
+				}
+			}
+			break;
+		}
+	}
+
+	// Correlation rules, state (ID to address) is kept by aggregator, so only captures are collected
+	for (itcr = group->correlations.begin(); itcr != group->correlations.end(); ++itcr) {
+		if (job->correlations.size() <= job->correlationCount) {
+			job->correlations.resize(job->correlationCount + 1);
+		}
+		capture = &job->correlations[job->correlationCount];
+		try {
+			if (Util::containsLiteral(line, itcr->startLiteral) && std::regex_match(line, *matchResults, itcr->start) && matchResults->size() > 2) {
+				capture->start = true;
+				capture->address.assign((*matchResults)[itcr->addressGroup].first, (*matchResults)[itcr->addressGroup].second);
+				capture->id.assign((*matchResults)[itcr->idGroup].first, (*matchResults)[itcr->idGroup].second);
+			} else if (Util::containsLiteral(line, itcr->matchLiteral) && std::regex_match(line, *matchResults, itcr->match) && matchResults->size() > 1) {
+				capture->start = false;
+				capture->id.assign((*matchResults)[1].first, (*matchResults)[1].second);
+			} else {
+				continue;
+			}
+		} catch (std::regex_error& e) {
+			job->errorCode = e.code();
+			continue;
+		}
+		capture->rule = itcr - group->correlations.begin();
+		job->correlationCount++;
+	}
+
+	// Refused patterns (skipped in overload mode)
+	if (!job->refusedCheck) {
+		return;
+	}
+	for (ito = group->refusedPatternOrder.begin(); ito != group->refusedPatternOrder.end(); ++ito) {
+		itlp = group->refusedPatterns.begin() + *ito;
+		evaluationStart = std::chrono::steady_clock::now();
+		counter = counters != NULL ? &(*counters)[group->patterns.size() + *ito] : NULL;
+		if (counter != NULL) counter->evaluations++; else itlp->evaluations++;
+		if (!Util::containsLiteral(line, itlp->literal)) {
+			if (counter != NULL) counter->cost += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - evaluationStart).count();
+			else itlp->cost += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - evaluationStart).count();
+			continue;
+		}
+		try {
+			matched = std::regex_match(line, *matchResults, itlp->pattern);
+		} catch (std::regex_error& e) {
+			job->errorCode = e.code();
+			matched = false;
+		}
+		if (counter != NULL) counter->cost += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - evaluationStart).count();
+		else itlp->cost += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - evaluationStart).count();
+		if (matched && matchResults->size() > 1) {
+			job->refused = *ito;
+			job->refusedAddress.assign((*matchResults)[1].first, (*matchResults)[1].second);
+			job->refusedPort.clear();
+			job->refusedPortMissing = false;
+			if (itlp->portSearch && matchResults->size() > 2) {
+				job->refusedPort.assign((*matchResults)[2].first, (*matchResults)[2].second);
+			} else if (itlp->portSearch) {
+				job->refusedPortMissing = true;
+			}
+			break;
+		}
+	}
+}
+
+/*
+ * Reader, slot for next line or NULL if ring of next worker is full (backpressure)
+ */
+hb::MatchJob* MatchPipeline::claim()
+{
+	return this->workers[this->submitWorker]->jobs.claim();
+}
+
+/*
+ * Reader, pass claimed line to worker
+ */
+void MatchPipeline::submit()
+{
+	this->workers[this->submitWorker]->jobs.publish();
+	this->workers[this->submitWorker]->signal.wake();
+	this->submitWorker = (this->submitWorker + 1) % this->workers.size();
+	this->submitted++;
+}
+
+/*
+ * Aggregator, next matched line in order of submission or NULL if it is not matched yet
+ */
+hb::MatchJob* MatchPipeline::next()
+{
+	if (this->collected == this->submitted) {
+		return NULL;
+	}
+	return this->workers[this->collectWorker]->results.front();
+}
+
+/*
+ * Aggregator, return slot of collected line to worker
+ */
+void MatchPipeline::release()
+{
+	this->workers[this->collectWorker]->results.pop();
+	this->collectWorker = (this->collectWorker + 1) % this->workers.size();
+	this->collected++;
+}
+
+/*
+ * Whether submitted lines are not collected yet
+ */
+bool MatchPipeline::pending()
+{
+	return this->collected < this->submitted;
+}
+
+/*
+ * Add pattern statistics of workers to patterns of log groups, only when nothing is pending (workers are idle)
+ * Note, counters are written by worker before result is published, so they are visible after last result is collected
+ * Counters are kept by position (no allocation on next check), so positions out of range after config reload are only reset
+ */
+void MatchPipeline::mergeCounters(std::vector<hb::LogGroup>* groups)
+{
+	hb::Pattern* pattern = NULL;
+	if (this->pending()) {
+		return;
+	}
+	for (std::vector<std::unique_ptr<hb::MatchWorker>>::iterator itw = this->workers.begin(); itw != this->workers.end(); ++itw) {
+		for (std::size_t g = 0; g < (*itw)->counters.size(); g++) {
+			for (std::size_t i = 0; i < (*itw)->counters[g].size(); i++) {
+				if ((*itw)->counters[g][i].evaluations == 0) {
+					continue;
+				}
+				pattern = NULL;
+				if (g < groups->size() && i < (*groups)[g].patterns.size()) {
+					pattern = &(*groups)[g].patterns[i];
+				} else if (g < groups->size() && i - (*groups)[g].patterns.size() < (*groups)[g].refusedPatterns.size()) {
+					pattern = &(*groups)[g].refusedPatterns[i - (*groups)[g].patterns.size()];
+				}
+				if (pattern != NULL) {
+					pattern->evaluations += (*itw)->counters[g][i].evaluations;
+					pattern->cost += (*itw)->counters[g][i].cost;
+				}
+				(*itw)->counters[g][i].evaluations = 0;
+				(*itw)->counters[g][i].cost = 0.0;
+			}
+		}
+	}
+}
+
+/*
+ * Count of workers
+ */
+std::size_t MatchPipeline::size()
+{
+	return this->workers.size();
+}
+
+/*
+ * Count of lines in ring of each worker
+ */
+std::size_t MatchPipeline::capacity()
+{
+	return this->ringCapacity;
+}
+
+/*
+ * Seconds worker spent matching
+ */
+double MatchPipeline::busy(std::size_t worker)
+{
+	return (double)this->workers[worker]->busy.load(std::memory_order_relaxed) / 1e9;
+}
+
+/*
+ * Times worker waited for aggregator (result ring full)
+ */
+unsigned long long int MatchPipeline::stalls(std::size_t worker)
+{
+	return this->workers[worker]->stalls.load(std::memory_order_relaxed);
+}
+
+/*
+ * Constructor, starts persister thread, capacity is count of records in ring
+ */
+RecordPersister::RecordPersister(hb::Data* data, std::size_t capacity) : data(data), jobs(capacity), running(true), completed(0), busyTime(0), failures(0)
+{
+	this->thread = std::thread(&RecordPersister::run, this);
+}
+
+/*
+ * Destructor, writes saved records and stops persister thread
+ */
+RecordPersister::~RecordPersister()
+{
+	this->drain();
+	this->running.store(false);
+	this->signal.wake();
+	if (this->thread.joinable()) {
+		this->thread.join();
+	}
+}
+
+/*
+ * Persister thread loop, parks when there are no records
+ */
+void RecordPersister::run()
+{
+	hb::PersistJob* job = NULL;
+	unsigned int idle = 0;
+	std::chrono::steady_clock::time_point start;
+	bool written = false;
+	while (this->running.load(std::memory_order_relaxed)) {
+		job = this->jobs.front();
+		if (job == NULL) {
+			idleWait(&idle, &this->signal, [this]() { return this->jobs.front() != NULL || !this->running.load(); });
+			continue;
+		}
+		idle = 0;
+
+		start = std::chrono::steady_clock::now();
+		if (job->newEntry) {
+			written = this->data->appendRecord(job->address, job->record);
+		} else {
+			written = this->data->replaceRecord(job->address, job->record);
+		}
+		if (!written) {
+			this->failures.fetch_add(1, std::memory_order_relaxed);
+		}
+		this->busyTime.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+		this->jobs.pop();
+		this->completed.fetch_add(1, std::memory_order_release);
+	}
+}
+
+/*
+ * Aggregator, pass copy of record to persister (waits if ring is full)
+ */
+void RecordPersister::save(const std::string& address, const hb::SuspiciosAddressType& record, bool newEntry)
+{
+	hb::PersistJob* job = NULL;
+	while ((job = this->jobs.claim()) == NULL) {
+		this->stallCount++;
+		std::this_thread::yield();
+	}
+	job->address.assign(address);
+	job->record = record;
+	job->newEntry = newEntry;
+	this->jobs.publish();
+	this->signal.wake();
+	this->submitted++;
+}
+
+/*
+ * Aggregator, wait until all saved records are written
+ */
+void RecordPersister::drain()
+{
+	while (this->completed.load(std::memory_order_acquire) < this->submitted) {
+		std::this_thread::yield();
+	}
+}
+
+/*
+ * Seconds spent writing records
+ */
+double RecordPersister::busy()
+{
+	return (double)this->busyTime.load(std::memory_order_relaxed) / 1e9;
+}
+
+/*
+ * Records that failed to be written
+ */
+unsigned long long int RecordPersister::failed()
+{
+	return this->failures.load(std::memory_order_relaxed);
+}
+
+/*
+ * Times aggregator waited because ring was full (persister is bottleneck)
+ */
+unsigned long long int RecordPersister::stalls()
+{
+	return this->stallCount;
+}
+
+/*
+ * Aggregator, count of records failed since last call
+ */
+unsigned long long int RecordPersister::takeFailed()
+{
+	unsigned long long int failed = this->failures.load(std::memory_order_acquire);
+	unsigned long long int taken = failed - this->failuresTaken;
+	this->failuresTaken = failed;
+	return taken;
+}
+
+/*
+ * Constructor, starts applier thread, capacity is count of rules in each ring
+ */
+FirewallApplier::FirewallApplier(hb::Logger* log, hb::Firewall* target, std::size_t capacity) : log(log), target(target), jobs(capacity), priorityJobs(capacity), running(true), completed(0), overtakenCount(0), busyTime(0), failures(0), failedCount(0)
+{
+	this->latencyTime[0].store(0);
+	this->latencyTime[1].store(0);
+	this->thread = std::thread(&FirewallApplier::run, this);
+}
+
+/*
+ * Destructor, applies queued rules and stops applier thread
+ */
+FirewallApplier::~FirewallApplier()
+{
+	this->drain();
+	this->running.store(false);
+	this->signal.wake();
+	if (this->thread.joinable()) {
+		this->thread.join();
+	}
+}
+
+/*
+ * Applier thread loop, priority ring is emptied first, parks when there are no rules
+ */
+void FirewallApplier::run()
+{
+	hb::FirewallJob* job = NULL;
+	hb::Ring<hb::FirewallJob>* ring = NULL;
+	unsigned int idle = 0;
+	std::chrono::steady_clock::time_point start;
+	bool applied = false;
+	while (this->running.load(std::memory_order_relaxed)) {
+		ring = &this->priorityJobs;
+		job = ring->front();
+		if (job == NULL) {
+			ring = &this->jobs;
+			job = ring->front();
+		}
+		if (job == NULL) {
+			idleWait(&idle, &this->signal, [this]() { return this->priorityJobs.front() != NULL || this->jobs.front() != NULL || !this->running.load(); });
+			continue;
+		}
+		idle = 0;
+
+		// Rule overtaken by priority rule already has its final state in firewall
+		if (ring == &this->jobs && this->overtakenCount.load(std::memory_order_acquire) > 0 && this->obsolete(job)) {
+			ring->pop();
+			this->completed.fetch_add(1, std::memory_order_release);
+			continue;
+		}
+
+		start = std::chrono::steady_clock::now();
+		try {
+			applied = job->append ? this->target->append(job->chain, job->rule) : this->target->remove(job->chain, job->rule);
+		} catch (std::runtime_error& e) {
+			this->log->error(e.what());
+			applied = false;
+		}
+		if (!applied) {
+			this->log->error("Failed to " + std::string(job->append ? "append rule to" : "remove rule from") + " chain " + job->chain + ": " + job->rule);
+			this->failures.fetch_add(1, std::memory_order_relaxed);
+			this->outcome(job, false);
+		} else {
+			if (job->lane >= 0) {
+				this->latencyTime[job->lane].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - job->readTime).count(), std::memory_order_relaxed);
+			}
+			if (this->failedCount.load(std::memory_order_relaxed) > 0) {
+				this->outcome(job, true);
+			}
+		}
+		this->busyTime.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+		ring->pop();
+		this->completed.fetch_add(1, std::memory_order_release);
+	}
+}
+
+/*
+ * Whether rule of normal ring was overtaken by priority rule queued after it
+ * Entries are dropped when last rule queued before any of them is reached
+ */
+bool FirewallApplier::obsolete(const hb::FirewallJob* job)
+{
+	std::lock_guard<std::mutex> lock(this->overtakenMutex);
+	std::unordered_map<std::string, unsigned long long int>::iterator ito = this->overtaken.find(job->rule);
+	bool skip = ito != this->overtaken.end() && job->sequence < ito->second;
+	if (job->sequence + 1 >= this->overtakenUntil) {
+		this->overtaken.clear();
+		this->overtakenCount.store(0, std::memory_order_release);
+	}
+	return skip;
+}
+
+/*
+ * Keep failed rule for aggregator, or drop it when later operation on same rule succeeded
+ * Failed removal of rule whose append failed before leaves rule missing
+ */
+void FirewallApplier::outcome(const hb::FirewallJob* job, bool applied)
+{
+	std::lock_guard<std::mutex> lock(this->failedMutex);
+	std::unordered_map<std::string, hb::FirewallJob>::iterator itf = this->failedRules.find(job->rule);
+	if (applied) {
+		if (itf != this->failedRules.end()) {
+			this->failedRules.erase(itf);
+		}
+	} else if (itf == this->failedRules.end()) {
+		this->failedRules.insert(std::pair<std::string, hb::FirewallJob>(job->rule, *job));
+	} else if (job->append) {
+		itf->second.append = true;
+	}
+	this->failedCount.store(this->failedRules.size(), std::memory_order_relaxed);
+}
+
+/*
+ * Pass rule to applier (waits if ring is full), appended rules of priority lane go to priority ring
+ */
+void FirewallApplier::enqueue(bool append, const std::string& chain, const std::string& rule)
+{
+	hb::FirewallJob* job = NULL;
+	bool priority = append && this->traceLane == 1;
+	hb::Ring<hb::FirewallJob>* ring = priority ? &this->priorityJobs : &this->jobs;
+	while ((job = ring->claim()) == NULL) {
+		this->stallCount++;
+		std::this_thread::yield();
+	}
+	job->append = append;
+	job->chain.assign(chain);
+	job->rule.assign(rule);
+	job->lane = append ? this->traceLane : -1;
+	job->readTime = this->traceTime;
+	job->sequence = priority ? 0 : this->normalSubmitted++;
+
+	// Same rule still queued in normal ring is skipped by applier
+	if (priority && this->normalSubmitted > 0) {
+		std::lock_guard<std::mutex> lock(this->overtakenMutex);
+		this->overtaken[rule] = this->normalSubmitted;
+		this->overtakenUntil = this->normalSubmitted;
+		this->overtakenCount.store(this->overtaken.size(), std::memory_order_release);
+	}
+	ring->publish();
+	this->signal.wake();
+	this->submitted++;
+}
+
+/*
+ * Firewall rules are applied to
+ */
+hb::Firewall* FirewallApplier::firewall()
+{
+	return this->target;
+}
+
+/*
+ * Rules appended until next call belong to block decision of line read at read time, lane -1 stops tracing
+ */
+void FirewallApplier::trace(int lane, std::chrono::steady_clock::time_point readTime)
+{
+	this->traceLane = lane;
+	this->traceTime = readTime;
+}
+
+/*
+ * Wait until all queued rules are applied
+ */
+void FirewallApplier::drain()
+{
+	while (this->completed.load(std::memory_order_acquire) < this->submitted) {
+		std::this_thread::yield();
+	}
+}
+
+/*
+ * Seconds spent applying rules
+ */
+double FirewallApplier::busy()
+{
+	return (double)this->busyTime.load(std::memory_order_relaxed) / 1e9;
+}
+
+/*
+ * Rules that failed to be applied
+ */
+unsigned long long int FirewallApplier::failed()
+{
+	return this->failures.load(std::memory_order_relaxed);
+}
+
+/*
+ * Times aggregator waited because ring was full (firewall is bottleneck)
+ */
+unsigned long long int FirewallApplier::stalls()
+{
+	return this->stallCount;
+}
+
+/*
+ * Seconds from reading line to applied rule of block decisions of lane since last call
+ */
+double FirewallApplier::takeLatency(unsigned int lane)
+{
+	return (double)this->latencyTime[lane].exchange(0, std::memory_order_relaxed) / 1e9;
+}
+
+/*
+ * Aggregator, rules whose last operation failed since last call, call after drain
+ */
+void FirewallApplier::takeFailed(std::vector<hb::FirewallJob>* jobs)
+{
+	std::lock_guard<std::mutex> lock(this->failedMutex);
+	for (std::unordered_map<std::string, hb::FirewallJob>::iterator itf = this->failedRules.begin(); itf != this->failedRules.end(); ++itf) {
+		jobs->push_back(itf->second);
+	}
+	this->failedRules.clear();
+	this->failedCount.store(0, std::memory_order_relaxed);
+}
+
+/*
+ * Create new chain, after queued rules are applied
+ */
+bool FirewallApplier::newChain(std::string chain)
+{
+	this->drain();
+	return this->target->newChain(chain);
+}
+
+/*
+ * Append rule to chain, rule is queued
+ */
+bool FirewallApplier::append(std::string chain, std::string rule)
+{
+	this->enqueue(true, chain, rule);
+	return true;
+}
+
+/*
+ * Append rules to chain with single call, after queued rules are applied
+ */
+bool FirewallApplier::append(std::string chain, std::vector<std::string>* rules)
+{
+	this->drain();
+	return this->target->append(chain, rules);
+}
+
+/*
+ * Delete rule from chain, rule is queued
+ */
+bool FirewallApplier::remove(std::string chain, std::string rule)
+{
+	this->enqueue(false, chain, rule);
+	return true;
+}
+
+/*
+ * Delete rules from chain with single call, after queued rules are applied
+ */
+bool FirewallApplier::remove(std::string chain, std::vector<std::string>* rules)
+{
+	this->drain();
+	return this->target->remove(chain, rules);
+}
+
+/*
+ * Get rule list, after queued rules are applied
+ */
+std::map<unsigned int, std::string> FirewallApplier::listRules(std::string chain)
+{
+	this->drain();
+	return this->target->listRules(chain);
+}
+
+/*
+ * Exec command with custom options, after queued rules are applied
+ */
+bool FirewallApplier::command(std::string options)
+{
+	this->drain();
+	return this->target->command(options);
+}
+
+/*
+ * Exec command with custom options and return stdout, after queued rules are applied
+ */
+std::map<unsigned int, std::string> FirewallApplier::custom(std::string options)
+{
+	this->drain();
+	return this->target->custom(options);
+}
@@ -0,0 +1,438 @@
+/*
+ * Staged pipeline of log file check: reader, matcher pool, aggregator, persister and firewall applier
+ * Reader (log parser) hands out lines to workers in round robin order through ring buffers and collects results in same order,
+ * so results are applied to data (aggregator, single owner of Data) in order of lines in log file
+ * Aggregator passes changed datafile records to persister and firewall rules to firewall applier through ring buffers,
+ * each stage has its own thread
+ */
+
+#ifndef HBPIPELINE_H
+#define HBPIPELINE_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Memory (unique_ptr)
+#include <memory>
+// Atomic
+#include <atomic>
+// Thread
+#include <thread>
+// Chrono (steady_clock)
+#include <chrono>
+// Mutex
+#include <mutex>
+// Condition variable
+#include <condition_variable>
+// Unordered map
+#include <unordered_map>
+// Regular expressions
+#include <regex>
+// Util
+#include "util.h"
+// Logger
+#include "logger.h"
+// Firewall interface
+#include "firewall.h"
+// Native log format parsers
+#include "nativeparser.h"
+// Ring buffer
+#include "ring.h"
+
+namespace hb{
+
+class Data;
+
+/*
+ * Correlation rule matched by line, start line captures ID and address, match line only ID
+ */
+struct CorrelationCapture {
+	unsigned int rule = 0;// Index in group->correlations
+	bool start = false;
+	std::string id = "";
+	std::string address = "";
+};
+
+/*
+ * Line of log group to match, filled by reader and completed by worker (captures are copied, so aggregator does not match line again)
+ */
+struct MatchJob {
+	hb::LogGroup* group = NULL;
+	std::size_t groupIndex = 0;// Position of log group in config, key of worker statistics
+	std::string line = "";
+	bool refusedCheck = true;// Whether refused patterns are matched (not in overload mode)
+	int pattern = -1;// Index of first matched pattern in group->patterns, -1 if none
+	std::string address = "";// Address and port captured by matched pattern
+	std::string port = "";
+	bool portMissing = false;// Pattern has port search, but regex has no port group
+	int refused = -1;// Index of first matched refused pattern in group->refusedPatterns, -1 if none
+	std::string refusedAddress = "";// Address and port captured by matched refused pattern
+	std::string refusedPort = "";
+	bool refusedPortMissing = false;
+	std::vector<hb::CorrelationCapture> correlations;// Correlation rules matched by line, first correlationCount entries (entries are reused)
+	std::size_t correlationCount = 0;
+	int errorCode = 0;// Regex error code, 0 if no error
+	std::chrono::steady_clock::time_point readTime;// Time line was read, start of block latency
+};
+
+/*
+ * Pattern statistics collected by worker, added to pattern when workers are idle
+ */
+struct MatchCounters {
+	unsigned long long int evaluations = 0;
+	double cost = 0.0;
+};
+
+/*
+ * Datafile record of address changed by aggregator
+ */
+struct PersistJob {
+	std::string address = "";
+	hb::SuspiciosAddressType record;
+	bool newEntry = false;// Record is appended to datafile, otherwise existing record is updated
+};
+
+/*
+ * Firewall rule to append or remove, rule of block decision carries time its line was read (block latency)
+ */
+struct FirewallJob {
+	bool append = true;
+	std::string chain = "";
+	std::string rule = "";
+	int lane = -1;// Lane of block decision (see LogParser::processLine), -1 if rule is not traced
+	std::chrono::steady_clock::time_point readTime;
+	unsigned long long int sequence = 0;// Position in normal ring, rules of normal ring overtaken by priority rule are skipped
+};
+
+/*
+ * Wakeup of idle stage thread, stage thread parks on condition after spinning without work,
+ * producer signals it after publishing to ring only if it is parked (no system call on busy path)
+ */
+struct StageSignal {
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::atomic<bool> parked;
+	StageSignal() : parked(false) {}
+
+	/*
+	 * Producer, wake stage thread if it is parked, call after publish (or after stop flag is cleared)
+	 */
+	void wake();
+};
+
+/*
+ * Worker thread with its rings, jobs from reader and matched jobs for aggregator
+ */
+struct MatchWorker {
+	hb::Ring<hb::MatchJob> jobs;
+	hb::Ring<hb::MatchJob> results;
+	hb::StageSignal signal;// Reader wakes idle worker
+	std::thread thread;
+	std::smatch matchResults;
+	hb::LogFields fields;
+	std::vector<std::vector<hb::MatchCounters>> counters;// By position of log group and pattern (refused patterns after patterns)
+	std::atomic<unsigned long long int> busy;// Nanoseconds spent matching
+	std::atomic<unsigned long long int> stalls;// Times result ring was full (aggregator is bottleneck)
+	MatchWorker(std::size_t capacity) : jobs(capacity), results(capacity), busy(0), stalls(0) {}
+};
+
+class MatchPipeline{
+	private:
+
+		/*
+		 * Workers, reader submits to and aggregator collects from them in same round robin order
+		 */
+		std::vector<std::unique_ptr<hb::MatchWorker>> workers;
+		std::size_t submitWorker = 0;
+		std::size_t collectWorker = 0;
+		unsigned long long int submitted = 0;
+		unsigned long long int collected = 0;
+		std::size_t ringCapacity = 0;
+
+		/*
+		 * Whether worker threads should keep running
+		 */
+		std::atomic<bool> running;
+
+		/*
+		 * Worker thread loop, spins and yields for a while when there are no jobs, then parks until reader submits next line
+		 */
+		void run(hb::MatchWorker* worker);
+
+	public:
+
+		/*
+		 * Constructor, starts worker threads, capacity is count of lines in each ring
+		 */
+		MatchPipeline(unsigned int matchers, std::size_t capacity);
+
+		/*
+		 * Destructor, stops worker threads
+		 */
+		~MatchPipeline();
+
+		/*
+		 * Match line with patterns and correlation rules of log group, first matched pattern and refused pattern are found
+		 * and their captures are copied to job, whitelist, data, correlation state and reports are left to aggregator
+		 * Statistics are added to counters (patterns, then refused patterns of log group), or to patterns if counters are NULL (reader)
+		 */
+		static void match(hb::MatchJob* job, const std::string& line, std::smatch* matchResults, hb::LogFields* fields, std::vector<hb::MatchCounters>* counters);
+
+		/*
+		 * Reader, slot for next line or NULL if ring of next worker is full (backpressure), line is passed to worker by submit
+		 */
+		hb::MatchJob* claim();
+		void submit();
+
+		/*
+		 * Aggregator, next matched line in order of submission or NULL if it is not matched yet, slot is returned by release
+		 */
+		hb::MatchJob* next();
+		void release();
+
+		/*
+		 * Whether submitted lines are not collected yet
+		 */
+		bool pending();
+
+		/*
+		 * Add pattern statistics of workers to patterns of log groups, only when nothing is pending (workers are idle)
+		 */
+		void mergeCounters(std::vector<hb::LogGroup>* groups);
+
+		/*
+		 * Count of workers
+		 */
+		std::size_t size();
+
+		/*
+		 * Count of lines in ring of each worker
+		 */
+		std::size_t capacity();
+
+		/*
+		 * Seconds worker spent matching and times it waited for aggregator
+		 */
+		double busy(std::size_t worker);
+		unsigned long long int stalls(std::size_t worker);
+
+};
+
+/*
+ * Persister, writes datafile records of addresses changed by aggregator in its own thread
+ * Records are written in order they were saved, other datafile writes wait until they are written (see drain)
+ */
+class RecordPersister{
+	private:
+
+		/*
+		 * Data object (datafile path and record writing), records of aggregator and thread
+		 */
+		hb::Data* data;
+		hb::Ring<hb::PersistJob> jobs;
+		hb::StageSignal signal;
+		std::thread thread;
+		std::atomic<bool> running;
+
+		/*
+		 * Records saved by aggregator and records written by persister
+		 */
+		unsigned long long int submitted = 0;
+		std::atomic<unsigned long long int> completed;
+
+		/*
+		 * Nanoseconds spent writing, records that failed to be written and times aggregator waited for persister
+		 */
+		std::atomic<unsigned long long int> busyTime;
+		std::atomic<unsigned long long int> failures;
+		unsigned long long int stallCount = 0;
+
+		/*
+		 * Failed records already taken by aggregator (see takeFailed)
+		 */
+		unsigned long long int failuresTaken = 0;
+
+		/*
+		 * Persister thread loop
+		 */
+		void run();
+
+	public:
+
+		/*
+		 * Constructor, starts persister thread, capacity is count of records in ring
+		 */
+		RecordPersister(hb::Data* data, std::size_t capacity);
+
+		/*
+		 * Destructor, writes saved records and stops persister thread
+		 */
+		~RecordPersister();
+
+		/*
+		 * Aggregator, pass copy of record to persister (waits if ring is full)
+		 */
+		void save(const std::string& address, const hb::SuspiciosAddressType& record, bool newEntry);
+
+		/*
+		 * Aggregator, wait until all saved records are written
+		 */
+		void drain();
+
+		/*
+		 * Seconds spent writing, failed records and times aggregator waited because ring was full
+		 */
+		double busy();
+		unsigned long long int failed();
+		unsigned long long int stalls();
+
+		/*
+		 * Aggregator, count of records failed since last call, datafile no longer matches data if not 0
+		 */
+		unsigned long long int takeFailed();
+
+};
+
+/*
+ * Firewall applier, firewall of data while log files are checked, rules are appended and removed in its own thread
+ * Rules of priority lane (high severity block decisions) have own ring, which is always emptied first,
+ * so immediate block is not queued behind backlog of other rules
+ * Other firewall calls (batches, rule lists, commands) are done by caller after queued rules are applied
+ * Rules that failed to be applied are kept until aggregator takes them (see takeFailed), data is then reconciled with firewall
+ */
+class FirewallApplier : public hb::Firewall{
+	private:
+
+		/*
+		 * Logger, firewall rules are applied to (iptables or simulated), rules of aggregator and thread
+		 */
+		hb::Logger* log;
+		hb::Firewall* target;
+		hb::Ring<hb::FirewallJob> jobs;
+		hb::Ring<hb::FirewallJob> priorityJobs;
+		hb::StageSignal signal;
+		std::thread thread;
+		std::atomic<bool> running;
+
+		/*
+		 * Rules queued by aggregator and rules applied by applier (both rings), rules queued to normal ring
+		 */
+		unsigned long long int submitted = 0;
+		std::atomic<unsigned long long int> completed;
+		unsigned long long int normalSubmitted = 0;
+
+		/*
+		 * Rules of priority lane with normal rules queued before them (rule -> count of normal rules queued before it),
+		 * earlier append or remove of same rule must not be applied after it, entries are kept until normal ring reaches last of them
+		 */
+		std::unordered_map<std::string, unsigned long long int> overtaken;
+		unsigned long long int overtakenUntil = 0;
+		std::mutex overtakenMutex;
+		std::atomic<std::size_t> overtakenCount;
+
+		/*
+		 * Block decision traced rules belong to, see trace()
+		 */
+		int traceLane = -1;
+		std::chrono::steady_clock::time_point traceTime;
+
+		/*
+		 * Nanoseconds spent applying rules, failed rules and times aggregator waited for applier
+		 */
+		std::atomic<unsigned long long int> busyTime;
+		std::atomic<unsigned long long int> failures;
+		unsigned long long int stallCount = 0;
+
+		/*
+		 * Nanoseconds from reading line to applied rule of its block decision, by lane
+		 */
+		std::atomic<unsigned long long int> latencyTime[2];
+
+		/*
+		 * Rules whose last operation failed (rule -> failed job, append if rule is missing), rule applied later is dropped
+		 */
+		std::unordered_map<std::string, hb::FirewallJob> failedRules;
+		std::mutex failedMutex;
+		std::atomic<std::size_t> failedCount;
+
+		/*
+		 * Applier thread loop
+		 */
+		void run();
+
+		/*
+		 * Whether rule of normal ring was overtaken by priority rule queued after it
+		 */
+		bool obsolete(const hb::FirewallJob* job);
+
+		/*
+		 * Keep failed rule for aggregator, or drop it when later operation on same rule succeeded
+		 */
+		void outcome(const hb::FirewallJob* job, bool applied);
+
+		/*
+		 * Pass rule to applier (waits if ring is full), appended rules of priority lane go to priority ring
+		 */
+		void enqueue(bool append, const std::string& chain, const std::string& rule);
+
+	public:
+
+		/*
+		 * Constructor, starts applier thread, capacity is count of rules in each ring
+		 */
+		FirewallApplier(hb::Logger* log, hb::Firewall* target, std::size_t capacity);
+
+		/*
+		 * Destructor, applies queued rules and stops applier thread
+		 */
+		~FirewallApplier();
+
+		/*
+		 * Firewall rules are applied to
+		 */
+		hb::Firewall* firewall();
+
+		/*
+		 * Rules appended until next call belong to block decision of line read at read time, lane -1 stops tracing
+		 * Rules appended for priority lane (1) are queued to priority ring
+		 */
+		void trace(int lane, std::chrono::steady_clock::time_point readTime);
+
+		/*
+		 * Wait until all queued rules are applied
+		 */
+		void drain();
+
+		/*
+		 * Seconds spent applying rules, failed rules, times aggregator waited because ring was full
+		 * and seconds from reading line to applied rule of block decisions of lane (since last call)
+		 */
+		double busy();
+		unsigned long long int failed();
+		unsigned long long int stalls();
+		double takeLatency(unsigned int lane);
+
+		/*
+		 * Aggregator, rules whose last operation failed since last call (append set if rule is missing, otherwise rule is still in firewall)
+		 * Call after drain, so that no operation on rules is pending
+		 */
+		void takeFailed(std::vector<hb::FirewallJob>* jobs);
+
+		/*
+		 * Firewall interface, single rules are queued, other calls wait for queued rules and are passed to firewall
+		 */
+		bool newChain(std::string chain);
+		bool append(std::string chain, std::string rule);
+		bool append(std::string chain, std::vector<std::string>* rules);
+		bool remove(std::string chain, std::string rule);
+		bool remove(std::string chain, std::vector<std::string>* rules);
+		std::map<unsigned int, std::string> listRules(std::string chain);
+		bool command(std::string options);
+		std::map<unsigned int, std::string> custom(std::string options);
+
+};
+
+}
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * Offline pattern profiler, measures cost of configured patterns against sample
+ * log files. Each pattern is evaluated for each line (unlike daemon, which
+ * stops at first match), so results do not depend on pattern order.
+ */
+
+// Standard input/output stream library (cin, cout, cerr, clog)
+#include <iostream>
+// File stream library (ifstream)
+#include <fstream>
+// Parametric manipulators (setw, setprecision)
+#include <iomanip>
+// Standard map library
+#include <map>
+// Algorithms (sort)
+#include <algorithm>
+// Chrono (steady_clock)
+#include <chrono>
+// C Math (log)
+#include <cmath>
+// JSON
+#include <jsoncpp/json/json.h>
+// Header
+#include "profiler.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+PatternProfiler::PatternProfiler(hb::Logger* log, hb::Config* config)
+: log(log), config(config)
+{
+
+}
+
+/*
+ * Run all patterns against each line of sample files
+ */
+bool PatternProfiler::profile(std::vector<std::string> sampleFiles)
+{
+	std::vector<hb::LogGroup>::iterator itlg;
+	std::vector<hb::LogFile>::iterator itlf;
+	std::vector<hb::Pattern>::iterator itlp;
+	std::vector<std::string>::iterator itsf;
+	std::map<std::string, std::vector<unsigned int>> fileGroups;// File path -> indexes of log groups to check it with
+	std::vector<unsigned int> groupProfiles;// Log group index -> index of first profile
+	std::smatch patternMatchResults;
+	std::string line;
+	unsigned int groupIndex, profileIndex;
+	bool matched;
+	double ns;
+
+	// Profile for each pattern
+	this->profiles.clear();
+	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+		groupProfiles.push_back(this->profiles.size());
+		profileIndex = 0;
+		for (itlp = itlg->patterns.begin(); itlp != itlg->patterns.end(); ++itlp) {
+			hb::PatternProfile profile;
+			profile.group = itlg->name;
+			profile.type = "pattern";
+			profile.index = ++profileIndex;
+			profile.patternString = itlp->patternString;
+			profile.literal = itlp->literal;
+			this->profiles.push_back(profile);
+		}
+		profileIndex = 0;
+		for (itlp = itlg->refusedPatterns.begin(); itlp != itlg->refusedPatterns.end(); ++itlp) {
+			hb::PatternProfile profile;
+			profile.group = itlg->name;
+			profile.type = "refused";
+			profile.index = ++profileIndex;
+			profile.patternString = itlp->patternString;
+			profile.literal = itlp->literal;
+			this->profiles.push_back(profile);
+		}
+	}
+
+	// Sample files are checked with all log groups, without sample files each log group is checked with own log files
+	groupIndex = 0;
+	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+		if (sampleFiles.size() > 0) {
+			for (itsf = sampleFiles.begin(); itsf != sampleFiles.end(); ++itsf) {
+				fileGroups[*itsf].push_back(groupIndex);
+			}
+		} else {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				fileGroups[itlf->path].push_back(groupIndex);
+			}
+		}
+		groupIndex++;
+	}
+
+	// Read each file once
+	for (std::map<std::string, std::vector<unsigned int>>::iterator itfg = fileGroups.begin(); itfg != fileGroups.end(); ++itfg) {
+		std::ifstream is(itfg->first, std::ifstream::binary);
+		if (!is || !is.is_open()) {
+			this->log->error("Unable to open file " + itfg->first + " for reading!");
+			std::cerr << "Unable to open file " << itfg->first << " for reading!" << std::endl;
+			return false;
+		}
+		this->log->debug("Profiling patterns with " + itfg->first);
+
+		while (std::getline(is, line)) {
+			for (std::vector<unsigned int>::iterator itg = itfg->second.begin(); itg != itfg->second.end(); ++itg) {
+				hb::LogGroup* group = &this->config->logGroups[*itg];
+				profileIndex = groupProfiles[*itg];
+				for (unsigned int t = 0; t < 2; t++) {
+					std::vector<hb::Pattern>* patterns = (t == 0) ? &group->patterns : &group->refusedPatterns;
+					for (itlp = patterns->begin(); itlp != patterns->end(); ++itlp) {
+						hb::PatternProfile* profile = &this->profiles[profileIndex++];
+						try {
+							auto start = std::chrono::steady_clock::now();
+							matched = std::regex_match(line, patternMatchResults, itlp->pattern);
+							auto end = std::chrono::steady_clock::now();
+							ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+							profile->evaluations++;
+							profile->totalNs += ns;
+							profile->samples.push_back(ns > 4e9 ? 4000000000u : (unsigned int)ns);
+							if (ns > profile->worstNs) {
+								profile->worstNs = ns;
+								profile->worstLine = line;
+							}
+							if (matched) {
+								profile->matches++;
+								if (!Util::containsLiteral(line, itlp->literal)) {
+									profile->prefilterMissed++;
+								}
+							} else {
+								profile->nonMatchNs += ns;
+								if (!Util::containsLiteral(line, itlp->literal)) {
+									profile->prefilterSkippable++;
+									profile->skippableNs += ns;
+								}
+							}
+						} catch (std::regex_error& e) {
+							std::string message = e.what();
+							this->log->error(message + ": " + std::to_string(e.code()));
+							this->log->error(hb::Util::regexErrorCode2Text(e.code()));
+						}
+					}
+				}
+			}
+		}
+		is.close();
+	}
+
+	// Growth with line length, measured with slowest line of each pattern
+	groupIndex = 0;
+	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+		profileIndex = groupProfiles[groupIndex++];
+		for (itlp = itlg->patterns.begin(); itlp != itlg->patterns.end(); ++itlp) {
+			this->measureGrowth(&this->profiles[profileIndex++], &(*itlp));
+		}
+		for (itlp = itlg->refusedPatterns.begin(); itlp != itlg->refusedPatterns.end(); ++itlp) {
+			this->measureGrowth(&this->profiles[profileIndex++], &(*itlp));
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Measure how regex time grows with line length, slowest line is repeated 1, 2, 4, 8 and 16 times
+ * Note, std::regex is recursive, so line length is limited to keep stack usage sane
+ */
+void PatternProfiler::measureGrowth(hb::PatternProfile* profile, hb::Pattern* pattern)
+{
+	if (profile->worstLine.length() == 0) {
+		return;
+	}
+
+	std::smatch patternMatchResults;
+	std::string line;
+	double firstLength = 0.0, firstNs = 0.0, lastLength = 0.0, lastNs = 0.0;
+	unsigned int points = 0;
+
+	try {
+		for (unsigned int repeat = 1; repeat <= 16; repeat *= 2) {
+			line = profile->worstLine;
+			for (unsigned int i = 1; i < repeat; i++) {
+				line += " " + profile->worstLine;
+			}
+			if (line.length() > 4096 && points >= 2) {
+				break;
+			}
+
+			// Fastest of 5 runs to reduce noise
+			double best = 0.0;
+			for (unsigned int run = 0; run < 5; run++) {
+				auto start = std::chrono::steady_clock::now();
+				std::regex_match(line, patternMatchResults, pattern->pattern);
+				auto end = std::chrono::steady_clock::now();
+				double ns = std::chrono::duration<double, std::nano>(end - start).count();
+				if (run == 0 || ns < best) best = ns;
+			}
+
+			if (points == 0) {
+				firstLength = line.length();
+				firstNs = best;
+			}
+			lastLength = line.length();
+			lastNs = best;
+			points++;
+
+			// Do not wait for catastrophic backtracking to finish
+			if (best > 50000000.0) {
+				break;
+			}
+		}
+	} catch (std::regex_error& e) {
+		std::string message = e.what();
+		this->log->error(message + ": " + std::to_string(e.code()));
+		this->log->error(hb::Util::regexErrorCode2Text(e.code()));
+	}
+
+	if (points >= 2 && firstNs > 0.0 && lastLength > firstLength) {
+		profile->growth = std::log(lastNs / firstNs) / std::log(lastLength / firstLength);
+		profile->superlinear = profile->growth > this->superlinearThreshold;
+	}
+}
+
+/*
+ * Percentile (0 - 100) of evaluation times
+ */
+double PatternProfiler::percentile(std::vector<unsigned int>* samples, double p)
+{
+	if (samples->size() == 0) {
+		return 0.0;
+	}
+	std::size_t n = (std::size_t)std::ceil(p / 100.0 * samples->size());
+	if (n > 0) n--;
+	if (n >= samples->size()) n = samples->size() - 1;
+	std::nth_element(samples->begin(), samples->begin() + n, samples->end());
+	return (*samples)[n];
+}
+
+/*
+ * Print (stdout) results as table
+ */
+void PatternProfiler::printTable()
+{
+	std::string group = "";
+	unsigned long long int nonMatched;
+	std::string worstLine;
+
+	for (std::vector<hb::PatternProfile>::iterator it = this->profiles.begin(); it != this->profiles.end(); ++it) {
+		if (it == this->profiles.begin() || it->group != group) {
+			group = it->group;
+			std::cout << std::endl << "Log group: " << group << " (" << it->evaluations << " lines)" << std::endl;
+			std::cout << std::right << std::setw(4) << "#" << " " << std::left << std::setw(8) << "type" << std::right << std::setw(10) << "matches" << std::setw(11) << "mean us" << std::setw(11) << "p99 us" << std::setw(14) << "non-match ms" << std::setw(8) << "skip %" << std::setw(8) << "growth" << "  flags" << std::endl;
+		}
+
+		nonMatched = it->evaluations - it->matches;
+		std::cout << std::right << std::setw(4) << it->index << " " << std::left << std::setw(8) << it->type;
+		std::cout << std::right << std::setw(10) << it->matches;
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << std::setw(11) << (it->evaluations > 0 ? it->totalNs / it->evaluations / 1000.0 : 0.0);
+		std::cout << std::setw(11) << PatternProfiler::percentile(&it->samples, 99.0) / 1000.0;
+		std::cout << std::setw(14) << it->nonMatchNs / 1000000.0;
+		std::cout << std::setprecision(1) << std::setw(8) << (nonMatched > 0 ? (double)it->prefilterSkippable * 100.0 / nonMatched : 0.0);
+		std::cout << std::setprecision(2) << std::setw(8) << it->growth;
+		std::cout << " ";
+		if (it->superlinear) std::cout << " superlinear";
+		if (it->literal.length() == 0) std::cout << " no-prefilter";
+		if (it->prefilterMissed > 0) std::cout << " prefilter-missed";
+		std::cout << std::endl;
+
+		std::cout << "     " << it->patternString << std::endl;
+		if (it->literal.length() > 0) {
+			std::cout << "     literal: \"" << it->literal << "\"" << std::endl;
+		}
+		if (it->worstLine.length() > 0) {
+			worstLine = it->worstLine;
+			if (worstLine.length() > 100) {
+				worstLine = worstLine.substr(0, 97) + "...";
+			}
+			std::cout << "     worst " << it->worstNs / 1000.0 << " us: " << worstLine << std::endl;
+		}
+	}
+}
+
+/*
+ * Print (stdout) results as JSON
+ */
+void PatternProfiler::printJSON()
+{
+	Json::Value root;
+	root["patterns"] = Json::Value(Json::arrayValue);
+	for (std::vector<hb::PatternProfile>::iterator it = this->profiles.begin(); it != this->profiles.end(); ++it) {
+		Json::Value item;
+		item["group"] = it->group;
+		item["type"] = it->type;
+		item["index"] = it->index;
+		item["pattern"] = it->patternString;
+		item["literal"] = it->literal;
+		item["evaluations"] = (Json::UInt64)it->evaluations;
+		item["matches"] = (Json::UInt64)it->matches;
+		item["meanNs"] = it->evaluations > 0 ? it->totalNs / it->evaluations : 0.0;
+		item["p99Ns"] = PatternProfiler::percentile(&it->samples, 99.0);
+		item["totalNs"] = it->totalNs;
+		item["nonMatchNs"] = it->nonMatchNs;
+		item["prefilterSkippable"] = (Json::UInt64)it->prefilterSkippable;
+		item["prefilterSkippableNs"] = it->skippableNs;
+		item["prefilterMissed"] = (Json::UInt64)it->prefilterMissed;
+		item["worstNs"] = it->worstNs;
+		item["worstLine"] = it->worstLine;
+		item["growth"] = it->growth;
+		item["superlinear"] = it->superlinear;
+		root["patterns"].append(item);
+	}
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "\t";
+	std::cout << Json::writeString(builder, root) << std::endl;
+}
@@ -0,0 +1,104 @@
+/*
+ * Offline pattern profiler, measures cost of configured patterns against sample log files
+ */
+
+#ifndef HBPROFILER_H
+#define HBPROFILER_H
+
+// Vector
+#include <vector>
+// String
+#include <string>
+// Logger
+#include "logger.h"
+// Config
+#include "config.h"
+// Util
+#include "util.h"
+
+namespace hb{
+
+/*
+ * Profile of single pattern
+ */
+struct PatternProfile {
+	std::string group = "";// Log group name
+	std::string type = "";// pattern or refused
+	unsigned int index = 0;// Position of pattern in log group
+	std::string patternString = "";// Regex as string
+	std::string literal = "";// Literal used by prefilter
+	unsigned long long int evaluations = 0;// Line count regex was evaluated for
+	unsigned long long int matches = 0;// Matched line count
+	unsigned long long int prefilterSkippable = 0;// Not matched lines that prefilter would skip
+	unsigned long long int prefilterMissed = 0;// Matched lines that do not contain literal (prefilter would wrongly skip, should be 0)
+	double totalNs = 0.0;// Total regex time
+	double nonMatchNs = 0.0;// Regex time on not matched lines
+	double skippableNs = 0.0;// Regex time on lines that prefilter would skip
+	std::vector<unsigned int> samples;// Regex time for each evaluation (ns), for percentiles
+	double worstNs = 0.0;// Slowest evaluation
+	std::string worstLine = "";// Line of slowest evaluation
+	double growth = 0.0;// Exponent of time growth with line length (1 - linear)
+	bool superlinear = false;// Whether time grows faster than line length
+};
+
+class PatternProfiler{
+	private:
+
+		/*
+		 * Measure how regex time grows with line length
+		 */
+		void measureGrowth(hb::PatternProfile* profile, hb::Pattern* pattern);
+
+		/*
+		 * Percentile (0 - 100) of evaluation times
+		 */
+		static double percentile(std::vector<unsigned int>* samples, double p);
+
+	public:
+
+		/*
+		 * Logger object
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Config object
+		 */
+		hb::Config* config;
+
+		/*
+		 * Profiles of all configured patterns
+		 */
+		std::vector<hb::PatternProfile> profiles;
+
+		/*
+		 * Growth exponent above which pattern is reported as superlinear
+		 */
+		double superlinearThreshold = 1.5;
+
+		/*
+		 * Constructor
+		 */
+		PatternProfiler(hb::Logger* log, hb::Config* config);
+
+		/*
+		 * Run all patterns against each line of sample files (or configured log files of each group if no sample files given)
+		 * Note, config patterns must be processed
+		 */
+		bool profile(std::vector<std::string> sampleFiles);
+
+		/*
+		 * Print (stdout) results as table
+		 */
+		void printTable();
+
+		/*
+		 * Print (stdout) results as JSON
+		 */
+		void printJSON();
+
+};
+
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Bounded lock-free ring buffer for one producer thread and one consumer thread (SPSC)
+ * Slots are reused, so items keep their buffers (string capacity) and steady state does not allocate
+ */
+
+#ifndef HBRING_H
+#define HBRING_H
+
+// Atomic
+#include <atomic>
+// Vector
+#include <vector>
+
+namespace hb{
+
+template<typename T>
+class Ring{
+	private:
+
+		/*
+		 * Slots, size is power of two
+		 */
+		std::vector<T> slots;
+		std::size_t mask = 0;
+
+		/*
+		 * Position of next slot to publish (written by producer) and next slot to consume (written by consumer)
+		 * Padded to separate cache lines, so that producer and consumer do not invalidate each other on every item
+		 */
+		char padding1[64];
+		std::atomic<std::size_t> head;
+		char padding2[64];
+		std::atomic<std::size_t> tail;
+		char padding3[64];
+
+	public:
+
+		/*
+		 * Constructor, capacity is rounded up to power of two
+		 */
+		Ring(std::size_t capacity)
+		{
+			std::size_t size = 2;
+			while (size < capacity) {
+				size <<= 1;
+			}
+			this->slots.resize(size);
+			this->mask = size - 1;
+			this->head.store(0, std::memory_order_relaxed);
+			this->tail.store(0, std::memory_order_relaxed);
+		}
+
+		/*
+		 * Producer, free slot to fill or NULL if ring is full (backpressure), item is visible to consumer after publish
+		 */
+		T* claim()
+		{
+			std::size_t h = this->head.load(std::memory_order_relaxed);
+			if (h - this->tail.load(std::memory_order_acquire) > this->mask) {
+				return NULL;
+			}
+			return &this->slots[h & this->mask];
+		}
+		void publish()
+		{
+			this->head.store(this->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/*
+		 * Consumer, oldest published item or NULL if ring is empty, slot is returned to producer by pop
+		 */
+		T* front()
+		{
+			std::size_t t = this->tail.load(std::memory_order_relaxed);
+			if (t == this->head.load(std::memory_order_acquire)) {
+				return NULL;
+			}
+			return &this->slots[t & this->mask];
+		}
+		void pop()
+		{
+			this->tail.store(this->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/*
+		 * Count of published items not consumed yet (approximate if called by other thread)
+		 */
+		std::size_t size()
+		{
+			return this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_acquire);
+		}
+
+		/*
+		 * Count of slots
+		 */
+		std::size_t capacity()
+		{
+			return this->mask + 1;
+		}
+
+};
+
+}
+
+#endif
@@ -0,0 +1,284 @@
+/*
+ * Simulated firewall, keeps rules in memory instead of calling iptables
+ */
+
+// Standard string library
+#include <string>
+// String stream library
+#include <sstream>
+// Standard map library
+#include <map>
+// Vector
+#include <vector>
+// Algorithms (find)
+#include <algorithm>
+// Exceptions
+#include <stdexcept>
+// POSIX (usleep)
+namespace cunistd{
+	#include <unistd.h>
+}
+// Header
+#include "simfirewall.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+SimulatedFirewall::SimulatedFirewall()
+: generator(0), distribution(0.0, 1.0)
+{
+
+}
+SimulatedFirewall::SimulatedFirewall(unsigned int latency, double failureRate, unsigned int seed)
+: generator(seed), distribution(0.0, 1.0), latency(latency), failureRate(failureRate)
+{
+
+}
+
+/*
+ * Sleep for configured latency and decide whether operation should fail
+ * Note, failure is reported the same way as iptables failure - with exception
+ */
+void SimulatedFirewall::operation(std::string description)
+{
+	if (this->latency > 0) {
+		cunistd::usleep(this->latency);
+		this->counters.latency += this->latency;
+	}
+	if (this->failureRate > 0.0 && this->distribution(this->generator) < this->failureRate) {
+		this->counters.failures++;
+		throw std::runtime_error("Simulated firewall failure: " + description);
+	}
+}
+
+/*
+ * Whether chain is one of built in iptables chains
+ */
+bool SimulatedFirewall::isBuiltInChain(std::string chain)
+{
+	return chain == "INPUT" || chain == "FORWARD" || chain == "OUTPUT";
+}
+
+/*
+ * Insert rule at the beginning of chain (iptables -I), call with mutex locked
+ */
+void SimulatedFirewall::appendRule(std::string chain, std::string rule)
+{
+	if (this->chains.count(chain) == 0 && !SimulatedFirewall::isBuiltInChain(chain)) {
+		this->counters.failures++;
+		throw std::runtime_error("Failed to execute iptables, returned code: 1");
+	}
+	std::vector<std::string>& rules = this->chains[chain];
+	rules.insert(rules.begin(), rule);
+	this->counters.append++;
+}
+
+/*
+ * Delete first matching rule from chain (iptables -D), call with mutex locked
+ */
+void SimulatedFirewall::removeRule(std::string chain, std::string rule)
+{
+	std::map<std::string, std::vector<std::string>>::iterator itc = this->chains.find(chain);
+	if (itc == this->chains.end()) {
+		this->counters.failures++;
+		throw std::runtime_error("Failed to execute iptables, returned code: 1");
+	}
+	std::vector<std::string>::iterator itr = std::find(itc->second.begin(), itc->second.end(), rule);
+	if (itr == itc->second.end()) {
+		this->counters.failures++;
+		throw std::runtime_error("Failed to execute iptables, returned code: 1");
+	}
+	itc->second.erase(itr);
+	this->counters.remove++;
+}
+
+/*
+ * Create new chain
+ */
+bool SimulatedFirewall::newChain(std::string chain)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->operation("-N " + chain);
+	if (this->chains.count(chain) > 0 || SimulatedFirewall::isBuiltInChain(chain)) {
+		this->counters.failures++;
+		throw std::runtime_error("Failed to execute iptables, returned code: 1");
+	}
+	this->chains[chain] = std::vector<std::string>();
+	this->counters.newChain++;
+	return true;
+}
+
+/*
+ * Append rule to chain
+ */
+bool SimulatedFirewall::append(std::string chain, std::string rule)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->operation("-I " + chain + " " + rule);
+	this->appendRule(chain, rule);
+	return true;
+}
+
+/*
+ * Append rules to chain, each rule is separate operation (as with iptables)
+ */
+bool SimulatedFirewall::append(std::string chain, std::vector<std::string>* rules)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	for (std::vector<std::string>::iterator it = rules->begin(); it != rules->end(); ++it) {
+		this->operation("-I " + chain + " " + *it);
+		this->appendRule(chain, *it);
+	}
+	return true;
+}
+
+/*
+ * Delete rule from chain
+ */
+bool SimulatedFirewall::remove(std::string chain, std::string rule)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->operation("-D " + chain + " " + rule);
+	this->removeRule(chain, rule);
+	return true;
+}
+
+/*
+ * Delete rules from chain, each rule is separate operation (as with iptables)
+ */
+bool SimulatedFirewall::remove(std::string chain, std::vector<std::string>* rules)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	for (std::vector<std::string>::iterator it = rules->begin(); it != rules->end(); ++it) {
+		this->operation("-D " + chain + " " + *it);
+		this->removeRule(chain, *it);
+	}
+	return true;
+}
+
+/*
+ * List chain rules, first line is policy (built in chains) or chain creation
+ * (user defined chains) followed by rules, i.e. same as iptables --list-rules
+ */
+std::map<unsigned int, std::string> SimulatedFirewall::listRules(std::string chain)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->operation("--list-rules " + chain);
+	this->counters.listRules++;
+
+	std::map<unsigned int, std::string> rules;
+	unsigned int ruleInd = 0;
+	std::map<std::string, std::vector<std::string>>::iterator itc = this->chains.find(chain);
+	if (SimulatedFirewall::isBuiltInChain(chain)) {
+		rules.insert(std::pair<unsigned int, std::string>(ruleInd++, "-P " + chain + " ACCEPT"));
+	} else if (itc != this->chains.end()) {
+		rules.insert(std::pair<unsigned int, std::string>(ruleInd++, "-N " + chain));
+	} else {
+		this->counters.failures++;
+		throw std::runtime_error("Failed to execute iptables, returned code: 1");
+	}
+	if (itc != this->chains.end()) {
+		for (std::vector<std::string>::iterator itr = itc->second.begin(); itr != itc->second.end(); ++itr) {
+			rules.insert(std::pair<unsigned int, std::string>(ruleInd++, "-A " + chain + " " + *itr));
+		}
+	}
+	return rules;
+}
+
+/*
+ * Simulate iptables command with custom options
+ */
+bool SimulatedFirewall::command(std::string options)
+{
+	std::istringstream iss(options);
+	std::string action, chain, rule;
+	iss >> action >> chain;
+	std::getline(iss, rule);
+	std::size_t pos = rule.find_first_not_of(" ");
+	rule = (pos != std::string::npos) ? rule.substr(pos) : "";
+
+	if (action == "-N") {
+		return this->newChain(chain);
+	} else if (action == "-I" || action == "-A") {
+		return this->append(chain, rule);
+	} else if (action == "-D") {
+		return this->remove(chain, rule);
+	}
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->operation(options);
+	this->counters.command++;
+	if (action == "-X") {
+		if (this->chains.erase(chain) == 0) {
+			this->counters.failures++;
+			throw std::runtime_error("Failed to execute iptables, returned code: 1");
+		}
+	} else if (action == "-F") {
+		if (chain.length() > 0) {
+			this->chains[chain].clear();
+		} else {
+			for (std::map<std::string, std::vector<std::string>>::iterator itc = this->chains.begin(); itc != this->chains.end(); ++itc) {
+				itc->second.clear();
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * Simulate iptables command with custom options and return stdout in map each line as entry in map
+ */
+std::map<unsigned int, std::string> SimulatedFirewall::custom(std::string options)
+{
+	std::istringstream iss(options);
+	std::string action, chain;
+	iss >> action >> chain;
+	if (action == "-S" || action == "--list-rules") {
+		return this->listRules(chain.length() > 0 ? chain : "INPUT");
+	}
+	this->command(options);
+	return std::map<unsigned int, std::string>();
+}
+
+/*
+ * Get copy of operation counters
+ */
+SimulatedFirewallCounters SimulatedFirewall::getCounters()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->counters;
+}
+
+/*
+ * Reset operation counters
+ */
+void SimulatedFirewall::resetCounters()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->counters = SimulatedFirewallCounters();
+}
+
+/*
+ * Rule count in chain
+ */
+unsigned int SimulatedFirewall::ruleCount(std::string chain)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	std::map<std::string, std::vector<std::string>>::iterator itc = this->chains.find(chain);
+	if (itc == this->chains.end()) {
+		return 0;
+	}
+	return itc->second.size();
+}
+
+/*
+ * Remove all chains and rules
+ */
+void SimulatedFirewall::clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->chains.clear();
+}
@@ -0,0 +1,153 @@
+/*
+ * Simulated firewall, keeps rules in memory instead of calling iptables
+ *
+ * Intended for tests and benchmarks (no root access required, real firewall
+ * is not changed), can also be selected for daemon with firewall.backend.
+ */
+
+// Map
+#include <map>
+// Vector
+#include <vector>
+// Standard string library
+#include <string>
+// Mutex
+#include <mutex>
+// Random number generator
+#include <random>
+// Firewall interface
+#include "firewall.h"
+
+#ifndef HBSIMFIREWALL_H
+#define HBSIMFIREWALL_H
+
+namespace hb{
+
+/*
+ * Operation counters of simulated firewall
+ */
+struct SimulatedFirewallCounters {
+	unsigned long long int newChain = 0;
+	unsigned long long int append = 0;// Rules appended (each rule in bulk append counts)
+	unsigned long long int remove = 0;// Rules removed (each rule in bulk remove counts)
+	unsigned long long int listRules = 0;
+	unsigned long long int command = 0;// Both command() and custom()
+	unsigned long long int failures = 0;// Injected and real (e.g. removing missing rule) failures
+	unsigned long long int latency = 0;// Total injected latency, microseconds
+};
+
+class SimulatedFirewall : public Firewall{
+	private:
+
+		/*
+		 * Rules by chain, in the same order as iptables would list them
+		 */
+		std::map<std::string, std::vector<std::string>> chains;
+
+		/*
+		 * Guards chains, counters and random generator
+		 */
+		std::mutex mutex;
+
+		/*
+		 * Random generator for failure injection
+		 */
+		std::mt19937 generator;
+		std::uniform_real_distribution<double> distribution;
+
+		/*
+		 * Operation counters
+		 */
+		SimulatedFirewallCounters counters;
+
+		/*
+		 * Sleep for configured latency and decide whether operation should fail, call with mutex locked
+		 */
+		void operation(std::string description);
+
+		/*
+		 * Whether chain is one of built in iptables chains
+		 */
+		static bool isBuiltInChain(std::string chain);
+
+		/*
+		 * Append/remove without locking, call with mutex locked
+		 */
+		void appendRule(std::string chain, std::string rule);
+		void removeRule(std::string chain, std::string rule);
+
+	public:
+
+		/*
+		 * Latency injected for each operation, microseconds
+		 */
+		unsigned int latency = 0;
+
+		/*
+		 * Probability of operation failure, 0.0 - 1.0
+		 */
+		double failureRate = 0.0;
+
+		/*
+		 * Constructor
+		 */
+		SimulatedFirewall();
+		SimulatedFirewall(unsigned int latency, double failureRate, unsigned int seed = 0);
+
+		/*
+		 * Create new chain
+		 */
+		bool newChain(std::string chain) override;
+
+		/*
+		 * Append chain with new rule
+		 */
+		bool append(std::string chain, std::string rule) override;
+		bool append(std::string chain, std::vector<std::string>* rules) override;
+
+		/*
+		 * Delete rule from chain
+		 */
+		bool remove(std::string chain, std::string rule) override;
+		bool remove(std::string chain, std::vector<std::string>* rules) override;
+
+		/*
+		 * Get rule list, same format as iptables --list-rules
+		 */
+		std::map<unsigned int, std::string> listRules(std::string chain) override;
+
+		/*
+		 * Simulate iptables command with custom options (-N, -X, -F, -I, -A, -D)
+		 */
+		bool command(std::string options) override;
+
+		/*
+		 * Simulate iptables command with custom options, -S/--list-rules returns rule list
+		 */
+		std::map<unsigned int, std::string> custom(std::string options) override;
+
+		/*
+		 * Get copy of operation counters
+		 */
+		SimulatedFirewallCounters getCounters();
+
+		/*
+		 * Reset operation counters
+		 */
+		void resetCounters();
+
+		/*
+		 * Rule count in chain
+		 */
+		unsigned int ruleCount(std::string chain);
+
+		/*
+		 * Remove all chains and rules
+		 */
+		void clear();
+
+};
+
+}
+
+#endif
@@ -0,0 +1,363 @@
+/*
+ * Binary snapshot of data to bootstrap new hosts
+ */
+
+// C string (strerror)
+#include <cstring>
+// C standard input/output (rename, remove)
+#include <cstdio>
+// Errors
+#include <errno.h>
+// Time (time)
+#include <ctime>
+// Address conversion (inet_pton, inet_ntop)
+#include <arpa/inet.h>
+// Address ranges (address validation)
+#include "cidr.h"
+// Header
+#include "snapshot.h"
+
+// Hostblock namespace
+using namespace hb;
+
+// Header length (magic, version, reserved, creation time) and end record length (type, count, checksum)
+static const std::size_t kSnapshotHeader = 16;
+static const std::size_t kSnapshotEnd = 13;
+
+/*
+ * Lookup table of CRC-32 (reflected polynomial 0xedb88320)
+ */
+struct CrcTable{
+	unsigned int entries[256];
+	CrcTable() {
+		for (unsigned int i = 0; i < 256; i++) {
+			unsigned int c = i;
+			for (unsigned int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			}
+			this->entries[i] = c;
+		}
+	}
+};
+static const CrcTable kCrcTable;
+
+/*
+ * Append integer in network byte order
+ */
+static void putInteger(std::string* output, unsigned long long int value, unsigned int bytes)
+{
+	for (unsigned int i = bytes; i > 0; i--) {
+		output->push_back((char)((value >> ((i - 1) * 8)) & 0xff));
+	}
+}
+
+/*
+ * Integer in network byte order
+ */
+static unsigned long long int getInteger(const std::string& input, std::size_t pos, unsigned int bytes)
+{
+	unsigned long long int value = 0;
+	for (unsigned int i = 0; i < bytes; i++) {
+		value = (value << 8) | (unsigned char)input[pos + i];
+	}
+	return value;
+}
+
+/*
+ * Append address, binary form for IPv4 and IPv6 addresses, text for address ranges (address/length)
+ * Returns false for anything else, address ends up in firewall rules of importing host
+ */
+static bool putAddress(std::string* output, const std::string& address)
+{
+	unsigned char binary[16];
+	hb::Prefix prefix;
+	if (inet_pton(AF_INET, address.c_str(), binary) == 1) {
+		output->push_back(4);
+		output->append((const char*)binary, 4);
+	} else if (inet_pton(AF_INET6, address.c_str(), binary) == 1) {
+		output->push_back(6);
+		output->append((const char*)binary, 16);
+	} else if (address.length() <= 255 && hb::PrefixTrie::parse(address, &prefix)) {
+		output->push_back(0);
+		output->push_back((char)address.length());
+		output->append(address);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Address at position, position is moved after address, returns false if address does not fit in limit or text is not address range
+ */
+static bool getAddress(const std::string& input, std::size_t* pos, std::size_t limit, std::string* address)
+{
+	char text[INET6_ADDRSTRLEN];
+	if (*pos >= limit) {
+		return false;
+	}
+	unsigned int family = (unsigned char)input[*pos];
+	std::size_t length = family == 4 ? 4 : (family == 6 ? 16 : 0);
+	if (family == 0) {
+		if (*pos + 2 > limit) {
+			return false;
+		}
+		length = (unsigned char)input[*pos + 1];
+		if (*pos + 2 + length > limit) {
+			return false;
+		}
+		address->assign(input, *pos + 2, length);
+		hb::Prefix prefix;
+		if (!hb::PrefixTrie::parse(*address, &prefix)) {
+			return false;
+		}
+		*pos += 2 + length;
+		return true;
+	}
+	if (length == 0 || *pos + 1 + length > limit) {
+		return false;
+	}
+	if (inet_ntop(family == 4 ? AF_INET : AF_INET6, input.data() + *pos + 1, text, sizeof(text)) == NULL) {
+		return false;
+	}
+	address->assign(text);
+	*pos += 1 + length;
+	return true;
+}
+
+/*
+ * Constructor
+ */
+SnapshotWriter::SnapshotWriter(hb::Logger* log)
+{
+	this->log = log;
+}
+
+/*
+ * Create snapshot file, writes header
+ */
+bool SnapshotWriter::open(const std::string& path)
+{
+	this->path = path;
+	this->tmpPath = path + ".tmp";
+	this->file.open(this->tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!this->file.is_open()) {
+		this->log->error("Unable to create snapshot " + this->tmpPath + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+		return false;
+	}
+	std::time_t currentRawTime;
+	std::time(&currentRawTime);
+	this->buffer.clear();
+	this->buffer.append("HBSN");
+	putInteger(&this->buffer, kSnapshotVersion, 2);
+	putInteger(&this->buffer, 0, 2);
+	putInteger(&this->buffer, (unsigned long long int)currentRawTime, 8);
+	this->crc = 0;
+	this->count = 0;
+	return true;
+}
+
+/*
+ * Add record
+ */
+bool SnapshotWriter::write(const hb::SnapshotRecord& record)
+{
+	std::size_t recordStart = this->buffer.length();
+	this->buffer.push_back(record.type);
+	if (record.type == 'A') {
+		if (!putAddress(&this->buffer, record.address)) {
+			this->buffer.resize(recordStart);
+			return false;
+		}
+		putInteger(&this->buffer, record.activity.lastActivity, 8);
+		putInteger(&this->buffer, record.activity.activityScore, 4);
+		putInteger(&this->buffer, record.activity.activityCount, 4);
+		putInteger(&this->buffer, record.activity.refusedCount, 4);
+		putInteger(&this->buffer, (record.activity.whitelisted ? 1 : 0) | (record.activity.blacklisted ? 2 : 0), 1);
+		putInteger(&this->buffer, record.activity.lastReported, 8);
+	} else if (record.type == 'B') {
+		if (!putAddress(&this->buffer, record.address)) {
+			this->buffer.resize(recordStart);
+			return false;
+		}
+		putInteger(&this->buffer, record.abuseIPDB.totalReports, 4);
+		putInteger(&this->buffer, record.abuseIPDB.abuseConfidenceScore, 4);
+	} else if (record.type == 'S') {
+		putInteger(&this->buffer, record.syncTime, 8);
+		putInteger(&this->buffer, record.blacklistGenTime, 8);
+	} else {
+		this->buffer.resize(recordStart);
+		return false;
+	}
+	this->count++;
+	if (this->buffer.length() >= 1048576) {
+		return this->flush();
+	}
+	return true;
+}
+
+/*
+ * Write buffer to file and add it to checksum
+ */
+bool SnapshotWriter::flush()
+{
+	this->crc = SnapshotReader::checksum(this->buffer.data(), this->buffer.length(), this->crc);
+	this->file.write(this->buffer.data(), this->buffer.length());
+	this->buffer.clear();
+	if (!this->file.good()) {
+		this->log->error("Failed to write snapshot " + this->tmpPath + "!");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Write end record and replace snapshot file
+ */
+bool SnapshotWriter::close()
+{
+	this->buffer.push_back('E');
+	putInteger(&this->buffer, this->count, 8);
+	if (!this->flush()) {
+		this->file.close();
+		std::remove(this->tmpPath.c_str());
+		return false;
+	}
+	putInteger(&this->buffer, this->crc, 4);
+	this->file.write(this->buffer.data(), this->buffer.length());
+	this->buffer.clear();
+	this->file.close();
+	if (this->file.fail() || std::rename(this->tmpPath.c_str(), this->path.c_str()) != 0) {
+		this->log->error("Failed to save snapshot " + this->path + "!");
+		std::remove(this->tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Count of written records
+ */
+unsigned long long int SnapshotWriter::records()
+{
+	return this->count;
+}
+
+/*
+ * Constructor
+ */
+SnapshotReader::SnapshotReader(hb::Logger* log)
+{
+	this->log = log;
+}
+
+/*
+ * Read snapshot file and check version and checksum
+ */
+bool SnapshotReader::open(const std::string& path)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file.is_open()) {
+		this->log->error("Unable to open snapshot " + path + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+		return false;
+	}
+	file.seekg(0, std::ios::end);
+	std::streamoff size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	this->buffer.assign(size > 0 ? (std::size_t)size : 0, '\0');
+	file.read(&this->buffer[0], this->buffer.length());
+	if (!file.good() && !file.eof()) {
+		this->log->error("Failed to read snapshot " + path + "!");
+		return false;
+	}
+
+	if (this->buffer.length() < kSnapshotHeader + kSnapshotEnd || this->buffer.compare(0, 4, "HBSN") != 0) {
+		this->log->error("File " + path + " is not hostblock snapshot!");
+		return false;
+	}
+	if (getInteger(this->buffer, 4, 2) != kSnapshotVersion) {
+		this->log->error("Unsupported version " + std::to_string(getInteger(this->buffer, 4, 2)) + " of snapshot " + path + "!");
+		return false;
+	}
+	this->end = this->buffer.length() - kSnapshotEnd;
+	if (this->buffer[this->end] != 'E' || SnapshotReader::checksum(this->buffer.data(), this->buffer.length() - 4, 0) != getInteger(this->buffer, this->buffer.length() - 4, 4)) {
+		this->log->error("Checksum of snapshot " + path + " does not match, snapshot is incomplete or damaged!");
+		return false;
+	}
+	this->count = getInteger(this->buffer, this->end + 1, 8);
+	this->position = kSnapshotHeader;
+	return true;
+}
+
+/*
+ * Next record, returns false if there are no more records or record is not valid
+ */
+bool SnapshotReader::next(hb::SnapshotRecord* record)
+{
+	if (this->position >= this->end) {
+		return false;
+	}
+	std::size_t pos = this->position + 1;
+	record->type = this->buffer[this->position];
+	if (record->type == 'A') {
+		if (!getAddress(this->buffer, &pos, this->end, &record->address) || pos + 29 > this->end) {
+			return false;
+		}
+		record->activity.lastActivity = getInteger(this->buffer, pos, 8);
+		record->activity.activityScore = (unsigned int)getInteger(this->buffer, pos + 8, 4);
+		record->activity.activityCount = (unsigned int)getInteger(this->buffer, pos + 12, 4);
+		record->activity.refusedCount = (unsigned int)getInteger(this->buffer, pos + 16, 4);
+		record->activity.whitelisted = (this->buffer[pos + 20] & 1) != 0;
+		record->activity.blacklisted = (this->buffer[pos + 20] & 2) != 0;
+		record->activity.lastReported = getInteger(this->buffer, pos + 21, 8);
+		record->activity.iptableRule = false;
+		pos += 29;
+	} else if (record->type == 'B') {
+		if (!getAddress(this->buffer, &pos, this->end, &record->address) || pos + 8 > this->end) {
+			return false;
+		}
+		record->abuseIPDB.totalReports = (unsigned int)getInteger(this->buffer, pos, 4);
+		record->abuseIPDB.abuseConfidenceScore = (unsigned int)getInteger(this->buffer, pos + 4, 4);
+		record->abuseIPDB.iptableRule = false;
+		pos += 8;
+	} else if (record->type == 'S') {
+		if (pos + 16 > this->end) {
+			return false;
+		}
+		record->syncTime = getInteger(this->buffer, pos, 8);
+		record->blacklistGenTime = getInteger(this->buffer, pos + 8, 8);
+		pos += 16;
+	} else {
+		return false;
+	}
+	this->position = pos;
+	return true;
+}
+
+/*
+ * Whether all records are read
+ */
+bool SnapshotReader::done()
+{
+	return this->position >= this->end;
+}
+
+/*
+ * Count of records in snapshot
+ */
+unsigned long long int SnapshotReader::records()
+{
+	return this->count;
+}
+
+/*
+ * CRC-32 (IEEE 802.3) of data, continuing from crc of previous data
+ */
+unsigned int SnapshotReader::checksum(const char* data, std::size_t length, unsigned int crc)
+{
+	crc = ~crc;
+	for (std::size_t i = 0; i < length; i++) {
+		crc = kCrcTable.entries[(crc ^ (unsigned char)data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
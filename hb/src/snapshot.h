@@ -0,0 +1,149 @@
+/*
+ * Binary snapshot of data (suspicious, whitelisted and blacklisted addresses, AbuseIPDB blacklist) to bootstrap new hosts
+ *
+ * Integers in network byte order, address as family (1 byte, 4 or 6) and 4 or 16 bytes, or family 0, length (1 byte) and address range text (address/length)
+ *   Header: "HBSN", version (2), reserved (2), creation time (8)
+ *   A - address: address, last activity (8), activity score (4), activity count (4), refused count (4), flags (1, whitelisted 1, blacklisted 2), last reported (8)
+ *   B - AbuseIPDB blacklisted address: address, total reports (4), abuse confidence score (4)
+ *   S - AbuseIPDB sync: sync time (8), blacklist generation time (8)
+ *   E - end: count of records (8), CRC-32 of all preceding bytes (4)
+ */
+
+#ifndef HBSNAPSHOT_H
+#define HBSNAPSHOT_H
+
+// Standard string library
+#include <string>
+// File stream
+#include <fstream>
+// Logger
+#include "logger.h"
+// Util
+#include "util.h"
+
+namespace hb{
+
+// Snapshot format version
+static const unsigned int kSnapshotVersion = 1;
+
+/*
+ * Record of snapshot, type is A, B or S
+ */
+struct SnapshotRecord{
+	char type = 0;
+	std::string address = "";
+	hb::SuspiciosAddressType activity;
+	hb::AbuseIPDBBlacklistedAddressType abuseIPDB;
+	unsigned long long int syncTime = 0;
+	unsigned long long int blacklistGenTime = 0;
+};
+
+class SnapshotWriter{
+	private:
+
+		/*
+		 * Logger
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Snapshot is written to temporary file and renamed when complete
+		 */
+		std::string path;
+		std::string tmpPath;
+		std::ofstream file;
+
+		/*
+		 * Encoded records not written yet, checksum and count of written records
+		 */
+		std::string buffer;
+		unsigned int crc = 0;
+		unsigned long long int count = 0;
+
+		/*
+		 * Write buffer to file and add it to checksum
+		 */
+		bool flush();
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		SnapshotWriter(hb::Logger* log);
+
+		/*
+		 * Create snapshot file, writes header
+		 */
+		bool open(const std::string& path);
+
+		/*
+		 * Add record, record with address that is not IP address or address range is refused
+		 */
+		bool write(const hb::SnapshotRecord& record);
+
+		/*
+		 * Write end record and replace snapshot file
+		 */
+		bool close();
+
+		/*
+		 * Count of written records
+		 */
+		unsigned long long int records();
+
+};
+
+class SnapshotReader{
+	private:
+
+		/*
+		 * Logger
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Contents of snapshot file (validated by open), position of next record and end of records
+		 */
+		std::string buffer;
+		std::size_t position = 0;
+		std::size_t end = 0;
+		unsigned long long int count = 0;
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		SnapshotReader(hb::Logger* log);
+
+		/*
+		 * Read snapshot file and check version and checksum
+		 */
+		bool open(const std::string& path);
+
+		/*
+		 * Next record, returns false if there are no more records or record is not valid
+		 */
+		bool next(hb::SnapshotRecord* record);
+
+		/*
+		 * Whether all records are read
+		 */
+		bool done();
+
+		/*
+		 * Count of records in snapshot
+		 */
+		unsigned long long int records();
+
+		/*
+		 * CRC-32 (IEEE 802.3) of data, continuing from crc of previous data
+		 */
+		static unsigned int checksum(const char* data, std::size_t length, unsigned int crc);
+
+};
+
+}
+
+#endif
@@ -6,6 +6,10 @@
 #include <string>
 // std::locale, std::tolower
 #include <locale>
+// C character classification (isalnum, isdigit, tolower)
+#include <cctype>
+// C time (gmtime_r)
+#include <ctime>
 // Header
 #include "util.h"
 
@@ -108,3 +112,524 @@ std::string Util::regexErrorCode2Text(std::regex_constants::error_type code)
 			return "Unknown regex error!";
 	}
 }
+
+/*
+ * Longest literal (lower case) that must be present in any string matched by regex
+ * Note, only top level of ECMAScript regex is analysed, groups, character classes,
+ * escaped character classes and optional characters end literal. If regex has
+ * alternative at top level, literal cannot be determined and empty string is returned.
+ */
+std::string Util::requiredLiteral(std::string regex)
+{
+	std::string best = "";
+	std::string current = "";
+	bool lastIsLiteral = false;// Whether last character in current literal can be repeated/made optional by quantifier
+	std::size_t i = 0;
+	unsigned int depth = 0;
+	unsigned int min = 0;
+	char c;
+
+	while (i < regex.length()) {
+		c = regex[i];
+		if (c == '\\') {
+			if (i + 1 >= regex.length()) break;
+			c = regex[i + 1];
+			i += 2;
+			if (std::isalnum((unsigned char)c)) {
+				// Character class (\d, \s, \w), assertion (\b) or character code (\x41, A, \cA, \0), ends literal
+				if (c == 'x') i += 2;
+				else if (c == 'u') i += 4;
+				else if (c == 'c') i += 1;
+				if (current.length() > best.length()) best = current;
+				current = "";
+				lastIsLiteral = false;
+			} else {
+				current += std::tolower((unsigned char)c);
+				lastIsLiteral = true;
+			}
+		} else if (c == '(') {
+			// Skip group
+			depth = 1;
+			i++;
+			while (i < regex.length() && depth > 0) {
+				if (regex[i] == '\\') {
+					i++;
+				} else if (regex[i] == '[') {
+					i++;
+					if (i < regex.length() && regex[i] == '^') i++;
+					if (i < regex.length() && regex[i] == ']') i++;
+					while (i < regex.length() && regex[i] != ']') {
+						if (regex[i] == '\\') i++;
+						i++;
+					}
+				} else if (regex[i] == '(') {
+					depth++;
+				} else if (regex[i] == ')') {
+					depth--;
+				}
+				i++;
+			}
+			if (current.length() > best.length()) best = current;
+			current = "";
+			lastIsLiteral = false;
+		} else if (c == '[') {
+			// Skip character class
+			i++;
+			if (i < regex.length() && regex[i] == '^') i++;
+			if (i < regex.length() && regex[i] == ']') i++;
+			while (i < regex.length() && regex[i] != ']') {
+				if (regex[i] == '\\') i++;
+				i++;
+			}
+			i++;
+			if (current.length() > best.length()) best = current;
+			current = "";
+			lastIsLiteral = false;
+		} else if (c == '*' || c == '?' || c == '+' || c == '{') {
+			// Quantifier, if it allows zero repetitions last character is not required
+			min = (c == '+') ? 1 : 0;
+			if (c == '{') {
+				i++;
+				while (i < regex.length() && std::isdigit((unsigned char)regex[i])) {
+					min = min * 10 + (regex[i] - '0');
+					i++;
+				}
+				while (i < regex.length() && regex[i] != '}') i++;
+			}
+			i++;
+			if (lastIsLiteral && min == 0) current.pop_back();
+			if (current.length() > best.length()) best = current;
+			current = "";
+			lastIsLiteral = false;
+		} else if (c == '|') {
+			// Alternative at top level, nothing is required
+			return "";
+		} else if (c == '.' || c == '^' || c == '$') {
+			i++;
+			if (current.length() > best.length()) best = current;
+			current = "";
+			lastIsLiteral = false;
+		} else {
+			current += std::tolower((unsigned char)c);
+			lastIsLiteral = true;
+			i++;
+		}
+	}
+	if (current.length() > best.length()) best = current;
+
+	return best;
+}
+
+/*
+ * Case insensitive search for lower case literal in string
+ */
+bool Util::containsLiteral(const std::string& str, const std::string& literal)
+{
+	if (literal.length() == 0) return true;
+	if (literal.length() > str.length()) return false;
+	const char first = literal[0];
+	const std::size_t last = str.length() - literal.length();
+	std::size_t j;
+	for (std::size_t i = 0; i <= last; i++) {
+		if (std::tolower((unsigned char)str[i]) != first) continue;
+		for (j = 1; j < literal.length(); j++) {
+			if (std::tolower((unsigned char)str[i + j]) != literal[j]) break;
+		}
+		if (j == literal.length()) return true;
+	}
+	return false;
+}
+
+/*
+ * Find value of string field in JSON object line (container json-file log), without copying
+ * Minimal scanner, key must not be preceded by backslash (escaped quote inside other value)
+ */
+bool Util::jsonStringField(const std::string& line, const std::string& name, std::size_t* start, std::size_t* end, bool* escaped)
+{
+	std::size_t pos = 0, n = line.length();
+	*escaped = false;
+	while (true) {
+		pos = line.find(name, pos);
+		if (pos == std::string::npos) {
+			return false;
+		}
+		if (pos > 0 && line[pos - 1] == '"' && (pos < 2 || line[pos - 2] != '\\') && pos + name.length() < n && line[pos + name.length()] == '"') {
+			break;
+		}
+		pos++;
+	}
+
+	// Separator and opening quote
+	pos += name.length() + 1;
+	while (pos < n && line[pos] == ' ') pos++;
+	if (pos >= n || line[pos] != ':') {
+		return false;
+	}
+	pos++;
+	while (pos < n && line[pos] == ' ') pos++;
+	if (pos >= n || line[pos] != '"') {
+		return false;
+	}
+	*start = ++pos;
+
+	// Closing quote
+	while (pos < n && line[pos] != '"') {
+		if (line[pos] == '\\') {
+			*escaped = true;
+			pos++;
+		}
+		pos++;
+	}
+	if (pos >= n) {
+		return false;
+	}
+	*end = pos;
+
+	// Trailing new line of message
+	if (*end - *start >= 2 && line.compare(*end - 2, 2, "\\n") == 0) {
+		*end -= 2;
+		if (*end - *start >= 2 && line.compare(*end - 2, 2, "\\r") == 0) {
+			*end -= 2;
+		}
+		*escaped = line.find('\\', *start) < *end;
+	}
+	return true;
+}
+
+/*
+ * Value of hexadecimal digits at position (invalid digits count as 0)
+ */
+unsigned long int Util::hexValue(const std::string& str, std::size_t pos, std::size_t length)
+{
+	unsigned long int value = 0;
+	char c;
+	for (std::size_t i = pos; i < pos + length && i < str.length(); i++) {
+		c = str[i];
+		value <<= 4;
+		if (c >= '0' && c <= '9') value |= c - '0';
+		else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+	}
+	return value;
+}
+
+/*
+ * Unescape JSON string value between start and end into output (\uXXXX is written as UTF-8), capacity of output is reused
+ */
+void Util::jsonUnescape(const std::string& line, std::size_t start, std::size_t end, std::string* output)
+{
+	unsigned long int code, low;
+	output->clear();
+	for (std::size_t i = start; i < end; i++) {
+		if (line[i] != '\\' || i + 1 >= end) {
+			output->push_back(line[i]);
+			continue;
+		}
+		i++;
+		switch (line[i]) {
+			case 'n': output->push_back('\n'); break;
+			case 'r': output->push_back('\r'); break;
+			case 't': output->push_back('\t'); break;
+			case 'b': output->push_back('\b'); break;
+			case 'f': output->push_back('\f'); break;
+			case 'u':
+				if (i + 4 >= end) {
+					return;
+				}
+				code = Util::hexValue(line, i + 1, 4);
+				i += 4;
+				// Surrogate pair
+				if (code >= 0xD800 && code <= 0xDBFF && i + 6 < end && line[i + 1] == '\\' && line[i + 2] == 'u') {
+					low = Util::hexValue(line, i + 3, 4);
+					if (low >= 0xDC00 && low <= 0xDFFF) {
+						code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+						i += 6;
+					}
+				}
+				if (code < 0x80) {
+					output->push_back((char)code);
+				} else if (code < 0x800) {
+					output->push_back((char)(0xC0 | (code >> 6)));
+					output->push_back((char)(0x80 | (code & 0x3F)));
+				} else if (code < 0x10000) {
+					output->push_back((char)(0xE0 | (code >> 12)));
+					output->push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+					output->push_back((char)(0x80 | (code & 0x3F)));
+				} else {
+					output->push_back((char)(0xF0 | (code >> 18)));
+					output->push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+					output->push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+					output->push_back((char)(0x80 | (code & 0x3F)));
+				}
+				break;
+			default:// \" \\ \/
+				output->push_back(line[i]);
+		}
+	}
+}
+
+/*
+ * Whether literal can be found in JSON escaped text as is (no characters that JSON encoders escape, Docker also escapes <, > and &)
+ */
+bool Util::jsonRawSafe(const std::string& literal)
+{
+	for (std::size_t i = 0; i < literal.length(); i++) {
+		unsigned char c = (unsigned char)literal[i];
+		if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\' || c == '<' || c == '>' || c == '&') {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find program name (tag or APP-NAME) in syslog line header (RFC3164 or RFC5424), without copying
+ * RFC3164: [<PRI>]Mmm dd hh:mm:ss HOSTNAME TAG[PID]: MSG (ISO 8601 timestamp is also accepted)
+ * RFC5424: <PRI>VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID ...
+ */
+bool Util::syslogProgram(const std::string& line, std::size_t* start, std::size_t* length)
+{
+	const char* s = line.data();
+	std::size_t n = line.length(), pos = 0, end = 0;
+	bool rfc5424 = false;
+
+	// Optional priority
+	if (n > 0 && s[0] == '<') {
+		pos = 1;
+		while (pos < n && pos < 4 && s[pos] >= '0' && s[pos] <= '9') pos++;
+		if (pos >= n || s[pos] != '>') {
+			return false;
+		}
+		pos++;
+		// Version, present only in RFC5424
+		if (pos + 1 < n && s[pos] >= '1' && s[pos] <= '9' && s[pos + 1] == ' ') {
+			rfc5424 = true;
+			pos += 2;
+		}
+	}
+
+	if (rfc5424) {
+		// Skip timestamp and hostname
+		for (unsigned int field = 0; field < 2; field++) {
+			while (pos < n && s[pos] != ' ') pos++;
+			if (pos >= n) {
+				return false;
+			}
+			pos++;
+		}
+		end = pos;
+		while (end < n && s[end] != ' ') end++;
+		// Nil value
+		if (end == pos || (end - pos == 1 && s[pos] == '-')) {
+			return false;
+		}
+	} else {
+		// Timestamp, fixed length "Mmm dd hh:mm:ss " or ISO 8601 until space
+		if (pos + 16 <= n && s[pos + 3] == ' ' && s[pos + 6] == ' ' && s[pos + 9] == ':' && s[pos + 12] == ':' && s[pos + 15] == ' ') {
+			pos += 16;
+		} else if (pos + 11 <= n && s[pos] >= '0' && s[pos] <= '9' && s[pos + 4] == '-' && s[pos + 7] == '-' && s[pos + 10] == 'T') {
+			while (pos < n && s[pos] != ' ') pos++;
+			pos++;
+		} else {
+			return false;
+		}
+		// Skip hostname
+		while (pos < n && s[pos] != ' ') pos++;
+		pos++;
+		if (pos >= n) {
+			return false;
+		}
+		// Tag ends with [, : or space
+		end = pos;
+		while (end < n && s[end] != '[' && s[end] != ':' && s[end] != ' ') end++;
+		if (end == pos || end >= n) {
+			return false;
+		}
+	}
+
+	*start = pos;
+	*length = end - pos;
+	return true;
+}
+
+/*
+ * Split AbuseIPDB comment template into literal text and placeholders (%i, %p, %m, %d)
+ */
+std::vector<hb::CommentToken> Util::compileComment(const std::string& comment)
+{
+	std::vector<hb::CommentToken> tokens;
+	std::string text = "";
+	for (std::size_t i = 0; i < comment.length(); i++) {
+		if (comment[i] == '%' && i + 1 < comment.length() && (comment[i + 1] == 'i' || comment[i + 1] == 'p' || comment[i + 1] == 'm' || comment[i + 1] == 'd')) {
+			if (text.length() > 0) {
+				hb::CommentToken token;
+				token.text = text;
+				tokens.push_back(token);
+				text = "";
+			}
+			hb::CommentToken token;
+			token.placeholder = comment[i + 1];
+			tokens.push_back(token);
+			i++;
+		} else {
+			text += comment[i];
+		}
+	}
+	if (text.length() > 0) {
+		hb::CommentToken token;
+		token.text = text;
+		tokens.push_back(token);
+	}
+	return tokens;
+}
+
+/*
+ * Days since 1970-01-01 for date in proleptic Gregorian calendar
+ * http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+ */
+long long int Util::daysFromCivil(long long int year, unsigned int month, unsigned int day)
+{
+	year -= month <= 2 ? 1 : 0;
+	long long int era = (year >= 0 ? year : year - 399) / 400;
+	long long int yearOfEra = year - era * 400;
+	long long int dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	long long int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097 + dayOfEra - 719468;
+}
+
+/*
+ * Parse timestamp from log line with fixed format, without regex and time zone database
+ * Examples: syslog "%b %e %H:%M:%S", Apache "[%d/%b/%Y:%H:%M:%S %z", ISO 8601 "%Y-%m-%dT%H:%M:%S"
+ */
+bool Util::parseLogTime(const std::string& line, const std::string& format, long int utcOffset, unsigned long long int reference, unsigned long long int* time)
+{
+	static const char months[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+	const char* s = line.data();
+	std::size_t n = line.length(), pos = 0, f = 0, prefix = 0;
+	long long int year = -1, month = 1, day = 1, hour = 0, minute = 0, second = 0, epoch = -1, offset = utcOffset;
+	unsigned int m;
+
+	// Read from 1 to max digits
+	auto digits = [s, n, &pos](unsigned int max, long long int* value) -> bool {
+		unsigned int count = 0;
+		*value = 0;
+		while (pos < n && count < max && s[pos] >= '0' && s[pos] <= '9') {
+			*value = *value * 10 + (s[pos] - '0');
+			pos++;
+			count++;
+		}
+		return count > 0;
+	};
+
+	// Literal text before first placeholder
+	while (prefix < format.length() && format[prefix] != '%') prefix++;
+	if (prefix > 0) {
+		pos = line.find(format.data(), 0, prefix);
+		if (pos == std::string::npos) {
+			return false;
+		}
+		pos += prefix;
+		f = prefix;
+	}
+
+	while (f < format.length()) {
+		// Literal character
+		if (format[f] != '%' || f + 1 == format.length() || format[f + 1] == '%') {
+			if (pos >= n || s[pos] != format[f]) {
+				return false;
+			}
+			pos++;
+			f += format[f] == '%' ? 2 : 1;
+			continue;
+		}
+		switch (format[f + 1]) {
+			case 'Y':
+				if (!digits(4, &year)) return false;
+				break;
+			case 'm':
+				if (!digits(2, &month)) return false;
+				break;
+			case 'e':
+				if (pos < n && s[pos] == ' ') pos++;
+				if (!digits(2, &day)) return false;
+				break;
+			case 'd':
+				if (!digits(2, &day)) return false;
+				break;
+			case 'H':
+				if (!digits(2, &hour)) return false;
+				break;
+			case 'M':
+				if (!digits(2, &minute)) return false;
+				break;
+			case 'S':
+				if (!digits(2, &second)) return false;
+				break;
+			case 's':
+				if (!digits(20, &epoch)) return false;
+				break;
+			case 'f':
+				while (pos < n && s[pos] >= '0' && s[pos] <= '9') pos++;
+				break;
+			case 'b':
+				if (pos + 3 > n) return false;
+				for (m = 0; m < 12; m++) {
+					if (std::tolower(s[pos]) == months[m * 3] && std::tolower(s[pos + 1]) == months[m * 3 + 1] && std::tolower(s[pos + 2]) == months[m * 3 + 2]) {
+						break;
+					}
+				}
+				if (m == 12) return false;
+				month = m + 1;
+				pos += 3;
+				break;
+			case 'z':
+				// Z, +hhmm or +hh:mm
+				if (pos < n && s[pos] == 'Z') {
+					offset = 0;
+					pos++;
+				} else if (pos < n && (s[pos] == '+' || s[pos] == '-')) {
+					long long int hours = 0, minutes = 0;
+					bool negative = s[pos] == '-';
+					pos++;
+					if (!digits(2, &hours)) return false;
+					if (pos < n && s[pos] == ':') pos++;
+					if (!digits(2, &minutes)) return false;
+					offset = (hours * 3600 + minutes * 60) * (negative ? -1 : 1);
+				} else {
+					return false;
+				}
+				break;
+			default:
+				return false;
+		}
+		f += 2;
+	}
+
+	if (epoch >= 0) {
+		*time = (unsigned long long int)epoch;
+		return true;
+	}
+	if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+		return false;
+	}
+
+	// Year is not logged (syslog), use year of reference time, or previous year if time would be in future
+	bool guessYear = year < 0;
+	if (guessYear) {
+		std::time_t local = (std::time_t)reference + offset;
+		struct tm parts;
+		if (gmtime_r(&local, &parts) == NULL) {
+			return false;
+		}
+		year = parts.tm_year + 1900;
+	}
+	long long int result = Util::daysFromCivil(year, (unsigned int)month, (unsigned int)day) * 86400 + hour * 3600 + minute * 60 + second - offset;
+	if (guessYear && result > (long long int)reference + 86400) {
+		result = Util::daysFromCivil(year - 1, (unsigned int)month, (unsigned int)day) * 86400 + hour * 3600 + minute * 60 + second - offset;
+	}
+	if (result < 0) {
+		return false;
+	}
+	*time = (unsigned long long int)result;
+	return true;
+}
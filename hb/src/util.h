@@ -9,6 +9,16 @@
 #include <vector>
 // RegEx
 #include <regex>
+// Bitset
+#include <bitset>
+// Smart pointers (shared_ptr)
+#include <memory>
+// List
+#include <list>
+// Map
+#include <map>
+// Correlation table
+#include "correlation.h"
 
 namespace hb{
 
@@ -20,6 +30,53 @@ enum Report {
 	NotSet
 };
 
+/*
+ * Token of compiled AbuseIPDB comment template
+ */
+struct CommentToken {
+	char placeholder = 0;// Placeholder (i - address, p - port, m - matched line, d - datetime), 0 for literal text
+	std::string text = "";// Literal text
+};
+
+/*
+ * AbuseIPDB report policy of pattern, resolved from global, log group and pattern settings when patterns are processed (immutable afterwards)
+ */
+struct ReportPolicy {
+	bool report = false;// Whether to report matches (API key is set and report setting resolves to true)
+	std::bitset<64> categories;// AbuseIPDB categories
+	std::vector<unsigned int> categoryList;// Same categories as list (for API request)
+	std::vector<CommentToken> comment;// Compiled comment template, empty for no comment
+	bool commentUsesLine = false;// Whether comment contains matched line (%m)
+};
+
+/*
+ * Pattern severity, match of high severity pattern blocks address on first hit
+ */
+enum Severity {
+	Normal,
+	High
+};
+
+/*
+ * Format of log lines, lines of native formats are split into fields without regex (see NativeParser)
+ */
+enum LogFormat {
+	Regex,
+	ApacheCombined,
+	Sshd,
+	PostfixSasl
+};
+
+/*
+ * Rate rule, address is blocked if count of matches happen within seconds (count 0 - no rule)
+ */
+struct RateLimit {
+	unsigned int count = 0;
+	unsigned int seconds = 0;
+	unsigned int bucketSeconds = 1;// Bucket width of rate window, period divided by bucket count (set when patterns are processed)
+	unsigned int window = 0;// Index of rate window of address, rules with same bucket width share window (set when patterns are processed)
+};
+
 /*
  * Pattern
  */
@@ -27,11 +84,53 @@ struct Pattern {
 	std::string patternString = "";// Regex as string
 	bool portSearch = false;// Whether should search for port in pattern
 	std::regex pattern;// Regex to match
+	std::string literal = "";// Lower case literal that must be present in line for regex to match, empty if unknown (prefilter)
+	unsigned int index = 0;// Position in log group as configured (starting from 1), stable identity for logs and metrics
+	unsigned long long int evaluations = 0;// Line count pattern was tried for (since config load)
+	unsigned long long int hits = 0;// Matched line count (since config load)
+	double cost = 0.0;// Total evaluation time including prefilter (ns, since config load)
 	unsigned int score = 1;// Score if pattern matched
 	Report abuseipdbReport = Report::NotSet;
 	std::vector<unsigned int> abuseipdbCategories;
 	std::string abuseipdbComment;
 	bool abuseipdbCommentIsSet = false;// Comment is optional, if empty string is set at this level, then do not send comment (do not use comment from global settings)
+	std::shared_ptr<const ReportPolicy> reportPolicy;// Resolved report policy (set when patterns are processed)
+	RateLimit rate;// Rate rule (if not set for pattern, then log group rule is used when patterns are processed)
+	Severity severity = Severity::Normal;
+	bool native = false;// Native rule (log.native), fields parsed by native parser of log group are compared instead of regex
+	std::string nativeEvent = "";// Event of message (sshd, postfix_sasl), empty for any
+	std::vector<unsigned int> nativeStatus;// Response status codes (apache_combined), empty for any
+	std::string nativePath = "";// Lower case text that request path must contain (apache_combined), empty for any
+};
+
+/*
+ * Correlation rule, start pattern captures address and ID (%i and %k), later line that matches match pattern with same ID (%k) is scored as activity of address
+ */
+struct CorrelationRule {
+	std::string startString = "";// Start pattern as string
+	std::regex start;
+	std::string startLiteral = "";// Prefilter of start pattern
+	unsigned int addressGroup = 1;// Regex group of address in start pattern
+	unsigned int idGroup = 2;// Regex group of ID in start pattern
+	std::string matchString = "";// Match pattern as string
+	std::regex match;
+	std::string matchLiteral = "";// Prefilter of match pattern
+	unsigned int index = 0;// Position in log group as configured (starting from 1)
+	unsigned int score = 1;// Score if match pattern matched line with known ID
+	unsigned int ttl = 600;// Seconds address is kept for ID
+	unsigned int entries = 10000;// Max count of IDs kept
+	std::shared_ptr<hb::CorrelationTable> table;// State (created when patterns are processed)
+	unsigned long long int starts = 0;// Lines matched with start pattern (since config load)
+	unsigned long long int hits = 0;// Lines matched with match pattern and known ID (since config load)
+	unsigned long long int misses = 0;// Lines matched with match pattern, but ID is not known (since config load)
+};
+
+/*
+ * Source of log lines, container json-file logs have one JSON object per line with message in "log" field
+ */
+enum LogSource {
+	Plain,
+	DockerJson
 };
 
 /*
@@ -41,6 +140,11 @@ struct LogFile {
 	std::string path = "";// Path (config file)
 	unsigned long long int bookmark = 0;// Bookmark for seekg (data file)
 	unsigned long long int size = 0;// File size when last processed (data file)
+	unsigned long long int tailStart = 0;// Range after bookmark already processed by newest first reading, empty if equal (data file)
+	unsigned long long int tailEnd = 0;
+	bool tailRecord = false;// Whether datafile has parsed range record
+	unsigned long long int inode = 0;// Inode of file bookmark belongs to, 0 if not known yet (data file)
+	bool inodeRecord = false;// Whether datafile has inode record
 	bool dataFileRecord = false;
 };
 
@@ -50,12 +154,28 @@ struct LogFile {
 struct LogGroup {
 	std::vector<Pattern> patterns;
 	std::vector<Pattern> refusedPatterns;
+	std::vector<CorrelationRule> correlations;
 	std::vector<LogFile> logFiles;
 	std::string name = "";
 	Report abuseipdbReport = Report::NotSet;
 	std::vector<unsigned int> abuseipdbCategories;
 	std::string abuseipdbComment;
 	bool abuseipdbCommentIsSet = false;// Comment is optional, if empty string is set at this level, then do not send comment (do not use comment from log group or global settings)
+	Report reorder = Report::NotSet;// Whether patterns may be evaluated in other order than configured, if not set - only when it cannot change results
+	bool reorderPatterns = false;// Resolved when patterns are processed
+	bool reorderRefusedPatterns = false;
+	std::vector<unsigned int> patternOrder;// Evaluation order, indexes in patterns
+	std::vector<unsigned int> refusedPatternOrder;// Evaluation order, indexes in refusedPatterns
+	std::vector<std::string> programs;// Syslog programs (tags) of interest, empty for all lines
+	RateLimit rate;// Rate rule for all patterns of log group
+	unsigned int overloadSample = 1;// In overload mode match only each Nth line, 0 skips all lines
+	unsigned long long int overloadLines = 0;// Lines seen in overload mode (sampling counter)
+	unsigned long long int linesShed = 0;// Lines not matched with patterns because of overload mode
+	LogFormat format = LogFormat::Regex;// Format of log lines for native rules
+	LogSource source = LogSource::Plain;// Source of log lines (plain text or container json-file)
+	bool rawPrefilter = false;// Whether escaped JSON line can be rejected by prefilter literals before unescaping (resolved when patterns are processed)
+	std::string timeFormat = "";// Format of timestamp in log lines, for historic log replay (see Util::parseLogTime)
+	unsigned long long int lastLogTime = 0;// Last timestamp parsed from log line
 };
 
 /*
@@ -79,6 +199,57 @@ struct SuspiciosAddressStatType{
 	std::string address = "";
 };
 
+/*
+ * Recent matches of address, ring of fixed count of buckets (each bucket counts matches during bucket width seconds)
+ */
+static const unsigned int kRateBuckets = 16;
+struct RateWindowType{
+	unsigned int bucketSeconds = 0;// Bucket width, window is restarted if rule with other width uses it
+	unsigned long long int newestStart = 0;// Start time of newest bucket
+	unsigned int newest = 0;// Index of newest bucket
+	unsigned short buckets[kRateBuckets] = {0};
+};
+
+/*
+ * Aggregate activity of subnet (all addresses with same prefix)
+ */
+struct SubnetActivityType{
+	unsigned long long int lastActivity = 0;
+	unsigned int activityScore = 0;
+	unsigned int activityCount = 0;
+	std::string rule = "";// iptables rule of subnet, empty if subnet is not blocked
+	std::list<std::string>::iterator lru;// Position in least recently updated list
+};
+
+/*
+ * Address or range listed in blocklist feeds
+ */
+struct FeedEntryType{
+	unsigned int sources = 0;// Count of feeds that list entry
+	std::string rule = "";// iptables rule of entry, empty if entry is not blocked (whitelisted or IPv6)
+};
+
+/*
+ * Block decision of hostblock instance, published to peers
+ */
+struct PeerDelta{
+	unsigned long long int sequence = 0;// Sequence number in log of publishing instance
+	std::string address = "";
+	unsigned int score = 0;// Score of address at publishing instance (without score multiplier)
+	unsigned long long int expires = 0;// Time when block expires, 0 if publishing instance keeps block until score is 0
+	std::string source = "";// Name of publishing instance
+};
+
+/*
+ * Block decisions of peers about address, address is blocked while sum of scores of decisions not expired yet reaches peer block score
+ */
+struct PeerBlockType{
+	std::map<std::string, std::pair<unsigned int, unsigned long long int>> decisions;// Source -> score and expiry time
+	unsigned int score = 0;// Sum of scores of decisions not expired yet
+	unsigned long long int expires = 0;// Time when last decision expires
+	std::string rule = "";// iptables rule of address created because of peers, empty if there is none
+};
+
 /*
  * Data about AbuseIPDB blacklisted address
  */
@@ -93,8 +264,14 @@ struct AbuseIPDBBlacklistedAddressType{
  */
 struct ReportToAbuseIPDB {
 	std::string ip;
-	std::vector<unsigned int> categories;
+	std::shared_ptr<const ReportPolicy> policy;// Report policy of matched pattern (categories), shared instead of copied
 	std::string comment;
+	// Move-only, reports are moved through queue
+	ReportToAbuseIPDB() = default;
+	ReportToAbuseIPDB(const ReportToAbuseIPDB&) = delete;
+	ReportToAbuseIPDB& operator=(const ReportToAbuseIPDB&) = delete;
+	ReportToAbuseIPDB(ReportToAbuseIPDB&&) = default;
+	ReportToAbuseIPDB& operator=(ReportToAbuseIPDB&&) = default;
 };
 
 /*
@@ -145,6 +322,16 @@ struct AbuseIPDBJSONData {
 class Util{
 	private:
 
+		/*
+		 * Days since 1970-01-01 for date in proleptic Gregorian calendar
+		 */
+		static long long int daysFromCivil(long long int year, unsigned int month, unsigned int day);
+
+		/*
+		 * Value of hexadecimal digits at position (invalid digits count as 0)
+		 */
+		static unsigned long int hexValue(const std::string& str, std::size_t pos, std::size_t length);
+
 	public:
 
 		/*
@@ -172,6 +359,52 @@ class Util{
 		 */
 		static std::string regexErrorCode2Text(std::regex_constants::error_type code);
 
+		/*
+		 * Longest literal (lower case) that must be present in any string matched by regex, empty string if not found
+		 */
+		static std::string requiredLiteral(std::string regex);
+
+		/*
+		 * Case insensitive search for lower case literal in string
+		 */
+		static bool containsLiteral(const std::string& str, const std::string& literal);
+
+		/*
+		 * Find program name (tag or APP-NAME) in syslog line header (RFC3164 or RFC5424), without copying
+		 * Returns false if line does not look like syslog line
+		 */
+		static bool syslogProgram(const std::string& line, std::size_t* start, std::size_t* length);
+
+		/*
+		 * Find value of string field in JSON object line (container json-file log), without copying
+		 * Value is between start and end (still escaped, trailing new line is excluded), escaped is set if value contains escape sequences
+		 * Returns false if field is not found or value is not terminated
+		 */
+		static bool jsonStringField(const std::string& line, const std::string& name, std::size_t* start, std::size_t* end, bool* escaped);
+
+		/*
+		 * Unescape JSON string value between start and end into output (\uXXXX is written as UTF-8), capacity of output is reused
+		 */
+		static void jsonUnescape(const std::string& line, std::size_t start, std::size_t end, std::string* output);
+
+		/*
+		 * Whether literal can be found in JSON escaped text as is (no characters that JSON encoders escape)
+		 */
+		static bool jsonRawSafe(const std::string& literal);
+
+		/*
+		 * Split AbuseIPDB comment template into literal text and placeholders (%i, %p, %m, %d)
+		 */
+		static std::vector<hb::CommentToken> compileComment(const std::string& comment);
+
+		/*
+		 * Parse timestamp from log line with fixed format (%Y %m %d %e %b %H %M %S %z %s, %f skips fraction of second), without regex and time zone database
+		 * Literal text at start of format is searched in line, otherwise timestamp must be at start of line
+		 * Time without %z is local time with given UTC offset (seconds), year missing in format (syslog) is taken from reference time
+		 * Returns false if line does not match format
+		 */
+		static bool parseLogTime(const std::string& line, const std::string& format, long int utcOffset, unsigned long long int reference, unsigned long long int* time);
+
 };
 
 }
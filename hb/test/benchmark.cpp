@@ -0,0 +1,715 @@
+/*
+ * Data layer microbenchmarks
+ *
+ * Generates datafiles with requested record count, AbuseIPDB section and
+ * tombstone (records marked for removal) ratio, runs each hb::Data datafile
+ * operation against them and writes results as JSON (stdout or file), so that
+ * results from different releases can be compared. Summary table is written to
+ * stderr.
+ *
+ * Log line processing is measured with heap allocation counter, lines that do
+ * not match any pattern and lines matched by native parser must not allocate
+ * (exit code 1 otherwise).
+ *
+ * Usage:
+ * benchmark [-s 1000,100000,1000000] [-t 0.5] [-o results.json] [-f /tmp/hostblock.bench.data]
+ */
+
+// Standard input/output stream library (cin, cout, cerr, clog)
+#include <iostream>
+// File stream library (ofstream)
+#include <fstream>
+// Parametric manipulators (setw, setfill)
+#include <iomanip>
+// Standard string library
+#include <string>
+// Standard vector library
+#include <vector>
+// Algorithms (shuffle)
+#include <algorithm>
+// Functional (function)
+#include <functional>
+// Chrono (steady_clock)
+#include <chrono>
+// Random
+#include <random>
+// C standard library (malloc, free)
+#include <cstdlib>
+// Queue
+#include <queue>
+// Mutex
+#include <mutex>
+// Thread
+#include <thread>
+// Atomic
+#include <atomic>
+// Syslog
+namespace csyslog{
+	#include <syslog.h>
+}
+// C getopt
+namespace cgetopt{
+	#include <getopt.h>
+}
+// JSON
+#include <jsoncpp/json/json.h>
+// Logger
+#include "../src/logger.h"
+// Simulated firewall
+#include "../src/simfirewall.h"
+// Config
+#include "../src/config.h"
+// Data
+#include "../src/data.h"
+// Log parser
+#include "../src/logparser.h"
+// Native log format parsers
+#include "../src/nativeparser.h"
+
+/*
+ * Heap allocation counter (atomic, matcher pool scenarios allocate from several threads)
+ */
+static std::atomic<unsigned long long int> allocationCount(0);
+
+/*
+ * Scalar and array forms are replaced together, so that every form allocates and frees with malloc and free
+ */
+static void* countedAllocation(std::size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void* p = std::malloc(size == 0 ? 1 : size);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t size)
+{
+	return countedAllocation(size);
+}
+
+void* operator new[](std::size_t size)
+{
+	return countedAllocation(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t size) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t size) noexcept
+{
+	std::free(p);
+}
+
+/*
+ * Dataset description
+ */
+struct Dataset {
+	std::string name = "";
+	unsigned int records = 0;// Total count of d, a and r records
+	double abuseipdbRatio = 0.0;// Part of records that are AbuseIPDB blacklist records
+	double tombstoneRatio = 0.0;// Part of records that are marked for removal
+};
+
+/*
+ * Content of generated datafile, needed to pick targets for operations
+ */
+struct DatasetContent {
+	std::vector<std::string> addresses;// Live suspicious address records
+	std::vector<std::string> abuseipdbAddresses;// Live AbuseIPDB blacklist records
+	unsigned int tombstones = 0;
+	unsigned long long int size = 0;// Datafile size in bytes
+};
+
+/*
+ * Result of single operation benchmark
+ */
+struct Result {
+	std::string operation = "";
+	unsigned int iterations = 0;
+	double meanNs = 0.0;
+	double minNs = 0.0;
+	double maxNs = 0.0;
+};
+
+/*
+ * Result of log line processing benchmark
+ */
+struct LineResult {
+	std::string scenario = "";
+	unsigned int lines = 0;
+	double allocationsPerLine = 0.0;
+	double nsPerLine = 0.0;
+};
+
+/*
+ * Log file used for bookmark records in generated datafiles
+ */
+static const std::string kBenchmarkLogFile = "/var/log/hostblock-benchmark.log";
+
+/*
+ * Address from index, first octet separates suspicious, AbuseIPDB and new addresses
+ */
+std::string indexToAddress(unsigned int prefix, unsigned int index)
+{
+	return std::to_string(prefix) + "." + std::to_string((index >> 16) & 255) + "." + std::to_string((index >> 8) & 255) + "." + std::to_string(index & 255);
+}
+
+/*
+ * Write datafile with same layout as Data::saveData (d records, b records, a records, s record), tombstones are spread across d and a sections
+ */
+DatasetContent generateDatafile(std::string path, Dataset dataset)
+{
+	DatasetContent content;
+	std::mt19937 generator(dataset.records);
+	std::uniform_real_distribution<double> distribution(0.0, 1.0);
+	std::vector<char> types(dataset.records, 'd');
+	for (unsigned int i = 0; i < dataset.records; i++) {
+		double r = distribution(generator);
+		if (r < dataset.tombstoneRatio) types[i] = 'r';
+		else if (r < dataset.tombstoneRatio + dataset.abuseipdbRatio) types[i] = 'a';
+	}
+
+	std::ofstream f(path, std::ios::out | std::ios::trunc);
+	std::string address;
+
+	// Suspicious address section, tombstones are ex-suspicious address records
+	for (unsigned int i = 0; i < dataset.records; i++) {
+		if (types[i] == 'a') continue;
+		if (types[i] == 'r' && i % 2 == 1) continue;
+		address = indexToAddress(10, i);
+		f << types[i];
+		f << std::right << std::setw(39) << address;
+		f << std::right << std::setw(20) << 1500000000 + i;
+		f << std::right << std::setw(10) << 0;
+		f << std::right << std::setw(10) << (i % 100) + 1;
+		f << std::right << std::setw(10) << i % 7;
+		f << 'n';
+		f << 'n';
+		f << std::right << std::setw(20) << 0;
+		f << "\n";
+		if (types[i] == 'd') content.addresses.push_back(address);
+		else content.tombstones++;
+	}
+
+	// Log file bookmark
+	f << 'b';
+	f << std::right << std::setw(20) << 0;
+	f << std::right << std::setw(20) << 0;
+	f << kBenchmarkLogFile;
+	f << "\n";
+
+	// AbuseIPDB section, tombstones are ex-AbuseIPDB records
+	for (unsigned int i = 0; i < dataset.records; i++) {
+		if (types[i] == 'd') continue;
+		if (types[i] == 'r' && i % 2 == 0) continue;
+		address = indexToAddress(172, i);
+		f << types[i];
+		f << std::right << std::setw(39) << address;
+		f << std::right << std::setw(10) << (i % 50) + 1;
+		f << std::right << std::setw(3) << 90 + (i % 11);
+		f << "\n";
+		if (types[i] == 'a') content.abuseipdbAddresses.push_back(address);
+		else content.tombstones++;
+	}
+
+	// AbuseIPDB sync data
+	f << 's';
+	f << std::right << std::setw(20) << 0;
+	f << std::right << std::setw(20) << 0;
+	f << "\n";
+
+	content.size = f.tellp();
+	f.close();
+
+	return content;
+}
+
+/*
+ * Run operation until minimal time has passed (at least once, at most maxIterations), prepare is not included in measurement
+ */
+Result measure(std::string operation, double minTime, unsigned int maxIterations, std::function<bool()> prepare, std::function<void()> run)
+{
+	Result result;
+	result.operation = operation;
+	double total = 0.0;
+	while (result.iterations < maxIterations && (result.iterations == 0 || total < minTime * 1e9)) {
+		if (!prepare()) break;
+		auto start = std::chrono::steady_clock::now();
+		run();
+		auto end = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(end - start).count();
+		if (result.iterations == 0 || ns < result.minNs) result.minNs = ns;
+		if (ns > result.maxNs) result.maxNs = ns;
+		total += ns;
+		result.iterations++;
+	}
+	if (result.iterations > 0) result.meanNs = total / result.iterations;
+	return result;
+}
+
+/*
+ * Append same line to log file
+ */
+void appendLines(std::string path, std::string line, unsigned int count)
+{
+	std::ofstream f(path, std::ios::out | std::ios::app);
+	for (unsigned int i = 0; i < count; i++) {
+		f << line << "\n";
+	}
+}
+
+/*
+ * Heap allocations and time per line for log file check, fixed cost of each check (file open, metrics, datafile update) is excluded by difference of two checks with different line count
+ */
+LineResult measureLines(hb::LogParser* logParser, std::string logFilePath, std::string scenario, std::string line, unsigned int lines)
+{
+	LineResult result;
+	result.scenario = scenario;
+	result.lines = lines;
+
+	// Warm up, buffers reach their capacity
+	appendLines(logFilePath, line, 100);
+	logParser->checkFiles();
+
+	appendLines(logFilePath, line, lines);
+	unsigned long long int allocations = allocationCount;
+	auto start = std::chrono::steady_clock::now();
+	logParser->checkFiles();
+	double ns1 = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	unsigned long long int allocations1 = allocationCount - allocations;
+
+	appendLines(logFilePath, line, lines * 2);
+	allocations = allocationCount;
+	start = std::chrono::steady_clock::now();
+	logParser->checkFiles();
+	double ns2 = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	unsigned long long int allocations2 = allocationCount - allocations;
+
+	result.allocationsPerLine = ((double)allocations2 - (double)allocations1) / lines;
+	result.nsPerLine = (ns2 - ns1) / lines;
+	return result;
+}
+
+/*
+ * Heap allocations and time per line for matching line with rule only (no file reading), regex and native parser of same rule
+ */
+LineResult measureMatch(std::string scenario, unsigned int lines, std::function<bool()> match)
+{
+	LineResult result;
+	result.scenario = scenario;
+	result.lines = lines;
+	unsigned int matches = 0;
+	match();
+	unsigned long long int allocations = allocationCount;
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < lines; i++) {
+		if (match()) matches++;
+	}
+	result.nsPerLine = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lines;
+	result.allocationsPerLine = (double)(allocationCount - allocations) / lines;
+	if (matches != lines) {
+		std::cerr << "Rule did not match line in scenario " << scenario << "!" << std::endl;
+	}
+	return result;
+}
+
+/*
+ * Print usage
+ */
+void printUsage()
+{
+	std::cout << "Usage: benchmark [-s sizes] [-t seconds] [-o output] [-f datafile]" << std::endl;
+	std::cout << "Options:" << std::endl;
+	std::cout << "  -s, --sizes       comma separated datafile record counts (default 1000,100000,1000000)" << std::endl;
+	std::cout << "  -t, --time        minimal measurement time for each operation in seconds (default 0.5)" << std::endl;
+	std::cout << "  -o, --output      write JSON results to file instead of stdout" << std::endl;
+	std::cout << "  -f, --datafile    path for generated datafile (default /tmp/hostblock.bench.data)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<unsigned int> sizes = {1000, 100000, 1000000};
+	double minTime = 0.5;
+	std::string outputPath = "";
+	std::string dataFilePath = "/tmp/hostblock.bench.data";
+
+	// Options
+	static struct cgetopt::option long_options[] =
+	{
+		{"help",     no_argument,       0, 'h'},
+		{"sizes",    required_argument, 0, 's'},
+		{"time",     required_argument, 0, 't'},
+		{"output",   required_argument, 0, 'o'},
+		{"datafile", required_argument, 0, 'f'},
+		{0, 0, 0, 0}
+	};
+	int option_index = 0;
+	int c;
+	while ((c = cgetopt::getopt_long(argc, argv, "hs:t:o:f:", long_options, &option_index)) != -1) {
+		switch (c) {
+			case 's': {
+				sizes.clear();
+				std::string list = cgetopt::optarg;
+				std::size_t start = 0, end = 0;
+				while (start < list.length()) {
+					end = list.find_first_of(",", start);
+					if (end == std::string::npos) end = list.length();
+					unsigned int size = std::strtoul(list.substr(start, end - start).c_str(), NULL, 10);
+					if (size > 0) sizes.push_back(size);
+					start = end + 1;
+				}
+				break;
+			}
+			case 't':
+				minTime = std::strtod(cgetopt::optarg, NULL);
+				break;
+			case 'o':
+				outputPath = cgetopt::optarg;
+				break;
+			case 'f':
+				dataFilePath = cgetopt::optarg;
+				break;
+			default:
+				printUsage();
+				return 0;
+		}
+	}
+
+	// Only errors to syslog, debug messages in data layer would dominate measurements
+	hb::Logger log = hb::Logger(LOG_USER);
+	log.setLevel(LOG_ERR);
+
+	// Minimal config, no configuration file needed
+	hb::Config cfg = hb::Config(&log);
+	cfg.dataFilePath = dataFilePath;
+	hb::LogGroup logGroup;
+	logGroup.name = "Benchmark";
+	hb::LogFile logFile;
+	logFile.path = kBenchmarkLogFile;
+	logGroup.logFiles.push_back(logFile);
+	cfg.logGroups.push_back(logGroup);
+
+	// No latency, benchmark measures datafile operations
+	hb::SimulatedFirewall firewall;
+
+	// Dataset variants for each size
+	std::vector<Dataset> datasets;
+	for (std::vector<unsigned int>::iterator it = sizes.begin(); it != sizes.end(); ++it) {
+		Dataset dataset;
+		dataset.records = *it;
+		dataset.name = "plain";
+		datasets.push_back(dataset);
+		dataset.name = "abuseipdb";
+		dataset.abuseipdbRatio = 0.5;
+		datasets.push_back(dataset);
+		dataset.name = "tombstones";
+		dataset.abuseipdbRatio = 0.0;
+		dataset.tombstoneRatio = 0.25;
+		datasets.push_back(dataset);
+		dataset.name = "mixed";
+		dataset.abuseipdbRatio = 0.4;
+		dataset.tombstoneRatio = 0.2;
+		datasets.push_back(dataset);
+	}
+
+	Json::Value root;
+	root["version"] = hb::kHostblockVersion;
+	root["timestamp"] = (Json::UInt64)std::time(nullptr);
+	root["minTime"] = minTime;
+	root["hardwareThreads"] = std::thread::hardware_concurrency();
+	root["results"] = Json::Value(Json::arrayValue);
+
+	std::cerr << std::left << std::setw(12) << "dataset" << std::right << std::setw(10) << "records" << " " << std::left << std::setw(26) << "operation" << std::right << std::setw(8) << "iter" << std::setw(16) << "mean ns" << std::setw(12) << "ns/record" << std::endl;
+
+	const unsigned int batchSize = 100;
+	for (std::vector<Dataset>::iterator itd = datasets.begin(); itd != datasets.end(); ++itd) {
+		hb::Data data = hb::Data(&log, &cfg, &firewall);
+		DatasetContent content;
+		std::mt19937 generator(itd->records);
+		std::vector<std::string> targets;
+		unsigned int newIndex = 0;
+		std::vector<std::string> batch;
+		std::vector<Result> results;
+
+		// Regenerate datafile and load it, used before operations that modify datafile
+		auto reset = [&]() {
+			content = generateDatafile(dataFilePath, *itd);
+			data.loadData();
+			targets = content.addresses;
+			std::shuffle(targets.begin(), targets.end(), generator);
+		};
+		// Random live suspicious address
+		auto randomAddress = [&]() -> std::string {
+			if (content.addresses.size() == 0) return indexToAddress(11, 0);
+			return content.addresses[generator() % content.addresses.size()];
+		};
+		auto always = []() { return true; };
+
+		// Loading datafile, with more than 1000 tombstones loadData compacts datafile so it has to be regenerated each iteration
+		content = generateDatafile(dataFilePath, *itd);
+		bool compacts = content.tombstones > 1000;
+		results.push_back(measure("loadData", minTime, 1000, [&]() {
+			if (compacts) content = generateDatafile(dataFilePath, *itd);
+			return true;
+		}, [&]() {
+			data.loadData();
+		}));
+
+		// Saving whole datafile
+		reset();
+		results.push_back(measure("saveData", minTime, 1000, always, [&]() {
+			data.saveData();
+		}));
+
+		// Appending single record
+		reset();
+		results.push_back(measure("addAddress", minTime, 100000, [&]() {
+			std::string address = indexToAddress(11, newIndex++);
+			data.suspiciousAddresses[address] = hb::SuspiciosAddressType();
+			batch.assign(1, address);
+			return true;
+		}, [&]() {
+			data.addAddress(batch[0]);
+		}));
+
+		// Updating single record (scan until record found)
+		reset();
+		results.push_back(measure("updateAddress", minTime, 100000, [&]() {
+			if (content.addresses.size() == 0) return false;
+			batch.assign(1, randomAddress());
+			data.suspiciousAddresses[batch[0]].lastActivity++;
+			return true;
+		}, [&]() {
+			data.updateAddress(batch[0]);
+		}));
+
+		// Marking single record as removed, each iteration with different address
+		reset();
+		results.push_back(measure("removeAddress", minTime, 100000, [&]() {
+			if (targets.size() == 0) return false;
+			batch.assign(1, targets.back());
+			targets.pop_back();
+			return true;
+		}, [&]() {
+			data.removeAddress(batch[0]);
+		}));
+
+		// Updating log file bookmark (scan until bookmark record found)
+		reset();
+		results.push_back(measure("updateFile", minTime, 100000, [&]() {
+			cfg.logGroups[0].logFiles[0].bookmark++;
+			cfg.logGroups[0].logFiles[0].size++;
+			return true;
+		}, [&]() {
+			data.updateFile(kBenchmarkLogFile);
+		}));
+
+		// Appending batch of AbuseIPDB records
+		reset();
+		results.push_back(measure("addAbuseIPDBAddresses", minTime, 10000, [&]() {
+			batch.clear();
+			for (unsigned int i = 0; i < batchSize; i++) {
+				std::string address = indexToAddress(173, newIndex++);
+				hb::AbuseIPDBBlacklistedAddressType record;
+				record.totalReports = 1;
+				record.abuseConfidenceScore = 100;
+				data.abuseIPDBBlacklist[address] = record;
+				batch.push_back(address);
+			}
+			return true;
+		}, [&]() {
+			data.addAbuseIPDBAddresses(&batch);
+		}));
+
+		// Updating batch of AbuseIPDB records (full scan, each a record compared against batch)
+		reset();
+		results.push_back(measure("updateAbuseIPDBAddresses", minTime, 10000, [&]() {
+			batch.clear();
+			for (unsigned int i = 0; i < batchSize; i++) {
+				if (content.abuseipdbAddresses.size() == 0) {
+					batch.push_back(indexToAddress(174, i));
+					continue;
+				}
+				std::string address = content.abuseipdbAddresses[generator() % content.abuseipdbAddresses.size()];
+				data.abuseIPDBBlacklist[address].totalReports++;
+				batch.push_back(address);
+			}
+			return true;
+		}, [&]() {
+			data.updateAbuseIPDBAddresses(&batch);
+		}));
+
+		// Saving activity of known address (score recalculation, firewall check and datafile update)
+		reset();
+		results.push_back(measure("saveActivity", minTime, 100000, [&]() {
+			if (content.addresses.size() == 0) return false;
+			batch.assign(1, randomAddress());
+			return true;
+		}, [&]() {
+			data.saveActivity(batch[0], 1, 1, 0);
+		}));
+
+		// Snapshot of whole data, and reading it (checksum included) into empty data as on bootstrap of new host
+		reset();
+		std::string snapshotPath = dataFilePath + ".snapshot";
+		hb::SnapshotReader snapshotReader(&log);
+		results.push_back(measure("exportSnapshot", minTime, 1000, always, [&]() {
+			data.exportSnapshot(snapshotPath);
+		}));
+		results.push_back(measure("importSnapshot", minTime, 1000, [&]() {
+			data.suspiciousAddresses.clear();
+			data.abuseIPDBBlacklist.clear();
+			return true;
+		}, [&]() {
+			if (snapshotReader.open(snapshotPath)) {
+				data.importSnapshot(&snapshotReader, 0);
+			}
+		}));
+		std::remove(snapshotPath.c_str());
+
+		// Add results to JSON and summary
+		for (std::vector<Result>::iterator itr = results.begin(); itr != results.end(); ++itr) {
+			Json::Value item;
+			item["dataset"] = itd->name;
+			item["records"] = itd->records;
+			item["abuseipdbRatio"] = itd->abuseipdbRatio;
+			item["tombstoneRatio"] = itd->tombstoneRatio;
+			item["datafileSize"] = (Json::UInt64)content.size;
+			item["operation"] = itr->operation;
+			item["iterations"] = itr->iterations;
+			item["meanNs"] = itr->meanNs;
+			item["minNs"] = itr->minNs;
+			item["maxNs"] = itr->maxNs;
+			item["nsPerRecord"] = itr->meanNs / itd->records;
+			root["results"].append(item);
+
+			std::cerr << std::left << std::setw(12) << itd->name << std::right << std::setw(10) << itd->records << " " << std::left << std::setw(26) << itr->operation << std::right << std::setw(8) << itr->iterations << std::setw(16) << std::fixed << std::setprecision(0) << itr->meanNs << std::setw(12) << std::setprecision(3) << itr->meanNs / itd->records << std::endl;
+		}
+	}
+
+	// Log line processing
+	std::string logFilePath = dataFilePath + ".log";
+	hb::Config lineCfg = hb::Config(&log);
+	lineCfg.dataFilePath = dataFilePath;
+	hb::LogGroup sshGroup;
+	sshGroup.name = "OpenSSH";
+	std::vector<std::string> sshPatterns = {
+		"^.+? sshd\\[\\d+\\]: Invalid user .+? from %i",
+		"^.+? sshd\\[\\d+\\]: Failed password for invalid user .+? from %i port %p ssh2",
+		"^.+? sshd\\[\\d+\\]: Connection closed by %i port %p \\[preauth\\]"
+	};
+	for (std::vector<std::string>::iterator itp = sshPatterns.begin(); itp != sshPatterns.end(); ++itp) {
+		hb::Pattern pattern;
+		pattern.patternString = *itp;
+		sshGroup.patterns.push_back(pattern);
+	}
+	hb::LogFile sshLogFile;
+	sshLogFile.path = logFilePath;
+	sshGroup.logFiles.push_back(sshLogFile);
+	lineCfg.logGroups.push_back(sshGroup);
+	// Same rules for native sshd parser, separate log file
+	std::string nativeLogFilePath = logFilePath + ".native";
+	hb::LogGroup nativeGroup;
+	nativeGroup.name = "OpenSSHNative";
+	nativeGroup.format = hb::LogFormat::Sshd;
+	std::vector<std::string> nativeRules = {"event=invalid_user", "event=failed_password_invalid_user", "event=connection_closed"};
+	for (std::vector<std::string>::iterator itr = nativeRules.begin(); itr != nativeRules.end(); ++itr) {
+		hb::Pattern pattern;
+		hb::NativeParser::rule(*itr, nativeGroup.format, &pattern);
+		nativeGroup.patterns.push_back(pattern);
+	}
+	hb::LogFile nativeLogFile;
+	nativeLogFile.path = nativeLogFilePath;
+	nativeGroup.logFiles.push_back(nativeLogFile);
+	lineCfg.logGroups.push_back(nativeGroup);
+	lineCfg.processPatterns();
+	std::ofstream(nativeLogFilePath, std::ios::out | std::ios::trunc).close();
+	std::ofstream(logFilePath, std::ios::out | std::ios::trunc).close();
+	std::ofstream(dataFilePath, std::ios::out | std::ios::trunc).close();
+	hb::Data lineData = hb::Data(&log, &lineCfg, &firewall);
+	lineData.loadData();
+	std::queue<hb::ReportToAbuseIPDB> reportingQueue;
+	std::mutex reportingQueueMutex;
+	hb::LogParser logParser = hb::LogParser(&log, &lineCfg, &lineData, &reportingQueue, &reportingQueueMutex);
+
+	std::vector<LineResult> lineResults;
+	// Not matched by any pattern and rejected by prefilter, must not allocate
+	lineResults.push_back(measureLines(&logParser, logFilePath, "unmatched", "Jun  2 11:25:00 somehost CRON[1234]: pam_unix(cron:session): session opened for user root by (uid=0)", 10000));
+	// Not matched, but regex is evaluated (std::regex allocates internally)
+	lineResults.push_back(measureLines(&logParser, logFilePath, "regex", "Jun  2 11:25:00 somehost sshd[1234]: Connection closed by authenticating user root 10.1.1.1 port 22 [preauth]", 10000));
+	// Same line split into fields by native parser, no regex
+	lineResults.push_back(measureLines(&logParser, nativeLogFilePath, "native", "Jun  2 11:25:00 somehost sshd[1234]: Connection closed by authenticating user root 10.1.1.1 port 22 [preauth]", 10000));
+	// Same line without throttling (historic log replay), matched by reader and by matcher pools of 1 to 8 threads (scales with cores until reader or aggregator is busy all the time)
+	logParser.historic = true;
+	lineResults.push_back(measureLines(&logParser, logFilePath, "replay-reader", "Jun  2 11:25:00 somehost sshd[1234]: Connection closed by authenticating user root 10.1.1.1 port 22 [preauth]", 10000));
+	for (unsigned int matchers = 1; matchers <= 8; matchers *= 2) {
+		lineCfg.matchThreads = matchers;
+		lineResults.push_back(measureLines(&logParser, logFilePath, "replay-pool-" + std::to_string(matchers), "Jun  2 11:25:00 somehost sshd[1234]: Connection closed by authenticating user root 10.1.1.1 port 22 [preauth]", 10000));
+	}
+	lineCfg.matchThreads = 0;
+	logParser.historic = false;
+	std::remove(logFilePath.c_str());
+	std::remove(nativeLogFilePath.c_str());
+
+	// Matching only, same Apache access log line with regex pattern and with native rule
+	std::string accessLine = "10.1.1.1 - - [17/Jun/2016:07:07:07 +0000] \"GET /phpMyAdmin-3.0.1.0/scripts/setup.php HTTP/1.1\" 404 298 \"-\" \"ZmEu\"";
+	std::regex accessPattern("^(\\d{1,3}\\.\\d{1,3}\\.\\d{1,3}\\.\\d{1,3}) \\S+ \\S+ \\[[^\\]]*\\] \"\\S+ \\S*phpmyadmin\\S* [^\" ]+\" (404)( .*)?$", std::regex_constants::icase);
+	std::smatch accessMatch;
+	hb::Pattern accessRule;
+	hb::NativeParser::rule("status=404 path=phpmyadmin", hb::LogFormat::ApacheCombined, &accessRule);
+	hb::LogFields accessFields;
+	lineResults.push_back(measureMatch("match-regex", 100000, [&]() {
+		return std::regex_match(accessLine, accessMatch, accessPattern);
+	}));
+	lineResults.push_back(measureMatch("match-native", 100000, [&]() {
+		return hb::NativeParser::parse<hb::LogFormat::ApacheCombined>(accessLine, &accessFields) && hb::NativeParser::matches(&accessRule, accessFields);
+	}));
+
+	bool allocationFailure = false;
+	root["lineProcessing"] = Json::Value(Json::arrayValue);
+	std::cerr << std::endl << "Hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+	std::cerr << std::endl << std::left << std::setw(14) << "scenario" << std::right << std::setw(10) << "lines" << std::setw(16) << "allocs/line" << std::setw(16) << "ns/line" << std::endl;
+	for (std::vector<LineResult>::iterator itl = lineResults.begin(); itl != lineResults.end(); ++itl) {
+		Json::Value item;
+		item["scenario"] = itl->scenario;
+		item["lines"] = itl->lines;
+		item["allocationsPerLine"] = itl->allocationsPerLine;
+		item["nsPerLine"] = itl->nsPerLine;
+		root["lineProcessing"].append(item);
+		std::cerr << std::left << std::setw(14) << itl->scenario << std::right << std::setw(10) << itl->lines << std::setw(16) << std::fixed << std::setprecision(3) << itl->allocationsPerLine << std::setw(16) << std::setprecision(0) << itl->nsPerLine << std::endl;
+		if ((itl->scenario == "unmatched" || itl->scenario == "match-native") && itl->allocationsPerLine > 0.0) {
+			std::cerr << "Heap allocations while processing unmatched lines!" << std::endl;
+			allocationFailure = true;
+		}
+	}
+
+	std::remove(dataFilePath.c_str());
+
+	// Output results
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "\t";
+	if (outputPath.length() > 0) {
+		std::ofstream f(outputPath, std::ios::out | std::ios::trunc);
+		if (!f.is_open()) {
+			std::cerr << "Unable to open " << outputPath << " for writing!" << std::endl;
+			return 1;
+		}
+		f << Json::writeString(builder, root) << std::endl;
+	} else {
+		std::cout << Json::writeString(builder, root) << std::endl;
+	}
+
+	return allocationFailure ? 1 : 0;
+}
@@ -6,22 +6,41 @@
 #include <map>
 // Standard vector library
 #include <vector>
+// Set
+#include <set>
+// Queue
+#include <queue>
+// Mutex
+#include <mutex>
+// Thread (sleep_for)
+#include <thread>
 // Syslog
 namespace csyslog{
 	#include <syslog.h>
 }
 // Limits
 #include <climits>
+// File stream library (ifstream)
+#include <fstream>
 // Logger
 #include "../src/logger.h"
 // Iptables
 #include "../src/iptables.h"
+// Simulated firewall
+#include "../src/simfirewall.h"
 // Config
 #include "../src/config.h"
 // Data
 #include "../src/data.h"
 // LogParser
 #include "../src/logparser.h"
+#include "../src/nativeparser.h"
+// Peer sync
+#include "../src/peersync.h"
+// Blocklist feeds
+#include "../src/feed.h"
+// Directory creation (mkdir)
+#include <sys/stat.h>
 
 int main(int argc, char *argv[])
 {
@@ -33,12 +52,21 @@ int main(int argc, char *argv[])
 
 	bool testSyslog = false;
 	bool testIptables = false;
+	bool testSimulatedFirewall = true;
 	bool testConfig = false;
+	bool testPrefilter = true;
+	bool testSyslogHeader = true;
+	bool testReportPolicy = true;
+	bool testAddressRanges = true;
 	bool testData = false;
 	bool removeTempData = false;
 	bool testLogParsing = true;
 	bool testConfiguredLogParsing = true;
 
+	// AbuseIPDB reporting queue, reports are not sent during tests
+	std::queue<hb::ReportToAbuseIPDB> abuseipdbReportingQueue;
+	std::mutex abuseipdbReportingQueueMutex;
+
 	try{
 		// Syslog
 		std::cout << "Creating Logger object..." << std::endl;
@@ -96,6 +124,156 @@ int main(int argc, char *argv[])
 		end = clock();
 		std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
 
+		// Pattern prefilter
+		if (testPrefilter){
+			std::cout << "Checking pattern prefilter literals..." << std::endl;
+			std::map<std::string, std::string> literals = {
+				{"^.+? sshd\\[\\d+\\]: Invalid user .+? from %i", "]: invalid user "},
+				{"^abc?d+ef{0,2}gh$", "ab"},
+				{"^(foo|bar) Login.*FAILED$", " login"},
+				{"^foo|bar$", ""},
+				{"\\x41BC[a-z]+\\.done", ".done"}
+			};
+			for (std::map<std::string, std::string>::iterator itl = literals.begin(); itl != literals.end(); ++itl) {
+				if (hb::Util::requiredLiteral(itl->first) != itl->second) {
+					std::cerr << "Wrong prefilter literal for " << itl->first << ": \"" << hb::Util::requiredLiteral(itl->first) << "\"" << std::endl;
+				}
+			}
+			if (!hb::Util::containsLiteral("Aug  3 sshd[1]: INVALID User x", "]: invalid user") || hb::Util::containsLiteral("sshd[1]: Invalid", "]: invalid user")) {
+				std::cerr << "Case insensitive literal search failed!" << std::endl;
+			}
+			// Prefilter must not skip lines that match
+			std::vector<std::string> testLogFiles = {"hb/test/test_sshd_log_file", "hb/test/test_apache_access_log_file"};
+			unsigned int skipped = 0, missed = 0;
+			std::string line;
+			for (std::vector<std::string>::iterator itf = testLogFiles.begin(); itf != testLogFiles.end(); ++itf) {
+				std::ifstream is(*itf);
+				while (std::getline(is, line)) {
+					for (std::vector<hb::LogGroup>::iterator itg = cfg.logGroups.begin(); itg != cfg.logGroups.end(); ++itg) {
+						for (std::vector<hb::Pattern>::iterator itp = itg->patterns.begin(); itp != itg->patterns.end(); ++itp) {
+							if (!hb::Util::containsLiteral(line, itp->literal)) {
+								skipped++;
+								if (std::regex_match(line, itp->pattern)) missed++;
+							}
+						}
+					}
+				}
+			}
+			std::cout << "Prefilter skipped " << skipped << " regex evaluations" << std::endl;
+			if (missed > 0) {
+				std::cerr << "Prefilter skipped " << missed << " matching lines!" << std::endl;
+			}
+		}
+
+		// Syslog header parser
+		if (testSyslogHeader) {
+			std::cout << "Checking syslog header parser..." << std::endl;
+			std::map<std::string, std::string> headers = {
+				{"Jun  2 11:25:00 somehost sshd[127127]: Invalid user admin from 10.10.10.10", "sshd"},
+				{"<38>Jun 12 01:02:03 host postfix/smtpd[1]: connect from x", "postfix/smtpd"},
+				{"2024-06-02T11:25:00.123456+00:00 somehost kernel: message", "kernel"},
+				{"<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog - ID47 - message", "evntslog"},
+				{"<165>1 2003-10-11T22:14:15.003Z host - - - - message", ""},
+				{"10.0.0.1 - - [02/Jun/2024:11:25:00 +0000] \"GET / HTTP/1.1\" 200 1", ""},
+				{"", ""}
+			};
+			std::size_t programStart = 0, programLength = 0;
+			for (std::map<std::string, std::string>::iterator ith = headers.begin(); ith != headers.end(); ++ith) {
+				std::string program = "";
+				if (hb::Util::syslogProgram(ith->first, &programStart, &programLength)) {
+					program = ith->first.substr(programStart, programLength);
+				}
+				if (program != ith->second) {
+					std::cerr << "Wrong syslog program for " << ith->first << ": \"" << program << "\"" << std::endl;
+				}
+			}
+		}
+
+		// AbuseIPDB report policy
+		if (testReportPolicy) {
+			std::cout << "Checking AbuseIPDB report policy..." << std::endl;
+			std::vector<hb::CommentToken> tokens = hb::Util::compileComment("Attack from %i:%p, %m at %d 100%");
+			std::string compiled = "";
+			for (std::vector<hb::CommentToken>::iterator itt = tokens.begin(); itt != tokens.end(); ++itt) {
+				if (itt->placeholder != 0) {
+					compiled += std::string("<") + itt->placeholder + ">";
+				} else {
+					compiled += itt->text;
+				}
+			}
+			if (compiled != "Attack from <i>:<p>, <m> at <d> 100%") {
+				std::cerr << "Wrong compiled comment template: " << compiled << std::endl;
+			}
+			// Masking, all occurrences, case insensitive, overlapping phrases
+			hb::Masker masker;
+			masker.add("myhost");
+			masker.add("10.0.0.5");
+			masker.add("Jane Doe");
+			masker.add("abc");
+			masker.add("bcd");
+			masker.build();
+			std::string masked = "> ";
+			masker.mask("MyHost sshd: 10.0.0.50 by jane doe on myhostmyhost abcd", &masked);
+			if (masked != "> ****** sshd: ********0 by ******** on ************ ****") {
+				std::cerr << "Wrong masked text: " << masked << std::endl;
+			}
+			for (std::vector<hb::LogGroup>::iterator itg = cfg.logGroups.begin(); itg != cfg.logGroups.end(); ++itg) {
+				for (std::vector<hb::Pattern>::iterator itp = itg->patterns.begin(); itp != itg->patterns.end(); ++itp) {
+					if (!itp->reportPolicy) {
+						std::cerr << "Report policy not resolved for pattern: " << itp->patternString << std::endl;
+					} else if (cfg.abuseipdbKey.size() == 0 && itp->reportPolicy->report) {
+						std::cerr << "Report enabled without API key for pattern: " << itp->patternString << std::endl;
+					}
+				}
+			}
+		}
+
+		// Address range lookup
+		if (testAddressRanges) {
+			std::cout << "Checking address range lookup..." << std::endl;
+			hb::PrefixTrie trie;
+			std::vector<std::string> invalid = {"10.0.0.0/33", "10.0.0/8", "10.0.0.0/", "10.0.0.0/8x", "::1/129", "host", ""};
+			for (std::vector<std::string>::iterator iti = invalid.begin(); iti != invalid.end(); ++iti) {
+				if (trie.insert(*iti, hb::Blacklist)) {
+					std::cerr << "Invalid address range accepted: " << *iti << std::endl;
+				}
+			}
+			trie.insert("10.0.0.0/8", hb::Blacklist);
+			trie.insert("10.1.0.0/16", hb::Whitelist);
+			trie.insert("10.1.2.0/24", hb::Blacklist);
+			trie.insert("10.1.2.128/25", hb::Whitelist);
+			trie.insert("192.168.1.77/22", hb::Whitelist);
+			trie.insert("2001:db8::/32", hb::Blacklist);
+			trie.insert("2001:db8:1::/48", hb::Whitelist);
+			std::map<std::string, std::string> lookups = {
+				{"10.200.0.1", "10.0.0.0/8"},
+				{"10.1.200.1", "10.1.0.0/16"},
+				{"10.1.2.1", "10.1.2.0/24"},
+				{"10.1.2.200", "10.1.2.128/25"},
+				{"192.168.3.255", "192.168.0.0/22"},
+				{"192.168.4.0", ""},
+				{"11.0.0.1", ""},
+				{"2001:db8:2::1", "2001:db8::/32"},
+				{"2001:db8:1:ffff::1", "2001:db8:1::/48"},
+				{"2001:db9::1", ""},
+				{"not an address", ""}
+			};
+			std::string range;
+			for (std::map<std::string, std::string>::iterator itl = lookups.begin(); itl != lookups.end(); ++itl) {
+				range = "";
+				trie.lookup(itl->first, &range);
+				if (range != itl->second) {
+					std::cerr << "Wrong address range for " << itl->first << ": \"" << range << "\"" << std::endl;
+				}
+			}
+			if (!trie.overlaps("10.1.0.0/12", hb::Whitelist) || !trie.overlaps("10.1.2.192/26", hb::Whitelist) || trie.overlaps("10.2.0.0/16", hb::Whitelist) || trie.overlaps("10.200.0.0/16", hb::Whitelist) || !trie.overlaps("10.1.2.0/25", hb::Blacklist)) {
+				std::cerr << "Wrong address range overlap check!" << std::endl;
+			}
+			if (trie.size() != 7 || trie.ranges(hb::Whitelist).size() != 4 || trie.lookup("10.1.2.200") != hb::Whitelist || trie.lookup("10.1.2.1") != hb::Blacklist) {
+				std::cerr << "Wrong address range list!" << std::endl;
+			}
+		}
+
 		// iptables
 		std::cout << "Creating Iptables object..." << std::endl;
 		hb::Iptables iptbl = hb::Iptables();
@@ -136,11 +314,60 @@ int main(int argc, char *argv[])
 		end = clock();
 		std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
 
+		// Simulated firewall
+		std::cout << "Creating SimulatedFirewall object..." << std::endl;
+		hb::SimulatedFirewall simfw;
+		if (testSimulatedFirewall){
+			std::string ruleStart = "";
+			std::string ruleEnd = "";
+			std::size_t posip = cfg.iptablesRule.find("%i");
+			if (posip != std::string::npos) {
+				ruleStart = cfg.iptablesRule.substr(0, posip);
+				ruleEnd = cfg.iptablesRule.substr(posip + 2);
+			}
+			std::cout << "Adding 10000 rules to simulated firewall..." << std::endl;
+			clock_t fwStart = clock();
+			for (unsigned int i = 0; i < 10000; ++i) {
+				simfw.append("INPUT", ruleStart + "10.20." + std::to_string(i / 256) + "." + std::to_string(i % 256) + ruleEnd);
+			}
+			std::cout << "Rules in INPUT: " << simfw.ruleCount("INPUT") << std::endl;
+			std::map<unsigned int, std::string> rules = simfw.listRules("INPUT");
+			std::cout << "First listed rule: " << rules[0] << " Second listed rule: " << rules[1] << std::endl;
+			std::cout << "Removing 10000 rules from simulated firewall..." << std::endl;
+			for (unsigned int i = 0; i < 10000; ++i) {
+				simfw.remove("INPUT", ruleStart + "10.20." + std::to_string(i / 256) + "." + std::to_string(i % 256) + ruleEnd);
+			}
+			std::cout << "Rules in INPUT: " << simfw.ruleCount("INPUT") << std::endl;
+			std::cout << "Blocks per second: " << (double)20000 / ((double)(clock() - fwStart)/CLOCKS_PER_SEC) << std::endl;
+			std::cout << "Removing missing rule, expecting failure..." << std::endl;
+			try {
+				simfw.remove("INPUT", ruleStart + "10.20.0.0" + ruleEnd);
+				std::cerr << "Removing missing rule from simulated firewall did not fail!" << std::endl;
+			} catch (std::runtime_error& e) {
+				std::cout << e.what() << std::endl;
+			}
+			std::cout << "Injecting 50% failure rate..." << std::endl;
+			hb::SimulatedFirewall failingfw(0, 0.5, 1);
+			unsigned int failed = 0;
+			for (unsigned int i = 0; i < 1000; ++i) {
+				try {
+					failingfw.append("INPUT", ruleStart + "10.30." + std::to_string(i / 256) + "." + std::to_string(i % 256) + ruleEnd);
+				} catch (std::runtime_error& e) {
+					failed++;
+				}
+			}
+			hb::SimulatedFirewallCounters counters = failingfw.getCounters();
+			std::cout << "Failed appends: " << failed << " Counted failures: " << counters.failures << " Appended: " << counters.append << std::endl;
+			simfw.resetCounters();
+		}
+		end = clock();
+		std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+
 		// Data
 		std::cout << "Creating Data object..." << std::endl;
 		std::vector<hb::LogGroup>::iterator itlg;
 		std::vector<hb::LogFile>::iterator itlf;
-		hb::Data data = hb::Data(&log, &cfg, &iptbl);
+		hb::Data data = hb::Data(&log, &cfg, &simfw);
 		cfg.dataFilePath = "hb/test/test_data";
 		std::cout << "Loading data..." << std::endl;
 		if (!data.loadData()) {
@@ -309,8 +536,783 @@ int main(int argc, char *argv[])
 
 			// Check log files
 			std::cout << "Log file check..." << std::endl;
-			hb::LogParser lp = hb::LogParser(&log, &cfg, &data);
+			hb::LogParser lp = hb::LogParser(&log, &cfg, &data, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
+			hb::Metrics metrics;
+			lp.metrics = &metrics;
 			lp.checkFiles();
+
+			// Pattern statistics, each line must be evaluated by first pattern in order
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				if (itlg->patternOrder.size() != itlg->patterns.size() || itlg->refusedPatternOrder.size() != itlg->refusedPatterns.size()) {
+					std::cerr << "Pattern evaluation order size mismatch in group " << itlg->name << "!" << std::endl;
+				}
+				if (itlg->logFiles.size() > 0 && itlg->patterns.size() > 0 && itlg->patterns[itlg->patternOrder[0]].evaluations == 0) {
+					std::cerr << "No pattern evaluations counted in group " << itlg->name << "!" << std::endl;
+				}
+			}
+			if (metrics.format().find("hostblock_pattern_hits_total{group=\"OpenSSH\",type=\"pattern\",index=\"1\"}") == std::string::npos) {
+				std::cerr << "Pattern metrics missing!" << std::endl;
+			}
+
+			// Same physical file in multiple log groups must be read once
+			std::cout << "Shared log file check..." << std::endl;
+			unsigned long long int expectedLines = 0;
+			std::string countLine;
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					itlf->bookmark = 0;
+					itlf->size = 0;
+					std::ifstream countStream(itlf->path);
+					while (std::getline(countStream, countLine)) {
+						expectedLines++;
+					}
+				}
+			}
+			unsigned long long int sshdLines = 0;
+			std::ifstream sshdStream("hb/test/test_sshd_log_file");
+			while (std::getline(sshdStream, countLine)) {
+				sshdLines++;
+			}
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				if (itlg->name == "ApacheAccess") {
+					hb::LogFile logFile;
+					logFile.path = "hb/test/test_sshd_log_file";
+					itlg->logFiles.push_back(logFile);
+					// Apache log lines have no syslog header and must still be matched, sshd lines must be skipped
+					itlg->programs.push_back("httpd");
+				}
+			}
+			lp.linesRead = 0;
+			lp.checkFiles();
+			if (lp.linesRead != expectedLines) {
+				std::cerr << "Shared log file read more than once! Lines read: " << lp.linesRead << " Expected: " << expectedLines << std::endl;
+			}
+			if (lp.linesSkippedByProgram != sshdLines) {
+				std::cerr << "Syslog program routing skipped " << lp.linesSkippedByProgram << " lines, expected " << sshdLines << "!" << std::endl;
+			}
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					if (itlf->bookmark == 0 || itlf->bookmark != itlf->size) {
+						std::cerr << "Bookmark of " << itlf->path << " in group " << itlg->name << " not at end of file!" << std::endl;
+					}
+				}
+			}
+
+			// Rotated file shared by log groups must be read once
+			std::cout << "Shared rotated log file check..." << std::endl;
+			std::string rotationPath = cfg.dataFilePath + ".rotation";
+			std::ofstream(rotationPath) << "rotation check line 1\n";
+			data.addFile(rotationPath);
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				hb::LogFile logFile;
+				logFile.path = rotationPath;
+				itlg->logFiles.push_back(logFile);
+			}
+			lp.checkFiles();
+			std::ofstream(rotationPath, std::ios::app) << "rotation check line 2\nrotation check line 3\n";
+			std::rename(rotationPath.c_str(), (rotationPath + ".1").c_str());
+			std::ofstream(rotationPath) << "rotation check line 4\n";
+			unsigned long long int rotationsBefore = lp.rotationsFollowed;
+			lp.linesRead = 0;
+			lp.checkFiles();
+			if (lp.rotationsFollowed != rotationsBefore + 1 || lp.linesRead != 3) {
+				std::cerr << "Shared rotated log file read more than once! Lines read: " << lp.linesRead << " Expected: 3" << std::endl;
+			}
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				itlg->logFiles.pop_back();
+			}
+			data.removeFile(rotationPath);
+			std::remove(rotationPath.c_str());
+			std::remove((rotationPath + ".1").c_str());
+
+			// Matches from whitelisted range must be ignored, blacklisted range must have single rule
+			std::cout << "Address range check..." << std::endl;
+			cfg.addressRanges.insert("10.10.10.0/29", hb::Blacklist);
+			cfg.addressRanges.insert("10.10.10.8/29", hb::Whitelist);
+			std::size_t rulesBefore = simfw.ruleCount("INPUT");
+			data.updateRangeRules();
+			data.updateRangeRules();
+			if (simfw.ruleCount("INPUT") != rulesBefore + 1) {
+				std::cerr << "Expected single firewall rule for blacklisted address range, rule count changed by " << simfw.ruleCount("INPUT") - rulesBefore << "!" << std::endl;
+			}
+			unsigned int whitelistedCount = data.suspiciousAddresses["10.10.10.10"].activityCount;
+			unsigned int notListedCount = data.suspiciousAddresses["10.10.10.16"].activityCount;
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					itlf->bookmark = 0;
+					itlf->size = 0;
+				}
+			}
+			lp.checkFiles();
+			if (lp.matchesWhitelisted == 0 || data.suspiciousAddresses["10.10.10.10"].activityCount != whitelistedCount) {
+				std::cerr << "Match from whitelisted address range was not ignored!" << std::endl;
+			}
+			if (data.suspiciousAddresses["10.10.10.16"].activityCount <= notListedCount) {
+				std::cerr << "Match from address outside of whitelisted range was ignored!" << std::endl;
+			}
+			cfg.addressRanges.clear();
+			data.updateRangeRules();
+			if (simfw.ruleCount("INPUT") != rulesBefore) {
+				std::cerr << "Firewall rule for address range was not removed!" << std::endl;
+			}
+
+			// Aggregate activity of subnet, single rule for whole subnet, count of subnets limited
+			std::cout << "Subnet activity check..." << std::endl;
+			cfg.subnetScoreToBlock = 1;
+			cfg.subnetCacheSize = 2;
+			rulesBefore = simfw.ruleCount("INPUT");
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					itlf->bookmark = 0;
+					itlf->size = 0;
+				}
+			}
+			lp.checkFiles();
+			if (data.subnetActivity.count("10.10.10.0/24") == 0 || data.subnetActivity["10.10.10.0/24"].rule.length() == 0 || simfw.ruleCount("INPUT") > rulesBefore + 1) {
+				std::cerr << "Expected single firewall rule for subnet 10.10.10.0/24!" << std::endl;
+			}
+			for (std::map<std::string, hb::SuspiciosAddressType>::iterator itsa = data.suspiciousAddresses.begin(); itsa != data.suspiciousAddresses.end(); ++itsa) {
+				if (itsa->first.substr(0, 9) == "10.10.10." && itsa->second.iptableRule && !itsa->second.blacklisted) {
+					std::cerr << "Address " << itsa->first << " in blocked subnet has own firewall rule!" << std::endl;
+				}
+			}
+			// Blocked subnet stays in full cache until its rule expires, only then it can be dropped
+			std::string subnetRule = data.subnetActivity["10.10.10.0/24"].rule;
+			data.saveActivity("192.0.2.1", 1, 1, 0);
+			data.saveActivity("198.51.100.1", 1, 1, 0);
+			if (data.subnetActivity.size() != 2 || data.subnetLRU.size() != 1 || data.subnetActivity.count("192.0.2.0/24") > 0 || data.subnetActivity["198.51.100.0/24"].activityCount != 1) {
+				std::cerr << "Least recently updated subnet was not dropped!" << std::endl;
+			}
+			std::map<unsigned int, std::string> pinnedRules = simfw.listRules("INPUT");
+			bool pinnedRule = false;
+			for (std::map<unsigned int, std::string>::iterator itr = pinnedRules.begin(); itr != pinnedRules.end(); ++itr) {
+				pinnedRule = pinnedRule || itr->second.find(subnetRule) != std::string::npos;
+			}
+			if (data.subnetActivity.count("10.10.10.0/24") == 0 || data.subnetActivity["10.10.10.0/24"].rule != subnetRule || !pinnedRule) {
+				std::cerr << "Blocked subnet was dropped from full cache and unblocked!" << std::endl;
+			}
+			data.subnetActivity["10.10.10.0/24"].activityScore = 0;
+			data.subnetActivity["10.10.10.0/24"].lastActivity = 0;
+			data.updateSubnetRules();
+			data.saveActivity("203.0.113.1", 1, 1, 0);
+			if (data.subnetActivity.count("10.10.10.0/24") > 0 || data.subnetActivity.count("198.51.100.0/24") == 0 || data.subnetLRU.size() != 2) {
+				std::cerr << "Subnet with expired rule was not dropped first!" << std::endl;
+			}
+			data.removeSubnetRules();
+			cfg.subnetScoreToBlock = 0;
+			if (data.subnetActivity.size() != 0) {
+				std::cerr << "Subnet activity was not cleared!" << std::endl;
+			}
+			std::map<unsigned int, std::string> subnetRules = simfw.listRules("INPUT");
+			for (std::map<unsigned int, std::string>::iterator itr = subnetRules.begin(); itr != subnetRules.end(); ++itr) {
+				if (itr->second.find("/24") != std::string::npos) {
+					std::cerr << "Firewall rule for subnet was not removed: " << itr->second << std::endl;
+				}
+			}
+
+			// Adjacent blocked addresses must be replaced with single rule of prefix, prefix with whitelisted address must not be aggregated
+			std::cout << "Address aggregation check..." << std::endl;
+			cfg.addressAggregation[24] = 3;
+			for (unsigned int a = 1; a <= 5; a++) {
+				data.saveActivity("198.18.5." + std::to_string(a), 1000000, 1, 0);
+				data.saveActivity("198.18.6." + std::to_string(a), 1000000, 1, 0);
+			}
+			data.suspiciousAddresses["198.18.6.100"].whitelisted = true;
+			rulesBefore = simfw.ruleCount("INPUT");
+			data.updateAggregates();
+			unsigned int aggregatedRules = 0, hostRules = 0;
+			std::map<unsigned int, std::string> aggregationRules = simfw.listRules("INPUT");
+			for (std::map<unsigned int, std::string>::iterator itr = aggregationRules.begin(); itr != aggregationRules.end(); ++itr) {
+				if (itr->second.find("198.18.5.") != std::string::npos) {
+					aggregatedRules++;
+				}
+				if (itr->second.find("198.18.6.") != std::string::npos) {
+					hostRules++;
+				}
+			}
+			if (data.aggregateRules.count("198.18.5.0/24") == 0 || data.aggregateRules.count("198.18.6.0/24") > 0 || aggregatedRules != 1 || hostRules != 5) {
+				std::cerr << "Wrong aggregation of blocked addresses, rules for aggregated prefix: " << aggregatedRules << " rules in prefix with whitelisted address: " << hostRules << "!" << std::endl;
+			}
+			std::size_t rulesAggregated = simfw.ruleCount("INPUT");
+			if (!data.suspiciousAddresses["198.18.5.1"].iptableRule) {
+				std::cerr << "Address covered by aggregated prefix is not marked as blocked!" << std::endl;
+			}
+			data.updateAggregates();
+			if (simfw.ruleCount("INPUT") != rulesAggregated) {
+				std::cerr << "Unchanged aggregation changed firewall rules!" << std::endl;
+			}
+			cfg.addressAggregation.clear();
+			data.aggregatesChanged = true;
+			data.updateAggregates();
+			if (data.aggregateRules.size() > 0 || simfw.ruleCount("INPUT") != rulesBefore) {
+				std::cerr << "Rules of addresses were not restored after aggregation was disabled!" << std::endl;
+			}
+
+			// Rate rule, burst blocks address in single pass, slow matches do not
+			std::cout << "Rate rule check..." << std::endl;
+			hb::RateWindowType window;
+			unsigned int burst = 0;
+			for (unsigned int m = 0; m < 50; m++) {
+				burst = hb::Data::countRate(&window, 1000000, 1, 10);
+			}
+			unsigned int slow = 0;
+			hb::RateWindowType slowWindow;
+			for (unsigned long long int t = 1000000; t < 1000000 + 50 * 20; t += 20) {
+				slow = hb::Data::countRate(&slowWindow, t, 1, 10);
+			}
+			hb::RateWindowType spreadWindow;
+			unsigned int spread = 0;
+			for (unsigned long long int t = 1000000; t < 1000000 + 12; t++) {
+				spread = hb::Data::countRate(&spreadWindow, t, 1, 10);
+			}
+			if (burst != 50 || slow != 1 || spread != 10 || hb::Data::countRate(&spreadWindow, 1000000 + 100, 1, 10) != 1) {
+				std::cerr << "Wrong rate window counts, burst: " << burst << " slow: " << slow << " spread: " << spread << "!" << std::endl;
+			}
+			hb::RateLimit rate;
+			rate.count = 5;
+			rate.seconds = 10;
+			for (unsigned int m = 1; m <= 5; m++) {
+				data.saveActivity("198.18.7.1", 0, 1, 0, &rate);
+				if (m < 5 && data.suspiciousAddresses["198.18.7.1"].iptableRule) {
+					std::cerr << "Address blocked before rate was exceeded!" << std::endl;
+				}
+			}
+			if (!data.suspiciousAddresses["198.18.7.1"].iptableRule) {
+				std::cerr << "Address was not blocked after rate was exceeded!" << std::endl;
+			}
+			// Short rule next to long rule keeps its own bucket width, slow matches within long bucket do not block
+			hb::RateLimit longRate;
+			longRate.count = 100;
+			longRate.seconds = 3600;
+			longRate.bucketSeconds = 225;
+			longRate.window = 1;
+			data.activityTime = 2000000;
+			data.saveActivity("198.18.7.2", 0, 1, 0, &longRate);
+			for (unsigned int m = 0; m < 5; m++) {
+				data.activityTime = 2000000 + m * 20;
+				data.saveActivity("198.18.7.2", 0, 1, 0, &rate);
+			}
+			data.activityTime = 0;
+			if (data.suspiciousAddresses["198.18.7.2"].iptableRule || data.rateWindows["198.18.7.2"].size() != 2) {
+				std::cerr << "Matches of short rate rule were counted in buckets of long rule!" << std::endl;
+			}
+			std::cout << "High severity block check..." << std::endl;
+			data.saveActivity("198.18.8.1", 0, 1, 0, NULL, true);
+			if (!data.suspiciousAddresses["198.18.8.1"].iptableRule) {
+				std::cerr << "Address was not blocked on first high severity match!" << std::endl;
+			}
+			std::cout << "Correlation state check..." << std::endl;
+			hb::CorrelationTable correlationTable(60, 2);
+			std::string correlatedAddress;
+			correlationTable.insert("1001", "198.18.10.1", 1000);
+			correlationTable.insert("1002", "198.18.10.2", 1010);
+			correlationTable.insert("1001", "198.18.10.3", 1020);
+			if (!correlationTable.lookup("1001", 1030, &correlatedAddress) || correlatedAddress != "198.18.10.3" || correlationTable.size() != 2) {
+				std::cerr << "Correlation ID not mapped to last address: " << correlatedAddress << "!" << std::endl;
+			}
+			correlationTable.insert("1003", "198.18.10.4", 1030);
+			if (correlationTable.lookup("1002", 1030, &correlatedAddress) || correlationTable.evictions != 1 || correlationTable.size() != 2) {
+				std::cerr << "Oldest correlation ID not evicted from full table, evictions: " << correlationTable.evictions << "!" << std::endl;
+			}
+			if (correlationTable.lookup("1001", 1080, &correlatedAddress) || !correlationTable.lookup("1003", 1080, &correlatedAddress) || correlationTable.expirations != 1) {
+				std::cerr << "Correlation ID not expired after TTL, expirations: " << correlationTable.expirations << "!" << std::endl;
+			}
+			std::cout << "Native log format check..." << std::endl;
+			// Native rule and equivalent regex must give same result and address for each line of sample logs
+			std::vector<std::vector<std::string>> nativeCases = {
+				{"hb/test/test_apache_access_log_file", "apache_combined", "status=404", "^%i \\S+ \\S+ \\[[^\\]]*\\] \"(?:[^\"\\\\]|\\\\.)*\" 404( .*)?$"},
+				{"hb/test/test_apache_access_log_file", "apache_combined", "status=301,404 path=phpmyadmin", "^%i \\S+ \\S+ \\[[^\\]]*\\] \"\\S+ \\S*phpmyadmin\\S* [^\" ]+\" (301|404)( .*)?$"},
+				{"hb/test/test_sshd_log_file", "sshd", "event=invalid_user", "^.+? sshd\\[\\d+\\]: Invalid user .+? from %i(?: port \\d{1,5})?$"},
+				{"hb/test/test_sshd_log_file", "sshd", "event=root_refused", "^.+? sshd\\[\\d+\\]: ROOT LOGIN REFUSED FROM %i$"},
+				{"hb/test/test_sshd_log_file", "sshd", "event=not_allowed", "^.+? sshd\\[\\d+\\]: User .+? from %i not allowed because .+$"},
+				{"hb/test/test_sshd_log_file", "sshd", "event=connection_closed", "^.+? sshd\\[\\d+\\]: Connection closed by %i.*$"},
+				{"hb/test/test_postfix_log_file", "postfix_sasl", "event=sasl_failed", "^.+? postfix/\\S+\\[\\d+\\]: warning: [^\\[]+\\[%i\\]: SASL \\S+ authentication failed.*$"},
+				{"hb/test/test_postfix_log_file", "postfix_sasl", "event=auth_lost", "^.+? postfix/\\S+\\[\\d+\\]: lost connection after AUTH from [^\\[]+\\[%i\\]$"}
+			};
+			hb::LogFields fields;
+			std::smatch nativeMatch;
+			unsigned int nativeMatches = 0;
+			for (std::vector<std::vector<std::string>>::iterator itnc = nativeCases.begin(); itnc != nativeCases.end(); ++itnc) {
+				hb::LogFormat format;
+				hb::Pattern rule;
+				std::string regexString = (*itnc)[3];
+				if (!hb::NativeParser::format((*itnc)[1], &format) || !hb::NativeParser::rule((*itnc)[2], format, &rule)) {
+					std::cerr << "Failed to parse native rule " << (*itnc)[2] << "!" << std::endl;
+					continue;
+				}
+				std::regex equivalent(regexString.replace(regexString.find("%i"), 2, "(\\d{1,3}\\.\\d{1,3}\\.\\d{1,3}\\.\\d{1,3})"), std::regex_constants::icase);
+				std::ifstream sample((*itnc)[0]);
+				std::string sampleLine;
+				while (std::getline(sample, sampleLine)) {
+					bool nativeMatched = hb::NativeParser::parse(format, sampleLine, &fields) && hb::NativeParser::matches(&rule, fields);
+					bool regexMatched = std::regex_match(sampleLine, nativeMatch, equivalent);
+					if (nativeMatched != regexMatched || (regexMatched && fields.address != nativeMatch[1].str())) {
+						std::cerr << "Native rule " << (*itnc)[2] << " differs from regex, native: " << nativeMatched << " " << fields.address << " regex: " << regexMatched << " line: " << sampleLine << std::endl;
+					}
+					if (nativeMatched) nativeMatches++;
+				}
+			}
+			if (nativeMatches == 0) {
+				std::cerr << "No sample lines matched native rules!" << std::endl;
+			}
+			std::cout << "Container log source check..." << std::endl;
+			// Message of json-file line, escapes are decoded only by jsonUnescape, trailing newline is not part of message
+			std::vector<std::vector<std::string>> containerCases = {
+				{"{\"log\":\"Failed password for root from 10.0.0.1 port 22 ssh2\\n\",\"stream\":\"stdout\",\"time\":\"2024-01-01T00:00:00Z\"}", "0", "Failed password for root from 10.0.0.1 port 22 ssh2"},
+				{"{\"log\":\"GET \\\"/admin\\\" 404\\r\\n\",\"stream\":\"stdout\"}", "1", "GET \"/admin\" 404"},
+				{"{\"stream\":\"stderr\",\"log\":\"\\u003cscript\\u003e \\u00e9\\ud83d\\ude00\\tx\"}", "1", "<script> \u00e9\U0001F600\tx"},
+				{"{\"time\":\"x\",\"msg\":\"\\\"log\\\":\\\"fake\\\"\",\"log\":\"real\"}", "0", "real"}
+			};
+			std::size_t messageStart = 0, messageEnd = 0;
+			bool messageEscaped = false;
+			std::string message;
+			for (std::vector<std::vector<std::string>>::iterator itcc = containerCases.begin(); itcc != containerCases.end(); ++itcc) {
+				if (!hb::Util::jsonStringField((*itcc)[0], "log", &messageStart, &messageEnd, &messageEscaped) || messageEscaped != ((*itcc)[1] == "1")) {
+					std::cerr << "Failed to find message in container log line: " << (*itcc)[0] << std::endl;
+					continue;
+				}
+				hb::Util::jsonUnescape((*itcc)[0], messageStart, messageEnd, &message);
+				if (message != (*itcc)[2]) {
+					std::cerr << "Wrong message of container log line, expected: " << (*itcc)[2] << " got: " << message << std::endl;
+				}
+			}
+			if (hb::Util::jsonStringField("{\"log\":\"unterminated", "log", &messageStart, &messageEnd, &messageEscaped) || hb::Util::jsonStringField("plain syslog line", "log", &messageStart, &messageEnd, &messageEscaped)) {
+				std::cerr << "Invalid container log line accepted!" << std::endl;
+			}
+			if (!hb::Util::jsonRawSafe("failed password") || hb::Util::jsonRawSafe("user \"") || hb::Util::jsonRawSafe("<script")) {
+				std::cerr << "Wrong raw prefilter literal check!" << std::endl;
+			}
+			std::cout << "Matcher pool check..." << std::endl;
+			hb::Ring<int> ring(3);
+			int* ringSlot = NULL;
+			for (int i = 0; (ringSlot = ring.claim()) != NULL; i++) {
+				*ringSlot = i;
+				ring.publish();
+			}
+			if (ring.capacity() != 4 || ring.size() != 4 || ring.front() == NULL || *ring.front() != 0) {
+				std::cerr << "Wrong ring buffer capacity or order, capacity: " << ring.capacity() << " size: " << ring.size() << "!" << std::endl;
+			}
+			ring.pop();
+			if (ring.claim() == NULL || *ring.front() != 1) {
+				std::cerr << "Ring buffer slot not returned to producer!" << std::endl;
+			}
+			// Same lines matched by reader and by matcher pool (small rings, reader waits for workers) must give same hits and evaluations
+			// Evaluation order is fixed, reordering by measured cost could change count of evaluations between runs
+			std::vector<unsigned long long int> poolHits, poolEvaluations;
+			std::vector<bool> poolReorder;
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				poolReorder.push_back(itlg->reorderPatterns);
+				poolReorder.push_back(itlg->reorderRefusedPatterns);
+				itlg->reorderPatterns = false;
+				itlg->reorderRefusedPatterns = false;
+			}
+			for (unsigned int threads = 0; threads <= 2; threads += 2) {
+				unsigned long long int hits = 0, evaluations = 0;
+				cfg.matchThreads = threads;
+				cfg.matchRing = 4;
+				for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+					for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+						itlf->bookmark = 0;
+						itlf->size = 0;
+					}
+					for (std::vector<hb::Pattern>::iterator itpa = itlg->patterns.begin(); itpa != itlg->patterns.end(); ++itpa) {
+						hits -= itpa->hits;
+						evaluations -= itpa->evaluations;
+					}
+				}
+				lp.checkFiles();
+				for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+					for (std::vector<hb::Pattern>::iterator itpa = itlg->patterns.begin(); itpa != itlg->patterns.end(); ++itpa) {
+						hits += itpa->hits;
+						evaluations += itpa->evaluations;
+					}
+				}
+				poolHits.push_back(hits);
+				poolEvaluations.push_back(evaluations);
+			}
+			// Records written by persister stage and rules applied by firewall stage are in datafile and firewall after check
+			hb::Data poolData(&log, &cfg, &simfw);
+			poolData.loadData();
+			unsigned int poolRecordsDiffer = 0, poolRules = 0;
+			for (std::map<std::string, hb::SuspiciosAddressType>::iterator itsa = data.suspiciousAddresses.begin(); itsa != data.suspiciousAddresses.end(); ++itsa) {
+				// Addresses set up by other checks without activity have no record
+				if (itsa->second.activityCount == 0 && itsa->second.refusedCount == 0) {
+					continue;
+				}
+				if (poolData.suspiciousAddresses.count(itsa->first) == 0 || poolData.suspiciousAddresses[itsa->first].activityCount != itsa->second.activityCount || poolData.suspiciousAddresses[itsa->first].activityScore != itsa->second.activityScore) {
+					poolRecordsDiffer++;
+				}
+				if (itsa->second.iptableRule) {
+					poolRules++;
+				}
+			}
+			if (data.firewall != &simfw || data.persister != NULL || poolRecordsDiffer > 0 || (poolRules > 0 && simfw.ruleCount("INPUT") == 0)) {
+				std::cerr << "Persister and firewall stages did not write " << poolRecordsDiffer << " records and rules of matcher pool!" << std::endl;
+			}
+			cfg.matchThreads = 0;
+			lp.checkFiles();
+			itlg = cfg.logGroups.begin();
+			for (std::size_t i = 0; i + 1 < poolReorder.size(); i += 2, ++itlg) {
+				itlg->reorderPatterns = poolReorder[i];
+				itlg->reorderRefusedPatterns = poolReorder[i + 1];
+			}
+			if (poolHits[0] == 0 || poolHits[0] != poolHits[1] || poolEvaluations[0] != poolEvaluations[1]) {
+				std::cerr << "Matcher pool results differ from reader, hits: " << poolHits[0] << " / " << poolHits[1] << " evaluations: " << poolEvaluations[0] << " / " << poolEvaluations[1] << "!" << std::endl;
+			}
+			// Immediate block overtakes backlog of queued rules, earlier removal of same rule does not undo it
+			std::cout << "Firewall priority lane check..." << std::endl;
+			hb::SimulatedFirewall slowfw(1000, 0.0);
+			std::string laneRuleStart = "-s ", laneRuleEnd = " -j DROP";
+			{
+				hb::FirewallApplier applier(&log, &slowfw, 64);
+				applier.remove("INPUT", laneRuleStart + "10.50.0.100" + laneRuleEnd);
+				for (unsigned int i = 0; i < 30; i++) {
+					applier.append("INPUT", laneRuleStart + "10.50.0." + std::to_string(i) + laneRuleEnd);
+				}
+				applier.trace(1, std::chrono::steady_clock::now());
+				applier.append("INPUT", laneRuleStart + "10.50.0.100" + laneRuleEnd);
+				applier.trace(-1, std::chrono::steady_clock::now());
+				applier.drain();
+			}
+			// Rules are listed newest first, so rules listed after priority rule were applied before it
+			std::map<unsigned int, std::string> laneRules = slowfw.listRules("INPUT");
+			std::size_t appliedBefore = laneRules.size();
+			for (std::map<unsigned int, std::string>::iterator itr = laneRules.begin(); itr != laneRules.end(); ++itr) {
+				if (itr->second.find("10.50.0.100") != std::string::npos) {
+					appliedBefore = laneRules.size() - 1 - std::distance(laneRules.begin(), itr);
+				}
+			}
+			if (slowfw.ruleCount("INPUT") != 31 || appliedBefore >= 10) {
+				std::cerr << "Immediate block did not overtake queued rules, applied after " << appliedBefore << " of " << slowfw.ruleCount("INPUT") - 1 << " rules!" << std::endl;
+			}
+			// Address whose queued rule failed to be appended is not left marked as blocked
+			std::cout << "Firewall applier failure check..." << std::endl;
+			hb::SimulatedFirewall failingfw(0, 1.0);
+			std::vector<hb::FirewallJob> failedJobs;
+			{
+				hb::FirewallApplier applier(&log, &failingfw, 16);
+				data.firewall = &applier;
+				data.saveActivity("10.60.0.1", data.blockScore(), 1, 0);
+				bool queuedRule = data.suspiciousAddresses["10.60.0.1"].iptableRule;
+				applier.drain();
+				data.firewall = &simfw;
+				applier.takeFailed(&failedJobs);
+				for (std::vector<hb::FirewallJob>::iterator itfj = failedJobs.begin(); itfj != failedJobs.end(); ++itfj) {
+					data.ruleFailed(itfj->append, itfj->rule);
+				}
+				if (!queuedRule || failedJobs.size() != 1 || !failedJobs[0].append || data.suspiciousAddresses["10.60.0.1"].iptableRule) {
+					std::cerr << "Address is still marked as blocked after its rule failed to be appended!" << std::endl;
+				}
+			}
+			data.removeAddress("10.60.0.1");
+			// Decisions are received by peer once, after reconnect only new decisions are sent
+			std::cout << "Peer sync check..." << std::endl;
+			hb::PeerDelta peerDelta, peerDecoded;
+			peerDelta.sequence = 7;
+			peerDelta.address = "2001:db8::15";
+			peerDelta.score = 12;
+			peerDelta.expires = 1700000000;
+			peerDelta.source = "node-a";
+			std::string peerFrames, peerPayload;
+			char peerFrameType;
+			hb::PeerSync::encodeDelta(peerDelta, &peerFrames);
+			if (!hb::PeerSync::nextFrame(&peerFrames, &peerFrameType, &peerPayload) || peerFrameType != 'D' || !hb::PeerSync::decodeDelta(peerPayload, &peerDecoded)
+					|| peerDecoded.sequence != 7 || peerDecoded.address != "2001:db8::15" || peerDecoded.score != 12 || peerDecoded.expires != 1700000000 || peerDecoded.source != "node-a" || peerFrames.length() > 0) {
+				std::cerr << "Peer decision was not decoded as encoded!" << std::endl;
+			}
+			hb::PeerSync peerPublisher(&log, "node-a", 100), peerReceiver(&log, "node-b", 100);
+			std::vector<hb::PeerDelta> peerReceived;
+			if (!peerPublisher.start("127.0.0.1:0", std::vector<std::string>(), {"127.0.0.0/8"}) || peerPublisher.port() == 0) {
+				std::cerr << "Peer sync failed to listen on loopback!" << std::endl;
+			} else {
+				std::vector<std::string> peers = {"127.0.0.1:" + std::to_string(peerPublisher.port())};
+				peerDelta.address = "10.40.0.1";
+				peerPublisher.publish(peerDelta);
+				peerReceiver.start("", peers, std::vector<std::string>());
+				for (unsigned int i = 0; i < 50 && peerReceived.size() < 1; i++) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+					peerReceiver.receive(&peerReceived);
+				}
+				peerReceiver.stop();
+				peerDelta.address = "10.40.0.2";
+				peerPublisher.publish(peerDelta);
+				peerReceiver.start("", peers, std::vector<std::string>());
+				for (unsigned int i = 0; i < 50 && peerReceived.size() < 2; i++) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+					peerReceiver.receive(&peerReceived);
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(200));
+				peerReceiver.receive(&peerReceived);
+				if (peerReceived.size() != 2 || peerReceived[0].address != "10.40.0.1" || peerReceived[1].address != "10.40.0.2" || peerReceived[1].sequence != 2 || peerReceived[1].source != "node-a") {
+					std::cerr << "Peer received " << peerReceived.size() << " decisions instead of 2 after reconnect!" << std::endl;
+				}
+				peerReceiver.stop();
+				peerPublisher.stop();
+				// Peer from address that is not allowed is refused
+				peerPublisher.start("127.0.0.1:0", std::vector<std::string>(), {"192.0.2.0/24"});
+				peers = {"127.0.0.1:" + std::to_string(peerPublisher.port())};
+				peerReceiver.start("", peers, std::vector<std::string>());
+				for (unsigned int i = 0; i < 50 && peerPublisher.rejected.load() == 0; i++) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				}
+				peerReceived.clear();
+				peerReceiver.receive(&peerReceived);
+				if (peerPublisher.rejected.load() == 0 || peerReceived.size() > 0 || peerPublisher.subscriberCount.load() > 0) {
+					std::cerr << "Peer from address that is not allowed was not refused!" << std::endl;
+				}
+				peerReceiver.stop();
+				peerPublisher.stop();
+			}
+			rulesBefore = simfw.ruleCount("INPUT");
+			peerDelta.address = "10.40.0.3";
+			peerDelta.score = cfg.peerScoreToBlock / 2;
+			peerDelta.expires = 0;
+			data.savePeerBlock(peerDelta);
+			if (simfw.ruleCount("INPUT") != rulesBefore) {
+				std::cerr << "Address blocked by peers with score lower than needed!" << std::endl;
+			}
+			peerDelta.source = "node-c";
+			peerDelta.score = cfg.peerScoreToBlock - cfg.peerScoreToBlock / 2;
+			data.savePeerBlock(peerDelta);
+			if (simfw.ruleCount("INPUT") != rulesBefore + 1) {
+				std::cerr << "Address not blocked by sum of peer decisions!" << std::endl;
+			}
+			data.suspiciousAddresses["10.40.0.4"].whitelisted = true;
+			peerDelta.address = "10.40.0.4";
+			peerDelta.score = cfg.peerScoreToBlock;
+			data.savePeerBlock(peerDelta);
+			if (simfw.ruleCount("INPUT") != rulesBefore + 1) {
+				std::cerr << "Whitelisted address blocked by peers!" << std::endl;
+			}
+			data.suspiciousAddresses.erase("10.40.0.4");
+			data.removePeerRules();
+			if (simfw.ruleCount("INPUT") != rulesBefore || data.peerBlocks.size() > 0) {
+				std::cerr << "Firewall rules of peer decisions were not removed!" << std::endl;
+			}
+
+			// Snapshot restores same data, damaged snapshot is rejected, existing flags are kept on merge
+			std::cout << "Snapshot check..." << std::endl;
+			std::string snapshotPath = cfg.dataFilePath + ".snapshot";
+			data.abuseIPDBBlacklist["198.51.100.7"].totalReports = 3;
+			data.abuseIPDBBlacklist["198.51.100.7"].abuseConfidenceScore = 80;
+			if (!data.exportSnapshot(snapshotPath)) {
+				std::cerr << "Failed to save snapshot!" << std::endl;
+			} else {
+				hb::Data snapshotData = hb::Data(&log, &cfg, &simfw);
+				snapshotData.suspiciousAddresses["10.40.0.9"].whitelisted = true;
+				if (data.suspiciousAddresses.size() > 0) {
+					snapshotData.suspiciousAddresses[data.suspiciousAddresses.begin()->first].whitelisted = true;
+				}
+				hb::SnapshotReader snapshotReader(&log);
+				if (!snapshotReader.open(snapshotPath) || !snapshotData.importSnapshot(&snapshotReader, 2) || snapshotReader.done() || !snapshotData.importSnapshot(&snapshotReader, 0) || !snapshotReader.done()) {
+					std::cerr << "Failed to import snapshot in parts!" << std::endl;
+				}
+				if (snapshotData.suspiciousAddresses.size() != data.suspiciousAddresses.size() + 1 || snapshotData.abuseIPDBBlacklist.size() != data.abuseIPDBBlacklist.size()
+						|| snapshotData.abuseIPDBBlacklist["198.51.100.7"].abuseConfidenceScore != 80 || snapshotData.abuseIPDBSyncTime != data.abuseIPDBSyncTime) {
+					std::cerr << "Imported snapshot differs from exported data!" << std::endl;
+				}
+				for (std::map<std::string, hb::SuspiciosAddressType>::iterator sait = data.suspiciousAddresses.begin(); sait != data.suspiciousAddresses.end(); ++sait) {
+					hb::SuspiciosAddressType* imported = &snapshotData.suspiciousAddresses[sait->first];
+					if (imported->lastActivity != sait->second.lastActivity || imported->activityScore != sait->second.activityScore || imported->activityCount != sait->second.activityCount || imported->refusedCount != sait->second.refusedCount) {
+						std::cerr << "Imported address " << sait->first << " differs from exported!" << std::endl;
+						break;
+					}
+				}
+				if (data.suspiciousAddresses.size() > 0 && !snapshotData.suspiciousAddresses[data.suspiciousAddresses.begin()->first].whitelisted) {
+					std::cerr << "Flags of existing address were replaced by snapshot!" << std::endl;
+				}
+				std::fstream snapshotFile(snapshotPath, std::ios::in | std::ios::out | std::ios::binary);
+				snapshotFile.seekp(20);
+				snapshotFile.put('\x7f');
+				snapshotFile.close();
+				if (snapshotReader.open(snapshotPath)) {
+					std::cerr << "Damaged snapshot was not rejected!" << std::endl;
+				}
+				// Text that is not address would end up in firewall command line, writer refuses it and reader rejects it even with valid checksum
+				hb::SnapshotWriter injectionWriter(&log);
+				hb::SnapshotRecord injection;
+				injection.type = 'A';
+				injection.address = "10.40.0.1; touch /tmp/hostblock_injection";
+				if (!injectionWriter.open(snapshotPath) || injectionWriter.write(injection) || !injectionWriter.close() || injectionWriter.records() != 0) {
+					std::cerr << "Snapshot writer accepted address that is not IP address!" << std::endl;
+				}
+				std::string crafted = std::string("HBSN\x00\x01\x00\x00", 8) + std::string(8, '\0') + std::string("A\x00", 2) + (char)injection.address.length() + injection.address + std::string(29, '\0') + "E" + std::string(7, '\0') + '\x01';
+				unsigned int craftedCrc = hb::SnapshotReader::checksum(crafted.data(), crafted.length(), 0);
+				for (int i = 3; i >= 0; i--) {
+					crafted.push_back((char)((craftedCrc >> (i * 8)) & 0xff));
+				}
+				std::ofstream(snapshotPath, std::ios::binary | std::ios::trunc) << crafted;
+				hb::Data injectionData = hb::Data(&log, &cfg, &simfw);
+				if (!snapshotReader.open(snapshotPath)) {
+					std::cerr << "Crafted snapshot with valid checksum was not opened!" << std::endl;
+				} else if (injectionData.importSnapshot(&snapshotReader, 0) || injectionData.suspiciousAddresses.count(injection.address) > 0) {
+					std::cerr << "Snapshot address that is not IP address was imported!" << std::endl;
+				}
+				std::remove(snapshotPath.c_str());
+			}
+			data.abuseIPDBBlacklist.erase("198.51.100.7");
+
+			// Feed entries are parsed and diffed, only difference reaches firewall, entry listed by several sources has single rule
+			std::cout << "Blocklist feed check..." << std::endl;
+			std::vector<hb::Prefix> feedEntries, feedAdded, feedRemoved;
+			unsigned long long int feedInvalid = hb::FeedWatcher::parse("# honeypot\n10.50.0.2\n10.50.0.1 # again\n10.50.0.1\n10.60.1.7/24\n2001:db8::/32\n300.1.1.1\nnot an address\n; comment\n  \n10.50.0.3\r\n", &feedEntries);
+			if (feedInvalid != 2 || feedEntries.size() != 5 || hb::FeedWatcher::format(feedEntries[0]) != "10.50.0.1" || hb::FeedWatcher::format(feedEntries[3]) != "10.60.1.0/24" || hb::FeedWatcher::format(feedEntries[4]) != "2001:db8::/32") {
+				std::cerr << "Feed parsed to " << feedEntries.size() << " entries with " << feedInvalid << " invalid lines instead of 5 and 2!" << std::endl;
+			}
+			std::vector<hb::Prefix> feedPrevious(feedEntries.begin(), feedEntries.begin() + 3), feedCurrent(feedEntries.begin() + 1, feedEntries.begin() + 4);
+			hb::FeedWatcher::diff(feedPrevious, feedCurrent, &feedAdded, &feedRemoved);
+			if (feedAdded.size() != 1 || hb::FeedWatcher::format(feedAdded[0]) != "10.60.1.0/24" || feedRemoved.size() != 1 || hb::FeedWatcher::format(feedRemoved[0]) != "10.50.0.1") {
+				std::cerr << "Feed diff found " << feedAdded.size() << " added and " << feedRemoved.size() << " removed entries instead of 1 and 1!" << std::endl;
+			}
+			rulesBefore = simfw.ruleCount("INPUT");
+			std::size_t addressesBefore = data.suspiciousAddresses.size();
+			data.updateFeed("honeypot", &feedEntries);
+			if (simfw.ruleCount("INPUT") != rulesBefore + 4 || data.suspiciousAddresses.size() != addressesBefore) {
+				std::cerr << "Expected 4 firewall rules for feed (IPv6 entry without rule), rule count changed by " << simfw.ruleCount("INPUT") - rulesBefore << "!" << std::endl;
+			}
+			hb::FeedWatcher::parse("10.50.0.1\n", &feedEntries);
+			data.updateFeed("spamhaus", &feedEntries);
+			hb::FeedWatcher::parse("10.50.0.2\n", &feedEntries);
+			data.updateFeed("honeypot", &feedEntries);
+			if (simfw.ruleCount("INPUT") != rulesBefore + 2) {
+				std::cerr << "Expected 2 firewall rules after feed update, rule count changed by " << simfw.ruleCount("INPUT") - rulesBefore << "!" << std::endl;
+			}
+			feedEntries.clear();
+			data.updateFeed("spamhaus", &feedEntries);
+			data.removeFeedRules();
+			if (simfw.ruleCount("INPUT") != rulesBefore || data.feedEntries.size() > 0 || data.feedSources.size() > 0) {
+				std::cerr << "Firewall rules of feeds were not removed!" << std::endl;
+			}
+			std::string feedDirectory = cfg.dataFilePath + ".feeds";
+			mkdir(feedDirectory.c_str(), 0700);
+			std::ofstream(feedDirectory + "/honeypot") << "10.50.0.1\n";
+			hb::FeedWatcher feedWatcher(&log);
+			std::set<std::string> feedChanges;
+			if (!feedWatcher.watch(feedDirectory)) {
+				std::cerr << "Failed to watch feed directory!" << std::endl;
+			} else {
+				feedWatcher.changes(&feedChanges);
+				if (feedChanges.size() != 1 || !feedWatcher.load("honeypot", &feedEntries) || feedEntries.size() != 1) {
+					std::cerr << "Existing feed was not loaded after start of watch!" << std::endl;
+				}
+				feedChanges.clear();
+				std::ofstream(feedDirectory + "/.spamhaus.tmp") << "10.50.0.2\n";
+				std::rename((feedDirectory + "/.spamhaus.tmp").c_str(), (feedDirectory + "/spamhaus").c_str());
+				std::remove((feedDirectory + "/honeypot").c_str());
+				feedWatcher.changes(&feedChanges);
+				if (feedChanges.size() != 2 || feedChanges.count("spamhaus") == 0 || feedWatcher.load("honeypot", &feedEntries)) {
+					std::cerr << "Feed changes were not detected, " << feedChanges.size() << " changes instead of 2!" << std::endl;
+				}
+				feedWatcher.stop();
+			}
+			std::remove((feedDirectory + "/spamhaus").c_str());
+			std::remove(feedDirectory.c_str());
+
+			std::cout << "Overload mode check..." << std::endl;
+			if (!hb::LogParser::overloaded(false, 100, 0, 100, 0) || hb::LogParser::overloaded(false, 99, 0, 100, 0) || !hb::LogParser::overloaded(true, 50, 0, 100, 0) || hb::LogParser::overloaded(true, 49, 0, 100, 0) || !hb::LogParser::overloaded(false, 0, 30, 0, 30) || hb::LogParser::overloaded(true, 1000, 1000, 0, 0)) {
+				std::cerr << "Wrong overload mode thresholds!" << std::endl;
+			}
+			unsigned long long int linesShed = lp.linesShed;
+			cfg.overloadBytes = 1;
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				if (itlg->name == "ApacheAccess") {
+					itlg->overloadSample = 0;
+				}
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					itlf->bookmark = 0;
+					itlf->size = 0;
+				}
+			}
+			lp.checkFiles();
+			if (lp.linesShed == linesShed || lp.overload) {
+				std::cerr << "Overload mode did not shed lines or was not switched off at end of file, lines shed: " << lp.linesShed - linesShed << "!" << std::endl;
+			}
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				itlg->overloadSample = 1;
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					if (itlf->bookmark != itlf->size) {
+						std::cerr << "Bookmark of " << itlf->path << " in group " << itlg->name << " not at end of file after overload mode!" << std::endl;
+					}
+				}
+			}
+			cfg.overloadBytes = 0;
+			std::cout << "Newest first reading check..." << std::endl;
+			hb::LogFile rangeFile;
+			hb::LogParser::markProcessed(&rangeFile, 0, 100);
+			hb::LogParser::markProcessed(&rangeFile, 500, 600);
+			hb::LogParser::markProcessed(&rangeFile, 600, 700);
+			if (rangeFile.bookmark != 100 || rangeFile.tailStart != 500 || rangeFile.tailEnd != 700 || hb::LogParser::isProcessed(&rangeFile, 100) || !hb::LogParser::isProcessed(&rangeFile, 650)) {
+				std::cerr << "Wrong processed ranges, bookmark: " << rangeFile.bookmark << " range: " << rangeFile.tailStart << " - " << rangeFile.tailEnd << "!" << std::endl;
+			}
+			hb::LogParser::markProcessed(&rangeFile, 100, 500);
+			if (rangeFile.bookmark != 700 || rangeFile.tailEnd != rangeFile.tailStart) {
+				std::cerr << "Processed ranges not merged after gap was filled, bookmark: " << rangeFile.bookmark << "!" << std::endl;
+			}
+			std::set<std::string> physicalFiles;
+			expectedLines = 0;
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					itlf->bookmark = 0;
+					itlf->size = 0;
+					if (physicalFiles.insert(itlf->path).second) {
+						std::ifstream countStream(itlf->path);
+						while (std::getline(countStream, countLine)) {
+							expectedLines++;
+						}
+					}
+				}
+			}
+			cfg.newestWindow = 1000;
+			cfg.backfillBytes = 100;
+			lp.linesRead = 0;
+			lp.checkFiles();
+			bool tailsRead = lp.backfillPending > 0;
+			for (unsigned int c = 0; c < 1000 && lp.backfillPending > 0; c++) {
+				lp.checkFiles();
+			}
+			if (!tailsRead || lp.linesRead != expectedLines) {
+				std::cerr << "Newest first reading did not read each line once! Lines read: " << lp.linesRead << " Expected: " << expectedLines << std::endl;
+			}
+			for (itlg = cfg.logGroups.begin(); itlg != cfg.logGroups.end(); ++itlg) {
+				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+					if (itlf->bookmark != itlf->size || itlf->tailEnd != itlf->tailStart) {
+						std::cerr << "Bookmark of " << itlf->path << " in group " << itlg->name << " not at end of file after backfill!" << std::endl;
+					}
+				}
+			}
+			cfg.newestWindow = 0;
+			cfg.backfillBytes = 0;
+			std::cout << "Historic log replay check..." << std::endl;
+			unsigned long long int logTime = 0;
+			if (!hb::Util::parseLogTime("Oct 17 12:34:56 host sshd[1]: Invalid user", "%b %e %H:%M:%S", 0, 1792281600, &logTime) || logTime != 1792240496) {
+				std::cerr << "Wrong syslog timestamp: " << logTime << "!" << std::endl;
+			}
+			if (!hb::Util::parseLogTime("192.0.2.1 - - [17/Oct/2026:14:34:56 +0200] \"GET / HTTP/1.1\"", "[%d/%b/%Y:%H:%M:%S %z", 0, 0, &logTime) || logTime != 1792240496) {
+				std::cerr << "Wrong Apache timestamp: " << logTime << "!" << std::endl;
+			}
+			if (!hb::Util::parseLogTime("2026-10-17T12:34:56.123Z host", "%Y-%m-%dT%H:%M:%S.%f%z", 3600, 0, &logTime) || logTime != 1792240496) {
+				std::cerr << "Wrong ISO 8601 timestamp: " << logTime << "!" << std::endl;
+			}
+			if (!hb::Util::parseLogTime("Dec 31 23:00:00 host", "%b %e %H:%M:%S", 0, 1798761600, &logTime) || logTime != 1798758000 || hb::Util::parseLogTime("no timestamp", "%b %e %H:%M:%S", 0, 0, &logTime)) {
+				std::cerr << "Wrong syslog timestamp at year change: " << logTime << "!" << std::endl;
+			}
+			time_t replayTime;
+			time(&replayTime);
+			data.batch = true;
+			data.activityTime = (unsigned long long int)replayTime - 30 * 86400;
+			data.saveActivity("198.18.9.1", 20, 1, 0);
+			data.activityTime = (unsigned long long int)replayTime - 60;
+			data.saveActivity("198.18.9.2", 20, 1, 0);
+			if (data.suspiciousAddresses["198.18.9.2"].iptableRule) {
+				std::cerr << "Firewall rule created in batch mode!" << std::endl;
+			}
+			data.batch = false;
+			data.activityTime = 0;
+			data.applyBatch();
+			if (data.suspiciousAddresses["198.18.9.1"].iptableRule || !data.suspiciousAddresses["198.18.9.2"].iptableRule) {
+				std::cerr << "Historic activity scored in wrong time, old address blocked: " << data.suspiciousAddresses["198.18.9.1"].iptableRule << " recent address blocked: " << data.suspiciousAddresses["198.18.9.2"].iptableRule << "!" << std::endl;
+			}
+			std::cout << "Simulated firewall rules in INPUT: " << simfw.ruleCount("INPUT") << std::endl;
 		}
 		end = clock();
 		std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
@@ -378,7 +1380,7 @@ int main(int argc, char *argv[])
 
 			// Check log files
 			std::cout << "Log file check..." << std::endl;
-			hb::LogParser lp = hb::LogParser(&log, &cfg, &data);
+			hb::LogParser lp = hb::LogParser(&log, &cfg, &data, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
 			lp.checkFiles();
 			end = clock();
 			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;